@@ -0,0 +1,348 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Benchmark support shared by the speedCorrection and speedCorrectionLite benches
+
+    Wind distributions to time the correction paths over, cache eviction for cold
+    cache timings, cycle and branch miss counters from perf_event_open where the kernel
+    allows them, and a report of every timing that is printed as BENCH: lines as it is
+    recorded and can be written out as json to track results between releases.
+
+    Header only, included by the bench program alone.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _benchHarness_h_
+#define _benchHarness_h_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define benchMaxResults 512
+#define benchMaxColdRepeats 64
+
+// least bytes written to push the tables and inputs out of every cache level, more if
+// the system reports a larger cache
+#define benchEvictBytes (64<<20)
+
+typedef enum
+{
+    benchCalm = 0,              // light air, 0->10 mph from every direction
+    benchGusty,                 // 10->20 mph from the south west with gusts to 45
+    benchStorm,                 // 30->120 mph from the south
+    benchSweep,                 // uniform over 0->200 mph and 0->360 degrees
+    benchVeering,               // gusty, direction jittering around 90 then 270 degrees
+    benchDistributionCount
+} benchDistribution;
+
+static const char* const benchDistributionNames[benchDistributionCount] = {"calm","gusty","storm","sweep","veering"};
+
+typedef struct
+{
+    char group[40];
+    char path[40];
+    char distribution[16];
+    char cache[8];
+    double nsPerSample;
+    double cyclesPerSample;     // negative without counters
+    double branchMissesPerSample;
+} benchResult;
+
+typedef struct
+{
+    benchResult results[benchMaxResults];
+    int count;
+    int dropped;                // results recorded once the table was full
+} benchReport;
+
+// hardware counters of the calling thread, either counter is -1 if it can not be opened,
+// e.g. in a virtual machine without a pmu or with perf_event_paranoid set too high
+typedef struct
+{
+    int cycles;
+    int branchMisses;
+} benchCounters;
+
+static inline int benchOpenCounter(uint64_t config)
+{
+#ifdef __linux__
+    struct perf_event_attr attribute;
+    memset(&attribute,0,sizeof(attribute));
+    attribute.type = PERF_TYPE_HARDWARE;
+    attribute.size = sizeof(attribute);
+    attribute.config = config;
+    attribute.disabled = 1;
+    attribute.exclude_kernel = 1;
+    attribute.exclude_hv = 1;
+    return syscall(__NR_perf_event_open,&attribute,0,-1,-1,0);
+#else
+    return -1;
+#endif
+}
+
+static inline void benchOpenCounters(benchCounters* counters)
+{
+#ifdef __linux__
+    counters->cycles = benchOpenCounter(PERF_COUNT_HW_CPU_CYCLES);
+    counters->branchMisses = benchOpenCounter(PERF_COUNT_HW_BRANCH_MISSES);
+#else
+    counters->cycles = -1;
+    counters->branchMisses = -1;
+#endif
+}
+
+static inline void benchCloseCounters(benchCounters* counters)
+{
+    if(counters->cycles>=0)
+    {
+        close(counters->cycles);
+    }
+    if(counters->branchMisses>=0)
+    {
+        close(counters->branchMisses);
+    }
+}
+
+// count of a counter over one call of run(samples), -1 if it is not open
+template<typename Run> static inline double benchCount(int counter, Run run, size_t samples)
+{
+    uint64_t value = 0;
+#ifdef __linux__
+    if(counter>=0)
+    {
+        ioctl(counter,PERF_EVENT_IOC_RESET,0);
+        ioctl(counter,PERF_EVENT_IOC_ENABLE,0);
+        run(samples);
+        ioctl(counter,PERF_EVENT_IOC_DISABLE,0);
+        if(read(counter,&value,sizeof(value))==sizeof(value))
+        {
+            return (double)value;
+        }
+    }
+#endif
+    return -1.0;
+}
+
+static inline double benchNowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (now.tv_sec*1e9)+now.tv_nsec;
+}
+
+// xorshift, the same seed gives the same samples on every run and platform
+static inline double benchUniform(uint64_t* state)
+{
+    *state ^= *state<<13;
+    *state ^= *state>>7;
+    *state ^= *state<<17;
+    return (*state>>11)*(1.0/9007199254740992.0);
+}
+
+// roughly normal, the sum of four uniforms scaled to unit variance
+static inline double benchNormal(uint64_t* state)
+{
+    double sum = benchUniform(state)+benchUniform(state)+benchUniform(state)+benchUniform(state);
+    return (sum-2.0)*sqrt(3.0);
+}
+
+// fills count samples of a distribution, speeds in mph and directions in 0->360 degrees
+static inline void benchFillWind(benchDistribution distribution, float* speed, float* angle, size_t count)
+{
+    uint64_t state = 0x9e3779b97f4a7c15ULL+distribution;
+    for(size_t sample=0;sample<count;sample++)
+    {
+        double windSpeed = 0.0;
+        double direction = 0.0;
+        switch(distribution)
+        {
+            case benchCalm:
+                windSpeed = 10.0*benchUniform(&state)*benchUniform(&state);
+                direction = 360.0*benchUniform(&state);
+                break;
+            case benchGusty:
+                windSpeed = 15.0+(3.0*benchNormal(&state));
+                windSpeed += (benchUniform(&state)<0.1) ? 10.0+(20.0*benchUniform(&state)) : 0.0;
+                direction = 225.0+(30.0*benchNormal(&state));
+                break;
+            case benchStorm:
+                windSpeed = 70.0+(20.0*benchNormal(&state));
+                direction = 180.0+(20.0*benchNormal(&state));
+                break;
+            case benchVeering:
+                windSpeed = 15.0+(3.0*benchNormal(&state));
+                windSpeed += (benchUniform(&state)<0.1) ? 10.0+(20.0*benchUniform(&state)) : 0.0;
+                direction = ((sample<(count/2)) ? 90.0 : 270.0)+(10.0*benchNormal(&state));
+                break;
+            default:
+                windSpeed = 200.0*benchUniform(&state);
+                direction = 360.0*benchUniform(&state);
+                break;
+        }
+        speed[sample] = (windSpeed<0.0) ? 0.0 : windSpeed;
+        angle[sample] = fmod(direction+360.0,360.0);
+    }
+}
+
+// overwrites a buffer twice the size of the largest cache, returns -1 if it can not be allocated
+static inline int benchEvictCaches(void)
+{
+    static volatile char* buffer = NULL;
+    static size_t bufferBytes = benchEvictBytes;
+    if(!buffer)
+    {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        long cacheBytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        cacheBytes = (cacheBytes>0) ? cacheBytes : sysconf(_SC_LEVEL2_CACHE_SIZE);
+        bufferBytes = ((size_t)(2*cacheBytes)>bufferBytes) ? (size_t)(2*cacheBytes) : bufferBytes;
+#endif
+        buffer = (volatile char*)malloc(bufferBytes);
+        if(!buffer)
+        {
+            return -1;
+        }
+    }
+    for(size_t offset=0;offset<bufferBytes;offset+=64)
+    {
+        buffer[offset] = (char)offset;
+    }
+    return 0;
+}
+
+// mean ns per sample over repeated runs of the first samples, after one run to warm the
+// caches, run(samples) corrects that many samples
+template<typename Run> static inline double benchWarmNs(Run run, size_t samples, int repeats)
+{
+    run(samples);
+    double start = benchNowNs();
+    for(int repeat=0;repeat<repeats;repeat++)
+    {
+        run(samples);
+    }
+    return (benchNowNs()-start)/((double)repeats*samples);
+}
+
+// median ns per sample of runs over the first samples each straight after evicting the
+// caches, so the tables and inputs all come from memory
+template<typename Run> static inline double benchColdNs(Run run, size_t samples, int repeats)
+{
+    double ns[benchMaxColdRepeats];
+    repeats = (repeats>benchMaxColdRepeats) ? benchMaxColdRepeats : repeats;
+    for(int repeat=0;repeat<repeats;repeat++)
+    {
+        benchEvictCaches();
+        double start = benchNowNs();
+        run(samples);
+        ns[repeat] = (benchNowNs()-start)/samples;
+
+        for(int sorted=repeat;sorted>0 && ns[sorted]<ns[sorted-1];sorted--)
+        {
+            double swap = ns[sorted];
+            ns[sorted] = ns[sorted-1];
+            ns[sorted-1] = swap;
+        }
+    }
+    return ns[repeats/2];
+}
+
+// cycles and branch misses per sample are negative when there are no counters
+static inline void benchRecordCounters(benchReport* report, const char* group, const char* path, const char* distribution, const char* cache,
+                                       double nsPerSample, double cyclesPerSample, double branchMissesPerSample)
+{
+    printf("BENCH:%-8s %-16s %-8s %-5s %10.2f ns %14.0f samples/sec",group,path,distribution,cache,nsPerSample,1e9/nsPerSample);
+    if(cyclesPerSample>=0.0)
+    {
+        printf(" %8.2f cycles",cyclesPerSample);
+    }
+    if(branchMissesPerSample>=0.0)
+    {
+        printf(" %8.4f branch misses",branchMissesPerSample);
+    }
+    printf("\n");
+    if(report->count==benchMaxResults)
+    {
+        if(report->dropped++==0)
+        {
+            fprintf(stderr,"BENCH:results table full at %d, %s %s and later results are left out of the json\n",benchMaxResults,group,path);
+        }
+        return;
+    }
+
+    benchResult* result = &report->results[report->count++];
+    snprintf(result->group,sizeof(result->group),"%s",group);
+    snprintf(result->path,sizeof(result->path),"%s",path);
+    snprintf(result->distribution,sizeof(result->distribution),"%s",distribution);
+    snprintf(result->cache,sizeof(result->cache),"%s",cache);
+    result->nsPerSample = nsPerSample;
+    result->cyclesPerSample = cyclesPerSample;
+    result->branchMissesPerSample = branchMissesPerSample;
+}
+
+static inline void benchRecord(benchReport* report, const char* group, const char* path, const char* distribution, const char* cache, double nsPerSample)
+{
+    benchRecordCounters(report,group,path,distribution,cache,nsPerSample,-1.0,-1.0);
+}
+
+// returns 0, or -1 if the file can not be written or results were left out of it, the
+// results that fitted are still written
+static inline int benchWriteJson(const benchReport* report, const char* suite, const char* fileName)
+{
+    FILE* file = fopen(fileName,"w");
+    if(!file)
+    {
+        return -1;
+    }
+
+    fprintf(file,"{\n  \"suite\": \"%s\",\n  \"compiler\": \"%s\",\n  \"results\": [\n",suite,__VERSION__);
+    for(int index=0;index<report->count;index++)
+    {
+        const benchResult* result = &report->results[index];
+        fprintf(file,"    {\"group\": \"%s\", \"path\": \"%s\", \"distribution\": \"%s\", \"cache\": \"%s\", \"ns_per_sample\": %.3f, \"samples_per_sec\": %.0f",
+                result->group,result->path,result->distribution,result->cache,result->nsPerSample,1e9/result->nsPerSample);
+        if(result->cyclesPerSample>=0.0)
+        {
+            fprintf(file,", \"cycles_per_sample\": %.3f",result->cyclesPerSample);
+        }
+        if(result->branchMissesPerSample>=0.0)
+        {
+            fprintf(file,", \"branch_misses_per_sample\": %.5f",result->branchMissesPerSample);
+        }
+        fprintf(file,"}%s\n",(index<(report->count-1)) ? "," : "");
+    }
+    fprintf(file,"  ]\n}\n");
+
+    if(fclose(file)!=0)
+    {
+        return -1;
+    }
+    if(report->dropped>0)
+    {
+        fprintf(stderr,"BENCH:%d results left out of %s, raise benchMaxResults\n",report->dropped,fileName);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,94 @@
+# Compares the bench results of the library build modes
+#
+#     awk -f benchReport.awk build/debug/bench.json build/release/bench.json ...
+#
+# each file is the bench -j output of one mode, the mode is the name of the directory it
+# is in. Prints a REPORT: line for every timing with its ns per sample in each mode and the
+# speed up of the last mode over the first, then the geometric mean of each mode over the
+# timings every mode has
+#
+# Fergus Duncan (github : @fergusd)
+
+function field(line, name,    start, rest)
+{
+    start = index(line,"\"" name "\": ")
+    if(start==0)
+    {
+        return ""
+    }
+    rest = substr(line,start+length(name)+4)
+    if(substr(rest,1,1)=="\"")
+    {
+        rest = substr(rest,2)
+        return substr(rest,1,index(rest,"\"")-1)
+    }
+    match(rest,/^[-0-9.e+]+/)
+    return substr(rest,1,RLENGTH)
+}
+
+FNR==1 {
+    mode = FILENAME
+    sub(/\/bench\.json$/,"",mode)
+    sub(/^.*\//,"",mode)
+    modes[++modeCount] = mode
+}
+
+/"ns_per_sample"/ {
+    key = sprintf("%-8s %-16s %-8s %-5s",field($0,"group"),field($0,"path"),field($0,"distribution"),field($0,"cache"))
+    if(!(key in seen))
+    {
+        seen[key] = 1
+        keys[++keyCount] = key
+    }
+    ns[key,mode] = field($0,"ns_per_sample")+0
+}
+
+END {
+    header = sprintf("REPORT:%-8s %-16s %-8s %-5s","group","path","distribution","cache")
+    for(m=1;m<=modeCount;m++)
+    {
+        header = header sprintf(" %9s",modes[m])
+    }
+    print "REPORT:ns per sample by library build mode"
+    print header sprintf(" %9s","speed up")
+
+    complete = 0
+    for(k=1;k<=keyCount;k++)
+    {
+        key = keys[k]
+        line = "REPORT:" key
+        missing = 0
+        for(m=1;m<=modeCount;m++)
+        {
+            if((key,modes[m]) in ns && ns[key,modes[m]]>0)
+            {
+                line = line sprintf(" %9.2f",ns[key,modes[m]])
+            }
+            else
+            {
+                line = line sprintf(" %9s","-")
+                missing = 1
+            }
+        }
+        if(!missing)
+        {
+            line = line sprintf(" %8.2fx",ns[key,modes[1]]/ns[key,modes[modeCount]])
+            complete++
+            for(m=1;m<=modeCount;m++)
+            {
+                logSum[m] += log(ns[key,modes[m]])
+            }
+        }
+        print line
+    }
+
+    if(complete>0)
+    {
+        line = sprintf("REPORT:%-8s %-16s %-8s %-5s","all","geometric mean","","")
+        for(m=1;m<=modeCount;m++)
+        {
+            line = line sprintf(" %9.2f",exp(logSum[m]/complete))
+        }
+        print line sprintf(" %8.2fx",exp((logSum[1]-logSum[modeCount])/complete))
+    }
+}
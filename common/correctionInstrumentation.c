@@ -0,0 +1,300 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Instrumentation of the correction calls shared by speedCorrection and speedCorrectionLite
+
+    A thread's first recorded call allocates its block and pushes it onto a list with a
+    compare and swap, after that the thread only stores to its own block. Blocks are
+    never freed, so the counts of threads that have exited still add up in a snapshot,
+    and a snapshot can walk the list without a lock.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "correctionInstrumentation.h"
+
+typedef struct instrumentBlock
+{
+    uint64_t calls;
+    uint64_t sites[instrumentSites];
+    uint64_t extrapolated;
+    uint64_t invalidSpeeds;
+    uint64_t sectors[instrumentSectors];
+    uint64_t invalidAngles;
+    uint64_t latency[instrumentBuckets];
+    struct instrumentBlock* next;
+} __attribute__((aligned(64))) instrumentBlock;
+
+static instrumentBlock* instrumentBlocks = NULL;
+
+// the counters are only ever stored by the owning thread, a snapshot loads them as they are
+#define bumpCounter(counter) __atomic_store_n(&(counter),__atomic_load_n(&(counter),__ATOMIC_RELAXED)+1,__ATOMIC_RELAXED)
+
+static inline int latencyBucket(uint64_t ticks)
+{
+    if(ticks<instrumentLinearTicks)
+    {
+        return (int)ticks;
+    }
+
+    int magnitude = 63-__builtin_clzll(ticks);
+    if(magnitude>=instrumentMaxMagnitude)
+    {
+        return instrumentBuckets-1;
+    }
+    int subBucket = (int)(ticks>>(magnitude-instrumentSubBits))&((1<<instrumentSubBits)-1);
+    return instrumentLinearTicks+((magnitude-instrumentSubBits-1)<<instrumentSubBits)+subBucket;
+}
+
+uint64_t instrumentBucketTicks(int bucket)
+{
+    if(bucket<instrumentLinearTicks)
+    {
+        return bucket;
+    }
+
+    int magnitude = ((bucket-instrumentLinearTicks)>>instrumentSubBits)+instrumentSubBits+1;
+    uint64_t subBucket = (bucket-instrumentLinearTicks)&((1<<instrumentSubBits)-1);
+    return ((1ULL<<instrumentSubBits)+subBucket)<<(magnitude-instrumentSubBits);
+}
+
+#ifdef correctionInstrumentation
+
+static __thread instrumentBlock* threadBlock = NULL;
+__thread uint32_t instrumentCountdown = 0;
+
+static instrumentBlock* createThreadBlock(void)
+{
+    void* memory = NULL;
+    if(posix_memalign(&memory,64,sizeof(instrumentBlock))!=0)
+    {
+        return NULL;
+    }
+    instrumentBlock* block = (instrumentBlock*)memory;
+    memset(block,0,sizeof(instrumentBlock));
+
+    block->next = __atomic_load_n(&instrumentBlocks,__ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&instrumentBlocks,&block->next,block,true,__ATOMIC_RELEASE,__ATOMIC_RELAXED))
+    {
+    }
+    return block;
+}
+
+void recordCorrection(uint64_t startTicks, int site, float rawSpeed, float angle)
+{
+    uint64_t endTicks = (instrumentCountdown==0) ? instrumentTicks() : 0;
+
+    instrumentBlock* block = threadBlock;
+    if(__builtin_expect(!block,0))
+    {
+        // a thread that can not have a block goes uncounted
+        block = threadBlock = createThreadBlock();
+        if(!block)
+        {
+            return;
+        }
+    }
+
+    bumpCounter(block->calls);
+    bumpCounter(block->sites[(site>=0 && site<instrumentSites) ? site : instrumentSites-1]);
+    if(rawSpeed>davisCalibration[davisSiteCount-2].speed)
+    {
+        bumpCounter(block->extrapolated);
+    }
+    else if(!(rawSpeed>=0.0f))
+    {
+        bumpCounter(block->invalidSpeeds);
+    }
+    if(angle>=0.0f && angle<360.0f)
+    {
+        int sector = (int)(angle*(1.0f/90.0f));
+        bumpCounter(block->sectors[(sector<instrumentSectors) ? sector : instrumentSectors-1]);
+    }
+    else
+    {
+        bumpCounter(block->invalidAngles);
+    }
+    if(instrumentCountdown==0)
+    {
+        bumpCounter(block->latency[latencyBucket(endTicks-startTicks)]);
+        instrumentCountdown = instrumentLatencyInterval;
+    }
+    instrumentCountdown--;
+}
+
+#endif
+
+// ticks of instrumentTicks per ns, measured once against the monotonic clock
+static double measureTicksPerNs(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static double ticksPerNs = 0.0;
+    if(ticksPerNs==0.0)
+    {
+        struct timespec start;
+        struct timespec end;
+        struct timespec pause = {0,20000000};
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        uint64_t startTicks = __builtin_ia32_rdtsc();
+        nanosleep(&pause,NULL);
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        uint64_t endTicks = __builtin_ia32_rdtsc();
+        double ns = ((end.tv_sec-start.tv_sec)*1e9)+(end.tv_nsec-start.tv_nsec);
+        ticksPerNs = (endTicks-startTicks)/ns;
+    }
+    return ticksPerNs;
+#else
+    return 1.0;
+#endif
+}
+
+void snapshotInstrumentation(instrumentSnapshot* snapshot)
+{
+    memset(snapshot,0,sizeof(instrumentSnapshot));
+
+    for(const instrumentBlock* block=__atomic_load_n(&instrumentBlocks,__ATOMIC_ACQUIRE);block;block=block->next)
+    {
+        snapshot->calls += __atomic_load_n(&block->calls,__ATOMIC_RELAXED);
+        for(int site=0;site<instrumentSites;site++)
+        {
+            snapshot->sites[site] += __atomic_load_n(&block->sites[site],__ATOMIC_RELAXED);
+        }
+        snapshot->extrapolated += __atomic_load_n(&block->extrapolated,__ATOMIC_RELAXED);
+        snapshot->invalidSpeeds += __atomic_load_n(&block->invalidSpeeds,__ATOMIC_RELAXED);
+        for(int sector=0;sector<instrumentSectors;sector++)
+        {
+            snapshot->sectors[sector] += __atomic_load_n(&block->sectors[sector],__ATOMIC_RELAXED);
+        }
+        snapshot->invalidAngles += __atomic_load_n(&block->invalidAngles,__ATOMIC_RELAXED);
+        for(int bucket=0;bucket<instrumentBuckets;bucket++)
+        {
+            snapshot->latency[bucket] += __atomic_load_n(&block->latency[bucket],__ATOMIC_RELAXED);
+        }
+    }
+
+    snapshot->ticksPerNs = (snapshot->calls>0) ? measureTicksPerNs() : 1.0;
+}
+
+void resetInstrumentation(void)
+{
+    for(instrumentBlock* block=__atomic_load_n(&instrumentBlocks,__ATOMIC_ACQUIRE);block;block=block->next)
+    {
+        uint64_t* counter = &block->calls;
+        for(;counter<(uint64_t*)&block->next;counter++)
+        {
+            __atomic_store_n(counter,0,__ATOMIC_RELAXED);
+        }
+    }
+}
+
+double instrumentLatencyNs(const instrumentSnapshot* snapshot, double quantile)
+{
+    uint64_t total = 0;
+    for(int bucket=0;bucket<instrumentBuckets;bucket++)
+    {
+        total += snapshot->latency[bucket];
+    }
+    if(total==0)
+    {
+        return 0.0;
+    }
+
+    // the top of the bucket holding the call at the quantile's rank
+    uint64_t rank = (uint64_t)ceil(quantile*total);
+    rank = (rank<1) ? 1 : rank;
+    uint64_t seen = 0;
+    int bucket = 0;
+    for(;bucket<(instrumentBuckets-1);bucket++)
+    {
+        seen += snapshot->latency[bucket];
+        if(seen>=rank)
+        {
+            break;
+        }
+    }
+    return instrumentBucketTicks(bucket+1)/snapshot->ticksPerNs;
+}
+
+static const double reportedQuantiles[5] = {0.5,0.9,0.99,0.999,1.0};
+static const char* reportedQuantileNames[5] = {"p50","p90","p99","p999","max"};
+static const char* sectorNames[instrumentSectors] = {"0->90","90->180","180->270","270->360"};
+
+int printInstrumentation(const instrumentSnapshot* snapshot, FILE* file)
+{
+    double calls = (snapshot->calls>0) ? (double)snapshot->calls : 1.0;
+    fprintf(file,"INSTRUMENT:calls %lu\n",(unsigned long)snapshot->calls);
+    fprintf(file,"INSTRUMENT:extrapolated %lu (%.2f%%), invalid speeds %lu, invalid angles %lu\n",(unsigned long)snapshot->extrapolated,
+            100.0*snapshot->extrapolated/calls,(unsigned long)snapshot->invalidSpeeds,(unsigned long)snapshot->invalidAngles);
+    for(int site=1;site<instrumentSites;site++)
+    {
+        if(site==(instrumentSites-1))
+        {
+            fprintf(file,"INSTRUMENT:site %2d    top %12lu %6.2f%%\n",site,(unsigned long)snapshot->sites[site],100.0*snapshot->sites[site]/calls);
+        }
+        else
+        {
+            fprintf(file,"INSTRUMENT:site %2d %6d %12lu %6.2f%%\n",site,davisCalibration[site].speed,(unsigned long)snapshot->sites[site],100.0*snapshot->sites[site]/calls);
+        }
+    }
+    for(int sector=0;sector<instrumentSectors;sector++)
+    {
+        fprintf(file,"INSTRUMENT:sector %9s %12lu %6.2f%%\n",sectorNames[sector],(unsigned long)snapshot->sectors[sector],100.0*snapshot->sectors[sector]/calls);
+    }
+    fprintf(file,"INSTRUMENT:latency ns");
+    for(int quantile=0;quantile<5;quantile++)
+    {
+        fprintf(file," %s %.1f",reportedQuantileNames[quantile],instrumentLatencyNs(snapshot,reportedQuantiles[quantile]));
+    }
+    fprintf(file,"\n");
+
+    return ferror(file) ? -1 : 0;
+}
+
+int writeInstrumentationJson(const instrumentSnapshot* snapshot, FILE* file)
+{
+    fprintf(file,"{\n  \"calls\": %lu,\n  \"extrapolated\": %lu,\n  \"invalid_speeds\": %lu,\n  \"invalid_angles\": %lu,\n  \"sites\": [",
+            (unsigned long)snapshot->calls,(unsigned long)snapshot->extrapolated,(unsigned long)snapshot->invalidSpeeds,(unsigned long)snapshot->invalidAngles);
+    for(int site=0;site<instrumentSites;site++)
+    {
+        fprintf(file,"%s%lu",(site>0) ? ", " : "",(unsigned long)snapshot->sites[site]);
+    }
+    fprintf(file,"],\n  \"sectors\": {");
+    for(int sector=0;sector<instrumentSectors;sector++)
+    {
+        fprintf(file,"%s\"%s\": %lu",(sector>0) ? ", " : "",sectorNames[sector],(unsigned long)snapshot->sectors[sector]);
+    }
+    fprintf(file,"},\n  \"ticks_per_ns\": %.4f,\n  \"latency_ns\": {",snapshot->ticksPerNs);
+    for(int quantile=0;quantile<5;quantile++)
+    {
+        fprintf(file,"%s\"%s\": %.1f",(quantile>0) ? ", " : "",reportedQuantileNames[quantile],instrumentLatencyNs(snapshot,reportedQuantiles[quantile]));
+    }
+
+    // the histogram as the lowest tick count of each bucket holding any calls
+    fprintf(file,"},\n  \"latency_ticks\": [");
+    int written = 0;
+    for(int bucket=0;bucket<instrumentBuckets;bucket++)
+    {
+        if(snapshot->latency[bucket]>0)
+        {
+            fprintf(file,"%s[%lu, %lu]",(written++>0) ? ", " : "",(unsigned long)instrumentBucketTicks(bucket),(unsigned long)snapshot->latency[bucket]);
+        }
+    }
+    fprintf(file,"]\n}\n");
+
+    return ferror(file) ? -1 : 0;
+}
@@ -0,0 +1,115 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionInstrumentation_h_
+#define _correctionInstrumentation_h_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "davisCalibration.h"
+
+// counts and latency of the scalar correctSpeed calls (and correctSpeedTenths in
+// speedCorrectionLite)
+//
+// only built into interpolator.c when it is compiled with -DcorrectionInstrumentation
+// (make instrumented), otherwise the hooks are empty macros and the snapshot stays empty.
+// Each thread counts into its own cache line aligned block with plain stores, blocks are
+// kept after their thread exits, and a snapshot adds every block up
+//
+// latency is timed in ticks (the time stamp counter on x86, nanoseconds elsewhere) into a
+// log linear histogram, exact below 32 ticks and within 1/16th above, up to 2^40 ticks.
+// Reading the clock costs more than a correction, so only every instrumentLatencyInterval'th
+// call of each thread is timed, the counts cover every call
+#ifndef instrumentLatencyInterval
+#define instrumentLatencyInterval 16
+#endif
+#define instrumentSites davisSiteCount
+#define instrumentSectors 4
+#define instrumentSubBits 4
+#define instrumentLinearTicks (2<<instrumentSubBits)
+#define instrumentMaxMagnitude 40
+#define instrumentBuckets (instrumentLinearTicks+((instrumentMaxMagnitude-instrumentSubBits-1)<<instrumentSubBits))
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t sites[instrumentSites];        // calls by the speed site above the speed, the last
+                                            // is the top (999 or 255 mph) sentinel row
+    uint64_t extrapolated;                  // speeds above the highest calibrated site
+    uint64_t invalidSpeeds;                 // negative or not a number
+    uint64_t sectors[instrumentSectors];    // angles 0->90, 90->180, 180->270, 270->360
+    uint64_t invalidAngles;                 // outside 0->360 or not a number
+    uint64_t latency[instrumentBuckets];    // ticks of the timed calls
+    double ticksPerNs;
+} instrumentSnapshot;
+
+// adds up every thread's counts, ticksPerNs is measured against the monotonic clock the
+// first time (which takes 20ms)
+void snapshotInstrumentation(instrumentSnapshot* snapshot);
+
+// zeroes every thread's counts, counts other threads make while it runs may survive it
+void resetInstrumentation(void);
+
+// latency in ns below which quantile (0->1) of the calls fell, 0 without any calls
+double instrumentLatencyNs(const instrumentSnapshot* snapshot, double quantile);
+
+// lowest tick count a latency bucket holds
+uint64_t instrumentBucketTicks(int bucket);
+
+// both return 0, or -1 if the write fails
+int printInstrumentation(const instrumentSnapshot* snapshot, FILE* file);
+int writeInstrumentationJson(const instrumentSnapshot* snapshot, FILE* file);
+
+// the hooks interpolator.c calls
+#ifdef correctionInstrumentation
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t instrumentTicks(void)
+{
+    return __builtin_ia32_rdtsc();
+}
+#else
+#include <time.h>
+static inline uint64_t instrumentTicks(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return ((uint64_t)now.tv_sec*1000000000ULL)+now.tv_nsec;
+}
+#endif
+
+// calls this thread has left before the next timed call
+extern __thread uint32_t instrumentCountdown;
+
+static inline uint64_t instrumentStartTicks(void)
+{
+    return (instrumentCountdown==0) ? instrumentTicks() : 0;
+}
+
+void recordCorrection(uint64_t startTicks, int site, float rawSpeed, float angle);
+
+#define instrumentBegin() uint64_t instrumentStart = instrumentStartTicks()
+#define instrumentEnd(site,rawSpeed,angle) recordCorrection(instrumentStart,(site),(rawSpeed),(angle))
+
+#else
+
+#define instrumentBegin()
+#define instrumentEnd(site,rawSpeed,angle)
+
+#endif
+
+#endif
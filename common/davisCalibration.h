@@ -0,0 +1,338 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Davis Vantage Pro 2 anemometer calibration shared by speedCorrection and
+    speedCorrectionLite, from the document linked below :-
+
+    http://www.davis-tr.com/Downloads/Davis_Rzgr_Kepceleri_Karakteristikleri.pdf
+
+    The calibration is held once, in tenths of a mph, and the float, fixed point and
+    lattice tables the two builds use are all derived from it at compile time, so there
+    is nothing to initialise at run time and the builds can not drift apart.
+
+    correctSpeed<Table> is the correctSpeed calculation with the table, its site spacing
+    and its column count as compile time constants. For davisFloatTable it is bit
+    identical to correctSpeed in speedCorrection, for davisTenthsTable to correctSpeed in
+    speedCorrectionLite.
+
+    Header only, needs C++17.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _davisCalibration_h_
+#define _davisCalibration_h_
+
+#include <stdint.h>
+
+#define davisSiteCount 29
+#define davisColumnCount 3
+
+// correction sites, the speed and the corrections at 0, 90 and 180 degrees in tenths of a mph
+typedef struct
+{
+    uint8_t speed;
+    int8_t corrections[davisColumnCount];
+} davisSite;
+
+constexpr davisSite davisCalibration[davisSiteCount] = {{0,{0,0,0}}, // simplifies algorithm - causes zero correction at zero speed
+                                                        {20,{33,-23,-36}},
+                                                        {25,{35,-27,-46}},
+                                                        {30,{38,-29,-48}},
+                                                        {35,{42,-34,-53}},
+                                                        {40,{45,-41,-57}},
+                                                        {45,{47,-38,-45}},
+                                                        {50,{50,-45,-49}},
+                                                        {55,{53,-48,-52}},
+                                                        {60,{57,-53,-59}},
+                                                        {65,{58,-60,-60}},
+                                                        {70,{62,-56,-61}},
+                                                        {75,{64,-60,-68}},
+                                                        {80,{68,-64,-69}},
+                                                        {85,{71,-74,-68}},
+                                                        {90,{74,-80,-68}},
+                                                        {95,{75,-81,-75}},
+                                                        {100,{77,-79,-72}},
+                                                        {105,{82,-81,-77}},
+                                                        {110,{85,-85,-77}},
+                                                        {115,{89,-88,-85}},
+                                                        {120,{95,-94,-90}},
+                                                        {125,{100,-96,-98}},
+                                                        {130,{98,-98,-103}},
+                                                        {135,{98,-100,-110}},
+                                                        {140,{93,-102,-113}},
+                                                        {145,{95,-109,-105}},
+                                                        {150,{98,-121,-120}},
+                                                        {255,{98,-121,-120}}}; // simplifies algorithm - maintains same correction above 150
+
+// speed of a site with the top site moved to topSpeed
+constexpr float davisSiteSpeed(int site, float topSpeed)
+{
+    return (site==(davisSiteCount-1)) ? topSpeed : davisCalibration[site].speed;
+}
+
+// true when, at every angle site, the corrected speed at each site is above the one at the
+// site below, so the corrected speed rises with the raw speed at every angle and the
+// correction can be undone
+constexpr bool davisCorrectionMonotone(float topSpeed)
+{
+    for(int site=1;site<davisSiteCount;site++)
+    {
+        for(int column=0;column<davisColumnCount;column++)
+        {
+            float below = (davisSiteSpeed(site-1,topSpeed)*10.0f)+davisCalibration[site-1].corrections[column];
+            float above = (davisSiteSpeed(site,topSpeed)*10.0f)+davisCalibration[site].corrections[column];
+            if(!(above>below))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// longest run of equally spaced sites covering at least two intervals, found as
+// buildSpeedSiteIndex does, low==high when there is no such run
+typedef struct
+{
+    int low;
+    int high;
+} davisSiteRun;
+
+constexpr davisSiteRun findDavisSiteRun(float topSpeed)
+{
+    davisSiteRun run = {0,0};
+    int runStart = 0;
+    for(int site=1;site<davisSiteCount;site++)
+    {
+        float spacing = davisSiteSpeed(site,topSpeed)-davisSiteSpeed(site-1,topSpeed);
+        float runSpacing = davisSiteSpeed(runStart+1,topSpeed)-davisSiteSpeed(runStart,topSpeed);
+        if((site-runStart)>1 && spacing!=runSpacing)
+        {
+            runStart = site-1;
+        }
+
+        if((site-runStart)>=2 && (site-runStart)>(run.high-run.low))
+        {
+            run.low = runStart;
+            run.high = site;
+        }
+    }
+    return run;
+}
+
+// float representation, each row is the speed then the 0, 90 and 180 degree corrections
+// divided by correctionDivisor (10 for mph, 1 to stay in tenths)
+typedef struct
+{
+    float rows[davisSiteCount][davisColumnCount+1];
+} floatCorrectionTable;
+
+constexpr floatCorrectionTable makeFloatCorrectionTable(float topSpeed, float correctionDivisor)
+{
+    floatCorrectionTable table = {};
+    for(int site=0;site<davisSiteCount;site++)
+    {
+        table.rows[site][0] = davisSiteSpeed(site,topSpeed);
+        for(int column=0;column<davisColumnCount;column++)
+        {
+            table.rows[site][column+1] = davisCalibration[site].corrections[column]/correctionDivisor;
+        }
+    }
+    return table;
+}
+
+// every int8_t tenths value divided by 10, for profiles that keep their corrections in
+// tenths, a load from here is the divide without its latency
+typedef struct
+{
+    float mph[256];
+} tenthsDecodeTable;
+
+constexpr tenthsDecodeTable makeTenthsDecodeTable(void)
+{
+    tenthsDecodeTable table = {};
+    for(int tenths=-128;tenths<128;tenths++)
+    {
+        table.mph[tenths+128] = tenths/10.0f;
+    }
+    return table;
+}
+
+inline constexpr tenthsDecodeTable tenthsDecode = makeTenthsDecodeTable();
+
+#define tenthsToMph(tenths) (tenthsDecode.mph[(tenths)+128])
+
+// fixed point representation for speedCorrectionLite, with the per interval reciprocals
+// correctSpeedTenths divides by
+//
+// correctSpeedTenths rounds by taking floor(x/divisor) with x = 2*|correction|+90*speedDelta
+// and divisor = 180*speedDelta. floor(x/divisor) == (x*ceil(2^39/divisor))>>39 whenever
+// x*divisor < 2^39, which holds for x < 2^23 (|correction| is at most 128*90*255) and
+// divisor < 2^16, and the reciprocal fits in 32 bits for any speedDelta of 1 or more
+#define tenthsShift 39
+
+typedef struct
+{
+    uint8_t speeds[davisSiteCount];
+    int8_t corrections[davisSiteCount][davisColumnCount];
+    uint32_t tenthsReciprocal[davisSiteCount];  // interval above each site, 0 for the last
+} fixedPointCorrectionTable;
+
+constexpr fixedPointCorrectionTable makeFixedPointCorrectionTable(void)
+{
+    fixedPointCorrectionTable table = {};
+    for(int site=0;site<davisSiteCount;site++)
+    {
+        table.speeds[site] = davisCalibration[site].speed;
+        for(int column=0;column<davisColumnCount;column++)
+        {
+            table.corrections[site][column] = davisCalibration[site].corrections[column];
+        }
+    }
+    for(int site=0;site<(davisSiteCount-1);site++)
+    {
+        uint32_t divisor = 180*(table.speeds[site+1]-table.speeds[site]);
+        table.tenthsReciprocal[site] = (uint32_t)(((1ULL<<tenthsShift)+divisor-1)/divisor);
+    }
+    return table;
+}
+
+// tables for correctSpeed<Table>, a table provides the float rows, the uniform run of its
+// speed sites and the divisor taking its corrections to mph
+struct davisFloatTable
+{
+    static constexpr float topSpeed = 999.0f;
+    static constexpr float correctionDivisor = 1.0f;
+    static constexpr floatCorrectionTable table = makeFloatCorrectionTable(topSpeed,10.0f);
+    static constexpr davisSiteRun run = findDavisSiteRun(topSpeed);
+};
+
+struct davisTenthsTable
+{
+    static constexpr float topSpeed = 255.0f;
+    static constexpr float correctionDivisor = 10.0f;
+    static constexpr floatCorrectionTable table = makeFloatCorrectionTable(topSpeed,1.0f);
+    static constexpr davisSiteRun run = findDavisSiteRun(topSpeed);
+};
+
+struct davisFixedPointTable
+{
+    static constexpr fixedPointCorrectionTable table = makeFixedPointCorrectionTable();
+    static constexpr davisSiteRun run = findDavisSiteRun(255.0f);
+};
+
+// index of the site at or above rawSpeed (at least 1), speeds in the uniform run are found
+// from the constant spacing and the rest by a linear search of the sites outside the run
+template<typename Table>
+constexpr int correctionSite(float rawSpeed)
+{
+    constexpr const float (&rows)[davisSiteCount][davisColumnCount+1] = Table::table.rows;
+    constexpr int uniformLow = Table::run.low;
+    constexpr int uniformHigh = Table::run.high;
+    constexpr float uniformOrigin = rows[uniformLow][0];
+    constexpr float uniformLimit = rows[uniformHigh][0];
+    constexpr float uniformScale = (uniformHigh>uniformLow) ? 1.0f/(rows[uniformLow+1][0]-uniformOrigin) : 0.0f;
+
+    int site = 0;
+    if(uniformHigh>uniformLow && rawSpeed>uniformOrigin && rawSpeed<=uniformLimit)
+    {
+        site = uniformLow+(int)((rawSpeed-uniformOrigin)*uniformScale)+1;
+        site = (site>uniformHigh) ? uniformHigh : site;
+        site += (rawSpeed>rows[site][0]) ? 1 : 0;
+        site -= (rawSpeed<=rows[site-1][0]) ? 1 : 0;
+    }
+    else
+    {
+        // scan the sites on whichever side of the run the speed lies
+        site = (rawSpeed<=uniformOrigin) ? 0 : uniformHigh;
+        while(site<(davisSiteCount-1) && !((rawSpeed-rows[site][0])<=0.0))
+        {
+            site++;
+        }
+    }
+
+    return (site<1) ? 1 : site;
+}
+
+template<typename Table>
+constexpr float correctSpeed(float rawSpeed, float angle)
+{
+    constexpr const float (&rows)[davisSiteCount][davisColumnCount+1] = Table::table.rows;
+    constexpr double sectorWidth = 180.0/(davisColumnCount-1);
+
+    // fold the angle onto 0->180 in double as correctSpeed does
+    float correctionAngle = (angle>180.0) ? (180.0-(angle-180.0)) : angle;
+
+    int speedIndexHigh = correctionSite<Table>(rawSpeed);
+    int speedIndexLow = speedIndexHigh-1;
+
+    float speedDelta = (rows[speedIndexHigh][0]-rows[speedIndexLow][0]);
+    float speedOffset = (rawSpeed-rows[speedIndexLow][0]);
+    float speedFactor = (speedOffset/speedDelta);
+
+    // the sector is the pair of angle sites either side of the angle, an angle on a site
+    // uses the sector below it
+    int sector = 0;
+    for(int boundary=1;boundary<(davisColumnCount-1);boundary++)
+    {
+        sector += (correctionAngle>(boundary*sectorWidth)) ? 1 : 0;
+    }
+    float angleFactor = ((correctionAngle-(sector*sectorWidth))/sectorWidth);
+
+    float speedCorrectionLow = (rows[speedIndexLow][sector+2]-rows[speedIndexLow][sector+1]);
+    speedCorrectionLow *= angleFactor;
+    speedCorrectionLow += rows[speedIndexLow][sector+1];
+    float speedCorrectionHigh = (rows[speedIndexHigh][sector+2]-rows[speedIndexHigh][sector+1]);
+    speedCorrectionHigh *= angleFactor;
+    speedCorrectionHigh += rows[speedIndexHigh][sector+1];
+
+    float calculatedSpeed = ((speedCorrectionHigh-speedCorrectionLow)*speedFactor)+speedCorrectionLow;
+    if(Table::correctionDivisor!=1.0f)
+    {
+        calculatedSpeed /= Table::correctionDivisor;
+    }
+    calculatedSpeed += rawSpeed;
+
+    return calculatedSpeed;
+}
+
+// dense lattice representation, correctSpeed<Table>-rawSpeed at every speedStep x angleStep
+// node over 0->255 mph and 0->180 degrees, laid out as buildCorrectionLattice lays out its
+// storage so it can back a correctionLattice directly
+template<int speedStep, int angleStep>
+struct denseCorrectionLattice
+{
+    static constexpr int speedCount = ((255+speedStep-1)/speedStep)+1;
+    static constexpr int angleCount = ((180+angleStep-1)/angleStep)+1;
+    float corrections[speedCount*angleCount];
+};
+
+template<typename Table, int speedStep, int angleStep>
+constexpr denseCorrectionLattice<speedStep,angleStep> makeDenseCorrectionLattice(void)
+{
+    typedef denseCorrectionLattice<speedStep,angleStep> lattice;
+    lattice dense = {};
+    for(int row=0;row<lattice::speedCount;row++)
+    {
+        float rawSpeed = row*speedStep;
+        for(int column=0;column<lattice::angleCount;column++)
+        {
+            dense.corrections[(row*lattice::angleCount)+column] = correctSpeed<Table>(rawSpeed,column*angleStep)-rawSpeed;
+        }
+    }
+    return dense;
+}
+
+#endif
@@ -0,0 +1,219 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Differential test support shared by the speedCorrection and speedCorrectionLite
+    differentialTest programs
+
+    A sweep is cut into blocks of samples that worker threads take in turn, each block
+    compares one or more correction paths against a reference and keeps its own tally,
+    and the tallies are merged once the workers have finished. The first failure kept is
+    the one at the lowest sample position, so a sweep reports the same failure whatever
+    the thread count.
+
+    Header only, included by the differentialTest programs alone.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _differentialHarness_h_
+#define _differentialHarness_h_
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// most threads a sweep runs
+#define differentialMaxThreads 64
+
+// how far a result may stray from the reference
+typedef enum
+{
+    differentialUlps = 0,       // representable floats between them, 0 is bit identical
+    differentialTenths,         // absolute difference in tenths of a mph
+    differentialUnitCount
+} differentialUnits;
+
+static const char* const differentialUnitNames[differentialUnitCount] = {"ulps","tenths"};
+
+// tally of one path over some samples
+typedef struct
+{
+    uint64_t compared;
+    uint64_t failures;
+    double worst;               // largest error seen, in the path's units
+    uint64_t firstPosition;     // sample position of the first failure, UINT64_MAX without one
+    float firstRaw;
+    float firstAngle;
+    float firstValue;
+    float firstExpected;
+} differentialTally;
+
+static inline void differentialReset(differentialTally* tally)
+{
+    memset(tally,0,sizeof(*tally));
+    tally->firstPosition = UINT64_MAX;
+}
+
+// floats mapped onto integers that order as the floats do, -0 and +0 both map to 0
+static inline int64_t differentialOrdered(float value)
+{
+    int32_t bits;
+    memcpy(&bits,&value,sizeof(bits));
+    return (bits<0) ? -(int64_t)(bits&0x7fffffff) : (int64_t)bits;
+}
+
+// two NaNs match, a NaN against a number is an infinite error
+static inline double differentialError(differentialUnits units, float value, float expected)
+{
+    if(isnan(value) || isnan(expected))
+    {
+        return (isnan(value) && isnan(expected)) ? 0.0 : INFINITY;
+    }
+    if(units==differentialUlps)
+    {
+        int64_t distance = differentialOrdered(value)-differentialOrdered(expected);
+        return (double)((distance<0) ? -distance : distance);
+    }
+    if(value==expected)
+    {
+        return 0.0;
+    }
+    return fabs((double)value-(double)expected)*10.0;
+}
+
+static inline void differentialCompare(differentialTally* tally, differentialUnits units, double tolerance, uint64_t position,
+                                       float rawSpeed, float angle, float value, float expected)
+{
+    double error = differentialError(units,value,expected);
+    tally->compared++;
+    tally->worst = (error>tally->worst) ? error : tally->worst;
+    if(error<=tolerance)
+    {
+        return;
+    }
+
+    tally->failures++;
+    if(position<tally->firstPosition)
+    {
+        tally->firstPosition = position;
+        tally->firstRaw = rawSpeed;
+        tally->firstAngle = angle;
+        tally->firstValue = value;
+        tally->firstExpected = expected;
+    }
+}
+
+static inline void differentialMerge(differentialTally* total, const differentialTally* part)
+{
+    total->compared += part->compared;
+    total->failures += part->failures;
+    total->worst = (part->worst>total->worst) ? part->worst : total->worst;
+    if(part->firstPosition<total->firstPosition)
+    {
+        total->firstPosition = part->firstPosition;
+        total->firstRaw = part->firstRaw;
+        total->firstAngle = part->firstAngle;
+        total->firstValue = part->firstValue;
+        total->firstExpected = part->firstExpected;
+    }
+}
+
+// one DIFF: line per path, and the first failure if there was one, returns the failure count
+static inline uint64_t differentialReport(const char* path, differentialUnits units, double tolerance, const differentialTally* tally)
+{
+    printf("DIFF:%-14s %12llu samples, worst %10.4g %-6s (tolerance %g), %llu failures\n",path,(unsigned long long)tally->compared,
+           tally->worst,differentialUnitNames[units],tolerance,(unsigned long long)tally->failures);
+    if(tally->failures)
+    {
+        printf("DIFF:%-14s first failure at sample %llu, speed %.9g angle %.9g gave %.9g, expected %.9g\n",path,
+               (unsigned long long)tally->firstPosition,tally->firstRaw,tally->firstAngle,tally->firstValue,tally->firstExpected);
+    }
+    return tally->failures;
+}
+
+// xorshift, a block seeded from the sweep seed and its own number draws the same samples
+// whichever thread takes it
+static inline uint64_t differentialSeed(uint64_t seed, uint64_t block)
+{
+    uint64_t state = seed+((block+1)*0x9e3779b97f4a7c15ULL);
+    state = (state^(state>>30))*0xbf58476d1ce4e5b9ULL;
+    state = (state^(state>>27))*0x94d049bb133111ebULL;
+    state ^= state>>31;
+    return state ? state : 1;
+}
+
+static inline uint64_t differentialNext(uint64_t* state)
+{
+    *state ^= *state<<13;
+    *state ^= *state>>7;
+    *state ^= *state<<17;
+    return *state;
+}
+
+static inline double differentialUniform(uint64_t* state)
+{
+    return (differentialNext(state)>>11)*(1.0/9007199254740992.0);
+}
+
+template<typename Run> struct differentialSweep
+{
+    Run* run;
+    uint64_t blockCount;
+    uint64_t nextBlock;
+};
+
+template<typename Run> static void* differentialWorker(void* argument)
+{
+    differentialSweep<Run>* sweep = (differentialSweep<Run>*)argument;
+    for(;;)
+    {
+        uint64_t block = __atomic_fetch_add(&sweep->nextBlock,1,__ATOMIC_RELAXED);
+        if(block>=sweep->blockCount)
+        {
+            return NULL;
+        }
+        (*sweep->run)(block);
+    }
+}
+
+// calls run(block) once for each of blockCount blocks across threadCount threads, the
+// calling thread included, run must only touch state of its own block or take a lock.
+// Returns 0, or -1 if a thread could not be started (the blocks are still all run)
+template<typename Run> static inline int differentialRunBlocks(int threadCount, uint64_t blockCount, Run run)
+{
+    differentialSweep<Run> sweep = {&run,blockCount,0};
+    pthread_t threads[differentialMaxThreads];
+    int started = 0;
+    int result = 0;
+    threadCount = (threadCount>differentialMaxThreads) ? differentialMaxThreads : threadCount;
+    while((started+1)<threadCount)
+    {
+        if(pthread_create(&threads[started],NULL,differentialWorker<Run>,&sweep)!=0)
+        {
+            result = -1;
+            break;
+        }
+        started++;
+    }
+    differentialWorker<Run>(&sweep);
+    for(int thread=0;thread<started;thread++)
+    {
+        pthread_join(threads[thread],NULL);
+    }
+    return result;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Incremental windowed statistics shared by speedCorrection and speedCorrectionLite
+
+    Samples are numbered with a 16 bit sequence number that wraps. A window is never more
+    than 32768 samples long, so the age of any sample still in a window is the 16 bit
+    difference of the sequence numbers, and the ring is a power of two no longer than
+    65536 so a sequence number masked is its slot. The deques hold sequence numbers rather
+    than speeds, they look the speeds up in the ring, so every window shares the one copy
+    of each sample.
+
+    Integer only, no division on the update path.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <math.h>
+#include "rollingStatistics.h"
+
+static void clearDeque(rollingDeque* deque)
+{
+    deque->head = 0;
+    deque->count = 0;
+}
+
+// index of the entry position entries after the head
+static inline uint16_t dequeIndex(const rollingDeque* deque, uint16_t length, uint32_t position)
+{
+    uint32_t index = deque->head+position;
+    return (index>=length) ? index-length : index;
+}
+
+int initRollingStatistics(rollingStatistics* statistics, void* storage, const uint16_t* lengths, int windowCount)
+{
+    if(rollingStatisticsBytes(lengths,windowCount)==0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint16_t longest = 0;
+    for(int window=0;window<windowCount;window++)
+    {
+        longest = (lengths[window]>longest) ? lengths[window] : longest;
+    }
+    uint32_t capacity = 1;
+    while(capacity<longest)
+    {
+        capacity <<= 1;
+    }
+
+    uint16_t* next = (uint16_t*)storage;
+    statistics->samples = next;
+    statistics->mask = capacity-1;
+    next += capacity;
+
+    statistics->windowCount = windowCount;
+    for(int window=0;window<windowCount;window++)
+    {
+        statistics->windows[window].length = lengths[window];
+        statistics->windows[window].maxima.entries = next;
+        next += lengths[window];
+        statistics->windows[window].minima.entries = next;
+        next += lengths[window];
+    }
+
+    resetRollingStatistics(statistics);
+    return 0;
+}
+
+void resetRollingStatistics(rollingStatistics* statistics)
+{
+    statistics->next = 0;
+    statistics->peak = 0;
+    for(int window=0;window<statistics->windowCount;window++)
+    {
+        statistics->windows[window].filled = 0;
+        statistics->windows[window].sum = 0;
+        clearDeque(&statistics->windows[window].maxima);
+        clearDeque(&statistics->windows[window].minima);
+    }
+}
+
+void pushRollingTenths(rollingStatistics* statistics, uint16_t tenths)
+{
+    uint16_t sequence = statistics->next;
+    const uint16_t* samples = statistics->samples;
+    uint16_t mask = statistics->mask;
+
+    for(int window=0;window<statistics->windowCount;window++)
+    {
+        rollingWindow* rolling = &statistics->windows[window];
+        uint16_t length = rolling->length;
+
+        // the sample leaving the window is read before the new one can overwrite its slot
+        if(rolling->filled==length)
+        {
+            rolling->sum -= samples[(uint16_t)(sequence-length)&mask];
+        }
+        else
+        {
+            rolling->filled++;
+        }
+        rolling->sum += tenths;
+
+        // at most one sample expires from the front of each deque per push
+        rollingDeque* maxima = &rolling->maxima;
+        if(maxima->count>0 && (uint16_t)(sequence-maxima->entries[maxima->head])>=length)
+        {
+            maxima->head = dequeIndex(maxima,length,1);
+            maxima->count--;
+        }
+        uint16_t maximumBack = (maxima->count>0) ? dequeIndex(maxima,length,maxima->count-1) : 0;
+        while(maxima->count>0 && samples[maxima->entries[maximumBack]&mask]<=tenths)
+        {
+            maxima->count--;
+            maximumBack = (maximumBack==0) ? length-1 : maximumBack-1;
+        }
+        maxima->entries[dequeIndex(maxima,length,maxima->count++)] = sequence;
+
+        rollingDeque* minima = &rolling->minima;
+        if(minima->count>0 && (uint16_t)(sequence-minima->entries[minima->head])>=length)
+        {
+            minima->head = dequeIndex(minima,length,1);
+            minima->count--;
+        }
+        uint16_t minimumBack = (minima->count>0) ? dequeIndex(minima,length,minima->count-1) : 0;
+        while(minima->count>0 && samples[minima->entries[minimumBack]&mask]>=tenths)
+        {
+            minima->count--;
+            minimumBack = (minimumBack==0) ? length-1 : minimumBack-1;
+        }
+        minima->entries[dequeIndex(minima,length,minima->count++)] = sequence;
+    }
+
+    // every sample the deques still hold is younger than the longest window, so none
+    // of them shares this slot
+    statistics->samples[sequence&mask] = tenths;
+    statistics->next = sequence+1;
+    statistics->peak = (tenths>statistics->peak) ? tenths : statistics->peak;
+}
+
+void pushRollingSpeed(rollingStatistics* statistics, float speed)
+{
+    // a NaN is no reading, correctSpeed gives one for a NaN or infinite speed
+    if(isnan(speed))
+    {
+        return;
+    }
+    float tenths = (speed*10.0f)+0.5f;
+    tenths = (tenths<0.0f) ? 0.0f : ((tenths>65535.0f) ? 65535.0f : tenths);
+    pushRollingTenths(statistics,(uint16_t)tenths);
+}
+
+uint16_t rollingSamples(const rollingStatistics* statistics, int window)
+{
+    return statistics->windows[window].filled;
+}
+
+uint16_t rollingMeanTenths(const rollingStatistics* statistics, int window)
+{
+    const rollingWindow* rolling = &statistics->windows[window];
+    return (rolling->filled==0) ? 0 : (rolling->sum+(rolling->filled/2))/rolling->filled;
+}
+
+uint16_t rollingMaxTenths(const rollingStatistics* statistics, int window)
+{
+    const rollingDeque* maxima = &statistics->windows[window].maxima;
+    return (maxima->count==0) ? 0 : statistics->samples[maxima->entries[maxima->head]&statistics->mask];
+}
+
+uint16_t rollingMinTenths(const rollingStatistics* statistics, int window)
+{
+    const rollingDeque* minima = &statistics->windows[window].minima;
+    return (minima->count==0) ? 0 : statistics->samples[minima->entries[minima->head]&statistics->mask];
+}
+
+float rollingMean(const rollingStatistics* statistics, int window)
+{
+    const rollingWindow* rolling = &statistics->windows[window];
+    return (rolling->filled==0) ? 0.0f : rolling->sum/(10.0f*rolling->filled);
+}
+
+uint16_t rollingPeakTenths(const rollingStatistics* statistics)
+{
+    return statistics->peak;
+}
+
+void resetRollingPeak(rollingStatistics* statistics)
+{
+    statistics->peak = 0;
+}
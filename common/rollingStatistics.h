@@ -0,0 +1,116 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _rollingStatistics_h_
+#define _rollingStatistics_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// most windows one set of rolling statistics can keep and the longest window in samples
+#define rollingMaxWindows 4
+#define rollingMaxLength 32768
+
+// double ended queue of sample sequence numbers, the samples they refer to stay ordered
+// (falling for the maximum, rising for the minimum) so the front is the extreme
+typedef struct
+{
+    uint16_t* entries;          // one entry per sample of the window
+    uint16_t head;
+    uint16_t count;
+} rollingDeque;
+
+typedef struct
+{
+    uint16_t length;            // samples
+    uint16_t filled;            // samples seen, up to length
+    uint32_t sum;               // tenths of a mph, exact
+    rollingDeque maxima;
+    rollingDeque minima;
+} rollingWindow;
+
+// rolling mean, maximum and minimum of corrected speeds over several window lengths at once,
+// e.g. 3 second gusts with 2 and 10 minute averages, all windows read their samples from one
+// ring sized to the longest window. Each sample costs O(1) per window (amortised for the
+// extremes), speeds are kept in tenths of a mph so the sums are exact however long it runs
+//
+// all memory is supplied by the caller, rollingStatisticsBytes gives its size at compile
+// time, nothing is allocated
+typedef struct
+{
+    uint16_t* samples;          // ring of tenths of a mph, a power of two long
+    uint16_t mask;
+    uint16_t next;              // sequence number of the next sample, wraps at 65536
+    uint16_t peak;              // highest sample since the peak was last reset
+    uint8_t windowCount;
+    rollingWindow windows[rollingMaxWindows];
+} rollingStatistics;
+
+// bytes of storage for windows of the given lengths in samples, 0 if the lengths are invalid
+constexpr size_t rollingStatisticsBytes(const uint16_t* lengths, int windowCount)
+{
+    if(windowCount<1 || windowCount>rollingMaxWindows)
+    {
+        return 0;
+    }
+
+    size_t longest = 0;
+    size_t total = 0;
+    for(int window=0;window<windowCount;window++)
+    {
+        if(lengths[window]==0 || lengths[window]>rollingMaxLength)
+        {
+            return 0;
+        }
+        longest = (lengths[window]>longest) ? lengths[window] : longest;
+        total += lengths[window];
+    }
+
+    size_t capacity = 1;
+    while(capacity<longest)
+    {
+        capacity <<= 1;
+    }
+
+    // the ring and a maximum and minimum deque per window
+    return (capacity+(2*total))*sizeof(uint16_t);
+}
+
+// storage must be rollingStatisticsBytes long and 2 byte aligned, returns 0, or -1 with
+// errno set to EINVAL if the lengths are invalid
+int initRollingStatistics(rollingStatistics* statistics, void* storage, const uint16_t* lengths, int windowCount);
+
+// forgets every sample, the peak included
+void resetRollingStatistics(rollingStatistics* statistics);
+
+void pushRollingTenths(rollingStatistics* statistics, uint16_t tenths);
+
+// rounds a speed in mph to the nearest tenth, a NaN speed is skipped
+void pushRollingSpeed(rollingStatistics* statistics, float speed);
+
+// over the samples seen so far until a window fills, all 0 for a window with no samples
+uint16_t rollingSamples(const rollingStatistics* statistics, int window);
+uint16_t rollingMeanTenths(const rollingStatistics* statistics, int window);
+uint16_t rollingMaxTenths(const rollingStatistics* statistics, int window);
+uint16_t rollingMinTenths(const rollingStatistics* statistics, int window);
+float rollingMean(const rollingStatistics* statistics, int window);
+
+// the peak wind since initialisation or the last reset, e.g. the daily peak
+uint16_t rollingPeakTenths(const rollingStatistics* statistics);
+void resetRollingPeak(rollingStatistics* statistics);
+
+#endif
@@ -0,0 +1,400 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Streaming correction of logged wind archives
+
+    Archives are read in archiveChunkBytes chunks with plain read() calls, so pipes
+    work as well as files, and written back out in chunks of the same size. A record
+    or line split across two chunks is carried over to the start of the next one.
+
+    Binary chunks are corrected with the vector kernel, the speeds and directions are
+    pulled out of the packed records into arrays and the corrected speeds put back.
+    Csv lines are corrected one at a time, the speed and direction fields are parsed
+    and the speed written back with hand rolled decimal conversions rather than
+    strtof/snprintf, which would cost more than the rest of the line put together.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "archiveStream.h"
+#include "interpolator.h"
+#include "simdCorrection.h"
+
+#define recordsPerChunk (archiveChunkBytes/sizeof(archiveRecord))
+#define recordsPerBlock 1024
+
+// most integer digits and decimal places handled by the csv fast paths, fields outside
+// these are treated as non numeric and the line is copied through
+#define maxIntegerDigits 9
+#define maxDecimals 6
+
+static const double powersOfTen[maxDecimals+1] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6};
+
+// reads until the buffer is full or the input ends, returns the bytes read or -1
+static ssize_t readChunk(int fd, char* buffer, size_t bytes)
+{
+    size_t total = 0;
+    while(total<bytes)
+    {
+        ssize_t got = read(fd,buffer+total,bytes-total);
+        if(got<0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if(got==0)
+        {
+            break;
+        }
+        total += got;
+    }
+    return total;
+}
+
+static int writeChunk(int fd, const char* buffer, size_t bytes, streamStats* stats)
+{
+    size_t total = 0;
+    while(total<bytes)
+    {
+        ssize_t put = write(fd,buffer+total,bytes-total);
+        if(put<0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        total += put;
+    }
+    stats->bytesWritten += bytes;
+    return 0;
+}
+
+int correctBinaryStream(int inputFd, int outputFd, streamStats* stats)
+{
+    memset(stats,0,sizeof(streamStats));
+    posix_fadvise(inputFd,0,0,POSIX_FADV_SEQUENTIAL);
+
+    const size_t chunkBytes = recordsPerChunk*sizeof(archiveRecord);
+    char* buffer = (char*)malloc(chunkBytes);
+    float* speeds = (float*)malloc(recordsPerBlock*sizeof(float));
+    float* angles = (float*)malloc(recordsPerBlock*sizeof(float));
+    float* corrected = (float*)malloc(recordsPerBlock*sizeof(float));
+    int result = 0;
+
+    if(!buffer || !speeds || !angles || !corrected)
+    {
+        errno = ENOMEM;
+        result = -1;
+    }
+
+    while(result==0)
+    {
+        ssize_t got = readChunk(inputFd,buffer,chunkBytes);
+        if(got<0)
+        {
+            result = -1;
+            break;
+        }
+        stats->bytesRead += got;
+
+        // the chunk holds a whole number of records, so only the last chunk of the input
+        // can end with part of one, the records are corrected a block at a time so the
+        // speed and direction arrays stay in cache
+        size_t count = got/sizeof(archiveRecord);
+        for(size_t block=0;block<count;block+=recordsPerBlock)
+        {
+            size_t blockCount = ((count-block)<recordsPerBlock) ? (count-block) : recordsPerBlock;
+            char* records = buffer+(block*sizeof(archiveRecord));
+            for(size_t record=0;record<blockCount;record++)
+            {
+                const char* fields = records+(record*sizeof(archiveRecord));
+                memcpy(&speeds[record],fields+offsetof(archiveRecord,windSpeed),sizeof(float));
+                memcpy(&angles[record],fields+offsetof(archiveRecord,windDirection),sizeof(float));
+            }
+            correctSpeedSimd(speeds,angles,corrected,blockCount);
+            for(size_t record=0;record<blockCount;record++)
+            {
+                memcpy(records+(record*sizeof(archiveRecord))+offsetof(archiveRecord,windSpeed),&corrected[record],sizeof(float));
+            }
+        }
+        stats->records += count;
+        stats->corrected += count;
+
+        if(got>0 && writeChunk(outputFd,buffer,got,stats)<0)
+        {
+            result = -1;
+        }
+        if((size_t)got<chunkBytes)
+        {
+            break;
+        }
+    }
+
+    free(buffer);
+    free(speeds);
+    free(angles);
+    free(corrected);
+    return result;
+}
+
+// parses [spaces][sign]digits[.digits][spaces] filling the field, returns 0 for anything else
+static int parseDecimal(const char* start, const char* end, float* value, int* decimals)
+{
+    while(start<end && *start==' ')
+    {
+        start++;
+    }
+    while(end>start && end[-1]==' ')
+    {
+        end--;
+    }
+
+    int negative = 0;
+    if(start<end && (*start=='-' || *start=='+'))
+    {
+        negative = (*start=='-');
+        start++;
+    }
+
+    // integer digits then the fraction digits, anything left over is not a number
+    uint64_t mantissa = 0;
+    const char* character = start;
+    while(character<end && (unsigned)(*character-'0')<10)
+    {
+        mantissa = (mantissa*10)+(*character-'0');
+        character++;
+    }
+    int integerDigits = character-start;
+    int places = 0;
+    if(character<end && *character=='.')
+    {
+        const char* fraction = ++character;
+        while(character<end && (unsigned)(*character-'0')<10)
+        {
+            mantissa = (mantissa*10)+(*character-'0');
+            character++;
+        }
+        places = character-fraction;
+    }
+
+    if(character!=end || (integerDigits+places)==0 || integerDigits>maxIntegerDigits || places>maxDecimals)
+    {
+        return 0;
+    }
+
+    // the mantissa and power of ten are both exact in double so this is a single rounding
+    double magnitude = mantissa/powersOfTen[places];
+    *value = negative ? -magnitude : magnitude;
+    *decimals = places;
+    return 1;
+}
+
+// writes value to the given number of decimal places, returns the characters written
+static int formatDecimal(float value, int decimals, char* output)
+{
+    int length = 0;
+    double scaled = value*powersOfTen[decimals];
+    if(scaled<0.0)
+    {
+        output[length++] = '-';
+        scaled = -scaled;
+    }
+    uint64_t rounded = (uint64_t)(scaled+0.5);
+
+    char digits[24];
+    int digitCount = 0;
+    do
+    {
+        digits[digitCount++] = '0'+(rounded%10);
+        rounded /= 10;
+    } while(rounded>0 || digitCount<=decimals);
+
+    for(int digit=digitCount-1;digit>=0;digit--)
+    {
+        output[length++] = digits[digit];
+        if(digit==decimals && decimals>0)
+        {
+            output[length++] = '.';
+        }
+    }
+    return length;
+}
+
+// finds the speed and direction fields in a single pass over the line, returns 0 if the
+// line has too few fields
+static int findFields(const char* line, const char* end, const csvLayout* layout, const char** speedStart, const char** speedEnd, const char** directionStart, const char** directionEnd)
+{
+    int lastColumn = (layout->speedColumn>layout->directionColumn) ? layout->speedColumn : layout->directionColumn;
+    int column = 0;
+    const char* start = line;
+    for(const char* character=line;;character++)
+    {
+        if(character==end || *character==layout->separator)
+        {
+            if(column==layout->speedColumn)
+            {
+                *speedStart = start;
+                *speedEnd = character;
+            }
+            if(column==layout->directionColumn)
+            {
+                *directionStart = start;
+                *directionEnd = character;
+            }
+            if(column==lastColumn)
+            {
+                return 1;
+            }
+            if(character==end)
+            {
+                return 0;
+            }
+            column++;
+            start = character+1;
+        }
+    }
+}
+
+// corrects one line (without its newline) into output, returns the characters written and
+// sets corrected if the speed was replaced
+static size_t correctCsvLine(const char* line, size_t length, const csvLayout* layout, char* output, int* corrected)
+{
+    const char* end = line+length;
+    const char* content = ((length>0) && end[-1]=='\r') ? end-1 : end;
+    const char* speedStart = NULL;
+    const char* speedEnd = NULL;
+    const char* directionStart = NULL;
+    const char* directionEnd = NULL;
+    float rawSpeed;
+    float angle;
+    int decimals;
+    int ignored;
+
+    *corrected = 0;
+    if(!findFields(line,content,layout,&speedStart,&speedEnd,&directionStart,&directionEnd) ||
+       !parseDecimal(speedStart,speedEnd,&rawSpeed,&decimals) ||
+       !parseDecimal(directionStart,directionEnd,&angle,&ignored))
+    {
+        memcpy(output,line,length);
+        return length;
+    }
+
+    size_t prefix = speedStart-line;
+    memcpy(output,line,prefix);
+    size_t written = prefix+formatDecimal(correctSpeed(rawSpeed,angle),(decimals<1) ? 1 : decimals,output+prefix);
+    memcpy(output+written,speedEnd,end-speedEnd);
+    *corrected = 1;
+    return written+(end-speedEnd);
+}
+
+int correctCsvStream(int inputFd, int outputFd, const csvLayout* layout, streamStats* stats)
+{
+    memset(stats,0,sizeof(streamStats));
+    posix_fadvise(inputFd,0,0,POSIX_FADV_SEQUENTIAL);
+
+    // a corrected line is at most a few characters longer than the input line, the output
+    // buffer is flushed whenever it could not take another full chunk's worth of line
+    const size_t outputBytes = 2*archiveChunkBytes+64;
+    char* buffer = (char*)malloc(archiveChunkBytes);
+    char* output = (char*)malloc(outputBytes);
+    size_t held = 0;
+    size_t pending = 0;
+    int result = 0;
+
+    if(!buffer || !output)
+    {
+        errno = ENOMEM;
+        result = -1;
+    }
+
+    while(result==0)
+    {
+        ssize_t got = readChunk(inputFd,buffer+held,archiveChunkBytes-held);
+        if(got<0)
+        {
+            result = -1;
+            break;
+        }
+        stats->bytesRead += got;
+        size_t bytes = held+got;
+        int finished = ((size_t)got<(archiveChunkBytes-held));
+
+        const char* line = buffer;
+        const char* end = buffer+bytes;
+        while(line<end)
+        {
+            const char* newline = (const char*)memchr(line,'\n',end-line);
+            if(!newline && !finished)
+            {
+                break;
+            }
+
+            size_t length = (newline ? newline : end)-line;
+            int corrected;
+            pending += correctCsvLine(line,length,layout,output+pending,&corrected);
+            if(newline)
+            {
+                output[pending++] = '\n';
+            }
+            stats->records++;
+            stats->corrected += corrected;
+            line += length+(newline ? 1 : 0);
+
+            if(pending>=(outputBytes-archiveChunkBytes-64))
+            {
+                if(writeChunk(outputFd,output,pending,stats)<0)
+                {
+                    result = -1;
+                    break;
+                }
+                pending = 0;
+            }
+        }
+
+        if(result!=0 || finished)
+        {
+            break;
+        }
+
+        // carry the partial line to the start of the buffer, a line filling the whole
+        // buffer can never be completed
+        held = end-line;
+        if(held==archiveChunkBytes)
+        {
+            errno = EINVAL;
+            result = -1;
+            break;
+        }
+        memmove(buffer,line,held);
+    }
+
+    if(result==0 && pending>0 && writeChunk(outputFd,output,pending,stats)<0)
+    {
+        result = -1;
+    }
+
+    free(buffer);
+    free(output);
+    return result;
+}
@@ -0,0 +1,67 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _archiveStream_h_
+#define _archiveStream_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// size of the read and write buffers, the whole input is never held in memory
+#define archiveChunkBytes (1<<20)
+
+// packed binary archive record, 12 bytes little endian with no padding
+typedef struct __attribute__((packed))
+{
+    uint32_t timestamp;         // seconds since the epoch
+    float windSpeed;            // mph
+    float windDirection;        // degrees
+} archiveRecord;
+
+// where the wind fields are in a csv archive (WeeWX and WeatherLink exports put them
+// in different columns), columns count from 0
+typedef struct
+{
+    int speedColumn;
+    int directionColumn;
+    char separator;
+} csvLayout;
+
+typedef struct
+{
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t records;           // records or lines read
+    uint64_t corrected;         // records or lines whose speed was corrected
+} streamStats;
+
+// stream a binary archive from one file descriptor to another, correcting windSpeed in
+// every record, a trailing partial record is copied through unchanged
+//
+// returns 0, or -1 with errno set if a read or write fails
+int correctBinaryStream(int inputFd, int outputFd, streamStats* stats);
+
+// stream a csv archive from one file descriptor to another, replacing the speed field with
+// the corrected speed written to the same number of decimal places (at least one), lines
+// without a numeric speed and direction (headers, calm or missing readings) are copied
+// through unchanged, as is every other field
+//
+// returns 0, or -1 with errno set if a read or write fails or a line is longer than
+// archiveChunkBytes
+int correctCsvStream(int inputFd, int outputFd, const csvLayout* layout, streamStats* stats);
+
+#endif
@@ -0,0 +1,1069 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Benchmarks for interpolator.c
+
+    Times the speed site lookup using the linear search and the speed site index in
+    10 mph bands across 0->200 mph, the linear search gets slower the higher the
+    speed while the index should stay flat.
+
+    Then times a full correction of a 0->200 mph x 0->360 degree sweep through
+    correctSpeed, correctSpeed<davisFloatTable>, the default calibration profile, the batch api and the correction
+    lattice, and through the vector
+    kernel at every instruction set level the cpu supports.
+
+    Then times the work stealing bulk correction at 1 to 32 threads, each thread count
+    gets its own pool and the same 16M samples.
+
+    Then streams binary and csv archives from a temporary file to /dev/null through
+    archiveStream.c, the file is read back from the page cache so this is the rate the
+    corrector can sustain rather than the rate of the disk.
+
+    Finally times the scalar, batch and accelerated paths over calm, gusty, storm and
+    uniform sweep wind (benchHarness.h), warm with the tables cached and cold straight
+    after evicting every cache, and the fused correction and vector mean (windVector.c)
+    against correcting, decomposing with sinf and cosf and averaging as separate passes
+    over 4M samples in 10 minute windows of 1 second samples, and the rolling gust and
+    average statistics (rollingStatistics.c) against recomputing the windows from the
+    history every sample.
+
+    Finally correctSpeed, the batch api and the batch binned by speed site and angle
+    sector are timed over every distribution and over a recorded trace given with
+    bench -t archive (a binary archive as correctFile -b reads), with cycles and branch
+    misses per sample where the kernel allows perf_event_open. bench -j file writes all
+    these results to file as json.
+
+    Then a station year of gusty one minute readings is archived as columns
+    (columnArchive.c) and as a packed binary archive, and the sizes and the rate of
+    correcting the year again from each are compared, the column archive mapped, decoded
+    and corrected a chunk at a time and the binary archive streamed through
+    correctBinaryStream.
+
+    Then the correction cache (correctionCache.c) is timed in front of correctSpeed and a
+    calibration profile over a live feed of whole mph and whole degree readings.
+
+    Then a station year of csv is streamed through the correction pipeline
+    (correctionPipeline.c) with its stages on their own threads and with them run one
+    after another, from the page cache and with a 2 ms wait on every block read and
+    written, the overlap column is the time spent in the stages over the time taken.
+
+    Then the smooth interpolation (smoothCorrection.c) is timed against the linear one,
+    scalar and batch, over every distribution.
+
+    Then the inverse correction (inverseCorrection.c) is timed against finding the raw
+    speed by iterating correctSpeed.
+
+    Last 4096 stations, each with its own calibration, have their readings corrected a
+    block at a time in arrival order through calibration profiles and through packed
+    profiles (packedProfile.c), a sample and a block of stations at a time.
+
+    make benchInstrumented builds the bench with the correction calls instrumented
+    (correctionInstrumentation.h) and prints what every correctSpeed call of the run
+    counted, its timings show what the instrumentation costs.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "benchHarness.h"
+#include "interpolator.h"
+#include "correctionLattice.h"
+#include "simdCorrection.h"
+#include "davisCalibration.h"
+#include "archiveStream.h"
+#include "parallelCorrection.h"
+#include "calibrationProfile.h"
+#include "windVector.h"
+#include "columnArchive.h"
+#include "correctionCache.h"
+#include "correctionInstrumentation.h"
+#include "correctionPipeline.h"
+#include "smoothCorrection.h"
+#include "inverseCorrection.h"
+#include "packedProfile.h"
+
+#define bandWidth 10
+#define bandCount 20
+#define bandSamples 1000
+#define repeats 2000
+#define sweepSpeeds 800
+#define sweepAngles 360
+#define sweepRepeats 20
+#define archiveRecords 8000000
+#define archiveRepeats 3
+#define parallelSamples (1<<24)
+#define parallelRepeats 5
+#define suiteSamples 65536
+#define suiteWarmRepeats 50
+#define suiteColdSamples 256
+#define suiteColdRepeats 7
+#define vectorSamples (1<<22)
+#define vectorWindow 600
+#define vectorRepeats 3
+#define rollingSampleCount (1<<20)
+#define stationYearSamples 525600
+#define pipelineStallUs 2000
+
+static double elapsedNs(struct timespec start, struct timespec end)
+{
+    return ((end.tv_sec-start.tv_sec)*1e9)+(end.tv_nsec-start.tv_nsec);
+}
+
+// the file source and sink with a wait on every block, a disk or network slower than the
+// page cache
+typedef struct
+{
+    pipelineTextSource* source;
+    int fd;
+    int stallUs;
+} stalledIo;
+
+static int stalledRead(void* context, pipelineBlock* block)
+{
+    stalledIo* io = (stalledIo*)context;
+    usleep(io->stallUs);
+    return readTextBlock(io->source,block);
+}
+
+static int stalledWrite(void* context, pipelineBlock* block)
+{
+    stalledIo* io = (stalledIo*)context;
+    usleep(io->stallUs);
+    return writeTextBlock(&io->fd,block);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* jsonName = NULL;
+    const char* traceName = NULL;
+    int option;
+    while((option = getopt(argc,argv,"j:t:"))!=-1)
+    {
+        switch(option)
+        {
+            case 'j':
+                jsonName = optarg;
+                break;
+            case 't':
+                traceName = optarg;
+                break;
+            default:
+                fprintf(stderr,"usage: bench [-j results.json] [-t archive]\n");
+                return 1;
+        }
+    }
+
+    // the bench uses its own copy of the default speed sites so it does not depend
+    // on how the interpolator stores its table
+    float sites[29];
+    for(int site=0;site<29;site++)
+    {
+        sites[site] = (site==0) ? 0.0 : ((site==28) ? 999.0 : 15.0+(site*5.0));
+    }
+    speedSiteIndex index = buildSpeedSiteIndex(sites,1,29);
+
+    float speeds[bandSamples];
+    long checksum = 0;
+    double scanTotal = 0.0;
+    double findTotal = 0.0;
+
+    printf("BENCH:speed site lookup, ns per lookup\n");
+    printf("BENCH:%8s %10s %10s %8s\n","band","scan","index","gain");
+
+    for(int band=0;band<bandCount;band++)
+    {
+        for(int sample=0;sample<bandSamples;sample++)
+        {
+            speeds[sample] = (band*bandWidth)+((float)bandWidth*sample/bandSamples);
+        }
+
+        struct timespec start;
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<repeats;repeat++)
+        {
+            for(int sample=0;sample<bandSamples;sample++)
+            {
+                checksum += scanSpeedSite(&index,speeds[sample]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        double scanNs = elapsedNs(start,end)/((double)repeats*bandSamples);
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<repeats;repeat++)
+        {
+            for(int sample=0;sample<bandSamples;sample++)
+            {
+                checksum -= findSpeedSite(&index,speeds[sample]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        double findNs = elapsedNs(start,end)/((double)repeats*bandSamples);
+
+        scanTotal += scanNs;
+        findTotal += findNs;
+        printf("BENCH:%3d->%3d %10.2f %10.2f %7.2fx\n",band*bandWidth,(band+1)*bandWidth,scanNs,findNs,scanNs/findNs);
+    }
+
+    printf("BENCH:%8s %10.2f %10.2f %7.2fx\n","0->200",scanTotal/bandCount,findTotal/bandCount,scanTotal/findTotal);
+
+    // full corrections over a 0->200 mph sweep in 0.25 mph steps at every whole degree
+    int sweepSize = sweepSpeeds*sweepAngles;
+    float* sweepSpeed = (float*)malloc(sweepSize*sizeof(float));
+    float* sweepAngle = (float*)malloc(sweepSize*sizeof(float));
+    int* nodeSpeed = (int*)malloc(sweepSize*sizeof(int));
+    int* nodeAngle = (int*)malloc(sweepSize*sizeof(int));
+    float* corrected = (float*)malloc(sweepSize*sizeof(float));
+    for(int sample=0;sample<sweepSize;sample++)
+    {
+        sweepSpeed[sample] = (sample/sweepAngles)*0.25;
+        sweepAngle[sample] = sample%sweepAngles;
+        nodeSpeed[sample] = (int)sweepSpeed[sample];
+        nodeAngle[sample] = sample%sweepAngles;
+    }
+
+    correctionLattice lattice;
+    float* latticeStorage = (float*)malloc(correctionLatticeBytes(1.0,1.0));
+    buildCorrectionLattice(&lattice,latticeStorage,1.0,1.0);
+
+    const char* paths[6] = {"correctSpeed","template","profile","batch","lattice batch","lattice node"};
+    double pathNs[6];
+    double correctedTotal = 0.0;
+    for(int path=0;path<6;path++)
+    {
+        struct timespec start;
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<sweepRepeats;repeat++)
+        {
+            switch(path)
+            {
+                case 0:
+                    for(int sample=0;sample<sweepSize;sample++)
+                    {
+                        corrected[sample] = correctSpeed(sweepSpeed[sample],sweepAngle[sample]);
+                    }
+                    break;
+                case 1:
+                    for(int sample=0;sample<sweepSize;sample++)
+                    {
+                        corrected[sample] = correctSpeed<davisFloatTable>(sweepSpeed[sample],sweepAngle[sample]);
+                    }
+                    break;
+                case 2:
+                    for(int sample=0;sample<sweepSize;sample++)
+                    {
+                        corrected[sample] = correctSpeed(&defaultCalibrationProfile,sweepSpeed[sample],sweepAngle[sample]);
+                    }
+                    break;
+                case 3:
+                    correctSpeedBatch(sweepSpeed,sweepAngle,corrected,sweepSize);
+                    break;
+                case 4:
+                    correctSpeedLatticeBatch(&lattice,sweepSpeed,sweepAngle,corrected,sweepSize);
+                    break;
+                default:
+                    for(int sample=0;sample<sweepSize;sample++)
+                    {
+                        corrected[sample] = correctSpeedLatticeNode(&lattice,nodeSpeed[sample],nodeAngle[sample]);
+                    }
+                    break;
+            }
+            correctedTotal += corrected[sweepSize-1-repeat];
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        pathNs[path] = elapsedNs(start,end)/((double)sweepRepeats*sweepSize);
+    }
+
+    printf("BENCH:correction 0->200 mph sweep, lattice bytes:%d\n",(int)correctionLatticeFootprint(&lattice));
+    printf("BENCH:%14s %10s %14s\n","path","ns","samples/sec");
+    for(int path=0;path<6;path++)
+    {
+        printf("BENCH:%14s %10.2f %14.0f\n",paths[path],pathNs[path],1e9/pathNs[path]);
+    }
+
+    printf("BENCH:vector kernel, best level:%s\n",simdLevelName(bestSimdLevel()));
+    printf("BENCH:%14s %10s %14s\n","level","ns","samples/sec");
+    for(int level=simdScalar;level<simdLevelCount;level++)
+    {
+        if(!simdLevelSupported((simdLevel)level))
+        {
+            printf("BENCH:%14s %10s %14s\n",simdLevelName((simdLevel)level),"-","unsupported");
+            continue;
+        }
+
+        struct timespec start;
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<sweepRepeats;repeat++)
+        {
+            correctSpeedSimdLevel((simdLevel)level,sweepSpeed,sweepAngle,corrected,sweepSize);
+            correctedTotal += corrected[sweepSize-1-repeat];
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        double levelNs = elapsedNs(start,end)/((double)sweepRepeats*sweepSize);
+        printf("BENCH:%14s %10.2f %14.0f\n",simdLevelName((simdLevel)level),levelNs,1e9/levelNs);
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+
+    // parallel scaling, the input is far bigger than the last level cache so this measures
+    // what the threads can do while streaming from memory
+    float* bulkSpeed = (float*)malloc(parallelSamples*sizeof(float));
+    float* bulkAngle = (float*)malloc(parallelSamples*sizeof(float));
+    float* bulkCorrected = (float*)malloc(parallelSamples*sizeof(float));
+    for(int sample=0;sample<parallelSamples;sample++)
+    {
+        bulkSpeed[sample] = sweepSpeed[sample%sweepSize];
+        bulkAngle[sample] = sweepAngle[sample%sweepSize];
+    }
+
+    printf("BENCH:parallel correction, %d samples\n",parallelSamples);
+    printf("BENCH:%14s %10s %14s %8s\n","threads","ns","samples/sec","speedup");
+    double singleNs = 0.0;
+    for(int threads=1;threads<=32;threads*=2)
+    {
+        correctionPool* pool = createCorrectionPool(threads);
+        double bestNs = 0.0;
+        for(int repeat=0;repeat<parallelRepeats;repeat++)
+        {
+            struct timespec start;
+            struct timespec end;
+
+            clock_gettime(CLOCK_MONOTONIC,&start);
+            correctSpeedParallel(pool,bulkSpeed,bulkAngle,bulkCorrected,parallelSamples);
+            clock_gettime(CLOCK_MONOTONIC,&end);
+            double ns = elapsedNs(start,end)/parallelSamples;
+            bestNs = (repeat==0 || ns<bestNs) ? ns : bestNs;
+            correctedTotal += bulkCorrected[parallelSamples-1-repeat];
+        }
+        destroyCorrectionPool(pool);
+
+        singleNs = (threads==1) ? bestNs : singleNs;
+        printf("BENCH:%14d %10.2f %14.0f %7.2fx\n",threads,bestNs,1e9/bestNs,singleNs/bestNs);
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+
+    free(bulkSpeed);
+    free(bulkAngle);
+    free(bulkCorrected);
+
+    // archive streaming, the same readings as a packed binary archive and as a csv export
+    FILE* binaryArchive = tmpfile();
+    FILE* csvArchive = tmpfile();
+    for(int record=0;record<archiveRecords;record++)
+    {
+        archiveRecord archived = {(uint32_t)(1500000000+(record*60)),sweepSpeed[record%sweepSize],sweepAngle[record%sweepSize]};
+        fwrite(&archived,sizeof(archived),1,binaryArchive);
+        fprintf(csvArchive,"%u,%.2f,%.0f\n",archived.timestamp,archived.windSpeed,archived.windDirection);
+    }
+    fflush(binaryArchive);
+    fflush(csvArchive);
+
+    int sink = open("/dev/null",O_WRONLY);
+    csvLayout layout = {1,2,','};
+    const char* formats[2] = {"binary","csv"};
+    FILE* archives[2] = {binaryArchive,csvArchive};
+    printf("BENCH:archive stream, %d records\n",archiveRecords);
+    printf("BENCH:%14s %10s %10s %14s\n","format","MB","MB/s","records/sec");
+    for(int format=0;format<2;format++)
+    {
+        double bestSeconds = 0.0;
+        streamStats stats;
+        for(int repeat=0;repeat<archiveRepeats;repeat++)
+        {
+            lseek(fileno(archives[format]),0,SEEK_SET);
+
+            struct timespec start;
+            struct timespec end;
+
+            clock_gettime(CLOCK_MONOTONIC,&start);
+            int result = (format==0) ? correctBinaryStream(fileno(archives[format]),sink,&stats) : correctCsvStream(fileno(archives[format]),sink,&layout,&stats);
+            clock_gettime(CLOCK_MONOTONIC,&end);
+            if(result<0)
+            {
+                printf("BENCH:archive stream failed\n");
+                return 1;
+            }
+            double seconds = elapsedNs(start,end)*1e-9;
+            bestSeconds = (repeat==0 || seconds<bestSeconds) ? seconds : bestSeconds;
+        }
+        printf("BENCH:%14s %10.1f %10.0f %14.0f\n",formats[format],stats.bytesRead/1e6,stats.bytesRead/(bestSeconds*1e6),stats.records/bestSeconds);
+    }
+    close(sink);
+    fclose(binaryArchive);
+    fclose(csvArchive);
+
+    // every path over each wind distribution, the parallel pool is only timed warm as a
+    // cold run of a few hundred samples would time waking its threads
+    float* windSpeed = (float*)malloc(suiteSamples*sizeof(float));
+    float* windAngle = (float*)malloc(suiteSamples*sizeof(float));
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    correctionPool* pool = createCorrectionPool((processors<1) ? 1 : ((processors>parallelMaxThreads) ? parallelMaxThreads : (int)processors));
+    benchReport* report = (benchReport*)calloc(1,sizeof(benchReport));
+    printf("BENCH:wind distributions, %d samples warm, %d samples cold\n",suiteSamples,suiteColdSamples);
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+        const char* name = benchDistributionNames[distribution];
+
+        auto scalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                corrected[sample] = correctSpeed(windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto templated = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                corrected[sample] = correctSpeed<davisFloatTable>(windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto profiled = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                corrected[sample] = correctSpeed(&defaultCalibrationProfile,windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto batch = [&](size_t count) { correctSpeedBatch(windSpeed,windAngle,corrected,count); };
+        auto latticeBatch = [&](size_t count) { correctSpeedLatticeBatch(&lattice,windSpeed,windAngle,corrected,count); };
+        auto simd = [&](size_t count) { correctSpeedSimd(windSpeed,windAngle,corrected,count); };
+        auto parallel = [&](size_t count) { correctSpeedParallel(pool,windSpeed,windAngle,corrected,count); };
+
+        for(int cold=0;cold<2;cold++)
+        {
+            const char* cache = cold ? "cold" : "warm";
+            size_t samples = cold ? suiteColdSamples : suiteSamples;
+            auto timeSuitePath = [&](auto path) { return cold ? benchColdNs(path,samples,suiteColdRepeats) : benchWarmNs(path,samples,suiteWarmRepeats); };
+            benchRecord(report,"wind","correctSpeed",name,cache,timeSuitePath(scalar));
+            benchRecord(report,"wind","template",name,cache,timeSuitePath(templated));
+            benchRecord(report,"wind","profile",name,cache,timeSuitePath(profiled));
+            benchRecord(report,"wind","batch",name,cache,timeSuitePath(batch));
+            benchRecord(report,"wind","lattice batch",name,cache,timeSuitePath(latticeBatch));
+            benchRecord(report,"wind",simdLevelName(bestSimdLevel()),name,cache,timeSuitePath(simd));
+        }
+        benchRecord(report,"wind","parallel",name,"warm",benchWarmNs(parallel,suiteSamples,suiteWarmRepeats));
+        correctedTotal += corrected[suiteColdSamples-1];
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+
+    // one pass against three over arrays far bigger than the L2 cache
+    float* vectorSpeed = (float*)malloc(vectorSamples*sizeof(float));
+    float* vectorAngle = (float*)malloc(vectorSamples*sizeof(float));
+    float* vectorCorrected = (float*)malloc(vectorSamples*sizeof(float));
+    float* vectorU = (float*)malloc(vectorSamples*sizeof(float));
+    float* vectorV = (float*)malloc(vectorSamples*sizeof(float));
+    windSummary* summaries = (windSummary*)malloc(((vectorSamples/vectorWindow)+1)*sizeof(windSummary));
+    printf("BENCH:wind vector mean, %d samples, %d sample windows\n",vectorSamples,vectorWindow);
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        benchFillWind((benchDistribution)distribution,vectorSpeed,vectorAngle,vectorSamples);
+        const char* name = benchDistributionNames[distribution];
+
+        auto separate = [&](size_t count)
+        {
+            correctSpeedSimd(vectorSpeed,vectorAngle,vectorCorrected,count);
+            for(size_t sample=0;sample<count;sample++)
+            {
+                float radians = vectorAngle[sample]*(float)(M_PI/180.0);
+                vectorU[sample] = -vectorCorrected[sample]*sinf(radians);
+                vectorV[sample] = -vectorCorrected[sample]*cosf(radians);
+            }
+            size_t window = 0;
+            for(size_t first=0;first<count;first+=vectorWindow)
+            {
+                size_t last = ((first+vectorWindow)<count) ? first+vectorWindow : count;
+                windAccumulator sums = {0.0,0.0,0.0,last-first};
+                for(size_t sample=first;sample<last;sample++)
+                {
+                    sums.speedSum += vectorCorrected[sample];
+                    sums.uSum += vectorU[sample];
+                    sums.vSum += vectorV[sample];
+                }
+                summariseWind(&sums,&summaries[window++]);
+            }
+        };
+        auto fused = [&](size_t count) { correctWindWindows(vectorSpeed,vectorAngle,count,vectorWindow,summaries,NULL); };
+        auto fusedCorrected = [&](size_t count) { correctWindWindows(vectorSpeed,vectorAngle,count,vectorWindow,summaries,vectorCorrected); };
+        auto live = [&](size_t count)
+        {
+            windAccumulator sums;
+            resetWindAccumulator(&sums);
+            for(size_t sample=0;sample<count;sample++)
+            {
+                accumulateWind(&sums,vectorSpeed[sample],vectorAngle[sample]);
+            }
+            summariseWind(&sums,&summaries[0]);
+        };
+
+        benchRecord(report,"vector","separate passes",name,"warm",benchWarmNs(separate,vectorSamples,vectorRepeats));
+        benchRecord(report,"vector","fused",name,"warm",benchWarmNs(fused,vectorSamples,vectorRepeats));
+        benchRecord(report,"vector","fused corrected",name,"warm",benchWarmNs(fusedCorrected,vectorSamples,vectorRepeats));
+        benchRecord(report,"vector","live",name,"warm",benchWarmNs(live,vectorSamples,vectorRepeats));
+        correctedTotal += summaries[0].direction;
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+
+    free(vectorSpeed);
+    free(vectorAngle);
+    free(vectorCorrected);
+    free(vectorU);
+    free(vectorV);
+    free(summaries);
+
+    // 3 second gusts with 2 and 10 minute averages of 1 second samples
+    static constexpr uint16_t rollingLengths[3] = {3,120,600};
+    static uint16_t rollingStorage[rollingStatisticsBytes(rollingLengths,3)/sizeof(uint16_t)];
+    rollingStatistics statistics;
+    initRollingStatistics(&statistics,rollingStorage,rollingLengths,3);
+    uint16_t* rollingHistory = (uint16_t*)malloc(rollingSampleCount*sizeof(uint16_t));
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+        const char* name = benchDistributionNames[distribution];
+        long rollingTotal = 0;
+
+        auto incremental = [&](size_t count)
+        {
+            resetRollingStatistics(&statistics);
+            for(size_t sample=0;sample<count;sample++)
+            {
+                correctSpeedRolling(&statistics,windSpeed[sample%suiteSamples],windAngle[sample%suiteSamples]);
+                rollingTotal += rollingMaxTenths(&statistics,0)+rollingMeanTenths(&statistics,1)+rollingMeanTenths(&statistics,2);
+            }
+        };
+        auto recompute = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                float speed = correctSpeed(windSpeed[sample%suiteSamples],windAngle[sample%suiteSamples]);
+                rollingHistory[sample] = (uint16_t)((speed*10.0f)+0.5f);
+                for(int window=0;window<3;window++)
+                {
+                    size_t first = ((sample+1)>rollingLengths[window]) ? (sample+1)-rollingLengths[window] : 0;
+                    uint32_t sum = 0;
+                    uint16_t maximum = 0;
+                    for(size_t older=first;older<=sample;older++)
+                    {
+                        sum += rollingHistory[older];
+                        maximum = (rollingHistory[older]>maximum) ? rollingHistory[older] : maximum;
+                    }
+                    rollingTotal += (window==0) ? maximum : sum/((sample+1)-first);
+                }
+            }
+        };
+
+        benchRecord(report,"rolling","incremental",name,"warm",benchWarmNs(incremental,rollingSampleCount,vectorRepeats));
+        benchRecord(report,"rolling","recompute",name,"warm",benchWarmNs(recompute,rollingSampleCount/16,1));
+        correctedTotal += rollingTotal;
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    free(rollingHistory);
+
+    // binning against the sector branch, the recorded trace comes last as the extra distribution
+    size_t traceSamples = 0;
+    float* traceSpeed = NULL;
+    float* traceAngle = NULL;
+    if(traceName)
+    {
+        FILE* trace = fopen(traceName,"rb");
+        if(!trace)
+        {
+            printf("BENCH:can not read %s\n",traceName);
+            return 1;
+        }
+        fseek(trace,0,SEEK_END);
+        size_t records = ftell(trace)/sizeof(archiveRecord);
+        fseek(trace,0,SEEK_SET);
+        traceSpeed = (float*)malloc((records+1)*sizeof(float));
+        traceAngle = (float*)malloc((records+1)*sizeof(float));
+        archiveRecord record;
+        while(traceSamples<records && fread(&record,sizeof(record),1,trace)==1)
+        {
+            traceSpeed[traceSamples] = record.windSpeed;
+            traceAngle[traceSamples] = record.windDirection;
+            traceSamples++;
+        }
+        fclose(trace);
+    }
+
+    benchCounters counters;
+    benchOpenCounters(&counters);
+    printf("BENCH:sector binning, counters:%s\n",(counters.cycles>=0 || counters.branchMisses>=0) ? "perf_event_open" : "unavailable");
+    float* binnedCorrected = (float*)malloc(((traceSamples>suiteSamples) ? traceSamples : suiteSamples)*sizeof(float));
+    for(int distribution=0;distribution<=benchDistributionCount;distribution++)
+    {
+        const float* speed = windSpeed;
+        const float* angle = windAngle;
+        size_t samples = suiteSamples;
+        const char* name = "trace";
+        if(distribution<benchDistributionCount)
+        {
+            benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+            name = benchDistributionNames[distribution];
+        }
+        else if(traceSamples>0)
+        {
+            speed = traceSpeed;
+            angle = traceAngle;
+            samples = traceSamples;
+        }
+        else
+        {
+            break;
+        }
+
+        auto scalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                binnedCorrected[sample] = correctSpeed(speed[sample],angle[sample]);
+            }
+        };
+        auto batch = [&](size_t count) { correctSpeedBatch(speed,angle,binnedCorrected,count); };
+        auto binned = [&](size_t count) { correctSpeedBinned(speed,angle,binnedCorrected,count); };
+        auto timeCounted = [&](const char* path, auto run)
+        {
+            double ns = benchWarmNs(run,samples,suiteWarmRepeats);
+            double cycles = benchCount(counters.cycles,run,samples);
+            double branchMisses = benchCount(counters.branchMisses,run,samples);
+            benchRecordCounters(report,"binning",path,name,"warm",ns,(cycles<0.0) ? -1.0 : cycles/samples,(branchMisses<0.0) ? -1.0 : branchMisses/samples);
+        };
+        timeCounted("correctSpeed",scalar);
+        timeCounted("batch",batch);
+        timeCounted("binned",binned);
+        correctedTotal += binnedCorrected[samples-1];
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    benchCloseCounters(&counters);
+    free(binnedCorrected);
+    free(traceSpeed);
+    free(traceAngle);
+
+    // a station year re-corrected from a column archive and from a binary archive, both
+    // read back from the page cache
+    float* yearSpeed = (float*)malloc(stationYearSamples*sizeof(float));
+    float* yearAngle = (float*)malloc(stationYearSamples*sizeof(float));
+    benchFillWind(benchGusty,yearSpeed,yearAngle,stationYearSamples);
+    char columnName[] = "/tmp/benchColumnXXXXXX";
+    int columnFd = mkstemp(columnName);
+    columnWriter* writer = (columnFd<0) ? NULL : createColumnWriter(columnName);
+    FILE* yearArchive = tmpfile();
+    if(!writer || !yearArchive)
+    {
+        printf("BENCH:can not create the column archive\n");
+        return 1;
+    }
+    close(columnFd);
+    for(int sample=0;sample<stationYearSamples;sample++)
+    {
+        uint32_t timestamp = 1500000000+(sample*60);
+        appendColumnSample(writer,timestamp,yearSpeed[sample],yearAngle[sample]);
+        archiveRecord archived = {timestamp,yearSpeed[sample],yearAngle[sample]};
+        fwrite(&archived,sizeof(archived),1,yearArchive);
+    }
+    fflush(yearArchive);
+    if(closeColumnWriter(writer)<0)
+    {
+        printf("BENCH:can not write the column archive\n");
+        return 1;
+    }
+
+    static uint32_t chunkTimestamps[columnChunkSamples];
+    static float chunkSpeed[columnChunkSamples];
+    static float chunkDirection[columnChunkSamples];
+    static float chunkCorrected[columnChunkSamples];
+    auto columnPass = [&](bool correct)
+    {
+        columnReader* reader = openColumnArchive(columnName);
+        for(uint32_t chunk=0;reader && chunk<columnChunkCount(reader);chunk++)
+        {
+            uint32_t count = correct ? correctColumnChunk(reader,chunk,chunkTimestamps,chunkSpeed,chunkDirection,chunkCorrected) :
+                                       decodeColumnChunk(reader,chunk,chunkTimestamps,chunkSpeed,chunkDirection);
+            correctedTotal += correct ? chunkCorrected[count-1] : chunkSpeed[count-1];
+        }
+        closeColumnArchive(reader);
+    };
+
+    sink = open("/dev/null",O_WRONLY);
+    double bestNs[3] = {0.0,0.0,0.0};
+    for(int repeat=0;repeat<archiveRepeats;repeat++)
+    {
+        for(int path=0;path<3;path++)
+        {
+            struct timespec start;
+            struct timespec end;
+            streamStats stats;
+
+            clock_gettime(CLOCK_MONOTONIC,&start);
+            if(path==0)
+            {
+                lseek(fileno(yearArchive),0,SEEK_SET);
+                correctBinaryStream(fileno(yearArchive),sink,&stats);
+            }
+            else
+            {
+                columnPass(path==2);
+            }
+            clock_gettime(CLOCK_MONOTONIC,&end);
+            double ns = elapsedNs(start,end)/stationYearSamples;
+            bestNs[path] = (repeat==0 || ns<bestNs[path]) ? ns : bestNs[path];
+        }
+    }
+    close(sink);
+
+    struct stat columnStatus;
+    stat(columnName,&columnStatus);
+    printf("BENCH:station year, %d gusty samples, binary archive %ld bytes, column archive %ld bytes (%.2f bytes a sample)\n",
+           stationYearSamples,(long)(stationYearSamples*sizeof(archiveRecord)),(long)columnStatus.st_size,(double)columnStatus.st_size/stationYearSamples);
+    benchRecord(report,"column","binary stream","gusty","warm",bestNs[0]);
+    benchRecord(report,"column","decode","gusty","warm",bestNs[1]);
+    benchRecord(report,"column","decode correct","gusty","warm",bestNs[2]);
+    printf("BENCH:checksum %f\n",correctedTotal);
+    remove(columnName);
+    fclose(yearArchive);
+    free(yearSpeed);
+    free(yearAngle);
+
+    // the cache over each distribution reported as a console would, whole mph and degrees
+    correctionCache* cache = createCorrectionCache(4096);
+    printf("BENCH:correction cache, %d entries, %d samples\n",4096,suiteSamples);
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        const char* name = benchDistributionNames[distribution];
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+        for(int sample=0;sample<suiteSamples;sample++)
+        {
+            windSpeed[sample] = floorf(windSpeed[sample]+0.5f);
+            windSpeed[sample] = (windSpeed[sample]>255.0f) ? 255.0f : windSpeed[sample];
+            windAngle[sample] = fmodf(floorf(windAngle[sample]+0.5f),360.0f);
+        }
+
+        float cacheTotal = 0.0f;
+        auto scalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                cacheTotal += correctSpeed(windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto cached = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                cacheTotal += correctSpeedCached(cache,windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto profiled = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                cacheTotal += correctSpeed(&defaultCalibrationProfile,windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto profileCached = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                cacheTotal += correctSpeedCached(cache,&defaultCalibrationProfile,windSpeed[sample],windAngle[sample]);
+            }
+        };
+
+        correctionCacheStats before;
+        correctionCacheStats after;
+        invalidateCorrectionCache(cache);
+        correctionCacheStatistics(cache,&before);
+        benchRecord(report,"cache","correctSpeed",name,"warm",benchWarmNs(scalar,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"cache","cached",name,"warm",benchWarmNs(cached,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"cache","profile",name,"warm",benchWarmNs(profiled,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"cache","profile cached",name,"warm",benchWarmNs(profileCached,suiteSamples,suiteWarmRepeats));
+        correctionCacheStatistics(cache,&after);
+        uint64_t hits = after.hits-before.hits;
+        uint64_t misses = after.misses-before.misses;
+        printf("BENCH:cache    %-16s hit rate %.4f\n",name,(double)hits/(hits+misses));
+        correctedTotal += cacheTotal;
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    destroyCorrectionCache(cache);
+
+    // a station year of csv through read, parse, correct, aggregate, format and write, each
+    // stage on its own thread and all of them one after another on one thread, straight from
+    // the page cache and with a wait on every read and write
+    FILE* yearCsv = tmpfile();
+    yearSpeed = (float*)malloc(stationYearSamples*sizeof(float));
+    yearAngle = (float*)malloc(stationYearSamples*sizeof(float));
+    benchFillWind(benchGusty,yearSpeed,yearAngle,stationYearSamples);
+    for(int sample=0;sample<stationYearSamples;sample++)
+    {
+        fprintf(yearCsv,"%d,%.1f,%.0f\n",1500000000+(sample*60),yearSpeed[sample],yearAngle[sample]);
+    }
+    fflush(yearCsv);
+    free(yearSpeed);
+    free(yearAngle);
+
+    static pipelineTextSource yearSource;
+    pipelineAggregate yearAggregate;
+    stalledIo stalled = {&yearSource,open("/dev/null",O_WRONLY),0};
+    pipelineConfig pipeline;
+    memset(&pipeline,0,sizeof(pipeline));
+    pipeline.source = (pipelineStage){"read",stalledRead,&stalled,1};
+    pipeline.stages[0] = (pipelineStage){"parse",parseWindBlock,NULL,1};
+    pipeline.stages[1] = (pipelineStage){"correct",correctWindBlock,NULL,1};
+    pipeline.stages[2] = (pipelineStage){"aggregate",aggregateWindBlock,&yearAggregate,1};
+    pipeline.stages[3] = (pipelineStage){"format",formatWindBlock,NULL,1};
+    pipeline.stages[4] = (pipelineStage){"write",stalledWrite,&stalled,1};
+    pipeline.stageCount = 5;
+    pipeline.queueBlocks = 4;
+
+    // overlap is the time spent in the stages over the time taken, 1 when nothing overlaps
+    printf("BENCH:pipeline, %d csv lines, %d blocks, %d cores\n",stationYearSamples,
+           (stationYearSamples+pipelineBlockSamples-1)/pipelineBlockSamples,(int)sysconf(_SC_NPROCESSORS_ONLN));
+    printf("BENCH:%14s %10s %10s %10s %10s %10s\n","mode","stall us","ns","read s","compute s","overlap");
+    for(int stall=0;stall<2;stall++)
+    {
+        for(int sequential=1;sequential>=0;sequential--)
+        {
+            stalled.stallUs = stall ? pipelineStallUs : 0;
+            double bestNs = 0.0;
+            pipelineStats best;
+            for(int repeat=0;repeat<archiveRepeats;repeat++)
+            {
+                lseek(fileno(yearCsv),0,SEEK_SET);
+                yearSource.fd = fileno(yearCsv);
+                yearSource.carried = 0;
+                memset(&yearAggregate,0,sizeof(yearAggregate));
+                pipelineStats stats;
+                if((sequential ? runPipelineSequentially(&pipeline,&stats) : runPipeline(&pipeline,&stats))<0)
+                {
+                    printf("BENCH:pipeline failed\n");
+                    return 1;
+                }
+                double ns = stats.seconds*1e9/stats.samples;
+                if(repeat==0 || ns<bestNs)
+                {
+                    bestNs = ns;
+                    best = stats;
+                }
+            }
+
+            double computeSeconds = 0.0;
+            double stageSeconds = best.source.busySeconds;
+            for(int stage=0;stage<pipeline.stageCount;stage++)
+            {
+                computeSeconds += (stage<(pipeline.stageCount-1)) ? best.stages[stage].busySeconds : 0.0;
+                stageSeconds += best.stages[stage].busySeconds;
+            }
+            const char* mode = sequential ? "sequential" : "pipelined";
+            printf("BENCH:%14s %10d %10.2f %10.3f %10.3f %9.2fx\n",mode,stalled.stallUs,bestNs,best.source.busySeconds,
+                   computeSeconds,stageSeconds/best.seconds);
+            benchRecord(report,"pipeline",mode,stall ? "stalled" : "page cache","warm",bestNs);
+            correctedTotal += yearAggregate.peak;
+        }
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    close(stalled.fd);
+    fclose(yearCsv);
+
+    // the smooth interpolation against the linear one it replaces, scalar and batch, with
+    // how far the smooth curve moves each distribution's corrections
+    printf("BENCH:smooth interpolation, %d samples\n",suiteSamples);
+    float* smoothCorrected = (float*)malloc(suiteSamples*sizeof(float));
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        const char* name = benchDistributionNames[distribution];
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+
+        auto linearScalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                corrected[sample] = correctSpeed(windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto smoothScalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                smoothCorrected[sample] = correctSpeedSmooth(windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto linearBatch = [&](size_t count) { correctSpeedInterpolated(interpolationLinear,windSpeed,windAngle,corrected,count); };
+        auto smoothBatch = [&](size_t count) { correctSpeedInterpolated(interpolationSmooth,windSpeed,windAngle,smoothCorrected,count); };
+        benchRecord(report,"smooth","linear scalar",name,"warm",benchWarmNs(linearScalar,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"smooth","smooth scalar",name,"warm",benchWarmNs(smoothScalar,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"smooth","linear batch",name,"warm",benchWarmNs(linearBatch,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"smooth","smooth batch",name,"warm",benchWarmNs(smoothBatch,suiteSamples,suiteWarmRepeats));
+
+        float largest = 0.0f;
+        for(int sample=0;sample<suiteSamples;sample++)
+        {
+            float change = fabsf(smoothCorrected[sample]-corrected[sample]);
+            largest = (change>largest) ? change : largest;
+        }
+        printf("BENCH:smooth   %-16s largest change from linear %.3f mph\n",name,largest);
+        correctedTotal += smoothCorrected[suiteSamples-1];
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    free(smoothCorrected);
+
+    // undoing the correction through the inverse index against solving for the raw speed
+    // by iterating correctSpeed, raw = corrected-correction(raw), to the same accuracy
+    printf("BENCH:inverse correction, %d samples\n",suiteSamples);
+    float* rawRecovered = (float*)malloc(suiteSamples*sizeof(float));
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        const char* name = benchDistributionNames[distribution];
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+        correctSpeedSimd(windSpeed,windAngle,corrected,suiteSamples);
+
+        int iterations = 0;
+        auto iterated = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                float raw = corrected[sample];
+                for(int iteration=0;iteration<50;iteration++,iterations++)
+                {
+                    float next = raw+(corrected[sample]-correctSpeed(raw,windAngle[sample]));
+                    if(fabsf(next-raw)<=1e-5f*(1.0f+fabsf(raw)))
+                    {
+                        raw = next;
+                        break;
+                    }
+                    raw = next;
+                }
+                rawRecovered[sample] = raw;
+            }
+        };
+        auto indexed = [&](size_t count) { uncorrectSpeedBatch(&defaultInverseCorrection,corrected,windAngle,rawRecovered,count); };
+        benchRecord(report,"inverse","iterated",name,"warm",benchWarmNs(iterated,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"inverse","index batch",name,"warm",benchWarmNs(indexed,suiteSamples,suiteWarmRepeats));
+
+        float largest = 0.0f;
+        for(int sample=0;sample<suiteSamples;sample++)
+        {
+            float error = fabsf(rawRecovered[sample]-windSpeed[sample]);
+            largest = (error>largest) ? error : largest;
+        }
+        printf("BENCH:inverse  %-16s %.1f iterations a sample, largest round trip error %g mph\n",name,
+               (double)iterations/((double)suiteSamples*(suiteWarmRepeats+1)),largest);
+        correctedTotal += rawRecovered[suiteSamples-1];
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    free(rawRecovered);
+
+    // a service hosting a few thousand stations, each reading corrected with its station's
+    // calibration, readings from every station interleaved as they arrive
+    const int benchStations = 4096;
+    calibrationProfile* stationProfiles = (calibrationProfile*)malloc(benchStations*sizeof(calibrationProfile));
+    packedProfile* stationPacked = (packedProfile*)malloc(benchStations*sizeof(packedProfile));
+    uint16_t* station = (uint16_t*)malloc(suiteSamples*sizeof(uint16_t));
+    uint32_t stationSeed = 1;
+    for(int index=0;index<benchStations;index++)
+    {
+        stationProfiles[index] = defaultCalibrationProfile;
+        for(int site=1;site<(profileMaxSites-1);site++)
+        {
+            for(int column=0;column<3;column++)
+            {
+                stationSeed = (stationSeed*1664525u)+1013904223u;
+                stationProfiles[index].corrections[site][column] += (int)(stationSeed>>29)-4;
+            }
+        }
+        memcpy(stationProfiles[index].corrections[profileMaxSites-1],stationProfiles[index].corrections[profileMaxSites-2],3);
+        packCalibrationProfile(&stationProfiles[index],&stationPacked[index]);
+    }
+    for(int sample=0;sample<suiteSamples;sample++)
+    {
+        stationSeed = (stationSeed*1664525u)+1013904223u;
+        station[sample] = (stationSeed>>16)%benchStations;
+    }
+    printf("BENCH:stations, %d stations, profiles %d bytes, packed %d bytes, %d samples\n",benchStations,
+           (int)(benchStations*sizeof(calibrationProfile)),(int)(benchStations*sizeof(packedProfile)),suiteSamples);
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        const char* name = benchDistributionNames[distribution];
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+
+        auto profiled = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                corrected[sample] = correctSpeed(&stationProfiles[station[sample]],windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto packedScalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                corrected[sample] = correctSpeedPacked(&stationPacked[station[sample]],windSpeed[sample],windAngle[sample]);
+            }
+        };
+        auto packedStations = [&](size_t count) { correctStationsPacked(stationPacked,station,windSpeed,windAngle,corrected,count); };
+        benchRecord(report,"stations","profile",name,"warm",benchWarmNs(profiled,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"stations","packed scalar",name,"warm",benchWarmNs(packedScalar,suiteSamples,suiteWarmRepeats));
+        benchRecord(report,"stations","packed stations",name,"warm",benchWarmNs(packedStations,suiteSamples,suiteWarmRepeats));
+        correctedTotal += corrected[suiteSamples-1];
+    }
+    printf("BENCH:checksum %f\n",correctedTotal);
+    free(station);
+    free(stationPacked);
+    free(stationProfiles);
+
+#ifdef correctionInstrumentation
+    instrumentSnapshot snapshot;
+    snapshotInstrumentation(&snapshot);
+    printInstrumentation(&snapshot,stdout);
+#endif
+
+    if(jsonName && benchWriteJson(report,"speedCorrection",jsonName)<0)
+    {
+        printf("BENCH:can not write every result to %s\n",jsonName);
+        return 1;
+    }
+
+    free(report);
+    destroyCorrectionPool(pool);
+    free(windSpeed);
+    free(windAngle);
+
+    free(sweepSpeed);
+    free(sweepAngle);
+    free(nodeSpeed);
+    free(nodeAngle);
+    free(corrected);
+    free(latticeStorage);
+
+    // both lookups return the same sites so the checksum must come back to zero
+    if(checksum!=0)
+    {
+        printf("BENCH:lookup mismatch\n");
+        return 1;
+    }
+
+    return 0;
+}
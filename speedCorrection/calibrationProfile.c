@@ -0,0 +1,283 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Per anemometer calibration profiles for interpolator.c
+
+    A profile holds its corrections in tenths of a mph and decodes them as it corrects
+    through a table of every tenths value divided by 10. The float correctionTable is
+    generated from the same tenths with the same divide, so correcting with the default
+    profile reproduces correctSpeed bit for bit while the profile stays small enough to
+    share between threads without it crowding the cache.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calibrationProfile.h"
+#include "davisCalibration.h"
+
+#define zeroDegreeIndex 0
+#define ninetyDegreeIndex 1
+#define oneeightyDegreeIndex 2
+
+// longest profile text accepted by loadCalibrationProfile and longest line in a profile
+#define profileMaxBytes 65536
+#define profileMaxLine 256
+
+static_assert(sizeof(calibrationProfile)==128,"a profile must fit in two cache lines");
+
+// last generation given to a parsed profile, the default calibration is generation 0
+static uint32_t lastProfileGeneration = 0;
+
+// finds the longest run of equally spaced sites as buildSpeedSiteIndex does
+static constexpr void indexProfile(calibrationProfile* profile)
+{
+    int runStart = 0;
+    profile->uniformLow = 0;
+    profile->uniformHigh = 0;
+    for(int site=1;site<profile->siteCount;site++)
+    {
+        int spacing = profile->speeds[site]-profile->speeds[site-1];
+        int runSpacing = profile->speeds[runStart+1]-profile->speeds[runStart];
+        if((site-runStart)>1 && spacing!=runSpacing)
+        {
+            runStart = site-1;
+        }
+
+        if((site-runStart)>=2 && (site-runStart)>(profile->uniformHigh-profile->uniformLow))
+        {
+            profile->uniformLow = runStart;
+            profile->uniformHigh = site;
+        }
+    }
+
+    profile->uniformSpacing = 0;
+    profile->uniformScale = 0.0f;
+    if(profile->uniformHigh>profile->uniformLow)
+    {
+        profile->uniformSpacing = profile->speeds[profile->uniformLow+1]-profile->speeds[profile->uniformLow];
+        profile->uniformScale = 1.0f/profile->uniformSpacing;
+    }
+}
+
+static constexpr calibrationProfile makeDefaultProfile(void)
+{
+    calibrationProfile profile = {};
+    profile.siteCount = davisSiteCount;
+    for(int site=0;site<davisSiteCount;site++)
+    {
+        profile.speeds[site] = davisCalibration[site].speed;
+        for(int column=0;column<3;column++)
+        {
+            profile.corrections[site][column] = davisCalibration[site].corrections[column];
+        }
+    }
+    indexProfile(&profile);
+    return profile;
+}
+
+const calibrationProfile defaultCalibrationProfile = makeDefaultProfile();
+
+int parseCalibrationProfile(const char* text, calibrationProfile* profile)
+{
+    calibrationProfile parsed = {};
+    int siteCount = 0;
+
+    while(*text)
+    {
+        const char* end = strchr(text,'\n');
+        size_t length = end ? (size_t)(end-text) : strlen(text);
+        if(length>=profileMaxLine)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        // drop the comment and turn the separators into spaces
+        char line[profileMaxLine];
+        memcpy(line,text,length);
+        line[length] = '\0';
+        char* comment = strchr(line,'#');
+        if(comment)
+        {
+            *comment = '\0';
+        }
+        for(char* character=line;*character;character++)
+        {
+            *character = (*character==',' || *character=='\t' || *character=='\r') ? ' ' : *character;
+        }
+        text += length+(end ? 1 : 0);
+
+        double values[4];
+        int used = 0;
+        int fields = sscanf(line,"%lf %lf %lf %lf %n",&values[0],&values[1],&values[2],&values[3],&used);
+        if(fields<=0 && strspn(line," ")==strlen(line))
+        {
+            continue;
+        }
+
+        // a whole mph speed above the previous site (the first site at 0) and corrections
+        // that fit in a tenth of a mph int8_t
+        double speed = values[0];
+        if(fields!=4 || line[used]!='\0' || siteCount==profileMaxSites ||
+           speed!=floor(speed) || speed>profileTopSpeed ||
+           (siteCount==0 && speed!=0.0) || (siteCount>0 && speed<=parsed.speeds[siteCount-1]))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        parsed.speeds[siteCount] = (uint8_t)speed;
+        for(int column=0;column<3;column++)
+        {
+            double tenths = floor((values[column+1]*10.0)+0.5);
+            if(!(tenths>=-127.0 && tenths<=127.0))
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            parsed.corrections[siteCount][column] = (int8_t)tenths;
+        }
+        siteCount++;
+    }
+
+    // at least one site above zero, held up to the top speed
+    if(siteCount<2)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(parsed.speeds[siteCount-1]<profileTopSpeed)
+    {
+        if(siteCount==profileMaxSites)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        parsed.speeds[siteCount] = profileTopSpeed;
+        memcpy(parsed.corrections[siteCount],parsed.corrections[siteCount-1],sizeof(parsed.corrections[0]));
+        siteCount++;
+    }
+
+    parsed.siteCount = siteCount;
+    parsed.generation = __atomic_add_fetch(&lastProfileGeneration,1,__ATOMIC_RELAXED);
+    indexProfile(&parsed);
+    *profile = parsed;
+    return 0;
+}
+
+int loadCalibrationProfile(const char* path, calibrationProfile* profile)
+{
+    FILE* file = fopen(path,"r");
+    if(!file)
+    {
+        return -1;
+    }
+
+    // on the heap, the loader may run on a worker thread with a small stack
+    char* text = (char*)malloc(profileMaxBytes+1);
+    if(!text)
+    {
+        fclose(file);
+        errno = ENOMEM;
+        return -1;
+    }
+    size_t length = fread(text,1,profileMaxBytes+1,file);
+    int failed = ferror(file);
+    fclose(file);
+    if(failed || length>profileMaxBytes)
+    {
+        free(text);
+        errno = failed ? EIO : EINVAL;
+        return -1;
+    }
+    text[length] = '\0';
+
+    int parsed = parseCalibrationProfile(text,profile);
+    int error = errno;
+    free(text);
+    errno = error;
+    return parsed;
+}
+
+// index of the site at or above rawSpeed (at least 1) as findSpeedSite returns it
+static inline int profileSpeedSite(const calibrationProfile* profile, float rawSpeed)
+{
+    float uniformOrigin = profile->speeds[profile->uniformLow];
+    float uniformLimit = profile->speeds[profile->uniformHigh];
+    int site = 0;
+
+    if(profile->uniformHigh>profile->uniformLow && rawSpeed>uniformOrigin && rawSpeed<=uniformLimit)
+    {
+        site = profile->uniformLow+(int)((rawSpeed-uniformOrigin)*profile->uniformScale)+1;
+        site = (site>profile->uniformHigh) ? profile->uniformHigh : site;
+        site += (rawSpeed>profile->speeds[site]) ? 1 : 0;
+        site -= (rawSpeed<=profile->speeds[site-1]) ? 1 : 0;
+    }
+    else
+    {
+        // scan the sites on whichever side of the run the speed lies
+        site = (rawSpeed<=uniformOrigin) ? 0 : profile->uniformHigh;
+        while(site<(profile->siteCount-1) && !((rawSpeed-profile->speeds[site])<=0.0))
+        {
+            site++;
+        }
+    }
+
+    return (site<1) ? 1 : site;
+}
+
+float correctSpeed(const calibrationProfile* profile, float rawSpeed, float angle)
+{
+    // calculate the angle to be used in the calculation
+    float correctionAngle = (angle>180.0) ? (180.0-(angle-180.0)) : angle;
+
+    int speedIndexHigh = profileSpeedSite(profile,rawSpeed);
+    int speedIndexLow = speedIndexHigh-1;
+
+    // calculate the scaling factor based on the input speeds position relative to the
+    // high and low speed sites, above the top site the correction is held, 1+(f-f) is 1,
+    // or NaN for the infinite factor of an infinite speed as correctSpeed gives it
+    float speedDelta = ((float)profile->speeds[speedIndexHigh]-(float)profile->speeds[speedIndexLow]);
+    float speedOffset = (rawSpeed-profile->speeds[speedIndexLow]);
+    float speedFactor = (speedOffset/speedDelta);
+    speedFactor = (speedFactor>1.0f) ? 1.0f+(speedFactor-speedFactor) : speedFactor;
+
+    // 0->90 uses the 0 and 90 degree corrections, 90->180 the 90 and 180 degree corrections
+    int lowColumn = zeroDegreeIndex;
+    float angleFactor = (correctionAngle/90.0);
+    if(correctionAngle>90.0)
+    {
+        lowColumn = ninetyDegreeIndex;
+        angleFactor = ((correctionAngle-90.0)/90.0);
+    }
+
+    const int8_t* correctionsLow = profile->corrections[speedIndexLow];
+    const int8_t* correctionsHigh = profile->corrections[speedIndexHigh];
+    float speedCorrectionLow = (tenthsToMph(correctionsLow[lowColumn+1])-tenthsToMph(correctionsLow[lowColumn]));
+    speedCorrectionLow *= angleFactor;
+    speedCorrectionLow += tenthsToMph(correctionsLow[lowColumn]);
+    float speedCorrectionHigh = (tenthsToMph(correctionsHigh[lowColumn+1])-tenthsToMph(correctionsHigh[lowColumn]));
+    speedCorrectionHigh *= angleFactor;
+    speedCorrectionHigh += tenthsToMph(correctionsHigh[lowColumn]);
+
+    float calculatedSpeed = ((speedCorrectionHigh-speedCorrectionLow)*speedFactor)+speedCorrectionLow;
+    calculatedSpeed += rawSpeed;
+
+    return calculatedSpeed;
+}
@@ -0,0 +1,73 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _calibrationProfile_h_
+#define _calibrationProfile_h_
+
+#include <stdint.h>
+
+// most speed sites a profile can hold, including the zero speed site and the top site
+#define profileMaxSites 29
+
+// highest speed site, a profile holds the correction at its last site up to this speed
+#define profileTopSpeed 255
+
+// calibration of one anemometer, the speed sites and the corrections at 0, 90 and 180
+// degrees in tenths of a mph, packed into two cache lines
+//
+// a profile is only written while it is loaded, after that it is shared read only so any
+// number of threads can correct with it without locking. Every profile parsed or loaded is
+// given a new generation, copies keep it, so two profiles with the same generation hold the
+// same corrections (correctionCache.h relies on this)
+typedef struct
+{
+    uint8_t siteCount;
+    uint8_t uniformLow;                             // longest run of equally spaced sites
+    uint8_t uniformHigh;
+    uint8_t uniformSpacing;
+    float uniformScale;                             // 1/uniformSpacing, 0 without a run
+    uint8_t speeds[profileMaxSites];                // mph, from 0 up to profileTopSpeed
+    int8_t corrections[profileMaxSites][3];         // tenths of a mph
+    uint32_t generation;                            // 0 for the default calibration
+} __attribute__((aligned(64))) calibrationProfile;
+
+// the Davis calibration the global correctionTable holds, correcting with it gives the
+// same results as correctSpeed(rawSpeed,angle) bit for bit
+extern const calibrationProfile defaultCalibrationProfile;
+
+// profiles are text, one site per line as speed and the corrections at 0, 90 and 180
+// degrees in mph separated by spaces, commas or tabs, anything after a # is a comment
+//
+//     # speed   0deg   90deg  180deg
+//     0         0.0    0.0    0.0
+//     20        3.3   -2.3   -3.6
+//     ...
+//
+// speeds are whole mph starting at 0 and strictly increasing up to profileTopSpeed,
+// corrections are rounded to the nearest tenth and must lie within +/-12.7 mph, and the
+// last site is repeated at profileTopSpeed if the profile stops short of it
+//
+// both return 0, or -1 with errno set (EINVAL for a malformed profile) leaving the profile
+// untouched
+int parseCalibrationProfile(const char* text, calibrationProfile* profile);
+int loadCalibrationProfile(const char* path, calibrationProfile* profile);
+
+// corrects with the profile's sites, holding the top correction above them, an infinite
+// speed is NaN as correctSpeed(rawSpeed,angle) gives it
+float correctSpeed(const calibrationProfile* profile, float rawSpeed, float angle);
+
+#endif
@@ -0,0 +1,505 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Columnar chunked wind archive
+
+    File layout, little endian :-
+
+        header      magic, version, samples per chunk, chunk count, sample count and the
+                    offset of the index
+        chunks      per chunk the timestamp, speed and direction differences, each column
+                    bit packed and starting on a byte, then columnPadding zero bytes
+        index       one entry per chunk, its offset, size, span, extremes, first values
+                    and the bit width of each column
+
+    Speeds and directions are stored as zigzag encoded differences (0,-1,1,-2.. become
+    0,1,2,3..) so small changes either way take few bits, direction differences are taken
+    the short way round the compass. The padding lets the decoder read every value with
+    one unaligned 64 bit load whatever its width and position.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "columnArchive.h"
+#include "simdCorrection.h"
+
+#define columnMagic 0x31414357          // "WCA1"
+#define columnVersion 1
+#define columnPadding 8
+#define columnMaxBits 32
+
+// largest chunk payload, timestamp differences at 32 bits and speed and direction
+// differences at 9
+#define columnMaxPayload ((columnChunkSamples*(4+2+2))+columnPadding)
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkSamples;
+    uint32_t chunkCount;
+    uint64_t sampleCount;
+    uint64_t indexOffset;
+} columnHeader;
+
+typedef struct __attribute__((packed))
+{
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t samples;
+    uint32_t firstTimestamp;
+    uint32_t lastTimestamp;
+    uint8_t speedMin;
+    uint8_t speedMax;
+    uint16_t directionMin;
+    uint16_t directionMax;
+    uint8_t firstSpeed;
+    uint16_t firstDirection;
+    uint8_t timestampBits;
+    uint8_t speedBits;
+    uint8_t directionBits;
+} columnIndexEntry;
+
+struct columnWriter
+{
+    FILE* file;
+    uint64_t offset;
+    uint64_t sampleCount;
+    uint32_t pending;
+    uint32_t timestamps[columnChunkSamples];
+    uint8_t speeds[columnChunkSamples];
+    uint16_t directions[columnChunkSamples];
+    uint32_t differences[columnChunkSamples];
+    uint8_t payload[columnMaxPayload];
+    columnIndexEntry* index;
+    uint32_t chunkCount;
+    uint32_t indexCapacity;
+};
+
+struct columnReader
+{
+    const uint8_t* base;
+    size_t bytes;
+    const columnHeader* header;
+    const columnIndexEntry* index;
+};
+
+static inline uint32_t zigzag(int32_t difference)
+{
+    return ((uint32_t)difference<<1)^(uint32_t)(difference>>31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value>>1)^-(int32_t)(value&1);
+}
+
+static inline int bitsNeeded(uint32_t value)
+{
+    return (value==0) ? 0 : 32-__builtin_clz(value);
+}
+
+static inline size_t columnBytes(uint32_t values, int bits)
+{
+    return (((size_t)values*bits)+7)/8;
+}
+
+// packs values of the given width, lowest bits first, returns the bytes written
+static size_t packColumn(uint8_t* output, const uint32_t* values, uint32_t count, int bits)
+{
+    uint64_t pending = 0;
+    int pendingBits = 0;
+    size_t written = 0;
+    for(uint32_t value=0;value<count;value++)
+    {
+        pending |= (uint64_t)values[value]<<pendingBits;
+        pendingBits += bits;
+        while(pendingBits>=8)
+        {
+            output[written++] = (uint8_t)pending;
+            pending >>= 8;
+            pendingBits -= 8;
+        }
+    }
+    if(pendingBits>0)
+    {
+        output[written++] = (uint8_t)pending;
+    }
+    return written;
+}
+
+// the value at bit offset bit, the padding after the chunk makes the 8 byte load safe
+static inline uint32_t unpackValue(const uint8_t* column, uint64_t bit, uint64_t mask)
+{
+    uint64_t word;
+    memcpy(&word,column+(bit>>3),sizeof(word));
+    return (uint32_t)((word>>(bit&7))&mask);
+}
+
+columnWriter* createColumnWriter(const char* path)
+{
+    columnWriter* writer = (columnWriter*)malloc(sizeof(columnWriter));
+    if(!writer)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    writer->file = fopen(path,"wb");
+    if(!writer->file)
+    {
+        free(writer);
+        return NULL;
+    }
+
+    // the header is written again with the counts once the index is written
+    columnHeader header = {columnMagic,columnVersion,columnChunkSamples,0,0,0};
+    if(fwrite(&header,sizeof(header),1,writer->file)!=1)
+    {
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    writer->offset = sizeof(header);
+    writer->sampleCount = 0;
+    writer->pending = 0;
+    writer->index = NULL;
+    writer->chunkCount = 0;
+    writer->indexCapacity = 0;
+    return writer;
+}
+
+static int writeChunk(columnWriter* writer)
+{
+    uint32_t count = writer->pending;
+    if(count==0)
+    {
+        return 0;
+    }
+
+    if(writer->chunkCount==writer->indexCapacity)
+    {
+        uint32_t capacity = (writer->indexCapacity==0) ? 64 : writer->indexCapacity*2;
+        columnIndexEntry* index = (columnIndexEntry*)realloc(writer->index,capacity*sizeof(columnIndexEntry));
+        if(!index)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        writer->index = index;
+        writer->indexCapacity = capacity;
+    }
+
+    columnIndexEntry* entry = &writer->index[writer->chunkCount];
+    entry->offset = writer->offset;
+    entry->samples = count;
+    entry->firstTimestamp = writer->timestamps[0];
+    entry->lastTimestamp = writer->timestamps[count-1];
+    entry->firstSpeed = writer->speeds[0];
+    entry->firstDirection = writer->directions[0];
+    entry->speedMin = writer->speeds[0];
+    entry->speedMax = writer->speeds[0];
+    entry->directionMin = writer->directions[0];
+    entry->directionMax = writer->directions[0];
+    for(uint32_t sample=1;sample<count;sample++)
+    {
+        entry->speedMin = (writer->speeds[sample]<entry->speedMin) ? writer->speeds[sample] : entry->speedMin;
+        entry->speedMax = (writer->speeds[sample]>entry->speedMax) ? writer->speeds[sample] : entry->speedMax;
+        entry->directionMin = (writer->directions[sample]<entry->directionMin) ? writer->directions[sample] : entry->directionMin;
+        entry->directionMax = (writer->directions[sample]>entry->directionMax) ? writer->directions[sample] : entry->directionMax;
+    }
+
+    // each column as the differences from the sample before, at the widest difference's width
+    size_t bytes = 0;
+    uint32_t widest = 0;
+    for(uint32_t sample=1;sample<count;sample++)
+    {
+        writer->differences[sample-1] = writer->timestamps[sample]-writer->timestamps[sample-1];
+        widest |= writer->differences[sample-1];
+    }
+    entry->timestampBits = bitsNeeded(widest);
+    bytes += packColumn(writer->payload+bytes,writer->differences,count-1,entry->timestampBits);
+
+    widest = 0;
+    for(uint32_t sample=1;sample<count;sample++)
+    {
+        writer->differences[sample-1] = zigzag(writer->speeds[sample]-writer->speeds[sample-1]);
+        widest |= writer->differences[sample-1];
+    }
+    entry->speedBits = bitsNeeded(widest);
+    bytes += packColumn(writer->payload+bytes,writer->differences,count-1,entry->speedBits);
+
+    widest = 0;
+    for(uint32_t sample=1;sample<count;sample++)
+    {
+        int32_t difference = writer->directions[sample]-writer->directions[sample-1];
+        difference += (difference>180) ? -360 : ((difference<=-180) ? 360 : 0);
+        writer->differences[sample-1] = zigzag(difference);
+        widest |= writer->differences[sample-1];
+    }
+    entry->directionBits = bitsNeeded(widest);
+    bytes += packColumn(writer->payload+bytes,writer->differences,count-1,entry->directionBits);
+
+    memset(writer->payload+bytes,0,columnPadding);
+    bytes += columnPadding;
+    entry->bytes = bytes;
+
+    if(fwrite(writer->payload,1,bytes,writer->file)!=bytes)
+    {
+        return -1;
+    }
+    writer->offset += bytes;
+    writer->sampleCount += count;
+    writer->chunkCount++;
+    writer->pending = 0;
+    return 0;
+}
+
+int appendColumnSample(columnWriter* writer, uint32_t timestamp, float rawSpeed, float direction)
+{
+    if(writer->pending>0 && timestamp<writer->timestamps[writer->pending-1])
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(writer->pending==0 && writer->chunkCount>0 && timestamp<writer->index[writer->chunkCount-1].lastTimestamp)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // nearest whole mph and degree, anything not a number is held as 0
+    float speed = rawSpeed+0.5f;
+    speed = (speed>=1.0f) ? ((speed<255.0f) ? speed : 255.0f) : 0.0f;
+    double degrees = floor(fmod((double)direction,360.0)+0.5);
+    degrees = (degrees<0.0) ? degrees+360.0 : degrees;
+    degrees = (degrees>=360.0 || degrees!=degrees) ? 0.0 : degrees;
+
+    writer->timestamps[writer->pending] = timestamp;
+    writer->speeds[writer->pending] = (uint8_t)speed;
+    writer->directions[writer->pending] = (uint16_t)degrees;
+    writer->pending++;
+
+    return (writer->pending==columnChunkSamples) ? writeChunk(writer) : 0;
+}
+
+int closeColumnWriter(columnWriter* writer)
+{
+    int result = writeChunk(writer);
+
+    size_t indexBytes = (size_t)writer->chunkCount*sizeof(columnIndexEntry);
+    columnHeader header = {columnMagic,columnVersion,columnChunkSamples,writer->chunkCount,writer->sampleCount,writer->offset};
+    if(result==0 && indexBytes>0 && fwrite(writer->index,1,indexBytes,writer->file)!=indexBytes)
+    {
+        result = -1;
+    }
+    if(result==0 && (fseek(writer->file,0,SEEK_SET)!=0 || fwrite(&header,sizeof(header),1,writer->file)!=1))
+    {
+        result = -1;
+    }
+    if(fclose(writer->file)!=0)
+    {
+        result = -1;
+    }
+
+    free(writer->index);
+    free(writer);
+    return result;
+}
+
+// every offset and width in the index must lie inside the file before anything is decoded
+static int validArchive(const uint8_t* base, size_t bytes)
+{
+    if(bytes<sizeof(columnHeader))
+    {
+        return 0;
+    }
+
+    const columnHeader* header = (const columnHeader*)base;
+    if(header->magic!=columnMagic || header->version!=columnVersion || header->chunkSamples!=columnChunkSamples ||
+       header->indexOffset<sizeof(columnHeader) || header->indexOffset>bytes ||
+       (bytes-header->indexOffset)!=(uint64_t)header->chunkCount*sizeof(columnIndexEntry))
+    {
+        return 0;
+    }
+
+    const columnIndexEntry* index = (const columnIndexEntry*)(base+header->indexOffset);
+    uint64_t samples = 0;
+    for(uint32_t chunk=0;chunk<header->chunkCount;chunk++)
+    {
+        const columnIndexEntry* entry = &index[chunk];
+        if(entry->samples==0 || entry->samples>columnChunkSamples || entry->offset<sizeof(columnHeader) ||
+           entry->offset>header->indexOffset || entry->bytes>(header->indexOffset-entry->offset) ||
+           entry->timestampBits>columnMaxBits || entry->speedBits>columnMaxBits || entry->directionBits>columnMaxBits ||
+           entry->firstDirection>=360)
+        {
+            return 0;
+        }
+
+        size_t needed = columnBytes(entry->samples-1,entry->timestampBits)+columnBytes(entry->samples-1,entry->speedBits)+
+                        columnBytes(entry->samples-1,entry->directionBits)+columnPadding;
+        if(entry->bytes<needed)
+        {
+            return 0;
+        }
+        samples += entry->samples;
+    }
+
+    return samples==header->sampleCount;
+}
+
+columnReader* openColumnArchive(const char* path)
+{
+    int fd = open(path,O_RDONLY);
+    if(fd<0)
+    {
+        return NULL;
+    }
+
+    struct stat status;
+    if(fstat(fd,&status)<0)
+    {
+        close(fd);
+        return NULL;
+    }
+    if((size_t)status.st_size<sizeof(columnHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL,status.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(mapping==MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    if(!validArchive((const uint8_t*)mapping,status.st_size))
+    {
+        munmap(mapping,status.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    columnReader* reader = (columnReader*)malloc(sizeof(columnReader));
+    if(!reader)
+    {
+        munmap(mapping,status.st_size);
+        errno = ENOMEM;
+        return NULL;
+    }
+    reader->base = (const uint8_t*)mapping;
+    reader->bytes = status.st_size;
+    reader->header = (const columnHeader*)mapping;
+    reader->index = (const columnIndexEntry*)(reader->base+reader->header->indexOffset);
+
+    // chunks are decoded in order, so ask for them ahead of the decoder
+    madvise(mapping,status.st_size,MADV_SEQUENTIAL);
+    return reader;
+}
+
+void closeColumnArchive(columnReader* reader)
+{
+    if(!reader)
+    {
+        return;
+    }
+    munmap((void*)reader->base,reader->bytes);
+    free(reader);
+}
+
+uint32_t columnChunkCount(const columnReader* reader)
+{
+    return reader->header->chunkCount;
+}
+
+uint64_t columnSampleCount(const columnReader* reader)
+{
+    return reader->header->sampleCount;
+}
+
+void columnChunk(const columnReader* reader, uint32_t chunk, columnChunkInfo* info)
+{
+    const columnIndexEntry* entry = &reader->index[chunk];
+    info->samples = entry->samples;
+    info->firstTimestamp = entry->firstTimestamp;
+    info->lastTimestamp = entry->lastTimestamp;
+    info->speedMin = entry->speedMin;
+    info->speedMax = entry->speedMax;
+    info->directionMin = entry->directionMin;
+    info->directionMax = entry->directionMax;
+}
+
+uint32_t decodeColumnChunk(const columnReader* reader, uint32_t chunk, uint32_t* timestamps, float* rawSpeed, float* direction)
+{
+    const columnIndexEntry* entry = &reader->index[chunk];
+    uint32_t count = entry->samples;
+    const uint8_t* column = reader->base+entry->offset;
+
+    if(timestamps)
+    {
+        uint64_t mask = (1ULL<<entry->timestampBits)-1;
+        uint32_t timestamp = entry->firstTimestamp;
+        timestamps[0] = timestamp;
+        for(uint32_t sample=1;sample<count;sample++)
+        {
+            timestamp += unpackValue(column,(uint64_t)(sample-1)*entry->timestampBits,mask);
+            timestamps[sample] = timestamp;
+        }
+    }
+    column += columnBytes(count-1,entry->timestampBits);
+
+    // a corrupt difference can not take a speed outside 0->255, it wraps
+    uint64_t mask = (1ULL<<entry->speedBits)-1;
+    uint8_t speed = entry->firstSpeed;
+    rawSpeed[0] = speed;
+    for(uint32_t sample=1;sample<count;sample++)
+    {
+        speed += unzigzag(unpackValue(column,(uint64_t)(sample-1)*entry->speedBits,mask));
+        rawSpeed[sample] = speed;
+    }
+    column += columnBytes(count-1,entry->speedBits);
+
+    mask = (1ULL<<entry->directionBits)-1;
+    int32_t degrees = entry->firstDirection;
+    direction[0] = degrees;
+    for(uint32_t sample=1;sample<count;sample++)
+    {
+        degrees += unzigzag(unpackValue(column,(uint64_t)(sample-1)*entry->directionBits,mask));
+        degrees += (degrees<0) ? 360 : ((degrees>=360) ? -360 : 0);
+        degrees = (degrees<0 || degrees>=360) ? 0 : degrees;
+        direction[sample] = degrees;
+    }
+
+    return count;
+}
+
+uint32_t correctColumnChunk(const columnReader* reader, uint32_t chunk, uint32_t* timestamps, float* rawSpeed,
+                            float* direction, float* __restrict correctedSpeed)
+{
+    uint32_t count = decodeColumnChunk(reader,chunk,timestamps,rawSpeed,direction);
+    correctSpeedSimd(rawSpeed,direction,correctedSpeed,count);
+    return count;
+}
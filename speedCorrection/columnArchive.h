@@ -0,0 +1,81 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _columnArchive_h_
+#define _columnArchive_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// samples per chunk, a decoded chunk of every column fits in the L2 cache
+#define columnChunkSamples 4096
+
+// raw wind archived by column, in chunks of columnChunkSamples samples
+//
+// speeds are held to the nearest whole mph (0->255, as speedCorrectionLite corrects them) and
+// directions to the nearest whole degree (0->359). Each chunk stores its timestamps, speeds
+// and directions as the differences between neighbouring samples, bit packed at the fewest
+// bits any difference in the chunk needs, so steady wind costs a few bits a sample. The file
+// ends with an index of the chunks giving each one's span and extremes, so a chunk can be
+// found or skipped without decoding it
+//
+// all integers are little endian, readers check the layout before trusting any offset
+
+// one chunk's metadata from the index
+typedef struct
+{
+    uint32_t samples;
+    uint32_t firstTimestamp;
+    uint32_t lastTimestamp;
+    uint8_t speedMin;           // mph
+    uint8_t speedMax;
+    uint16_t directionMin;      // degrees
+    uint16_t directionMax;
+} columnChunkInfo;
+
+typedef struct columnWriter columnWriter;
+typedef struct columnReader columnReader;
+
+// returns NULL with errno set if the file can not be created
+columnWriter* createColumnWriter(const char* path);
+
+// timestamps must not go backwards, returns 0, or -1 with errno set (EINVAL for a timestamp
+// before the last one, or the error of a failed write)
+int appendColumnSample(columnWriter* writer, uint32_t timestamp, float rawSpeed, float direction);
+
+// writes the last chunk and the index and closes the file, the writer is freed either way,
+// returns 0, or -1 with errno set
+int closeColumnWriter(columnWriter* writer);
+
+// maps an archive read only, returns NULL with errno set (EINVAL if it is not a well formed
+// column archive)
+columnReader* openColumnArchive(const char* path);
+void closeColumnArchive(columnReader* reader);
+
+uint32_t columnChunkCount(const columnReader* reader);
+uint64_t columnSampleCount(const columnReader* reader);
+void columnChunk(const columnReader* reader, uint32_t chunk, columnChunkInfo* info);
+
+// decodes a chunk straight from the mapping into columnChunkSamples long arrays, timestamps
+// may be NULL, returns the number of samples
+uint32_t decodeColumnChunk(const columnReader* reader, uint32_t chunk, uint32_t* timestamps, float* rawSpeed, float* direction);
+
+// decodes a chunk and corrects its speeds with the vector kernel, returns the number of samples
+uint32_t correctColumnChunk(const columnReader* reader, uint32_t chunk, uint32_t* timestamps, float* rawSpeed,
+                            float* direction, float* __restrict correctedSpeed);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Corrects the wind speeds in a logged archive, writing the archive back out in the
+    same format.
+
+    usage: correctFile [-b] [-s column] [-d column] [-t separator] [-q] [input [output]]
+
+        -b          binary archive of packed archiveRecords (see archiveStream.h)
+        -s column   csv column holding the wind speed in mph, from 0 (default 1)
+        -d column   csv column holding the wind direction in degrees (default 2)
+        -t char     csv field separator (default ,)
+        -q          do not report throughput on stderr
+
+    input and output default to stdin and stdout, - also means stdin or stdout. The output
+    may not be the input.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "archiveStream.h"
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: correctFile [-b] [-s column] [-d column] [-t separator] [-q] [input [output]]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    csvLayout layout = {1,2,','};
+    int binary = 0;
+    int quiet = 0;
+    int option;
+
+    while((option = getopt(argc,argv,"bs:d:t:q"))!=-1)
+    {
+        switch(option)
+        {
+            case 'b':
+                binary = 1;
+                break;
+            case 's':
+                layout.speedColumn = atoi(optarg);
+                break;
+            case 'd':
+                layout.directionColumn = atoi(optarg);
+                break;
+            case 't':
+                layout.separator = optarg[0];
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if((argc-optind)>2 || layout.speedColumn<0 || layout.directionColumn<0 || layout.speedColumn==layout.directionColumn)
+    {
+        usage();
+        return 2;
+    }
+
+    const char* inputName = (optind<argc) ? argv[optind] : "-";
+    const char* outputName = ((optind+1)<argc) ? argv[optind+1] : "-";
+    int inputFd = strcmp(inputName,"-") ? open(inputName,O_RDONLY) : STDIN_FILENO;
+    if(inputFd<0)
+    {
+        fprintf(stderr,"correctFile: %s: %s\n",inputName,strerror(errno));
+        return 1;
+    }
+    int outputFd = strcmp(outputName,"-") ? open(outputName,O_WRONLY|O_CREAT,0644) : STDOUT_FILENO;
+    if(outputFd<0)
+    {
+        fprintf(stderr,"correctFile: %s: %s\n",outputName,strerror(errno));
+        return 1;
+    }
+
+    // the output is only truncated once it is known not to be the input, which it would empty
+    struct stat inputStat;
+    struct stat outputStat;
+    if(fstat(inputFd,&inputStat)<0 || fstat(outputFd,&outputStat)<0)
+    {
+        fprintf(stderr,"correctFile: %s\n",strerror(errno));
+        return 1;
+    }
+    if(inputStat.st_dev==outputStat.st_dev && inputStat.st_ino==outputStat.st_ino && S_ISREG(inputStat.st_mode))
+    {
+        fprintf(stderr,"correctFile: %s and %s are the same file\n",inputName,outputName);
+        return 1;
+    }
+    if(S_ISREG(outputStat.st_mode) && strcmp(outputName,"-") && ftruncate(outputFd,0)<0)
+    {
+        fprintf(stderr,"correctFile: %s: %s\n",outputName,strerror(errno));
+        return 1;
+    }
+
+    struct timespec start;
+    struct timespec end;
+    streamStats stats;
+
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    int result = binary ? correctBinaryStream(inputFd,outputFd,&stats) : correctCsvStream(inputFd,outputFd,&layout,&stats);
+    clock_gettime(CLOCK_MONOTONIC,&end);
+
+    if(result<0)
+    {
+        fprintf(stderr,"correctFile: %s\n",strerror(errno));
+        return 1;
+    }
+    if(outputFd!=STDOUT_FILENO && close(outputFd)<0)
+    {
+        fprintf(stderr,"correctFile: %s: %s\n",outputName,strerror(errno));
+        return 1;
+    }
+
+    if(!quiet)
+    {
+        double seconds = (end.tv_sec-start.tv_sec)+((end.tv_nsec-start.tv_nsec)*1e-9);
+        fprintf(stderr,"correctFile: %llu records, %llu corrected, %.1f MB in %.3f s, %.0f MB/s\n",
+                (unsigned long long)stats.records,(unsigned long long)stats.corrected,stats.bytesRead/1e6,seconds,
+                (seconds>0.0) ? stats.bytesRead/(seconds*1e6) : 0.0);
+    }
+
+    return 0;
+}
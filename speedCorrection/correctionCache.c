@@ -0,0 +1,285 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Memo of corrections keyed on whole mph and whole degrees
+
+    A pair is keyed as speed*360+angle, below 2^17. Consecutive keys go to consecutive
+    slots, so the speeds a station actually sees in a spell of weather, every angle of a
+    few tens of mph, share a table of a few thousand entries without colliding.
+
+    An entry is the key and the epoch in the top 32 bits and the correction's bits in the
+    bottom 32, stored and loaded whole so a reader never sees half of one. An entry is
+    tagged with the epoch its corrector loaded before it corrected, so a miss racing an
+    invalidation stores an entry the new epoch will not match. The epoch has 15 bits, when
+    it wraps the table is cleared, a store from a miss that began 32767 invalidations ago
+    is the only way an old entry could match again.
+
+    Each of up to cacheCountingThreads running threads using any cache counts in its own
+    cache line with plain loads and stores, a thread beyond them shares a line and counts
+    atomically. A thread's line goes back to the free set when it exits, released after its
+    last count and claimed with an acquire, so the next thread to take it carries on from
+    the counts already there.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "correctionCache.h"
+#include "interpolator.h"
+
+#define keyBits 17
+#define epochMask 0x7fff
+
+#define hitCount 0
+#define missCount 1
+#define uncachedCount 2
+#define invalidationCount 3
+
+typedef struct
+{
+    uint64_t counts[4];
+} __attribute__((aligned(64))) cacheCounters;
+
+struct correctionCache
+{
+    uint64_t state;                 // profile generation in the top 32 bits, epoch in the bottom
+    uint64_t* entries;
+    uint32_t mask;
+    pthread_mutex_t lock;           // changing epoch, never taken by a hit
+
+    cacheCounters counters[cacheCountingThreads+1];
+};
+
+static_assert(cacheCountingThreads==64,"the free counter lines are one bit each of a 64 bit word");
+
+// each thread's counter line, the same in every cache, and the lines no thread holds
+static uint64_t freeCounterSlots = ~0ULL;
+static __thread int counterSlot = -1;
+static pthread_key_t counterSlotKey;
+static pthread_once_t counterSlotKeyOnce = PTHREAD_ONCE_INIT;
+
+static void releaseCounterSlot(void* value)
+{
+    int slot = (int)(intptr_t)value-1;
+    counterSlot = -1;
+    __atomic_fetch_or(&freeCounterSlots,1ULL<<slot,__ATOMIC_RELEASE);
+}
+
+static void createCounterSlotKey(void)
+{
+    pthread_key_create(&counterSlotKey,releaseCounterSlot);
+}
+
+static int claimCounterSlot(void)
+{
+    pthread_once(&counterSlotKeyOnce,createCounterSlotKey);
+    uint64_t freeSlots = __atomic_load_n(&freeCounterSlots,__ATOMIC_RELAXED);
+    while(freeSlots)
+    {
+        int slot = __builtin_ctzll(freeSlots);
+        if(__atomic_compare_exchange_n(&freeCounterSlots,&freeSlots,freeSlots&~(1ULL<<slot),true,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED))
+        {
+            // the key holds slot+1, a destructor is not run for a NULL value
+            pthread_setspecific(counterSlotKey,(void*)(intptr_t)(slot+1));
+            return slot;
+        }
+    }
+    return cacheCountingThreads;
+}
+
+static inline void countLookup(correctionCache* cache, int count)
+{
+    if(__builtin_expect(counterSlot<0,0))
+    {
+        counterSlot = claimCounterSlot();
+    }
+
+    uint64_t* counter = &cache->counters[counterSlot].counts[count];
+    if(counterSlot<cacheCountingThreads)
+    {
+        __atomic_store_n(counter,__atomic_load_n(counter,__ATOMIC_RELAXED)+1,__ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_fetch_add(counter,1,__ATOMIC_RELAXED);
+    }
+}
+
+correctionCache* createCorrectionCache(size_t entries)
+{
+    if(entries<1 || entries>cacheMaxEntries)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t capacity = cacheMinEntries;
+    while(capacity<entries)
+    {
+        capacity <<= 1;
+    }
+
+    void* memory = NULL;
+    if(posix_memalign(&memory,64,sizeof(correctionCache))!=0)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    correctionCache* cache = (correctionCache*)memory;
+    cache->entries = (uint64_t*)calloc(capacity,sizeof(uint64_t));
+    if(!cache->entries)
+    {
+        free(cache);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // epoch 0 is never used so an empty slot can not match
+    cache->state = ((uint64_t)defaultCalibrationProfile.generation<<32)|1;
+    cache->mask = capacity-1;
+    pthread_mutex_init(&cache->lock,NULL);
+    memset(cache->counters,0,sizeof(cache->counters));
+
+    return cache;
+}
+
+void destroyCorrectionCache(correctionCache* cache)
+{
+    if(!cache)
+    {
+        return;
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache);
+}
+
+// moves to the next epoch correcting with generation, called with the lock held
+static uint64_t advanceEpoch(correctionCache* cache, uint32_t generation)
+{
+    uint32_t epoch = ((uint32_t)cache->state&epochMask)+1;
+    if(epoch>epochMask)
+    {
+        for(uint32_t slot=0;slot<=cache->mask;slot++)
+        {
+            __atomic_store_n(&cache->entries[slot],0,__ATOMIC_RELAXED);
+        }
+        epoch = 1;
+    }
+
+    uint64_t state = ((uint64_t)generation<<32)|epoch;
+    __atomic_store_n(&cache->state,state,__ATOMIC_RELEASE);
+    countLookup(cache,invalidationCount);
+    return state;
+}
+
+void invalidateCorrectionCache(correctionCache* cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    advanceEpoch(cache,(uint32_t)(cache->state>>32));
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// another thread may have changed to the same generation while this one waited
+static uint64_t changeGeneration(correctionCache* cache, uint32_t generation)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint64_t state = cache->state;
+    if((uint32_t)(state>>32)!=generation)
+    {
+        state = advanceEpoch(cache,generation);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return state;
+}
+
+template<typename Corrector>
+static inline float lookupCorrection(correctionCache* cache, uint32_t generation, float rawSpeed, float angle, Corrector correct)
+{
+    // whole mph and whole degrees only, -0 is left out as the correctors may keep its sign
+    uint32_t speed = (rawSpeed>=0.0f && rawSpeed<=255.0f) ? (uint32_t)rawSpeed : 0;
+    uint32_t degrees = (angle>=0.0f && angle<360.0f) ? (uint32_t)angle : 0;
+    if(speed!=rawSpeed || degrees!=angle || signbit(rawSpeed) || signbit(angle))
+    {
+        countLookup(cache,uncachedCount);
+        return correct(rawSpeed,angle);
+    }
+
+    uint64_t state = __atomic_load_n(&cache->state,__ATOMIC_ACQUIRE);
+    if(__builtin_expect((uint32_t)(state>>32)!=generation,0))
+    {
+        state = changeGeneration(cache,generation);
+    }
+
+    uint32_t key = (speed*360)+degrees;
+    uint32_t tag = ((uint32_t)state<<keyBits)|key;
+    uint64_t* slot = &cache->entries[key&cache->mask];
+    uint64_t entry = __atomic_load_n(slot,__ATOMIC_RELAXED);
+
+    uint32_t bits;
+    float corrected;
+    if((uint32_t)(entry>>32)==tag)
+    {
+        bits = (uint32_t)entry;
+        memcpy(&corrected,&bits,sizeof(corrected));
+        countLookup(cache,hitCount);
+        return corrected;
+    }
+
+    corrected = correct(rawSpeed,angle);
+    memcpy(&bits,&corrected,sizeof(bits));
+    __atomic_store_n(slot,((uint64_t)tag<<32)|bits,__ATOMIC_RELAXED);
+    countLookup(cache,missCount);
+    return corrected;
+}
+
+float correctSpeedCached(correctionCache* cache, float rawSpeed, float angle)
+{
+    // the default profile corrects exactly as the global table, so the two share entries
+    return lookupCorrection(cache,defaultCalibrationProfile.generation,rawSpeed,angle,
+                            [](float speed, float degrees) { return correctSpeed(speed,degrees); });
+}
+
+float correctSpeedCached(correctionCache* cache, const calibrationProfile* profile, float rawSpeed, float angle)
+{
+    return lookupCorrection(cache,profile->generation,rawSpeed,angle,
+                            [profile](float speed, float degrees) { return correctSpeed(profile,speed,degrees); });
+}
+
+float correctSpeedCached(correctionCache* cache, const liveReader* reader, float rawSpeed, float angle)
+{
+    return correctSpeedCached(cache,currentLiveProfile(reader),rawSpeed,angle);
+}
+
+void correctionCacheStatistics(const correctionCache* cache, correctionCacheStats* stats)
+{
+    uint64_t totals[4] = {0,0,0,0};
+    for(int slot=0;slot<=cacheCountingThreads;slot++)
+    {
+        for(int count=0;count<4;count++)
+        {
+            totals[count] += __atomic_load_n(&cache->counters[slot].counts[count],__ATOMIC_RELAXED);
+        }
+    }
+
+    stats->hits = totals[hitCount];
+    stats->misses = totals[missCount];
+    stats->uncached = totals[uncachedCount];
+    stats->invalidations = totals[invalidationCount];
+}
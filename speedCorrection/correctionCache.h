@@ -0,0 +1,76 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionCache_h_
+#define _correctionCache_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calibrationProfile.h"
+#include "liveCalibration.h"
+
+// bounds on the number of cached corrections, a cache of n entries takes 8n bytes
+#define cacheMinEntries 64
+#define cacheMaxEntries 131072
+
+// running threads that count hits and misses without a read-modify-write, a thread that
+// finds them all taken shares one atomic counter, a thread's own is freed when it exits
+#define cacheCountingThreads 64
+
+// memo of corrections for the live feed
+//
+// a console reports whole mph and whole degrees, so a live feed corrects the same few
+// thousand speed and angle pairs over and over. The cache remembers the correction of each
+// pair it has seen in a fixed size direct mapped table, filled as pairs turn up, a pair
+// that lands on a slot already taken replaces it. Speeds that are not whole mph from 0 to
+// 255, or angles that are not whole degrees from 0 to 359, are corrected without the cache.
+//
+// each entry is one 64 bit word holding the pair, the correction and the cache epoch it was
+// made in, so a hit is one load and no lock. The cache remembers the generation of the
+// profile its entries were corrected with (calibrationProfile.h), and the first lookup with
+// a profile of another generation moves the cache to a new epoch, which turns every older
+// entry into a miss. So a cache sits in front of the default table, a profile or a live
+// calibration and never returns a correction from a table that has been replaced, but it
+// should only serve one calibration at a time or every lookup will invalidate it.
+typedef struct correctionCache correctionCache;
+
+typedef struct
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t uncached;          // pairs the cache can not hold
+    uint64_t invalidations;
+} correctionCacheStats;
+
+// entries is rounded up to a power of two, returns NULL with errno set (EINVAL if entries
+// is out of range)
+correctionCache* createCorrectionCache(size_t entries);
+void destroyCorrectionCache(correctionCache* cache);
+
+// drops every entry, the next lookup of each pair is a miss
+void invalidateCorrectionCache(correctionCache* cache);
+
+// the same corrections as correctSpeed(rawSpeed,angle), correctSpeed(profile,rawSpeed,angle)
+// and correctSpeedLive(reader,rawSpeed,angle), bit for bit
+float correctSpeedCached(correctionCache* cache, float rawSpeed, float angle);
+float correctSpeedCached(correctionCache* cache, const calibrationProfile* profile, float rawSpeed, float angle);
+float correctSpeedCached(correctionCache* cache, const liveReader* reader, float rawSpeed, float angle);
+
+// totals since the cache was created, counts from other threads may be a moment behind
+void correctionCacheStatistics(const correctionCache* cache, correctionCacheStats* stats);
+
+#endif
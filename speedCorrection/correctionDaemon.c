@@ -0,0 +1,136 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Serves wind speed corrections for many stations on a unix domain socket (see
+    correctionServer.h for the protocol) until interrupted.
+
+    usage: correctionDaemon [-b readings] [-d microseconds] [-p station=profile]... [-q] socket
+
+        -b readings         correct once this many readings are waiting (default 1024)
+        -d microseconds     or once the oldest has waited this long (default 500), 0 corrects
+                            whatever each wakeup reads
+        -p station=profile  calibration profile file for a station (see calibrationProfile.h),
+                            stations without one use the default calibration
+        -q                  do not report totals on stderr when stopped
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "correctionServer.h"
+
+static correctionServer* server = NULL;
+
+static void stopServing(int)
+{
+    stopCorrectionServer(server);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: correctionDaemon [-b readings] [-d microseconds] [-p station=profile]... [-q] socket\n");
+}
+
+int main(int argc, char* argv[])
+{
+    serverConfig config = {NULL,1024,500};
+    const char* profileOptions[serverMaxStations];
+    int profileCount = 0;
+    int quiet = 0;
+    int option;
+
+    while((option = getopt(argc,argv,"b:d:p:q"))!=-1)
+    {
+        switch(option)
+        {
+            case 'b':
+                config.batchReadings = atoi(optarg);
+                break;
+            case 'd':
+                config.maxDelayUs = atoi(optarg);
+                break;
+            case 'p':
+                if(profileCount==serverMaxStations)
+                {
+                    usage();
+                    return 2;
+                }
+                profileOptions[profileCount++] = optarg;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if((argc-optind)!=1)
+    {
+        usage();
+        return 2;
+    }
+    config.socketPath = argv[optind];
+
+    server = createCorrectionServer(&config);
+    if(!server)
+    {
+        fprintf(stderr,"correctionDaemon: %s: %s\n",config.socketPath,strerror(errno));
+        return 1;
+    }
+
+    for(int profile=0;profile<profileCount;profile++)
+    {
+        char* path = NULL;
+        long station = strtol(profileOptions[profile],&path,10);
+        calibrationProfile loaded;
+        if(path==profileOptions[profile] || *path!='=' || loadCalibrationProfile(path+1,&loaded)<0 ||
+           setStationProfile(server,(int)station,&loaded)<0)
+        {
+            fprintf(stderr,"correctionDaemon: %s: %s\n",profileOptions[profile],strerror(errno));
+            destroyCorrectionServer(server);
+            return 1;
+        }
+    }
+
+    struct sigaction action;
+    memset(&action,0,sizeof(action));
+    action.sa_handler = stopServing;
+    sigaction(SIGINT,&action,NULL);
+    sigaction(SIGTERM,&action,NULL);
+
+    int result = runCorrectionServer(server);
+    if(result<0)
+    {
+        fprintf(stderr,"correctionDaemon: %s\n",strerror(errno));
+    }
+
+    serverStats stats;
+    correctionServerStatistics(server,&stats);
+    if(!quiet)
+    {
+        fprintf(stderr,"correctionDaemon: %llu connections, %llu requests, %llu readings in %llu batches, %llu rejected, %llu dropped\n",
+                (unsigned long long)stats.connections,(unsigned long long)stats.requests,(unsigned long long)stats.readings,
+                (unsigned long long)stats.batches,(unsigned long long)stats.rejected,(unsigned long long)stats.dropped);
+    }
+    destroyCorrectionServer(server);
+
+    return (result<0) ? 1 : 0;
+}
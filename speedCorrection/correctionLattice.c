@@ -0,0 +1,134 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Precomputed correction lattice for interpolator.c
+
+    The lattice samples correctSpeed once at every node and stores the correction
+    (corrected speed - raw speed). The correction is well under half the raw speed, so
+    the subtraction is exact and adding it back to an integer raw speed at a node gives
+    the correctSpeed result bit for bit.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <math.h>
+#include "correctionLattice.h"
+#include "interpolator.h"
+
+static int latticeSpeedCount(float speedStep)
+{
+    return (int)ceil(latticeMaxSpeed/speedStep)+1;
+}
+
+static int latticeAngleCount(float angleStep)
+{
+    return (int)ceil(180.0/angleStep)+1;
+}
+
+size_t correctionLatticeBytes(float speedStep, float angleStep)
+{
+    return (size_t)latticeSpeedCount(speedStep)*latticeAngleCount(angleStep)*sizeof(float);
+}
+
+void buildCorrectionLattice(correctionLattice* lattice, float* storage, float speedStep, float angleStep)
+{
+    lattice->speedStep = speedStep;
+    lattice->angleStep = angleStep;
+    lattice->speedScale = 1.0f/speedStep;
+    lattice->angleScale = 1.0f/angleStep;
+    lattice->speedCount = latticeSpeedCount(speedStep);
+    lattice->angleCount = latticeAngleCount(angleStep);
+    lattice->unitSteps = (speedStep==1.0f && angleStep==1.0f) ? 1 : 0;
+    lattice->corrections = storage;
+
+    for(int row=0;row<lattice->speedCount;row++)
+    {
+        float rawSpeed = row*speedStep;
+        for(int column=0;column<lattice->angleCount;column++)
+        {
+            float angle = column*angleStep;
+            lattice->corrections[(row*lattice->angleCount)+column] = correctSpeed(rawSpeed,angle)-rawSpeed;
+        }
+    }
+}
+
+size_t correctionLatticeFootprint(const correctionLattice* lattice)
+{
+    return sizeof(correctionLattice)+((size_t)lattice->speedCount*lattice->angleCount*sizeof(float));
+}
+
+// bilinear blend, written without branches so the batch loop vectorises
+static inline float blendLattice(const correctionLattice* lattice, float rawSpeed, float angle)
+{
+    // fold the angle onto 0->180 as correctSpeed does
+    float foldedAngle = 360.0f-angle;
+    float correctionAngle = (foldedAngle<angle) ? foldedAngle : angle;
+
+    // position within the lattice, held inside the outer cells so the blend never reads
+    // past the last row or column
+    float speedPosition = rawSpeed*lattice->speedScale;
+    float speedLimit = lattice->speedCount-1;
+    speedPosition = (speedPosition<0.0f) ? 0.0f : speedPosition;
+    speedPosition = (speedPosition>speedLimit) ? speedLimit : speedPosition;
+    float anglePosition = correctionAngle*lattice->angleScale;
+    float angleLimit = lattice->angleCount-1;
+    anglePosition = (anglePosition<0.0f) ? 0.0f : anglePosition;
+    anglePosition = (anglePosition>angleLimit) ? angleLimit : anglePosition;
+
+    int row = (int)speedPosition;
+    row = (row>(lattice->speedCount-2)) ? (lattice->speedCount-2) : row;
+    int column = (int)anglePosition;
+    column = (column>(lattice->angleCount-2)) ? (lattice->angleCount-2) : column;
+    float speedFactor = speedPosition-row;
+    float angleFactor = anglePosition-column;
+
+    const float* corrections = lattice->corrections;
+    int low = (row*lattice->angleCount)+column;
+    int high = low+lattice->angleCount;
+    float correctionLow = ((corrections[low+1]-corrections[low])*angleFactor)+corrections[low];
+    float correctionHigh = ((corrections[high+1]-corrections[high])*angleFactor)+corrections[high];
+
+    return (((correctionHigh-correctionLow)*speedFactor)+correctionLow)+rawSpeed;
+}
+
+float correctSpeedLattice(const correctionLattice* lattice, float rawSpeed, float angle)
+{
+    return blendLattice(lattice,rawSpeed,angle);
+}
+
+float correctSpeedLatticeNode(const correctionLattice* lattice, int rawSpeed, int angle)
+{
+    if(!lattice->unitSteps)
+    {
+        return blendLattice(lattice,rawSpeed,angle);
+    }
+
+    int correctionAngle = (angle>180) ? (360-angle) : angle;
+    correctionAngle = (correctionAngle<0) ? 0 : correctionAngle;
+    correctionAngle = (correctionAngle>180) ? 180 : correctionAngle;
+    int row = (rawSpeed<0) ? 0 : rawSpeed;
+    row = (row>(lattice->speedCount-1)) ? (lattice->speedCount-1) : row;
+
+    return rawSpeed+lattice->corrections[(row*lattice->angleCount)+correctionAngle];
+}
+
+void correctSpeedLatticeBatch(const correctionLattice* lattice, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    // a local copy keeps the lattice parameters in registers across the loop
+    correctionLattice local = *lattice;
+    for(size_t sample=0;sample<count;sample++)
+    {
+        correctedSpeed[sample] = blendLattice(&local,rawSpeed[sample],angle[sample]);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionLattice_h_
+#define _correctionLattice_h_
+
+#include <stddef.h>
+
+// speeds covered by a lattice, speeds above this use the correction at the top row
+#define latticeMaxSpeed 255.0
+
+// dense grid of corrections over 0->latticeMaxSpeed mph and 0->180 degrees, built once
+// from correctSpeed so a correction is a single fetch (integer inputs on a 1 mph x 1 degree
+// lattice) or a bilinear blend of four nodes
+//
+// the correction table is itself bilinear between its speed and angle sites, so a lattice
+// whose steps divide the site spacing (5 mph, 90 degrees) reproduces correctSpeed to within
+// float rounding, coarser lattices trade accuracy for memory
+typedef struct
+{
+    float speedStep;            // mph between rows
+    float angleStep;            // degrees between columns
+    float speedScale;           // reciprocals of the steps
+    float angleScale;
+    int speedCount;             // rows, the last row is at or above latticeMaxSpeed
+    int angleCount;             // columns, the last column is at or above 180 degrees
+    int unitSteps;              // 1 mph x 1 degree lattice, integer inputs are nodes
+    float* corrections;         // speedCount*angleCount corrections, row major by speed
+} correctionLattice;
+
+// bytes of correction storage needed for a lattice of the given resolution
+size_t correctionLatticeBytes(float speedStep, float angleStep);
+
+// fills the caller supplied storage (at least correctionLatticeBytes) and sets up the lattice
+void buildCorrectionLattice(correctionLattice* lattice, float* storage, float speedStep, float angleStep);
+
+// memory used by a built lattice, the structure plus its correction storage
+size_t correctionLatticeFootprint(const correctionLattice* lattice);
+
+// bilinear blend of the four nodes around the input
+float correctSpeedLattice(const correctionLattice* lattice, float rawSpeed, float angle);
+
+// single fetch on a 1 mph x 1 degree lattice, bit identical to correctSpeed, falls back to
+// the bilinear blend on coarser lattices
+float correctSpeedLatticeNode(const correctionLattice* lattice, int rawSpeed, int angle);
+
+void correctSpeedLatticeBatch(const correctionLattice* lattice, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+#endif
@@ -0,0 +1,635 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Blocks are drawn from a fixed pool, so the memory in flight is bounded and the source
+    cannot run ahead of a stalled sink by more than the pool. Between each pair of stages
+    is a queue of queueBlocks slots indexed by block sequence: a block can only be put in
+    once every block more than queueBlocks before it has been taken out, and blocks are
+    taken out strictly in sequence. With one worker either side it is a plain bounded
+    single producer single consumer ring, with several workers feeding it (a parallel
+    stage) it is a multiple producer queue that also puts their blocks back in order.
+
+    A block carries thousands of samples, so a mutex and condition variable per queue
+    cost nothing measurable and let a waiting stage sleep rather than spin, which matters
+    when there are more stages than cores.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "correctionPipeline.h"
+#include "simdCorrection.h"
+
+#define noSequence UINT64_MAX
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pipelineBlock** slots;
+    int capacity;
+    uint64_t nextOut;
+    uint64_t end;               // sequence after the last block, noSequence until known
+} pipelineQueue;
+
+typedef struct pipelineRun pipelineRun;
+
+typedef struct
+{
+    pipelineRun* run;
+    int stage;                  // -1 for the source
+    pipelineStageStats stats;
+} pipelineWorker;
+
+struct pipelineRun
+{
+    const pipelineConfig* config;
+    pipelineQueue queues[pipelineMaxStages];    // queue i feeds stage i
+
+    pthread_mutex_t poolLock;
+    pthread_cond_t poolChanged;
+    pipelineBlock** freeBlocks;
+    int freeCount;
+
+    int failed;
+    int error;
+    int running[pipelineMaxStages];             // workers of each stage still going
+    uint64_t samples;
+};
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return ((uint64_t)now.tv_sec*1000000000ULL)+now.tv_nsec;
+}
+
+static int validPipeline(const pipelineConfig* config)
+{
+    if(!config || !config->source.run || config->stageCount<1 || config->stageCount>pipelineMaxStages ||
+       config->queueBlocks<1)
+    {
+        return 0;
+    }
+    for(int stage=0;stage<config->stageCount;stage++)
+    {
+        if(!config->stages[stage].run || config->stages[stage].workers<1 ||
+           config->stages[stage].workers>pipelineMaxWorkers)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// the first failure wins, every waiter is woken to see it
+static void failPipeline(pipelineRun* run, int error)
+{
+    pthread_mutex_lock(&run->poolLock);
+    if(!run->failed)
+    {
+        run->error = error;
+    }
+    __atomic_store_n(&run->failed,1,__ATOMIC_RELEASE);
+    pthread_cond_broadcast(&run->poolChanged);
+    pthread_mutex_unlock(&run->poolLock);
+
+    for(int stage=0;stage<run->config->stageCount;stage++)
+    {
+        pthread_mutex_lock(&run->queues[stage].lock);
+        pthread_cond_broadcast(&run->queues[stage].changed);
+        pthread_mutex_unlock(&run->queues[stage].lock);
+    }
+}
+
+static int pipelineFailed(pipelineRun* run)
+{
+    return __atomic_load_n(&run->failed,__ATOMIC_ACQUIRE);
+}
+
+// 0, or -1 if the pipeline failed while waiting for room
+static int putBlock(pipelineRun* run, pipelineQueue* queue, pipelineBlock* block)
+{
+    pthread_mutex_lock(&queue->lock);
+    while(!pipelineFailed(run) && block->sequence>=queue->nextOut+queue->capacity)
+    {
+        pthread_cond_wait(&queue->changed,&queue->lock);
+    }
+    int result = -1;
+    if(!pipelineFailed(run))
+    {
+        queue->slots[block->sequence%queue->capacity] = block;
+        pthread_cond_broadcast(&queue->changed);
+        result = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return result;
+}
+
+// the next block in sequence, or NULL once the last has been taken or the pipeline failed
+static pipelineBlock* takeBlock(pipelineRun* run, pipelineQueue* queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while(!pipelineFailed(run) && queue->nextOut!=queue->end && !queue->slots[queue->nextOut%queue->capacity])
+    {
+        pthread_cond_wait(&queue->changed,&queue->lock);
+    }
+    pipelineBlock* block = NULL;
+    if(!pipelineFailed(run) && queue->nextOut!=queue->end)
+    {
+        block = queue->slots[queue->nextOut%queue->capacity];
+        queue->slots[queue->nextOut%queue->capacity] = NULL;
+        queue->nextOut++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return block;
+}
+
+static void endQueue(pipelineQueue* queue, uint64_t end)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->end = end;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static pipelineBlock* allocateBlock(pipelineRun* run)
+{
+    pthread_mutex_lock(&run->poolLock);
+    while(!pipelineFailed(run) && !run->freeCount)
+    {
+        pthread_cond_wait(&run->poolChanged,&run->poolLock);
+    }
+    pipelineBlock* block = pipelineFailed(run) ? NULL : run->freeBlocks[--run->freeCount];
+    pthread_mutex_unlock(&run->poolLock);
+    return block;
+}
+
+static void releaseBlock(pipelineRun* run, pipelineBlock* block)
+{
+    pthread_mutex_lock(&run->poolLock);
+    run->freeBlocks[run->freeCount++] = block;
+    pthread_cond_signal(&run->poolChanged);
+    pthread_mutex_unlock(&run->poolLock);
+}
+
+static void* runSource(void* argument)
+{
+    pipelineWorker* worker = (pipelineWorker*)argument;
+    pipelineRun* run = worker->run;
+    const pipelineStage* source = &run->config->source;
+    uint64_t sequence = 0;
+
+    for(;;)
+    {
+        uint64_t waited = nowNs();
+        pipelineBlock* block = allocateBlock(run);
+        uint64_t started = nowNs();
+        worker->stats.blockedSeconds += (started-waited)*1e-9;
+        if(!block)
+        {
+            break;
+        }
+
+        block->sequence = sequence;
+        block->samples = 0;
+        block->bytes = 0;
+        int filled = source->run(source->context,block);
+        worker->stats.busySeconds += (nowNs()-started)*1e-9;
+        if(filled<=0)
+        {
+            releaseBlock(run,block);
+            if(filled<0)
+            {
+                failPipeline(run,errno);
+            }
+            break;
+        }
+
+        worker->stats.blocks++;
+        waited = nowNs();
+        if(putBlock(run,&run->queues[0],block)<0)
+        {
+            releaseBlock(run,block);
+            break;
+        }
+        worker->stats.blockedSeconds += (nowNs()-waited)*1e-9;
+        sequence++;
+    }
+
+    endQueue(&run->queues[0],sequence);
+    return NULL;
+}
+
+static void* runStage(void* argument)
+{
+    pipelineWorker* worker = (pipelineWorker*)argument;
+    pipelineRun* run = worker->run;
+    const pipelineStage* stage = &run->config->stages[worker->stage];
+    int last = (worker->stage==(run->config->stageCount-1));
+    pipelineQueue* input = &run->queues[worker->stage];
+    pipelineQueue* output = last ? NULL : &run->queues[worker->stage+1];
+
+    for(;;)
+    {
+        uint64_t waited = nowNs();
+        pipelineBlock* block = takeBlock(run,input);
+        uint64_t started = nowNs();
+        worker->stats.starvedSeconds += (started-waited)*1e-9;
+        if(!block)
+        {
+            break;
+        }
+
+        int result = stage->run(stage->context,block);
+        worker->stats.busySeconds += (nowNs()-started)*1e-9;
+        if(result<0)
+        {
+            releaseBlock(run,block);
+            failPipeline(run,errno);
+            break;
+        }
+
+        worker->stats.blocks++;
+        if(last)
+        {
+            __atomic_add_fetch(&run->samples,block->samples,__ATOMIC_RELAXED);
+            releaseBlock(run,block);
+            continue;
+        }
+        waited = nowNs();
+        if(putBlock(run,output,block)<0)
+        {
+            releaseBlock(run,block);
+            break;
+        }
+        worker->stats.blockedSeconds += (nowNs()-waited)*1e-9;
+    }
+
+    // the last of a stage's workers out passes the end on, by then the source has set it
+    if(output && !__atomic_sub_fetch(&run->running[worker->stage],1,__ATOMIC_ACQ_REL))
+    {
+        pthread_mutex_lock(&input->lock);
+        uint64_t end = input->end;
+        pthread_mutex_unlock(&input->lock);
+        endQueue(output,end);
+    }
+    return NULL;
+}
+
+static void addStageStats(pipelineStageStats* total, const pipelineStageStats* worker)
+{
+    total->blocks += worker->blocks;
+    total->busySeconds += worker->busySeconds;
+    total->starvedSeconds += worker->starvedSeconds;
+    total->blockedSeconds += worker->blockedSeconds;
+}
+
+int runPipeline(const pipelineConfig* config, pipelineStats* stats)
+{
+    if(!validPipeline(config))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // enough blocks to fill every queue and give every worker one to work on
+    int workerCount = 1;
+    int blockCount = 1;
+    for(int stage=0;stage<config->stageCount;stage++)
+    {
+        workerCount += config->stages[stage].workers;
+        blockCount += config->queueBlocks+config->stages[stage].workers;
+    }
+
+    pipelineRun* run = (pipelineRun*)calloc(1,sizeof(pipelineRun));
+    pipelineWorker* workers = (pipelineWorker*)calloc(workerCount,sizeof(pipelineWorker));
+    pthread_t* threads = (pthread_t*)calloc(workerCount,sizeof(pthread_t));
+    pipelineBlock* blocks = (pipelineBlock*)malloc(blockCount*sizeof(pipelineBlock));
+    pipelineBlock** slots = (pipelineBlock**)calloc((size_t)config->stageCount*config->queueBlocks+blockCount,sizeof(pipelineBlock*));
+    if(!run || !workers || !threads || !blocks || !slots)
+    {
+        free(run);
+        free(workers);
+        free(threads);
+        free(blocks);
+        free(slots);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    run->config = config;
+    pthread_mutex_init(&run->poolLock,NULL);
+    pthread_cond_init(&run->poolChanged,NULL);
+    run->freeBlocks = slots+(size_t)config->stageCount*config->queueBlocks;
+    for(int block=0;block<blockCount;block++)
+    {
+        run->freeBlocks[run->freeCount++] = &blocks[block];
+    }
+    for(int stage=0;stage<config->stageCount;stage++)
+    {
+        pipelineQueue* queue = &run->queues[stage];
+        pthread_mutex_init(&queue->lock,NULL);
+        pthread_cond_init(&queue->changed,NULL);
+        queue->slots = slots+(size_t)stage*config->queueBlocks;
+        queue->capacity = config->queueBlocks;
+        queue->end = noSequence;
+        run->running[stage] = config->stages[stage].workers;
+    }
+
+    uint64_t start = nowNs();
+    int started = 0;
+    for(int stage=-1;stage<config->stageCount;stage++)
+    {
+        int count = (stage<0) ? 1 : config->stages[stage].workers;
+        for(int copy=0;copy<count;copy++)
+        {
+            workers[started].run = run;
+            workers[started].stage = stage;
+            if(pthread_create(&threads[started],NULL,(stage<0) ? runSource : runStage,&workers[started]))
+            {
+                // the threads already going see the failure and wind down
+                failPipeline(run,EAGAIN);
+                stage = config->stageCount;
+                break;
+            }
+            started++;
+        }
+    }
+    for(int thread=0;thread<started;thread++)
+    {
+        pthread_join(threads[thread],NULL);
+    }
+    uint64_t end = nowNs();
+
+    if(stats)
+    {
+        memset(stats,0,sizeof(pipelineStats));
+        stats->seconds = (end-start)*1e-9;
+        stats->samples = run->samples;
+        for(int worker=0;worker<started;worker++)
+        {
+            addStageStats((workers[worker].stage<0) ? &stats->source : &stats->stages[workers[worker].stage],&workers[worker].stats);
+        }
+    }
+
+    int error = run->failed ? run->error : 0;
+    for(int stage=0;stage<config->stageCount;stage++)
+    {
+        pthread_mutex_destroy(&run->queues[stage].lock);
+        pthread_cond_destroy(&run->queues[stage].changed);
+    }
+    pthread_mutex_destroy(&run->poolLock);
+    pthread_cond_destroy(&run->poolChanged);
+    free(run);
+    free(workers);
+    free(threads);
+    free(blocks);
+    free(slots);
+
+    if(error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int runPipelineSequentially(const pipelineConfig* config, pipelineStats* stats)
+{
+    if(!validPipeline(config))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    pipelineBlock* block = (pipelineBlock*)malloc(sizeof(pipelineBlock));
+    if(!block)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pipelineStats totals;
+    memset(&totals,0,sizeof(totals));
+    uint64_t start = nowNs();
+    int result = 0;
+    for(uint64_t sequence=0;;sequence++)
+    {
+        block->sequence = sequence;
+        block->samples = 0;
+        block->bytes = 0;
+        uint64_t began = nowNs();
+        int filled = config->source.run(config->source.context,block);
+        totals.source.busySeconds += (nowNs()-began)*1e-9;
+        if(filled<=0)
+        {
+            result = filled;
+            break;
+        }
+        totals.source.blocks++;
+
+        for(int stage=0;stage<config->stageCount && result==0;stage++)
+        {
+            began = nowNs();
+            result = config->stages[stage].run(config->stages[stage].context,block);
+            totals.stages[stage].busySeconds += (nowNs()-began)*1e-9;
+            totals.stages[stage].blocks += (result==0);
+        }
+        if(result<0)
+        {
+            break;
+        }
+        totals.samples += block->samples;
+    }
+    totals.seconds = (nowNs()-start)*1e-9;
+
+    int error = errno;
+    free(block);
+    if(stats)
+    {
+        *stats = totals;
+    }
+    if(result<0)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int readTextBlock(void* context, pipelineBlock* block)
+{
+    pipelineTextSource* source = (pipelineTextSource*)context;
+    size_t have = source->carried;
+    memcpy(block->text,source->carry,have);
+
+    int ended = 0;
+    while(have<pipelineBlockBytes)
+    {
+        ssize_t got = read(source->fd,block->text+have,pipelineBlockBytes-have);
+        if(got<0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if(!got)
+        {
+            ended = 1;
+            break;
+        }
+        have += got;
+    }
+
+    // end the block after its last whole line, or after pipelineBlockSamples lines
+    size_t cut = 0;
+    size_t lines = 0;
+    for(size_t byte=0;byte<have && lines<pipelineBlockSamples;byte++)
+    {
+        if(block->text[byte]=='\n')
+        {
+            cut = byte+1;
+            lines++;
+        }
+    }
+    if(ended && lines<pipelineBlockSamples)
+    {
+        cut = have;         // a last line without a newline
+    }
+    else if(!cut)
+    {
+        errno = EOVERFLOW;  // a line longer than a block
+        return -1;
+    }
+
+    source->carried = have-cut;
+    memcpy(source->carry,block->text+cut,source->carried);
+    block->bytes = cut;
+    return (cut>0) ? 1 : 0;
+}
+
+int parseWindBlock(void*, pipelineBlock* block)
+{
+    size_t samples = 0;
+    const char* line = block->text;
+    const char* end = block->text+block->bytes;
+
+    while(line<end && samples<pipelineBlockSamples)
+    {
+        const char* next = (const char*)memchr(line,'\n',end-line);
+        next = next ? next+1 : end;
+
+        // strtoul and strtof stop at the comma or newline, a line is never longer than the
+        // block so copying it to terminate it is cheap and keeps them inside it
+        char copy[128];
+        size_t length = next-line;
+        if(length<sizeof(copy))
+        {
+            memcpy(copy,line,length);
+            copy[length] = 0;
+
+            char* field = NULL;
+            unsigned long timestamp = strtoul(copy,&field,10);
+            if(field!=copy && *field==',')
+            {
+                char* speedEnd = NULL;
+                float rawSpeed = strtof(field+1,&speedEnd);
+                if(speedEnd!=field+1 && *speedEnd==',')
+                {
+                    char* angleEnd = NULL;
+                    float angle = strtof(speedEnd+1,&angleEnd);
+                    if(angleEnd!=speedEnd+1 && (*angleEnd==0 || *angleEnd=='\n' || *angleEnd=='\r') && isfinite(rawSpeed) && isfinite(angle))
+                    {
+                        block->timestamp[samples] = (uint32_t)timestamp;
+                        block->rawSpeed[samples] = rawSpeed;
+                        block->angle[samples] = angle;
+                        samples++;
+                    }
+                }
+            }
+        }
+        line = next;
+    }
+
+    block->samples = samples;
+    return 0;
+}
+
+int correctWindBlock(void*, pipelineBlock* block)
+{
+    correctSpeedSimd(block->rawSpeed,block->angle,block->correctedSpeed,block->samples);
+    return 0;
+}
+
+int aggregateWindBlock(void* context, pipelineBlock* block)
+{
+    pipelineAggregate* aggregate = (pipelineAggregate*)context;
+    for(size_t sample=0;sample<block->samples;sample++)
+    {
+        accumulateCorrectedWind(&aggregate->wind,block->correctedSpeed[sample],block->angle[sample]);
+        if(block->correctedSpeed[sample]>aggregate->peak)
+        {
+            aggregate->peak = block->correctedSpeed[sample];
+        }
+    }
+    return 0;
+}
+
+int formatWindBlock(void*, pipelineBlock* block)
+{
+    size_t bytes = 0;
+    for(size_t sample=0;sample<block->samples;sample++)
+    {
+        int written = snprintf(block->text+bytes,pipelineBlockBytes-bytes,"%u,%.2f,%g\n",
+                               block->timestamp[sample],block->correctedSpeed[sample],block->angle[sample]);
+        if(written<0 || (size_t)written>=(pipelineBlockBytes-bytes))
+        {
+            errno = EOVERFLOW;
+            return -1;
+        }
+        bytes += written;
+    }
+    block->bytes = bytes;
+    return 0;
+}
+
+int writeTextBlock(void* context, pipelineBlock* block)
+{
+    int fd = *(const int*)context;
+    size_t written = 0;
+    while(written<block->bytes)
+    {
+        ssize_t put = write(fd,block->text+written,block->bytes-written);
+        if(put<0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        written += put;
+    }
+    return 0;
+}
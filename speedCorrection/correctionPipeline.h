@@ -0,0 +1,130 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionPipeline_h_
+#define _correctionPipeline_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "windVector.h"
+
+// samples in a block and the text a block can hold, read in or formatted out
+#define pipelineBlockSamples 4096
+#define pipelineBlockBytes (pipelineBlockSamples*64)
+
+// most stages after the source and most threads one stage may run
+#define pipelineMaxStages 8
+#define pipelineMaxWorkers 16
+
+// the unit of work passed between stages, a block is filled by the source and handed from
+// stage to stage, every stage sees every block
+typedef struct
+{
+    uint64_t sequence;          // set by the pipeline, blocks leave every stage in this order
+    size_t samples;
+    uint32_t timestamp[pipelineBlockSamples];
+    float rawSpeed[pipelineBlockSamples];
+    float angle[pipelineBlockSamples];
+    float correctedSpeed[pipelineBlockSamples];
+    size_t bytes;
+    char text[pipelineBlockBytes];
+} pipelineBlock;
+
+// a source returns 1 once it has filled a block, 0 at the end of its input or -1 with errno
+// set, every other stage returns 0 or -1 with errno set
+typedef int (*pipelineFunction)(void* context, pipelineBlock* block);
+
+typedef struct
+{
+    const char* name;
+    pipelineFunction run;
+    void* context;
+    int workers;                // threads, more than 1 only if run can share its context
+} pipelineStage;
+
+// the source and each stage run on their own threads, joined by bounded queues of
+// queueBlocks blocks. A stage with no block to work on waits for its queue, a stage with
+// nowhere to put its block waits for room downstream, and the source waits for a block
+// to come free, so the slowest stage sets the pace and a stalled stage holds every stage
+// before it back. Blocks leave a stage with several workers in the order they entered it.
+typedef struct
+{
+    pipelineStage source;
+    pipelineStage stages[pipelineMaxStages];    // the last one is the sink
+    int stageCount;
+    int queueBlocks;            // 1 or more
+} pipelineConfig;
+
+typedef struct
+{
+    uint64_t blocks;
+    double busySeconds;         // in the stage's function, summed over its workers
+    double starvedSeconds;      // waiting for a block to work on
+    double blockedSeconds;      // waiting for room downstream
+} pipelineStageStats;
+
+typedef struct
+{
+    double seconds;
+    uint64_t samples;
+    pipelineStageStats source;
+    pipelineStageStats stages[pipelineMaxStages];
+} pipelineStats;
+
+// both return 0 once the source is exhausted and every block has passed the sink, or -1
+// with errno set by the first stage to fail (EINVAL for a bad configuration), stats may be
+// NULL. runPipelineSequentially runs the same stages one block at a time on the calling
+// thread, as the chain ran before, for comparison
+int runPipeline(const pipelineConfig* config, pipelineStats* stats);
+int runPipelineSequentially(const pipelineConfig* config, pipelineStats* stats);
+
+// stock stages for streaming a csv archive of timestamp,speed,direction lines
+
+// source, reads whole lines from fd, at most pipelineBlockSamples of them a block
+typedef struct
+{
+    int fd;
+    size_t carried;             // bytes of a partial line kept for the next block
+    char carry[pipelineBlockBytes];
+} pipelineTextSource;
+
+int readTextBlock(void* source, pipelineBlock* block);
+
+// turns the text into samples, lines that do not hold a timestamp, speed and direction
+// (headers) or hold a nan or inf speed or direction are skipped, the context is unused
+int parseWindBlock(void* context, pipelineBlock* block);
+
+// corrects the speeds with the vector kernel, the context is unused so any number of
+// workers can share it
+int correctWindBlock(void* context, pipelineBlock* block);
+
+// adds the corrected wind to a running vector mean and peak
+typedef struct
+{
+    windAccumulator wind;
+    float peak;
+} pipelineAggregate;
+
+int aggregateWindBlock(void* aggregate, pipelineBlock* block);
+
+// replaces the text with timestamp,corrected speed,direction lines, the context is unused
+int formatWindBlock(void* context, pipelineBlock* block);
+
+// sink, writes the text to the file descriptor the context points to
+int writeTextBlock(void* fd, pipelineBlock* block);
+
+#endif
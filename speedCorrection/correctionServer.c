@@ -0,0 +1,587 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Multi station correction server on a unix domain socket
+
+    One thread waits on every connection with epoll. Each request read is appended to the
+    batch, its readings to the batch's flat speed and angle arrays. The batch is corrected
+    when it holds batchReadings readings, when a timerfd armed as its first request
+    arrived expires, or at the end of every wakeup when maxDelayUs is 0. Correcting
+    counting sorts the readings by station into scratch arrays, so each station's
+    readings are corrected in one run with its profile, and the responses are sent
+    straight from the scratch arrays in the order the requests arrived.
+
+    Connection slots carry a generation, a request remembers its slot's generation when
+    it is read, so a response is never sent to a descriptor that closed and was reused
+    while its request waited in the batch.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "correctionServer.h"
+#include "interpolator.h"
+#include "simdCorrection.h"
+
+// epoll tags past the connection slots
+#define listenTag serverMaxConnections
+#define stopTag (serverMaxConnections+1)
+#define timerTag (serverMaxConnections+2)
+
+// requests read from one connection per wakeup, so a busy client can not starve the rest
+#define serverReadsPerWakeup 64
+
+#define serverEvents 64
+#define requestBytes (sizeof(serverRequest)+(serverMaxReadings*sizeof(serverReading)))
+
+typedef struct
+{
+    int fd;                     // -1 when the slot is free
+    uint32_t generation;
+} serverConnection;
+
+typedef struct
+{
+    uint32_t requestId;
+    uint32_t generation;
+    uint16_t connection;
+    uint16_t station;
+    uint16_t status;
+    uint16_t count;
+    uint32_t first;             // first reading in the batch, then in the scratch arrays
+} pendingRequest;
+
+struct correctionServer
+{
+    int batchReadings;
+    int maxDelayUs;
+    char socketPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    int bound;                  // the socket file is ours to remove
+    int listenFd;
+    int epollFd;
+    int timerFd;
+    int stopFd;
+
+    calibrationProfile* profiles[serverMaxStations];    // NULL for the default calibration
+    serverConnection connections[serverMaxConnections];
+
+    // the batch, readings in arrival order and again sorted by station
+    pendingRequest* requests;
+    int pendingRequests;
+    int pendingReadings;
+    float* speed;
+    float* angle;
+    float* sortedSpeed;
+    float* sortedAngle;
+    float* corrected;
+    uint32_t* stationReadings;  // per station, zero outside a correction
+    uint16_t* stations;         // stations in the batch
+
+    uint8_t buffer[requestBytes];
+    serverStats stats;
+};
+
+#define batchCapacity (serverMaxBatch+serverMaxReadings)
+
+correctionServer* createCorrectionServer(const serverConfig* config)
+{
+    struct sockaddr_un address;
+    if(!config->socketPath || strlen(config->socketPath)>=sizeof(address.sun_path) ||
+       config->batchReadings<1 || config->batchReadings>serverMaxBatch || config->maxDelayUs<0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    correctionServer* server = (correctionServer*)calloc(1,sizeof(correctionServer));
+    if(!server)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    server->batchReadings = config->batchReadings;
+    server->maxDelayUs = config->maxDelayUs;
+    strcpy(server->socketPath,config->socketPath);
+    server->listenFd = -1;
+    server->epollFd = -1;
+    server->timerFd = -1;
+    server->stopFd = -1;
+    for(int slot=0;slot<serverMaxConnections;slot++)
+    {
+        server->connections[slot].fd = -1;
+    }
+
+    server->requests = (pendingRequest*)malloc(batchCapacity*sizeof(pendingRequest));
+    server->speed = (float*)malloc(batchCapacity*sizeof(float));
+    server->angle = (float*)malloc(batchCapacity*sizeof(float));
+    server->sortedSpeed = (float*)malloc(batchCapacity*sizeof(float));
+    server->sortedAngle = (float*)malloc(batchCapacity*sizeof(float));
+    server->corrected = (float*)malloc(batchCapacity*sizeof(float));
+    server->stationReadings = (uint32_t*)calloc(serverMaxStations,sizeof(uint32_t));
+    server->stations = (uint16_t*)malloc(serverMaxStations*sizeof(uint16_t));
+    if(!server->requests || !server->speed || !server->angle || !server->sortedSpeed || !server->sortedAngle ||
+       !server->corrected || !server->stationReadings || !server->stations)
+    {
+        destroyCorrectionServer(server);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset(&address,0,sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path,config->socketPath);
+
+    // a socket left by an earlier server is replaced, anything else at the path is not ours
+    struct stat existing;
+    if(lstat(config->socketPath,&existing)==0)
+    {
+        if(!S_ISSOCK(existing.st_mode))
+        {
+            destroyCorrectionServer(server);
+            errno = EEXIST;
+            return NULL;
+        }
+        unlink(config->socketPath);
+    }
+
+    server->listenFd = socket(AF_UNIX,SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+    server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    server->timerFd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+    server->stopFd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    server->bound = (server->listenFd>=0 && bind(server->listenFd,(struct sockaddr*)&address,sizeof(address))==0);
+    if(server->listenFd<0 || server->epollFd<0 || server->timerFd<0 || server->stopFd<0 ||
+       !server->bound || listen(server->listenFd,SOMAXCONN)<0)
+    {
+        int error = errno;
+        destroyCorrectionServer(server);
+        errno = error;
+        return NULL;
+    }
+
+    const int fds[3] = {server->listenFd,server->stopFd,server->timerFd};
+    const uint32_t tags[3] = {listenTag,stopTag,timerTag};
+    for(int fd=0;fd<3;fd++)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = tags[fd];
+        if(epoll_ctl(server->epollFd,EPOLL_CTL_ADD,fds[fd],&event)<0)
+        {
+            int error = errno;
+            destroyCorrectionServer(server);
+            errno = error;
+            return NULL;
+        }
+    }
+
+    return server;
+}
+
+void destroyCorrectionServer(correctionServer* server)
+{
+    if(!server)
+    {
+        return;
+    }
+
+    for(int slot=0;slot<serverMaxConnections;slot++)
+    {
+        if(server->connections[slot].fd>=0)
+        {
+            close(server->connections[slot].fd);
+        }
+    }
+    const int fds[4] = {server->listenFd,server->epollFd,server->timerFd,server->stopFd};
+    for(int fd=0;fd<4;fd++)
+    {
+        if(fds[fd]>=0)
+        {
+            close(fds[fd]);
+        }
+    }
+    if(server->bound)
+    {
+        unlink(server->socketPath);
+    }
+    for(int station=0;station<serverMaxStations;station++)
+    {
+        free(server->profiles[station]);
+    }
+
+    free(server->requests);
+    free(server->speed);
+    free(server->angle);
+    free(server->sortedSpeed);
+    free(server->sortedAngle);
+    free(server->corrected);
+    free(server->stationReadings);
+    free(server->stations);
+    free(server);
+}
+
+int setStationProfile(correctionServer* server, int station, const calibrationProfile* profile)
+{
+    if(station<0 || station>=serverMaxStations)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // the default calibration goes through the vector kernel
+    calibrationProfile* copy = NULL;
+    if(profile && profile->generation!=defaultCalibrationProfile.generation)
+    {
+        void* memory = NULL;
+        if(posix_memalign(&memory,64,sizeof(calibrationProfile))!=0)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        copy = (calibrationProfile*)memory;
+        *copy = *profile;
+    }
+
+    free(server->profiles[station]);
+    server->profiles[station] = copy;
+    return 0;
+}
+
+static void closeConnection(correctionServer* server, int slot)
+{
+    close(server->connections[slot].fd);
+    server->connections[slot].fd = -1;
+    server->connections[slot].generation++;
+}
+
+static void acceptConnections(correctionServer* server)
+{
+    int fd;
+    while((fd = accept4(server->listenFd,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC))>=0)
+    {
+        int slot = 0;
+        while(slot<serverMaxConnections && server->connections[slot].fd>=0)
+        {
+            slot++;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = slot;
+        if(slot==serverMaxConnections || epoll_ctl(server->epollFd,EPOLL_CTL_ADD,fd,&event)<0)
+        {
+            close(fd);
+            continue;
+        }
+        server->connections[slot].fd = fd;
+        server->stats.connections++;
+    }
+}
+
+// corrects the batch a station at a time and responds to every request in it
+static void correctBatch(correctionServer* server)
+{
+    if(server->pendingRequests==0)
+    {
+        return;
+    }
+
+    // count each station's readings, then turn the counts into where each station's run starts
+    int stationCount = 0;
+    for(int request=0;request<server->pendingRequests;request++)
+    {
+        const pendingRequest* pending = &server->requests[request];
+        if(pending->count>0 && server->stationReadings[pending->station]==0)
+        {
+            server->stations[stationCount++] = pending->station;
+        }
+        server->stationReadings[pending->station] += pending->count;
+    }
+    uint32_t start = 0;
+    for(int station=0;station<stationCount;station++)
+    {
+        uint32_t readings = server->stationReadings[server->stations[station]];
+        server->stationReadings[server->stations[station]] = start;
+        start += readings;
+    }
+
+    for(int request=0;request<server->pendingRequests;request++)
+    {
+        pendingRequest* pending = &server->requests[request];
+        uint32_t sorted = server->stationReadings[pending->station];
+        memcpy(&server->sortedSpeed[sorted],&server->speed[pending->first],pending->count*sizeof(float));
+        memcpy(&server->sortedAngle[sorted],&server->angle[pending->first],pending->count*sizeof(float));
+        server->stationReadings[pending->station] = sorted+pending->count;
+        pending->first = sorted;
+    }
+
+    // each station's run now ends where the next one starts
+    start = 0;
+    for(int station=0;station<stationCount;station++)
+    {
+        uint32_t end = server->stationReadings[server->stations[station]];
+        const calibrationProfile* profile = server->profiles[server->stations[station]];
+        if(profile)
+        {
+            for(uint32_t reading=start;reading<end;reading++)
+            {
+                server->corrected[reading] = correctSpeed(profile,server->sortedSpeed[reading],server->sortedAngle[reading]);
+            }
+        }
+        else
+        {
+            correctSpeedSimd(&server->sortedSpeed[start],&server->sortedAngle[start],&server->corrected[start],end-start);
+        }
+        server->stationReadings[server->stations[station]] = 0;
+        start = end;
+    }
+
+    for(int request=0;request<server->pendingRequests;request++)
+    {
+        const pendingRequest* pending = &server->requests[request];
+        serverConnection* connection = &server->connections[pending->connection];
+        if(connection->fd<0 || connection->generation!=pending->generation)
+        {
+            continue;
+        }
+
+        serverResponse response = {pending->requestId,pending->status,pending->count};
+        struct iovec parts[2] = {{&response,sizeof(response)},{&server->corrected[pending->first],pending->count*sizeof(float)}};
+        struct msghdr message;
+        memset(&message,0,sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        if(sendmsg(connection->fd,&message,MSG_DONTWAIT|MSG_NOSIGNAL)<0)
+        {
+            // a client that leaves its responses unread is cut off rather than let the
+            // server's memory or latency grow
+            server->stats.dropped += (errno==EAGAIN || errno==EWOULDBLOCK) ? 1 : 0;
+            closeConnection(server,pending->connection);
+        }
+    }
+
+    server->stats.batches++;
+    server->pendingRequests = 0;
+    server->pendingReadings = 0;
+}
+
+static void readRequests(correctionServer* server, int slot)
+{
+    uint8_t* buffer = server->buffer;
+    serverConnection* connection = &server->connections[slot];
+
+    for(int read=0;read<serverReadsPerWakeup && connection->fd>=0;read++)
+    {
+        ssize_t length = recv(connection->fd,buffer,requestBytes,MSG_DONTWAIT|MSG_TRUNC);
+        if(length<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+        {
+            return;
+        }
+        if(length<(ssize_t)sizeof(serverRequest))
+        {
+            // closed, failed or not a request
+            closeConnection(server,slot);
+            return;
+        }
+
+        serverRequest request;
+        memcpy(&request,buffer,sizeof(request));
+        pendingRequest* pending = &server->requests[server->pendingRequests++];
+        pending->requestId = request.requestId;
+        pending->generation = connection->generation;
+        pending->connection = slot;
+        pending->station = request.station;
+        pending->first = server->pendingReadings;
+        pending->status = 0;
+        pending->count = request.count;
+        if(request.station>=serverMaxStations || request.count>serverMaxReadings ||
+           (size_t)length!=sizeof(serverRequest)+(request.count*sizeof(serverReading)))
+        {
+            pending->status = EINVAL;
+            pending->station = 0;
+            pending->count = 0;
+            server->stats.rejected++;
+        }
+
+        const uint8_t* reading = buffer+sizeof(serverRequest);
+        for(int sample=0;sample<pending->count;sample++,reading+=sizeof(serverReading))
+        {
+            serverReading unpacked;
+            memcpy(&unpacked,reading,sizeof(unpacked));
+            server->speed[server->pendingReadings+sample] = unpacked.rawSpeed;
+            server->angle[server->pendingReadings+sample] = unpacked.angle;
+        }
+        server->pendingReadings += pending->count;
+        server->stats.requests++;
+        server->stats.readings += pending->count;
+
+        if(server->pendingRequests==1 && server->maxDelayUs>0)
+        {
+            struct itimerspec deadline = {{0,0},{server->maxDelayUs/1000000,(server->maxDelayUs%1000000)*1000L}};
+            timerfd_settime(server->timerFd,0,&deadline,NULL);
+        }
+        if(server->pendingReadings>=server->batchReadings || server->pendingRequests>=serverMaxBatch)
+        {
+            correctBatch(server);
+        }
+    }
+}
+
+int runCorrectionServer(correctionServer* server)
+{
+    struct epoll_event events[serverEvents];
+    int stopping = 0;
+
+    while(!stopping)
+    {
+        int ready = epoll_wait(server->epollFd,events,serverEvents,-1);
+        if(ready<0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        for(int event=0;event<ready;event++)
+        {
+            uint64_t tag = events[event].data.u64;
+            uint64_t expired;
+            if(tag==listenTag)
+            {
+                acceptConnections(server);
+            }
+            else if(tag==stopTag)
+            {
+                stopping = 1;
+            }
+            else if(tag==timerTag)
+            {
+                // the timer may belong to a batch already corrected, a new batch only
+                // gets corrected sooner than it had to be
+                if(read(server->timerFd,&expired,sizeof(expired))==sizeof(expired))
+                {
+                    correctBatch(server);
+                }
+            }
+            else if(server->connections[tag].fd>=0)
+            {
+                readRequests(server,(int)tag);
+            }
+        }
+
+        if(server->maxDelayUs==0 || stopping)
+        {
+            correctBatch(server);
+        }
+    }
+
+    uint64_t stops;
+    if(read(server->stopFd,&stops,sizeof(stops))<0)
+    {
+        // nothing to drain
+    }
+    return 0;
+}
+
+void stopCorrectionServer(correctionServer* server)
+{
+    uint64_t stop = 1;
+    if(write(server->stopFd,&stop,sizeof(stop))<0)
+    {
+        // the counter is already set
+    }
+}
+
+void correctionServerStatistics(const correctionServer* server, serverStats* stats)
+{
+    *stats = server->stats;
+}
+
+int connectCorrectionServer(const char* socketPath)
+{
+    struct sockaddr_un address;
+    if(strlen(socketPath)>=sizeof(address.sun_path))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&address,0,sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path,socketPath);
+
+    int fd = socket(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0);
+    if(fd<0)
+    {
+        return -1;
+    }
+    if(connect(fd,(struct sockaddr*)&address,sizeof(address))<0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int sendReadings(int fd, uint32_t requestId, uint16_t station, const serverReading* readings, uint16_t count)
+{
+    serverRequest request = {requestId,station,count};
+    struct iovec parts[2] = {{&request,sizeof(request)},{(void*)readings,count*sizeof(serverReading)}};
+    struct msghdr message;
+    memset(&message,0,sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    return (sendmsg(fd,&message,MSG_NOSIGNAL)<0) ? -1 : 0;
+}
+
+int receiveCorrected(int fd, uint32_t* requestId, uint16_t* status, float* corrected)
+{
+    uint8_t buffer[sizeof(serverResponse)+(serverMaxReadings*sizeof(float))];
+    ssize_t length = recv(fd,buffer,sizeof(buffer),MSG_TRUNC);
+    if(length<=0)
+    {
+        errno = (length==0) ? ECONNRESET : errno;
+        return -1;
+    }
+
+    serverResponse response;
+    if(length<(ssize_t)sizeof(response))
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy(&response,buffer,sizeof(response));
+    if(response.count>serverMaxReadings || (size_t)length!=sizeof(response)+(response.count*sizeof(float)))
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    memcpy(corrected,buffer+sizeof(response),response.count*sizeof(float));
+    *requestId = response.requestId;
+    *status = response.status;
+    return response.count;
+}
@@ -0,0 +1,118 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionServer_h_
+#define _correctionServer_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calibrationProfile.h"
+
+// stations are numbered from 0, each can have its own calibration profile
+#define serverMaxStations 4096
+
+// most readings in one request and most readings the server holds back for one batch
+#define serverMaxReadings 256
+#define serverMaxBatch 65536
+
+// most clients connected at once
+#define serverMaxConnections 1024
+
+// corrects bursts of readings from many stations sent over a local SOCK_SEQPACKET socket
+//
+// a client sends a request message, a serverRequest followed by count serverReadings, and
+// gets back a response message, a serverResponse followed by count corrected speeds as
+// floats, in the order it sent its requests. A connection may carry readings for any
+// number of stations and may send further requests before the responses come back.
+//
+// the server holds readings back until batchReadings of them are waiting or the oldest
+// has waited maxDelayUs, then corrects the batch a station at a time with each station's
+// profile (stations without one use the default calibration, through the vector kernel)
+// and responds to every request in it. Corrections are bit identical to correctSpeed with
+// the station's profile.
+//
+// all integers are in the host's byte order, the socket never leaves the machine
+typedef struct __attribute__((packed))
+{
+    uint32_t requestId;         // echoed in the response
+    uint16_t station;
+    uint16_t count;             // readings that follow, at most serverMaxReadings
+} serverRequest;
+
+typedef struct __attribute__((packed))
+{
+    float rawSpeed;             // mph
+    float angle;                // degrees
+} serverReading;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t requestId;
+    uint16_t status;            // 0, or EINVAL for an unknown station or too many readings
+    uint16_t count;             // corrected speeds that follow, 0 unless status is 0
+} serverResponse;
+
+typedef struct
+{
+    const char* socketPath;     // a socket left there is replaced, anything else is an error
+    int batchReadings;          // 1 to serverMaxBatch
+    int maxDelayUs;             // 0 corrects whatever each wakeup has read
+} serverConfig;
+
+typedef struct
+{
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t readings;
+    uint64_t batches;
+    uint64_t rejected;          // requests answered with EINVAL
+    uint64_t dropped;           // clients disconnected for not reading their responses
+} serverStats;
+
+typedef struct correctionServer correctionServer;
+
+// binds and listens, returns NULL with errno set (EINVAL for a bad configuration, EEXIST
+// if something other than a socket is at the socket path)
+correctionServer* createCorrectionServer(const serverConfig* config);
+
+// removes the socket, the server must not be running
+void destroyCorrectionServer(correctionServer* server);
+
+// copies the profile for a station, NULL puts it back on the default calibration, only
+// while the server is not running, returns 0, or -1 with errno set to EINVAL
+int setStationProfile(correctionServer* server, int station, const calibrationProfile* profile);
+
+// serves clients on the calling thread until stopCorrectionServer, returns 0, or -1 with
+// errno set if waiting for clients fails
+int runCorrectionServer(correctionServer* server);
+
+// makes runCorrectionServer return once it has answered every request it has read, safe
+// from any thread and from a signal handler
+void stopCorrectionServer(correctionServer* server);
+
+// totals so far, only exact once runCorrectionServer has returned
+void correctionServerStatistics(const correctionServer* server, serverStats* stats);
+
+// client side, both return 0, or -1 with errno set
+int connectCorrectionServer(const char* socketPath);
+int sendReadings(int fd, uint32_t requestId, uint16_t station, const serverReading* readings, uint16_t count);
+
+// waits for the next response, corrected must hold serverMaxReadings, returns the number
+// of corrected speeds, or -1 with errno set (EPROTO for a malformed response)
+int receiveCorrected(int fd, uint32_t* requestId, uint16_t* status, float* corrected);
+
+#endif
@@ -0,0 +1,591 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Checks every accelerated correction path against the reference correctSpeed (the
+    smooth batch against correctSpeedSmooth, and the inverse by correcting and undoing)
+    over
+
+        every whole mph from 0 to 255 at every whole degree from 0 to 359
+        the speed sites and the angle sites, the floats either side of them, and
+        negative, huge, infinite and NaN speeds and angles in every combination
+        a dense grid from -4 to 300 mph and 0 to 360 degrees
+        random samples, mostly over -10->1100 mph and -360->720 degrees, the rest
+        random bit patterns
+
+    and prints a DIFF: line for each path with the worst error and the failures, exiting
+    1 if any path strays past its tolerance. Each path is only checked over the inputs
+    its header promises to handle, e.g. a lattice over 0->255 mph and 0->360 degrees.
+
+    usage: differentialTest [-j threads] [-u ulps] [-e tenths] [-g steps] [-a steps] [-n samples] [-s seed]
+
+        -j threads  threads sweeping (default every processor)
+        -u ulps     tolerance of every path compared in ulps (default each path's own,
+                    0 for the paths documented as bit identical)
+        -e tenths   tolerance of every path compared in tenths of a mph (default each
+                    path's own)
+        -g steps    grid steps per mph (default 16)
+        -a steps    grid steps per degree (default 4)
+        -n samples  random samples (default 4194304)
+        -s seed     seed of the random samples (default 1)
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "differentialHarness.h"
+#include "interpolator.h"
+#include "davisCalibration.h"
+#include "simdCorrection.h"
+#include "correctionLattice.h"
+#include "parallelCorrection.h"
+#include "calibrationProfile.h"
+#include "correctionCache.h"
+#include "smoothCorrection.h"
+#include "inverseCorrection.h"
+#include "packedProfile.h"
+
+#define differentialBlockSamples 4096
+
+// stations the station batch is swept across, every one the default packed profile
+#define differentialStations 4096
+#define differentialMaxPaths 24
+
+// inputs a path is checked over
+typedef enum
+{
+    domainAny = 0,              // every float, NaN and infinity included
+    domainLattice,              // 0->latticeMaxSpeed mph and 0->360 degrees
+    domainWhole,                // whole mph from 0 to 255 and whole degrees from 0 to 359
+    domainCalibrated,           // 0->999 mph (the top site) and 0->360 degrees
+    domainCount
+} inputDomain;
+
+// what a path's results are compared with
+typedef enum
+{
+    referenceLinear = 0,        // correctSpeed
+    referenceSmooth,            // correctSpeedSmooth
+    referenceRaw                // the raw speed, for paths that correct and undo
+} pathReference;
+
+typedef void (*pathFunction)(const float* rawSpeed, const float* angle, float* __restrict result, size_t count);
+
+typedef struct
+{
+    char name[24];
+    pathFunction run;
+    inputDomain domain;
+    pathReference reference;
+    differentialUnits units;
+    double tolerance;
+} differentialPath;
+
+// sections of the sweep, laid end to end in sample position
+typedef enum
+{
+    sectionWhole = 0,
+    sectionEdge,
+    sectionGrid,
+    sectionFuzz,
+    sectionCount
+} sweepSection;
+
+static const char* const sectionNames[sectionCount] = {"whole","edge","grid","fuzz"};
+
+typedef struct
+{
+    uint64_t samples[sectionCount];
+    uint64_t firstBlock[sectionCount+1];
+    int gridSpeedSteps;
+    int gridAngleSteps;
+    uint64_t gridSpeeds;
+    uint64_t gridAngles;
+    uint64_t seed;
+} sweepLayout;
+
+static float edgeSpeeds[4*correctionTableSize+32];
+static int edgeSpeedCount;
+static float edgeAngles[64];
+static int edgeAngleCount;
+
+static correctionLattice unitLattice;
+static correctionPool* pool;
+static correctionCache* cache;
+static packedProfile stations[differentialStations];
+
+static void addEdge(float* edges, int* count, float value)
+{
+    edges[(*count)++] = value;
+}
+
+static void addEdgeNeighbours(float* edges, int* count, float value)
+{
+    addEdge(edges,count,nextafterf(value,-INFINITY));
+    addEdge(edges,count,value);
+    addEdge(edges,count,nextafterf(value,INFINITY));
+}
+
+static void buildEdges(void)
+{
+    for(int site=0;site<correctionTableSize;site++)
+    {
+        addEdgeNeighbours(edgeSpeeds,&edgeSpeedCount,correctionTable[site][0]);
+    }
+    const float speeds[] = {-0.0f,-1e-30f,-1.0f,-100.0f,1e-40f,FLT_MIN,0.5f,255.0f,255.5f,256.0f,1e4f,1e6f,1e30f,FLT_MAX,
+                            -FLT_MAX,INFINITY,-INFINITY,NAN};
+    for(size_t speed=0;speed<(sizeof(speeds)/sizeof(speeds[0]));speed++)
+    {
+        addEdge(edgeSpeeds,&edgeSpeedCount,speeds[speed]);
+    }
+
+    for(int site=0;site<=360;site+=90)
+    {
+        addEdgeNeighbours(edgeAngles,&edgeAngleCount,site);
+    }
+    const float angles[] = {-0.0f,-1e-30f,-90.0f,-360.0f,45.0f,135.0f,359.5f,450.0f,540.0f,720.0f,1e6f,INFINITY,-INFINITY,NAN};
+    for(size_t angle=0;angle<(sizeof(angles)/sizeof(angles[0]));angle++)
+    {
+        addEdge(edgeAngles,&edgeAngleCount,angles[angle]);
+    }
+}
+
+static void layoutSweep(sweepLayout* layout, int gridSpeedSteps, int gridAngleSteps, uint64_t fuzzSamples, uint64_t seed)
+{
+    layout->gridSpeedSteps = gridSpeedSteps;
+    layout->gridAngleSteps = gridAngleSteps;
+    layout->gridSpeeds = (304*(uint64_t)gridSpeedSteps)+1;
+    layout->gridAngles = (360*(uint64_t)gridAngleSteps)+1;
+    layout->seed = seed;
+
+    layout->samples[sectionWhole] = 256*360;
+    layout->samples[sectionEdge] = (uint64_t)edgeSpeedCount*edgeAngleCount;
+    layout->samples[sectionGrid] = layout->gridSpeeds*layout->gridAngles;
+    layout->samples[sectionFuzz] = fuzzSamples;
+    layout->firstBlock[0] = 0;
+    for(int section=0;section<sectionCount;section++)
+    {
+        uint64_t blocks = (layout->samples[section]+differentialBlockSamples-1)/differentialBlockSamples;
+        layout->firstBlock[section+1] = layout->firstBlock[section]+blocks;
+    }
+}
+
+// the samples of one block and the position of its first sample, returns the sample count
+static size_t fillBlock(const sweepLayout* layout, uint64_t block, float* rawSpeed, float* angle, uint64_t* position)
+{
+    int section = 0;
+    while(block>=layout->firstBlock[section+1])
+    {
+        section++;
+    }
+    uint64_t first = (block-layout->firstBlock[section])*differentialBlockSamples;
+    uint64_t remaining = layout->samples[section]-first;
+    size_t count = (remaining<differentialBlockSamples) ? remaining : differentialBlockSamples;
+
+    *position = first;
+    for(int earlier=0;earlier<section;earlier++)
+    {
+        *position += layout->samples[earlier];
+    }
+
+    uint64_t state = differentialSeed(layout->seed,block);
+    for(size_t sample=0;sample<count;sample++)
+    {
+        uint64_t index = first+sample;
+        switch(section)
+        {
+            case sectionWhole:
+                rawSpeed[sample] = index/360;
+                angle[sample] = index%360;
+                break;
+            case sectionEdge:
+                rawSpeed[sample] = edgeSpeeds[index/edgeAngleCount];
+                angle[sample] = edgeAngles[index%edgeAngleCount];
+                break;
+            case sectionGrid:
+                rawSpeed[sample] = -4.0f+((float)(index/layout->gridAngles)/layout->gridSpeedSteps);
+                angle[sample] = (float)(index%layout->gridAngles)/layout->gridAngleSteps;
+                break;
+            default:
+                if((differentialNext(&state)&3)==0)
+                {
+                    uint32_t bits = (uint32_t)differentialNext(&state);
+                    memcpy(&rawSpeed[sample],&bits,sizeof(bits));
+                    bits = (uint32_t)differentialNext(&state);
+                    memcpy(&angle[sample],&bits,sizeof(bits));
+                }
+                else
+                {
+                    rawSpeed[sample] = -10.0+(1110.0*differentialUniform(&state));
+                    angle[sample] = -360.0+(1080.0*differentialUniform(&state));
+                }
+                break;
+        }
+    }
+    return count;
+}
+
+static int inDomain(inputDomain domain, float rawSpeed, float angle)
+{
+    switch(domain)
+    {
+        case domainLattice:
+            return rawSpeed>=0.0f && rawSpeed<=latticeMaxSpeed && angle>=0.0f && angle<=360.0f;
+        case domainWhole:
+            return rawSpeed>=0.0f && rawSpeed<=255.0f && angle>=0.0f && angle<360.0f && rawSpeed==floorf(rawSpeed) && angle==floorf(angle);
+        case domainCalibrated:
+            return rawSpeed>=0.0f && rawSpeed<=999.0f && angle>=0.0f && angle<=360.0f;
+        default:
+            return 1;
+    }
+}
+
+static void runBatch(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedBatch(rawSpeed,angle,result,count);
+}
+
+static void runBatchInPlace(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    memcpy(result,rawSpeed,count*sizeof(float));
+    correctSpeedBatchInPlace(result,angle,count);
+}
+
+static void runBinned(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedBinned(rawSpeed,angle,result,count);
+}
+
+static void runSimdSse2(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedSimdLevel(simdSse2,rawSpeed,angle,result,count);
+}
+
+static void runSimdAvx2(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedSimdLevel(simdAvx2,rawSpeed,angle,result,count);
+}
+
+static void runSimdNeon(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedSimdLevel(simdNeon,rawSpeed,angle,result,count);
+}
+
+static void runParallel(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedParallel(pool,rawSpeed,angle,result,count);
+}
+
+static void runTemplate(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeed<davisFloatTable>(rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runProfile(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeed(&defaultCalibrationProfile,rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runPacked(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeedPacked(&defaultPackedProfile,rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runPackedBatch(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedPackedBatch(&defaultPackedProfile,rawSpeed,angle,result,count);
+}
+
+static void runPackedStations(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    uint16_t station[differentialBlockSamples];
+    for(size_t sample=0;sample<count;sample++)
+    {
+        station[sample] = (sample*7919)%differentialStations;
+    }
+    correctStationsPacked(stations,station,rawSpeed,angle,result,count);
+}
+
+static void runCache(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeedCached(cache,rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runLatticeNode(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeedLatticeNode(&unitLattice,(int)rawSpeed[sample],(int)angle[sample]);
+    }
+}
+
+static void runLattice(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedLatticeBatch(&unitLattice,rawSpeed,angle,result,count);
+}
+
+static void runSmoothBatch(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    correctSpeedSmoothBatch(&defaultSmoothCorrection,rawSpeed,angle,result,count);
+}
+
+static void runInverse(const float* rawSpeed, const float* angle, float* __restrict result, size_t count)
+{
+    float corrected[differentialBlockSamples];
+    correctSpeedBatch(rawSpeed,angle,corrected,count);
+    uncorrectSpeedBatch(&defaultInverseCorrection,corrected,angle,result,count);
+}
+
+static int pathCount;
+static differentialPath paths[differentialMaxPaths];
+
+static void addPath(const char* name, pathFunction run, inputDomain domain, pathReference reference, differentialUnits units, double tolerance)
+{
+    differentialPath* path = &paths[pathCount++];
+    snprintf(path->name,sizeof(path->name),"%s",name);
+    path->run = run;
+    path->domain = domain;
+    path->reference = reference;
+    path->units = units;
+    path->tolerance = tolerance;
+}
+
+static void addPaths(void)
+{
+    addPath("batch",runBatch,domainAny,referenceLinear,differentialUlps,0);
+    addPath("batch-inplace",runBatchInPlace,domainAny,referenceLinear,differentialUlps,0);
+    addPath("binned",runBinned,domainAny,referenceLinear,differentialUlps,0);
+    const pathFunction simdRuns[simdLevelCount] = {NULL,runSimdSse2,runSimdAvx2,runSimdNeon};
+    for(int level=simdSse2;level<simdLevelCount;level++)
+    {
+        if(simdLevelSupported((simdLevel)level))
+        {
+            char name[24];
+            snprintf(name,sizeof(name),"simd-%s",simdLevelName((simdLevel)level));
+            addPath(name,simdRuns[level],domainAny,referenceLinear,differentialUlps,simdUlpTolerance);
+        }
+    }
+    addPath("parallel",runParallel,domainAny,referenceLinear,differentialUlps,simdUlpTolerance);
+    addPath("template",runTemplate,domainAny,referenceLinear,differentialUlps,0);
+    addPath("profile",runProfile,domainAny,referenceLinear,differentialUlps,0);
+    addPath("packed",runPacked,domainAny,referenceLinear,differentialUlps,0);
+    addPath("packed-batch",runPackedBatch,domainAny,referenceLinear,differentialUlps,0);
+    addPath("packed-stations",runPackedStations,domainAny,referenceLinear,differentialUlps,0);
+    addPath("cache",runCache,domainAny,referenceLinear,differentialUlps,0);
+    addPath("lattice-node",runLatticeNode,domainWhole,referenceLinear,differentialUlps,0);
+    addPath("lattice",runLattice,domainLattice,referenceLinear,differentialTenths,0.001);
+    addPath("smooth-batch",runSmoothBatch,domainAny,referenceSmooth,differentialUlps,smoothUlpTolerance);
+    addPath("inverse",runInverse,domainCalibrated,referenceRaw,differentialTenths,0.01);
+}
+
+static float referenceSpeed(pathReference reference, float rawSpeed, float angle)
+{
+    switch(reference)
+    {
+        case referenceSmooth:
+            return correctSpeedSmooth(rawSpeed,angle);
+        case referenceRaw:
+            return rawSpeed;
+        default:
+            return correctSpeed(rawSpeed,angle);
+    }
+}
+
+// the samples of a block in each domain and their positions
+typedef struct
+{
+    size_t count;
+    float rawSpeed[differentialBlockSamples];
+    float angle[differentialBlockSamples];
+    uint64_t position[differentialBlockSamples];
+} domainSamples;
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: differentialTest [-j threads] [-u ulps] [-e tenths] [-g steps] [-a steps] [-n samples] [-s seed]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double ulpTolerance = -1.0;
+    double tenthsTolerance = -1.0;
+    int gridSpeedSteps = 16;
+    int gridAngleSteps = 4;
+    uint64_t fuzzSamples = 1<<22;
+    uint64_t seed = 1;
+    int option;
+
+    while((option = getopt(argc,argv,"j:u:e:g:a:n:s:"))!=-1)
+    {
+        switch(option)
+        {
+            case 'j':
+                threadCount = atoi(optarg);
+                break;
+            case 'u':
+                ulpTolerance = atof(optarg);
+                break;
+            case 'e':
+                tenthsTolerance = atof(optarg);
+                break;
+            case 'g':
+                gridSpeedSteps = atoi(optarg);
+                break;
+            case 'a':
+                gridAngleSteps = atoi(optarg);
+                break;
+            case 'n':
+                fuzzSamples = strtoull(optarg,NULL,0);
+                break;
+            case 's':
+                seed = strtoull(optarg,NULL,0);
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if(optind!=argc || threadCount<1 || gridSpeedSteps<1 || gridAngleSteps<1)
+    {
+        usage();
+        return 2;
+    }
+    threadCount = (threadCount>differentialMaxThreads) ? differentialMaxThreads : threadCount;
+
+    float* latticeStorage = (float*)malloc(correctionLatticeBytes(1.0f,1.0f));
+    pool = createCorrectionPool(2);
+    cache = createCorrectionCache(cacheMaxEntries);
+    if(!latticeStorage || !pool || !cache)
+    {
+        fprintf(stderr,"differentialTest: can not create the lattice, correction pool and cache\n");
+        return 1;
+    }
+    buildCorrectionLattice(&unitLattice,latticeStorage,1.0f,1.0f);
+    for(int station=0;station<differentialStations;station++)
+    {
+        stations[station] = defaultPackedProfile;
+    }
+
+    buildEdges();
+    addPaths();
+    for(int path=0;path<pathCount;path++)
+    {
+        double tolerance = (paths[path].units==differentialUlps) ? ulpTolerance : tenthsTolerance;
+        paths[path].tolerance = (tolerance>=0.0) ? tolerance : paths[path].tolerance;
+    }
+
+    sweepLayout layout;
+    layoutSweep(&layout,gridSpeedSteps,gridAngleSteps,fuzzSamples,seed);
+    uint64_t totalSamples = 0;
+    for(int section=0;section<sectionCount;section++)
+    {
+        printf("DIFF:section %-8s %12llu samples\n",sectionNames[section],(unsigned long long)layout.samples[section]);
+        totalSamples += layout.samples[section];
+    }
+
+    static differentialTally totals[differentialMaxPaths];
+    for(int path=0;path<pathCount;path++)
+    {
+        differentialReset(&totals[path]);
+    }
+    pthread_mutex_t totalsLock = PTHREAD_MUTEX_INITIALIZER;
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    int result = differentialRunBlocks(threadCount,layout.firstBlock[sectionCount],[&](uint64_t block)
+    {
+        float rawSpeed[differentialBlockSamples];
+        float angle[differentialBlockSamples];
+        float corrected[differentialBlockSamples];
+        uint64_t first;
+        size_t count = fillBlock(&layout,block,rawSpeed,angle,&first);
+
+        domainSamples domains[domainCount];
+        for(int domain=0;domain<domainCount;domain++)
+        {
+            domains[domain].count = 0;
+            for(size_t sample=0;sample<count;sample++)
+            {
+                if(inDomain((inputDomain)domain,rawSpeed[sample],angle[sample]))
+                {
+                    size_t index = domains[domain].count++;
+                    domains[domain].rawSpeed[index] = rawSpeed[sample];
+                    domains[domain].angle[index] = angle[sample];
+                    domains[domain].position[index] = first+sample;
+                }
+            }
+        }
+
+        differentialTally tallies[differentialMaxPaths];
+        for(int path=0;path<pathCount;path++)
+        {
+            const differentialPath* check = &paths[path];
+            const domainSamples* samples = &domains[check->domain];
+            differentialReset(&tallies[path]);
+            check->run(samples->rawSpeed,samples->angle,corrected,samples->count);
+            for(size_t sample=0;sample<samples->count;sample++)
+            {
+                float expected = referenceSpeed(check->reference,samples->rawSpeed[sample],samples->angle[sample]);
+                differentialCompare(&tallies[path],check->units,check->tolerance,samples->position[sample],
+                                    samples->rawSpeed[sample],samples->angle[sample],corrected[sample],expected);
+            }
+        }
+
+        pthread_mutex_lock(&totalsLock);
+        for(int path=0;path<pathCount;path++)
+        {
+            differentialMerge(&totals[path],&tallies[path]);
+        }
+        pthread_mutex_unlock(&totalsLock);
+    });
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    if(result<0)
+    {
+        fprintf(stderr,"differentialTest: could not start every thread, the sweep ran on fewer\n");
+    }
+
+    uint64_t failures = 0;
+    for(int path=0;path<pathCount;path++)
+    {
+        failures += differentialReport(paths[path].name,paths[path].units,paths[path].tolerance,&totals[path]);
+    }
+    double seconds = (end.tv_sec-start.tv_sec)+((end.tv_nsec-start.tv_nsec)*1e-9);
+    printf("DIFF:%llu samples across %d paths on %d threads in %.2f s, %llu failures\n",(unsigned long long)totalSamples,pathCount,
+           threadCount,seconds,(unsigned long long)failures);
+
+    destroyCorrectionCache(cache);
+    destroyCorrectionPool(pool);
+    free(latticeStorage);
+
+    return failures ? 1 : 0;
+}
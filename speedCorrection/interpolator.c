@@ -28,48 +28,142 @@
     Fergus Duncan (github : @fergusd)
 */
 
+#include <string.h>
 #include "interpolator.h"
+#include "davisCalibration.h"
+#include "correctionInstrumentation.h"
 
-#define correctionTableSize  29
 #define speedIndex 0
 #define zeroDegreeIndex 1
 #define ninetyDegreeIndex 2
 #define oneeightyDegreeIndex 3
 
-// from http://www.davis-tr.com/Downloads/Davis_Rzgr_Kepceleri_Karakteristikleri.pdf
-
-float correctionTable[correctionTableSize][4] = {{0,0.0,0.0,0.0}, // simplifies algorithm - causes zero correction at zero speed
-                                                 {20,3.3,-2.3,-3.6},
-                                                 {25,3.5,-2.7,-4.6},
-                                                 {30,3.8,-2.9,-4.8},
-                                                 {35,4.2,-3.4,-5.3},
-                                                 {40,4.5,-4.1,-5.7},
-                                                 {45,4.7,-3.8,-4.5},
-                                                 {50,5.0,-4.5,-4.9},
-                                                 {55,5.3,-4.8,-5.2},
-                                                 {60,5.7,-5.3,-5.9},
-                                                 {65,5.8,-6.0,-6.0},
-                                                 {70,6.2,-5.6,-6.1},
-                                                 {75,6.4,-6.0,-6.8},
-                                                 {80,6.8,-6.4,-6.9},
-                                                 {85,7.1,-7.4,-6.8},
-                                                 {90,7.4,-8.0,-6.8},
-                                                 {95,7.5,-8.1,-7.5},
-                                                 {100,7.7,-7.9,-7.2},
-                                                 {105,8.2,-8.1,-7.7},
-                                                 {110,8.5,-8.5,-7.7},
-                                                 {115,8.9,-8.8,-8.5},
-                                                 {120,9.5,-9.4,-9.0},
-                                                 {125,10.0,-9.6,-9.8},
-                                                 {130,9.8,-9.8,-10.3},
-                                                 {135,9.8,-10.0,-11.0},
-                                                 {140,9.3,-10.2,-11.3},
-                                                 {145,9.5,-10.9,-10.5},
-                                                 {150,9.8,-12.1,-12.0},
-                                                 {999,9.8,-12.1,-12.0}}; // simplifies algorithm - maintains same correction above 150
+// the table is generated at compile time from the calibration in davisCalibration.h
+const float (&correctionTable)[correctionTableSize][4] = davisFloatTable::table.rows;
+
+#define siteSpeed(index,site) ((index)->sites[(site)*(index)->siteStride])
+
+speedSiteIndex buildSpeedSiteIndex(const float* sites, int siteStride, int siteCount)
+{
+    speedSiteIndex index;
+    index.sites = sites;
+    index.siteStride = siteStride;
+    index.siteCount = siteCount;
+
+    // find the longest run of equally spaced sites, it must cover at least two intervals
+    // to be worth using, otherwise every lookup falls back to the binary search
+    index.uniformLow = 0;
+    index.uniformHigh = 0;
+    int runStart = 0;
+    for(int site=1;site<siteCount;site++)
+    {
+        float spacing = siteSpeed(&index,site)-siteSpeed(&index,site-1);
+        float runSpacing = siteSpeed(&index,runStart+1)-siteSpeed(&index,runStart);
+        if((site-runStart)>1 && spacing!=runSpacing)
+        {
+            runStart = site-1;
+        }
+
+        if((site-runStart)>=2 && (site-runStart)>(index.uniformHigh-index.uniformLow))
+        {
+            index.uniformLow = runStart;
+            index.uniformHigh = site;
+        }
+    }
+
+    if(index.uniformHigh>index.uniformLow)
+    {
+        index.uniformOrigin = siteSpeed(&index,index.uniformLow);
+        index.uniformLimit = siteSpeed(&index,index.uniformHigh);
+        index.uniformScale = 1.0f/(siteSpeed(&index,index.uniformLow+1)-index.uniformOrigin);
+    }
+    else
+    {
+        // no uniform run, an empty range sends every speed to the binary search
+        index.uniformOrigin = siteSpeed(&index,0);
+        index.uniformLimit = siteSpeed(&index,0);
+        index.uniformScale = 0.0;
+    }
+
+    return index;
+}
+
+int findSpeedSite(const speedSiteIndex* index, float rawSpeed)
+{
+    int site = 0;
+
+    if(rawSpeed>index->uniformOrigin && rawSpeed<=index->uniformLimit)
+    {
+        // the site above the speed follows directly from the spacing, the two compares
+        // fix up the candidate if rounding in the scaling put it one site out either way
+        int offset = (int)((rawSpeed-index->uniformOrigin)*index->uniformScale);
+        site = index->uniformLow+offset+1;
+        site = (site>index->uniformHigh) ? index->uniformHigh : site;
+        site += (rawSpeed>siteSpeed(index,site)) ? 1 : 0;
+        site -= (rawSpeed<=siteSpeed(index,site-1)) ? 1 : 0;
+    }
+    else
+    {
+        // binary search for the first site at or above the speed on whichever side of the
+        // equally spaced run the speed lies, speeds beyond the last site (and NaN) end on
+        // the last site as the linear search does
+        int low = 0;
+        int high = index->uniformLow;
+        if(!(rawSpeed<=index->uniformOrigin))
+        {
+            low = index->uniformHigh;
+            high = index->siteCount-1;
+        }
+        while(low<high)
+        {
+            int middle = (low+high)/2;
+            if(rawSpeed<=siteSpeed(index,middle))
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle+1;
+            }
+        }
+        site = low;
+    }
+
+    // zero (or negative) speeds overshoot on the first site, keep the low site in the table
+    return (site<1) ? 1 : site;
+}
+
+int scanSpeedSite(const speedSiteIndex* index, float rawSpeed)
+{
+    int site = 0;
+
+    for(site=0;site<(index->siteCount-1);site++)
+    {
+        if((rawSpeed-siteSpeed(index,site))<=0.0)
+        {
+            // overshot
+            break;
+        }
+    }
+
+    return (site<1) ? 1 : site;
+}
+
+// the index of the generated table, filled in at compile time rather than by buildSpeedSiteIndex
+static constexpr davisSiteRun defaultRun = davisFloatTable::run;
+static constexpr float defaultOrigin = davisFloatTable::table.rows[defaultRun.low][speedIndex];
+static const speedSiteIndex defaultSiteIndex = {&davisFloatTable::table.rows[0][speedIndex],
+                                                4,
+                                                correctionTableSize,
+                                                defaultRun.low,
+                                                defaultRun.high,
+                                                defaultOrigin,
+                                                davisFloatTable::table.rows[defaultRun.high][speedIndex],
+                                                1.0f/(davisFloatTable::table.rows[defaultRun.low+1][speedIndex]-defaultOrigin)};
 
 float correctSpeed(float rawSpeed, float angle)
 {
+    instrumentBegin();
     float calculatedSpeed = 0.0;
 
     // find the closest speed site in the correction table
@@ -90,17 +184,7 @@ float correctSpeed(float rawSpeed, float angle)
     // calculate the speed sites to be used in the calculation
     // speedIndexHigh will be the speed site above the input speed
     // speedIndexLow will be the speed site below the input speed
-    for(int index=0;index<correctionTableSize;index++)
-    {
-        if((rawSpeed-correctionTable[index][speedIndex])<=0.0)
-        {
-            // overshot
-            speedIndexHigh = index;
-            break;
-        }
-
-        speedIndexHigh = index;
-    }
+    speedIndexHigh = findSpeedSite(&defaultSiteIndex,rawSpeed);
 
     speedIndexLow = speedIndexHigh-1;
 
@@ -144,6 +228,171 @@ float correctSpeed(float rawSpeed, float angle)
         calculatedSpeed += rawSpeed;
     }
 
+    instrumentEnd(speedIndexHigh,rawSpeed,angle);
     return calculatedSpeed;
 }
 
+// branch free version of the correctSpeed calculation, every step is performed in the
+// same order and precision as correctSpeed so the results are bit identical, but the
+// site search and angle sector selection are done with compares and selects rather
+// than with a loop exit and an if/else so the compiler can vectorise across samples
+static inline float correctSample(float rawSpeed, float angle)
+{
+    const float* table = &correctionTable[0][0];
+
+    // calculate the angle to be used in the calculation, 360-angle is exact so this matches
+    // the double precision fold in correctSpeed, and picking the smaller of the two keeps the
+    // subtraction outside the select so it is not turned back into a branch
+    float foldedAngle = 360.0f-angle;
+    float correctionAngle = (foldedAngle<angle) ? foldedAngle : angle;
+
+    // count the speed sites below the input speed, this is the index the linear search
+    // in correctSpeed stops at, the table is indexed flat so the loads become gathers
+    int speedIndexHigh = 0;
+#pragma GCC unroll 32
+    for(int index=0;index<correctionTableSize;index++)
+    {
+        speedIndexHigh += (rawSpeed>correctionTable[index][speedIndex]) ? 1 : 0;
+    }
+
+    speedIndexHigh = (speedIndexHigh<1) ? 1 : speedIndexHigh;
+    speedIndexHigh = (speedIndexHigh>(correctionTableSize-1)) ? (correctionTableSize-1) : speedIndexHigh;
+    int rowHigh = speedIndexHigh*4;
+    int rowLow = rowHigh-4;
+
+    float speedDelta = (table[rowHigh+speedIndex]-table[rowLow+speedIndex]);
+    float speedOffset = (rawSpeed-table[rowLow+speedIndex]);
+    float speedFactor = (speedOffset/speedDelta);
+
+    // 0->90 uses the 0 and 90 degree columns, 90->180 uses the 90 and 180 degree columns
+    int upperSector = (correctionAngle<=90.0f) ? 0 : 1;
+    int angleIndex = zeroDegreeIndex+upperSector;
+    double angleOrigin = 90.0*upperSector;
+    float angleFactor = ((correctionAngle-angleOrigin)/90.0);
+
+    float speedCorrectionLow = (table[rowLow+angleIndex+1]-table[rowLow+angleIndex]);
+    speedCorrectionLow *= angleFactor;
+    speedCorrectionLow += table[rowLow+angleIndex];
+    float speedCorrectionHigh = (table[rowHigh+angleIndex+1]-table[rowHigh+angleIndex]);
+    speedCorrectionHigh *= angleFactor;
+    speedCorrectionHigh += table[rowHigh+angleIndex];
+
+    float calculatedSpeed = ((speedCorrectionHigh-speedCorrectionLow)*speedFactor)+speedCorrectionLow;
+    calculatedSpeed += rawSpeed;
+
+    return calculatedSpeed;
+}
+
+void correctSpeedBatch(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        correctedSpeed[sample] = correctSample(rawSpeed[sample],angle[sample]);
+    }
+}
+
+void correctSpeedBatchInPlace(float* __restrict speed, const float* angle, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        speed[sample] = correctSample(speed[sample],angle[sample]);
+    }
+}
+
+float correctSpeedRolling(rollingStatistics* statistics, float rawSpeed, float angle)
+{
+    float correctedSpeed = correctSample(rawSpeed,angle);
+    pushRollingSpeed(statistics,correctedSpeed);
+    return correctedSpeed;
+}
+
+// samples binned at a time by correctSpeedBinned and the bins, one per speed site interval
+// and angle sector
+#define binnedBlockSamples 1024
+#define binCount (2*(correctionTableSize-1))
+
+void correctSpeedBinned(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    const float* table = &correctionTable[0][0];
+    uint8_t bins[binnedBlockSamples];
+    uint16_t order[binnedBlockSamples];
+    float sortedSpeed[binnedBlockSamples];
+    float sortedAngle[binnedBlockSamples];
+    float sortedCorrected[binnedBlockSamples];
+
+    for(size_t blockStart=0;blockStart<count;blockStart+=binnedBlockSamples)
+    {
+        size_t blockCount = count-blockStart;
+        blockCount = (blockCount>binnedBlockSamples) ? binnedBlockSamples : blockCount;
+        const float* blockSpeed = rawSpeed+blockStart;
+        const float* blockAngle = angle+blockStart;
+
+        // bin every sample by the site above its speed and the sector of its folded angle,
+        // folded as correctSample folds it
+        uint16_t binStart[binCount+1] = {};
+        for(size_t sample=0;sample<blockCount;sample++)
+        {
+            float foldedAngle = 360.0f-blockAngle[sample];
+            float correctionAngle = (foldedAngle<blockAngle[sample]) ? foldedAngle : blockAngle[sample];
+            int upperSector = (correctionAngle<=90.0f) ? 0 : 1;
+            int bin = (upperSector*(correctionTableSize-1))+findSpeedSite(&defaultSiteIndex,blockSpeed[sample])-1;
+            bins[sample] = bin;
+            binStart[bin+1]++;
+        }
+        for(int bin=0;bin<binCount;bin++)
+        {
+            binStart[bin+1] += binStart[bin];
+        }
+
+        // gather each bin's samples together, counting sort so each bin keeps its order
+        uint16_t binNext[binCount];
+        memcpy(binNext,binStart,sizeof(binNext));
+        for(size_t sample=0;sample<blockCount;sample++)
+        {
+            uint16_t position = binNext[bins[sample]]++;
+            float foldedAngle = 360.0f-blockAngle[sample];
+            order[position] = sample;
+            sortedSpeed[position] = blockSpeed[sample];
+            sortedAngle[position] = (foldedAngle<blockAngle[sample]) ? foldedAngle : blockAngle[sample];
+        }
+
+        // within a bin the rows and columns are fixed, so the loop has no data dependent
+        // branches and loads, each step is as correctSample performs it
+        for(int bin=0;bin<binCount;bin++)
+        {
+            int upperSector = (bin>=(correctionTableSize-1)) ? 1 : 0;
+            int rowHigh = ((bin-(upperSector*(correctionTableSize-1)))+1)*4;
+            int rowLow = rowHigh-4;
+            int angleIndex = zeroDegreeIndex+upperSector;
+            double angleOrigin = 90.0*upperSector;
+
+            float speedLow = table[rowLow+speedIndex];
+            float speedDelta = (table[rowHigh+speedIndex]-speedLow);
+            float correctionLow = table[rowLow+angleIndex];
+            float correctionLowSpan = (table[rowLow+angleIndex+1]-correctionLow);
+            float correctionHigh = table[rowHigh+angleIndex];
+            float correctionHighSpan = (table[rowHigh+angleIndex+1]-correctionHigh);
+
+            for(int position=binStart[bin];position<binStart[bin+1];position++)
+            {
+                float speedFactor = ((sortedSpeed[position]-speedLow)/speedDelta);
+                float angleFactor = ((sortedAngle[position]-angleOrigin)/90.0);
+
+                float speedCorrectionLow = correctionLowSpan*angleFactor;
+                speedCorrectionLow += correctionLow;
+                float speedCorrectionHigh = correctionHighSpan*angleFactor;
+                speedCorrectionHigh += correctionHigh;
+
+                float calculatedSpeed = ((speedCorrectionHigh-speedCorrectionLow)*speedFactor)+speedCorrectionLow;
+                sortedCorrected[position] = calculatedSpeed+sortedSpeed[position];
+            }
+        }
+
+        // and back to the order the samples came in
+        float* blockCorrected = correctedSpeed+blockStart;
+        for(size_t position=0;position<blockCount;position++)
+        {
+            blockCorrected[order[position]] = sortedCorrected[position];
+        }
+    }
+}
@@ -18,7 +18,50 @@
 #ifndef _interpolator_h_
 #define _interpolator_h_
 
+#include <stddef.h>
+#include "rollingStatistics.h"
+
+// the default correction table, each row holds a speed site followed by the corrections
+// at 0, 90 and 180 degrees
+#define correctionTableSize  29
+extern const float (&correctionTable)[correctionTableSize][4];
+
+// finds the pair of speed sites bracketing a speed without scanning the table, speeds inside
+// the longest run of equally spaced sites are located arithmetically, all other speeds by
+// binary search
+typedef struct
+{
+    const float* sites;         // speed of the first site, sites are siteStride floats apart
+    int siteStride;
+    int siteCount;
+    int uniformLow;             // first and last site of the equally spaced run
+    int uniformHigh;
+    float uniformOrigin;        // speed of uniformLow
+    float uniformLimit;         // speed of uniformHigh
+    float uniformScale;         // reciprocal of the site spacing
+} speedSiteIndex;
+
+speedSiteIndex buildSpeedSiteIndex(const float* sites, int siteStride, int siteCount);
+
+// both return the index of the site at or above rawSpeed (at least 1, at most siteCount-1),
+// scanSpeedSite is the reference linear search
+int findSpeedSite(const speedSiteIndex* index, float rawSpeed);
+int scanSpeedSite(const speedSiteIndex* index, float rawSpeed);
+
 float correctSpeed(float rawSpeed, float angle);
 
+// corrects count samples, results are bit identical to calling correctSpeed on each sample
+void correctSpeedBatch(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+void correctSpeedBatchInPlace(float* __restrict speed, const float* angle, size_t count);
+
+// corrects count samples a block at a time, each block is sorted into bins by speed site and
+// angle sector, corrected a bin at a time with the sites and sector fixed and scattered back,
+// so direction jittering across 90 or 270 degrees costs no mispredicted branches. Bit
+// identical to correctSpeed
+void correctSpeedBinned(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+// correctSpeed, feeding the corrected speed to the rolling statistics as well
+float correctSpeedRolling(rollingStatistics* statistics, float rawSpeed, float angle);
+
 #endif
 
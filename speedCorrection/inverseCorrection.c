@@ -0,0 +1,192 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    The buckets span the corrected speeds from the lowest first site to the highest last
+    inner site, anything above that is on the top interval whatever the angle. With the
+    Davis table a bucket is about 0.6 mph and the narrowest interval of corrected speed
+    3.8 mph, so the site from a bucket is at most one out and the pair at the angle lies
+    within one site of it, a lookup is two bucket reads and a couple of compares.
+
+    Angles are folded and blended exactly as correctSpeed does, so the corrected speeds at
+    the sites either side are the ones correctSpeed would have used.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include "inverseCorrection.h"
+#include "interpolator.h"
+#include "davisCalibration.h"
+
+static_assert(davisCorrectionMonotone(davisFloatTable::topSpeed),"the Davis calibration must be invertible");
+
+int buildInverseCorrection(inverseCorrection* inverse, const float (*rows)[4], int rowCount)
+{
+    if(rowCount<2 || rowCount>inverseMaxSites)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(int row=1;row<rowCount;row++)
+    {
+        if(!(rows[row][0]>rows[row-1][0]))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    inverseCorrection built;
+    memset(&built,0,sizeof(built));
+    built.siteCount = rowCount;
+    for(int row=0;row<rowCount;row++)
+    {
+        built.sites[row] = rows[row][0];
+        for(int column=0;column<3;column++)
+        {
+            built.corrections[column][row] = rows[row][column+1];
+            built.correctedSites[column][row] = rows[row][0]+rows[row][column+1];
+            if(row>0 && !(built.correctedSites[column][row]>built.correctedSites[column][row-1]))
+            {
+                errno = EDOM;
+                return -1;
+            }
+        }
+    }
+
+    float low = built.correctedSites[0][0];
+    float high = built.correctedSites[0][rowCount-2];
+    for(int column=1;column<3;column++)
+    {
+        low = (built.correctedSites[column][0]<low) ? built.correctedSites[column][0] : low;
+        high = (built.correctedSites[column][rowCount-2]>high) ? built.correctedSites[column][rowCount-2] : high;
+    }
+    built.bucketOrigin = low;
+    built.bucketScale = (high>low) ? inverseBuckets/(high-low) : 1.0f;
+
+    for(int column=0;column<3;column++)
+    {
+        int site = 0;
+        for(int bucket=0;bucket<inverseBuckets;bucket++)
+        {
+            float start = low+(bucket/built.bucketScale);
+            while(site<(rowCount-2) && built.correctedSites[column][site+1]<=start)
+            {
+                site++;
+            }
+            built.buckets[column][bucket] = site;
+        }
+    }
+
+    *inverse = built;
+    return 0;
+}
+
+int buildInverseCorrection(inverseCorrection* inverse, const calibrationProfile* profile)
+{
+    if(profile->siteCount>inverseMaxSites)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    float rows[inverseMaxSites][4];
+    for(int row=0;row<profile->siteCount;row++)
+    {
+        rows[row][0] = profile->speeds[row];
+        for(int column=0;column<3;column++)
+        {
+            rows[row][column+1] = profile->corrections[row][column]/10.0f;
+        }
+    }
+    return buildInverseCorrection(inverse,rows,profile->siteCount);
+}
+
+static inverseCorrection buildDefaultInverseCorrection(void)
+{
+    inverseCorrection inverse;
+    buildInverseCorrection(&inverse,correctionTable,correctionTableSize);
+    return inverse;
+}
+
+const inverseCorrection defaultInverseCorrection = buildDefaultInverseCorrection();
+
+// the site at or below the corrected speed at an angle site, NaN takes bucket 0
+static inline int siteBelow(const inverseCorrection* inverse, int column, float correctedSpeed)
+{
+    float bucket = (correctedSpeed-inverse->bucketOrigin)*inverse->bucketScale;
+    bucket = (bucket>0.0f) ? bucket : 0.0f;
+    bucket = (bucket<(inverseBuckets-1)) ? bucket : (inverseBuckets-1);
+
+    const float* correctedSites = inverse->correctedSites[column];
+    int site = inverse->buckets[column][(int)bucket];
+    site -= (site>0 && correctedSpeed<correctedSites[site]) ? 1 : 0;
+    while(site<(inverse->siteCount-2) && correctedSpeed>=correctedSites[site+1])
+    {
+        site++;
+    }
+    return site;
+}
+
+static inline float uncorrectSample(const inverseCorrection* inverse, float correctedSpeed, float angle)
+{
+    // fold the angle and pick the sector and factor as correctSpeed does
+    float correctionAngle = (angle>180.0) ? (180.0-(angle-180.0)) : angle;
+    int sector = (correctionAngle<=90.0) ? 0 : 1;
+    float angleFactor = sector ? ((correctionAngle-90.0)/90.0) : (correctionAngle/90.0);
+    const float* lower = inverse->corrections[sector];
+    const float* upper = inverse->corrections[sector+1];
+
+    // the pair of sites at this angle lies between the pairs at the angle sites
+    int site = siteBelow(inverse,sector,correctedSpeed);
+    int otherSite = siteBelow(inverse,sector+1,correctedSpeed);
+    int lastSite = (otherSite>site) ? otherSite : site;
+    site = (otherSite<site) ? otherSite : site;
+    while(site<lastSite)
+    {
+        float correctionAbove = ((upper[site+1]-lower[site+1])*angleFactor)+lower[site+1];
+        if(!(correctedSpeed>=(inverse->sites[site+1]+correctionAbove)))
+        {
+            break;
+        }
+        site++;
+    }
+
+    float correctionLow = ((upper[site]-lower[site])*angleFactor)+lower[site];
+    float correctionHigh = ((upper[site+1]-lower[site+1])*angleFactor)+lower[site+1];
+    float speedLow = inverse->sites[site];
+    float speedDelta = inverse->sites[site+1]-speedLow;
+
+    // correctedSpeed = rawSpeed+correctionLow+(correctionHigh-correctionLow)*(rawSpeed-speedLow)/speedDelta
+    return speedLow+((correctedSpeed-speedLow-correctionLow)*speedDelta/(speedDelta+correctionHigh-correctionLow));
+}
+
+float uncorrectSpeed(float correctedSpeed, float angle)
+{
+    return uncorrectSample(&defaultInverseCorrection,correctedSpeed,angle);
+}
+
+float uncorrectSpeed(const inverseCorrection* inverse, float correctedSpeed, float angle)
+{
+    return uncorrectSample(inverse,correctedSpeed,angle);
+}
+
+void uncorrectSpeedBatch(const inverseCorrection* inverse, const float* correctedSpeed, const float* angle, float* __restrict rawSpeed, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        rawSpeed[sample] = uncorrectSample(inverse,correctedSpeed[sample],angle[sample]);
+    }
+}
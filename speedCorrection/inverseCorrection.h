@@ -0,0 +1,69 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _inverseCorrection_h_
+#define _inverseCorrection_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calibrationProfile.h"
+
+#define inverseMaxSites profileMaxSites
+
+// buckets of corrected speed in each angle site's index
+#define inverseBuckets 256
+
+// undoes correctSpeed, recovering the raw speed from a corrected speed and its angle
+//
+// at a given angle correctSpeed is a straight line between each pair of speed sites, so
+// the raw speed follows exactly from the corrected speeds at the two sites either side.
+// Those are a blend of the corrected speeds at the angle sites either side, and the pair
+// lies between the pairs found at the two angle sites, so each angle site keeps the
+// corrected speed at every site and an index of buckets of corrected speed giving the site
+// at or below each bucket's start
+//
+// a correction can only be undone if the corrected speed rises with the raw speed at every
+// angle, which holds when it rises from site to site at every angle site
+typedef struct
+{
+    int siteCount;
+    float sites[inverseMaxSites];
+    float corrections[3][inverseMaxSites];          // by angle site, mph
+    float correctedSites[3][inverseMaxSites];       // sites plus corrections
+    float bucketOrigin;                             // corrected speed at the start of bucket 0
+    float bucketScale;                              // buckets per mph
+    uint8_t buckets[3][inverseBuckets];             // site at or below the bucket's start
+} inverseCorrection;
+
+// the global correctionTable, built at start up
+extern const inverseCorrection defaultInverseCorrection;
+
+// from rows of a speed site and the corrections at 0, 90 and 180 degrees in mph, laid out as
+// correctionTable, or from a calibration profile. Returns 0, or -1 with errno set, EINVAL if
+// the sites do not strictly increase and EDOM if the corrected speed does not
+int buildInverseCorrection(inverseCorrection* inverse, const float (*rows)[4], int rowCount);
+int buildInverseCorrection(inverseCorrection* inverse, const calibrationProfile* profile);
+
+// the raw speed correctSpeed (or correctSpeed with the profile) takes to correctedSpeed at
+// this angle, to within float rounding, corrected speeds beyond the sites are undone along
+// the end intervals as correctSpeed extends them
+float uncorrectSpeed(float correctedSpeed, float angle);
+float uncorrectSpeed(const inverseCorrection* inverse, float correctedSpeed, float angle);
+
+void uncorrectSpeedBatch(const inverseCorrection* inverse, const float* correctedSpeed, const float* angle, float* __restrict rawSpeed, size_t count);
+
+#endif
@@ -0,0 +1,251 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Hot swappable calibration profiles, quiescent state based reclamation
+
+    The writer publishes a new profile with a release store of the current pointer and
+    then advances the epoch, the replaced profile is retired with the new epoch. A
+    reader reports a quiescent state by copying the epoch into its own slot with a
+    release store. Once every online reader's slot has reached a retired profile's
+    epoch, each of them has loaded the epoch after the pointer changed, so none can
+    still be using the old profile and it is freed.
+
+    Publishing, reclaiming and registering readers share one mutex, none of them are
+    on the read path.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "liveCalibration.h"
+
+// epoch of an offline or unused reader slot, later than any retirement
+#define offlineEpoch UINT64_MAX
+
+// a published profile, the profile comes first so it keeps its cache line alignment
+typedef struct liveProfile
+{
+    calibrationProfile profile;
+    uint64_t retiredEpoch;
+    struct liveProfile* next;           // retired list
+} liveProfile;
+
+// each reader's slot on its own cache line, only the reader stores to seenEpoch
+struct liveReader
+{
+    uint64_t seenEpoch;
+    liveCalibration* live;
+    int inUse;
+} __attribute__((aligned(64)));
+
+struct liveCalibration
+{
+    liveProfile* current;
+    uint64_t epoch;
+    char padding[64-sizeof(liveProfile*)-sizeof(uint64_t)];
+
+    liveReader readers[liveMaxReaders];
+    pthread_mutex_t lock;
+    liveProfile* retired;
+    size_t retiredCount;
+};
+
+static liveProfile* copyProfile(const calibrationProfile* profile)
+{
+    void* memory = NULL;
+    if(posix_memalign(&memory,64,sizeof(liveProfile))!=0)
+    {
+        return NULL;
+    }
+    liveProfile* copy = (liveProfile*)memory;
+    copy->profile = *profile;
+    copy->retiredEpoch = 0;
+    copy->next = NULL;
+    return copy;
+}
+
+liveCalibration* createLiveCalibration(const calibrationProfile* initial)
+{
+    void* memory = NULL;
+    if(posix_memalign(&memory,64,sizeof(liveCalibration))!=0)
+    {
+        return NULL;
+    }
+
+    liveCalibration* live = (liveCalibration*)memory;
+    live->current = copyProfile(initial);
+    if(!live->current)
+    {
+        free(live);
+        return NULL;
+    }
+    live->epoch = 1;
+    for(int slot=0;slot<liveMaxReaders;slot++)
+    {
+        live->readers[slot].seenEpoch = offlineEpoch;
+        live->readers[slot].live = live;
+        live->readers[slot].inUse = 0;
+    }
+    pthread_mutex_init(&live->lock,NULL);
+    live->retired = NULL;
+    live->retiredCount = 0;
+
+    return live;
+}
+
+void destroyLiveCalibration(liveCalibration* live)
+{
+    if(!live)
+    {
+        return;
+    }
+
+    while(live->retired)
+    {
+        liveProfile* next = live->retired->next;
+        free(live->retired);
+        live->retired = next;
+    }
+    free(live->current);
+    pthread_mutex_destroy(&live->lock);
+    free(live);
+}
+
+liveReader* registerLiveReader(liveCalibration* live)
+{
+    liveReader* reader = NULL;
+
+    pthread_mutex_lock(&live->lock);
+    for(int slot=0;slot<liveMaxReaders && !reader;slot++)
+    {
+        if(!live->readers[slot].inUse)
+        {
+            reader = &live->readers[slot];
+            reader->inUse = 1;
+            __atomic_store_n(&reader->seenEpoch,__atomic_load_n(&live->epoch,__ATOMIC_ACQUIRE),__ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&live->lock);
+
+    return reader;
+}
+
+void unregisterLiveReader(liveReader* reader)
+{
+    liveCalibration* live = reader->live;
+
+    pthread_mutex_lock(&live->lock);
+    __atomic_store_n(&reader->seenEpoch,offlineEpoch,__ATOMIC_RELEASE);
+    reader->inUse = 0;
+    pthread_mutex_unlock(&live->lock);
+}
+
+float correctSpeedLive(const liveReader* reader, float rawSpeed, float angle)
+{
+    const liveProfile* current = __atomic_load_n(&reader->live->current,__ATOMIC_ACQUIRE);
+    return correctSpeed(&current->profile,rawSpeed,angle);
+}
+
+const calibrationProfile* currentLiveProfile(const liveReader* reader)
+{
+    return &__atomic_load_n(&reader->live->current,__ATOMIC_ACQUIRE)->profile;
+}
+
+void liveQuiescent(liveReader* reader)
+{
+    __atomic_store_n(&reader->seenEpoch,__atomic_load_n(&reader->live->epoch,__ATOMIC_ACQUIRE),__ATOMIC_RELEASE);
+}
+
+void liveOffline(liveReader* reader)
+{
+    __atomic_store_n(&reader->seenEpoch,offlineEpoch,__ATOMIC_RELEASE);
+}
+
+void liveOnline(liveReader* reader)
+{
+    // the epoch must be visible to the writer before this reader loads a profile, which
+    // takes the full fence, a store followed by a load can otherwise pass each other
+    __atomic_store_n(&reader->seenEpoch,__atomic_load_n(&reader->live->epoch,__ATOMIC_ACQUIRE),__ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// frees every retired profile all readers have moved past, called with the lock held
+static void reclaimLocked(liveCalibration* live)
+{
+    uint64_t oldestSeen = offlineEpoch;
+    for(int slot=0;slot<liveMaxReaders;slot++)
+    {
+        uint64_t seen = __atomic_load_n(&live->readers[slot].seenEpoch,__ATOMIC_ACQUIRE);
+        oldestSeen = (seen<oldestSeen) ? seen : oldestSeen;
+    }
+
+    liveProfile** link = &live->retired;
+    while(*link)
+    {
+        liveProfile* retired = *link;
+        if(retired->retiredEpoch<=oldestSeen)
+        {
+            *link = retired->next;
+            free(retired);
+            live->retiredCount--;
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+}
+
+int publishCalibrationProfile(liveCalibration* live, const calibrationProfile* profile)
+{
+    liveProfile* published = copyProfile(profile);
+    if(!published)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pthread_mutex_lock(&live->lock);
+
+    // the pointer changes before the epoch advances, so a reader that has seen the new
+    // epoch can only load the new profile
+    liveProfile* replaced = live->current;
+    __atomic_store_n(&live->current,published,__ATOMIC_RELEASE);
+    uint64_t epoch = live->epoch+1;
+    __atomic_store_n(&live->epoch,epoch,__ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    replaced->retiredEpoch = epoch;
+    replaced->next = live->retired;
+    live->retired = replaced;
+    live->retiredCount++;
+
+    reclaimLocked(live);
+    pthread_mutex_unlock(&live->lock);
+
+    return 0;
+}
+
+size_t reclaimCalibrationProfiles(liveCalibration* live)
+{
+    pthread_mutex_lock(&live->lock);
+    reclaimLocked(live);
+    size_t waiting = live->retiredCount;
+    pthread_mutex_unlock(&live->lock);
+
+    return waiting;
+}
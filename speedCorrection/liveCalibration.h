@@ -0,0 +1,69 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _liveCalibration_h_
+#define _liveCalibration_h_
+
+#include <stddef.h>
+#include "calibrationProfile.h"
+
+// most reader threads registered with one live calibration at a time
+#define liveMaxReaders 64
+
+// a calibration profile that can be replaced while other threads correct with it
+//
+// readers load the current profile with a single acquire load and correct with it, so a
+// result always comes from one whole profile, old or new. A replaced profile is freed
+// once every registered reader has reported a quiescent state (a point where it holds no
+// profile) since the replacement, readers only ever store to their own slot, the read
+// path has no locks and no atomic read-modify-writes
+typedef struct liveCalibration liveCalibration;
+typedef struct liveReader liveReader;
+
+// returns NULL if memory can not be allocated
+liveCalibration* createLiveCalibration(const calibrationProfile* initial);
+
+// every reader must have been unregistered
+void destroyLiveCalibration(liveCalibration* live);
+
+// each reader thread registers once, returns NULL if liveMaxReaders are registered
+liveReader* registerLiveReader(liveCalibration* live);
+void unregisterLiveReader(liveReader* reader);
+
+// corrects with whichever profile is current, the reader must not be offline
+float correctSpeedLive(const liveReader* reader, float rawSpeed, float angle);
+
+// the current profile, the reader may use it until its next quiescent state
+const calibrationProfile* currentLiveProfile(const liveReader* reader);
+
+// the reader holds no profile, call between batches of corrections, replaced profiles
+// are only freed as fast as every reader reaches this
+void liveQuiescent(liveReader* reader);
+
+// a reader going idle goes offline so it does not hold up reclamation, it must come back
+// online before correcting again
+void liveOffline(liveReader* reader);
+void liveOnline(liveReader* reader);
+
+// copies the profile and makes it current, then frees any replaced profiles no reader can
+// still hold, returns 0, or -1 with errno set to ENOMEM leaving the current profile
+int publishCalibrationProfile(liveCalibration* live, const calibrationProfile* profile);
+
+// frees the replaced profiles no reader can still hold, returns how many are still waiting
+size_t reclaimCalibrationProfiles(liveCalibration* live);
+
+#endif
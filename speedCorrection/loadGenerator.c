@@ -0,0 +1,422 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Load generator for correctionServer.c, measures the throughput and latency of the
+    correction server under many stations sending bursts of gusty readings.
+
+    usage: loadGenerator [-s socket] [-c connections] [-n stations] [-r readings] [-q requests/sec]
+                         [-w window] [-t seconds] [-b readings] [-d microseconds] [-j file]
+
+        -s socket           server to load, without it a server is started in this process
+                            with every other station on its own calibration profile
+        -c connections      client connections, each with a sending and a receiving thread
+                            (default 8)
+        -n stations         stations spread over the connections (default 64)
+        -r readings         readings in each request (default 32)
+        -q requests/sec     total request rate, 0 sends as fast as the window allows
+                            (default 20000)
+        -w window           most requests a connection has unanswered (default 16)
+        -t seconds          how long to send for (default 2)
+        -b readings         batch size of the in process server (default 1024)
+        -d microseconds     longest wait of the in process server (default 500)
+        -j file             write the results to file as json
+
+    At a fixed rate latency is measured from when a request was due to be sent rather
+    than when it was sent, so a server that falls behind is charged for the requests
+    queued behind the slow one.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "benchHarness.h"
+#include "calibrationProfile.h"
+#include "correctionServer.h"
+
+#define maxConnections 256
+#define windSamples 65536
+
+typedef struct
+{
+    int fd;
+    int connection;
+    int connections;
+    int stations;
+    int readings;
+    int window;
+    double intervalNs;          // between this connection's requests, 0 for as fast as allowed
+    double seconds;
+    const serverReading* wind;
+
+    uint64_t* dueNs;            // when each unanswered request was due, by request id
+    uint32_t sent;
+    uint32_t received;
+    int sendingDone;
+
+    double* latencyUs;
+    size_t latencyCount;
+    size_t latencyCapacity;
+    long errors;
+} loadConnection;
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return ((uint64_t)now.tv_sec*1000000000ULL)+now.tv_nsec;
+}
+
+static void* sendRequests(void* argument)
+{
+    loadConnection* load = (loadConnection*)argument;
+    uint64_t start = nowNs();
+    uint64_t end = start+(uint64_t)(load->seconds*1e9);
+    double due = start;
+
+    for(uint32_t request=0;;request++)
+    {
+        uint64_t now = nowNs();
+        if(load->intervalNs>0.0)
+        {
+            if((uint64_t)due>=end)
+            {
+                break;
+            }
+            if((uint64_t)due>now)
+            {
+                struct timespec wake = {(time_t)((uint64_t)due/1000000000ULL),(long)((uint64_t)due%1000000000ULL)};
+                clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&wake,NULL);
+            }
+        }
+        else if(now>=end)
+        {
+            break;
+        }
+
+        while((request-__atomic_load_n(&load->received,__ATOMIC_ACQUIRE))>=(uint32_t)load->window)
+        {
+            sched_yield();
+        }
+
+        load->dueNs[request%load->window] = (load->intervalNs>0.0) ? (uint64_t)due : nowNs();
+        uint16_t station = (load->connection+((request*load->connections)%load->stations))%load->stations;
+        const serverReading* readings = &load->wind[((size_t)request*load->readings)%(windSamples-load->readings)];
+        if(sendReadings(load->fd,request,station,readings,load->readings)<0)
+        {
+            load->errors++;
+            break;
+        }
+        __atomic_store_n(&load->sent,request+1,__ATOMIC_RELEASE);
+        due += load->intervalNs;
+    }
+
+    __atomic_store_n(&load->sendingDone,1,__ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void* receiveResponses(void* argument)
+{
+    loadConnection* load = (loadConnection*)argument;
+    float corrected[serverMaxReadings];
+
+    for(;;)
+    {
+        int done = __atomic_load_n(&load->sendingDone,__ATOMIC_ACQUIRE);
+        if(done && load->received==__atomic_load_n(&load->sent,__ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+
+        struct pollfd waiting = {load->fd,POLLIN,0};
+        if(poll(&waiting,1,100)<=0)
+        {
+            continue;
+        }
+
+        uint32_t requestId;
+        uint16_t status;
+        int count = receiveCorrected(load->fd,&requestId,&status,corrected);
+        if(count<0)
+        {
+            load->errors++;
+            break;
+        }
+        uint64_t now = nowNs();
+        if(status!=0 || count!=load->readings || requestId!=load->received)
+        {
+            load->errors++;
+        }
+
+        if(load->latencyCount==load->latencyCapacity)
+        {
+            load->latencyCapacity = (load->latencyCapacity==0) ? 65536 : load->latencyCapacity*2;
+            load->latencyUs = (double*)realloc(load->latencyUs,load->latencyCapacity*sizeof(double));
+        }
+        load->latencyUs[load->latencyCount++] = (now-load->dueNs[requestId%load->window])*1e-3;
+        __atomic_store_n(&load->received,load->received+1,__ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static void* serve(void* argument)
+{
+    runCorrectionServer((correctionServer*)argument);
+    return NULL;
+}
+
+static int compareLatency(const void* first, const void* second)
+{
+    double a = *(const double*)first;
+    double b = *(const double*)second;
+    return (a<b) ? -1 : ((a>b) ? 1 : 0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: loadGenerator [-s socket] [-c connections] [-n stations] [-r readings] [-q requests/sec]\n"
+                   "                     [-w window] [-t seconds] [-b readings] [-d microseconds] [-j file]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* socketPath = NULL;
+    const char* jsonName = NULL;
+    int connections = 8;
+    int stations = 64;
+    int readings = 32;
+    double rate = 20000.0;
+    int window = 16;
+    double seconds = 2.0;
+    serverConfig config = {NULL,1024,500};
+    int option;
+
+    while((option = getopt(argc,argv,"s:c:n:r:q:w:t:b:d:j:"))!=-1)
+    {
+        switch(option)
+        {
+            case 's':
+                socketPath = optarg;
+                break;
+            case 'c':
+                connections = atoi(optarg);
+                break;
+            case 'n':
+                stations = atoi(optarg);
+                break;
+            case 'r':
+                readings = atoi(optarg);
+                break;
+            case 'q':
+                rate = atof(optarg);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                break;
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'b':
+                config.batchReadings = atoi(optarg);
+                break;
+            case 'd':
+                config.maxDelayUs = atoi(optarg);
+                break;
+            case 'j':
+                jsonName = optarg;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if(optind!=argc || connections<1 || connections>maxConnections || stations<1 || stations>serverMaxStations ||
+       readings<1 || readings>serverMaxReadings || rate<0.0 || window<1 || seconds<=0.0)
+    {
+        usage();
+        return 2;
+    }
+
+    // without a server to load, one runs here on a socket in a private directory
+    char directory[] = "/tmp/loadGeneratorXXXXXX";
+    char socketName[64];
+    correctionServer* server = NULL;
+    pthread_t serverThread;
+    if(!socketPath)
+    {
+        if(!mkdtemp(directory))
+        {
+            fprintf(stderr,"loadGenerator: %s\n",strerror(errno));
+            return 1;
+        }
+        snprintf(socketName,sizeof(socketName),"%s/socket",directory);
+        config.socketPath = socketName;
+        server = createCorrectionServer(&config);
+        if(!server)
+        {
+            fprintf(stderr,"loadGenerator: %s\n",strerror(errno));
+            rmdir(directory);
+            return 1;
+        }
+        calibrationProfile windy;
+        parseCalibrationProfile("0 0 0 0\n20 4.3 -1.3 -2.6\n150 10.8 -11.1 -11.0\n",&windy);
+        for(int station=1;station<stations;station+=2)
+        {
+            setStationProfile(server,station,&windy);
+        }
+        pthread_create(&serverThread,NULL,serve,server);
+        socketPath = socketName;
+    }
+
+    float* windSpeed = (float*)malloc(windSamples*sizeof(float));
+    float* windAngle = (float*)malloc(windSamples*sizeof(float));
+    serverReading* wind = (serverReading*)malloc(windSamples*sizeof(serverReading));
+    benchFillWind(benchGusty,windSpeed,windAngle,windSamples);
+    for(int sample=0;sample<windSamples;sample++)
+    {
+        wind[sample].rawSpeed = windSpeed[sample];
+        wind[sample].angle = windAngle[sample];
+    }
+
+    loadConnection loads[maxConnections];
+    pthread_t senders[maxConnections];
+    pthread_t receivers[maxConnections];
+    memset(loads,0,sizeof(loads));
+    for(int connection=0;connection<connections;connection++)
+    {
+        loadConnection* load = &loads[connection];
+        load->fd = connectCorrectionServer(socketPath);
+        if(load->fd<0)
+        {
+            fprintf(stderr,"loadGenerator: %s: %s\n",socketPath,strerror(errno));
+            return 1;
+        }
+        load->connection = connection;
+        load->connections = connections;
+        load->stations = stations;
+        load->readings = readings;
+        load->window = window;
+        load->intervalNs = (rate>0.0) ? (1e9*connections)/rate : 0.0;
+        load->seconds = seconds;
+        load->wind = wind;
+        load->dueNs = (uint64_t*)calloc(window,sizeof(uint64_t));
+    }
+
+    uint64_t start = nowNs();
+    for(int connection=0;connection<connections;connection++)
+    {
+        pthread_create(&receivers[connection],NULL,receiveResponses,&loads[connection]);
+        pthread_create(&senders[connection],NULL,sendRequests,&loads[connection]);
+    }
+    long errors = 0;
+    size_t requests = 0;
+    for(int connection=0;connection<connections;connection++)
+    {
+        pthread_join(senders[connection],NULL);
+        pthread_join(receivers[connection],NULL);
+        errors += loads[connection].errors;
+        requests += loads[connection].latencyCount;
+    }
+    double elapsed = (nowNs()-start)*1e-9;
+
+    // every latency together, sorted for the quantiles
+    double* latencies = (double*)malloc((requests+1)*sizeof(double));
+    size_t gathered = 0;
+    for(int connection=0;connection<connections;connection++)
+    {
+        memcpy(&latencies[gathered],loads[connection].latencyUs,loads[connection].latencyCount*sizeof(double));
+        gathered += loads[connection].latencyCount;
+        close(loads[connection].fd);
+        free(loads[connection].latencyUs);
+        free(loads[connection].dueNs);
+    }
+    qsort(latencies,requests,sizeof(double),compareLatency);
+    const double quantiles[5] = {0.5,0.9,0.99,0.999,1.0};
+    const char* quantileNames[5] = {"p50","p90","p99","p999","max"};
+    double quantileUs[5] = {0.0,0.0,0.0,0.0,0.0};
+    for(int quantile=0;quantile<5 && requests>0;quantile++)
+    {
+        size_t rank = (size_t)(quantiles[quantile]*requests);
+        quantileUs[quantile] = latencies[(rank<requests) ? rank : requests-1];
+    }
+
+    printf("BENCH:load, %d connections, %d stations, %d readings a request, %.0f requests/sec, window %d\n",
+           connections,stations,readings,rate,window);
+    printf("BENCH:%zu requests, %zu readings in %.2f s, %.0f requests/sec, %.0f readings/sec, %ld errors\n",
+           requests,requests*readings,elapsed,requests/elapsed,(requests*readings)/elapsed,errors);
+    printf("BENCH:latency us");
+    for(int quantile=0;quantile<5;quantile++)
+    {
+        printf(" %s %.1f",quantileNames[quantile],quantileUs[quantile]);
+    }
+    printf("\n");
+
+    serverStats stats;
+    memset(&stats,0,sizeof(stats));
+    if(server)
+    {
+        stopCorrectionServer(server);
+        pthread_join(serverThread,NULL);
+        correctionServerStatistics(server,&stats);
+        printf("BENCH:server batch %d readings or %d us, %llu batches, %.1f readings a batch, %llu rejected, %llu dropped\n",
+               config.batchReadings,config.maxDelayUs,(unsigned long long)stats.batches,
+               (stats.batches>0) ? (double)stats.readings/stats.batches : 0.0,(unsigned long long)stats.rejected,(unsigned long long)stats.dropped);
+        destroyCorrectionServer(server);
+        rmdir(directory);
+    }
+
+    if(jsonName)
+    {
+        FILE* file = fopen(jsonName,"w");
+        if(!file)
+        {
+            fprintf(stderr,"loadGenerator: %s: %s\n",jsonName,strerror(errno));
+            return 1;
+        }
+        fprintf(file,"{\n  \"suite\": \"loadGenerator\",\n  \"connections\": %d,\n  \"stations\": %d,\n  \"readings\": %d,\n"
+                     "  \"rate\": %.0f,\n  \"window\": %d,\n  \"requests\": %zu,\n  \"errors\": %ld,\n"
+                     "  \"requests_per_sec\": %.0f,\n  \"readings_per_sec\": %.0f,\n  \"latency_us\": {",
+                connections,stations,readings,rate,window,requests,errors,requests/elapsed,(requests*readings)/elapsed);
+        for(int quantile=0;quantile<5;quantile++)
+        {
+            fprintf(file,"%s\"%s\": %.1f",(quantile>0) ? ", " : "",quantileNames[quantile],quantileUs[quantile]);
+        }
+        fprintf(file,"}");
+        if(stats.batches>0)
+        {
+            fprintf(file,",\n  \"batch_readings\": %d,\n  \"max_delay_us\": %d,\n  \"batches\": %llu",
+                    config.batchReadings,config.maxDelayUs,(unsigned long long)stats.batches);
+        }
+        fprintf(file,"\n}\n");
+        if(fclose(file)!=0)
+        {
+            return 1;
+        }
+    }
+
+    free(latencies);
+    free(wind);
+    free(windSpeed);
+    free(windAngle);
+
+    return (errors>0) ? 1 : 0;
+}
@@ -0,0 +1,427 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Packed calibration profiles for services hosting thousands of stations
+
+    A calibrationProfile is 128 bytes, a third of it the speed sites, which every
+    calibration in the field places at 0 mph and then a fixed spacing apart. Packing the
+    axis as an origin and a spacing leaves the corrections, 3 bytes a site, and the site at
+    or above a speed is one multiply by the reciprocal of the spacing and a step either way
+    for rounding, with no scan and no load of the sites.
+
+    The avx2 kernel works on eight samples from eight stations at once. The site header and
+    the two sites either side of each sample are gathered as 4 byte words at
+    station*92 + 3*site + 4, unaligned, and the sector's two corrections are shifted down
+    and sign extended in the register, so a sample costs three gathers where the profile
+    costs twelve byte loads and twelve table loads.
+
+    The corrections are the profile's tenths decoded from the same table, and the steps
+    of the interpolation are the profile's in the same order, so a packed profile corrects
+    as the profile it was packed from bit for bit. A profile's top site repeating the site
+    below is dropped and held instead, which is the same result as interpolating between
+    two equal corrections.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "packedProfile.h"
+#include "interpolator.h"
+#include "simdCorrection.h"
+#include "davisCalibration.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define packedHaveX86
+#endif
+
+#define zeroDegreeIndex 0
+#define ninetyDegreeIndex 1
+
+// bytes before the corrections and the stride of a profile in a station array
+#define packedHeaderBytes 4
+#define packedStride ((int)sizeof(packedProfile))
+
+static_assert(sizeof(packedProfile)==92,"a packed profile must have no alignment gaps");
+static_assert(packedMaxStations*sizeof(packedProfile)<(size_t)INT32_MAX,"station offsets must fit a gather index");
+
+// 1 divided by every spacing, as constants, the tenths are decoded with davisCalibration.h's
+// table
+typedef struct
+{
+    float reciprocal[256];
+} spacingTable;
+
+static constexpr spacingTable makeSpacingTable(void)
+{
+    spacingTable table = {};
+    for(int spacing=1;spacing<256;spacing++)
+    {
+        table.reciprocal[spacing] = 1.0f/spacing;
+    }
+    return table;
+}
+
+static constexpr spacingTable spacingReciprocals = makeSpacingTable();
+
+// packs sites of whole mph speeds and tenths corrections, a last site repeating the one
+// below it is dropped and held
+static int packSites(const int* speeds, const int (*tenths)[3], int siteCount, packedProfile* packed)
+{
+    int held = 0;
+    if(siteCount>2 && memcmp(tenths[siteCount-1],tenths[siteCount-2],sizeof(tenths[0]))==0)
+    {
+        held = 1;
+        siteCount--;
+    }
+
+    if(siteCount<2 || siteCount>packedMaxSites || speeds[0]!=0 || speeds[1]<1 || speeds[1]>255)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    int spacing = (siteCount>2) ? speeds[2]-speeds[1] : 1;
+    if(spacing<1 || spacing>255)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(int site=2;site<siteCount;site++)
+    {
+        if((speeds[site]-speeds[site-1])!=spacing)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    for(int site=0;site<siteCount;site++)
+    {
+        for(int column=0;column<3;column++)
+        {
+            if(tenths[site][column]<-127 || tenths[site][column]>127)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+        }
+    }
+
+    memset(packed,0,sizeof(packedProfile));
+    packed->siteCount = siteCount;
+    packed->origin = speeds[1];
+    packed->spacing = spacing;
+    packed->held = held;
+    for(int site=0;site<siteCount;site++)
+    {
+        for(int column=0;column<3;column++)
+        {
+            packed->corrections[(site*3)+column] = tenths[site][column];
+        }
+    }
+
+    return 0;
+}
+
+int packCalibrationProfile(const calibrationProfile* profile, packedProfile* packed)
+{
+    int speeds[packedMaxSites];
+    int tenths[packedMaxSites][3];
+    if(profile->siteCount<2 || profile->siteCount>packedMaxSites)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(int site=0;site<profile->siteCount;site++)
+    {
+        speeds[site] = profile->speeds[site];
+        for(int column=0;column<3;column++)
+        {
+            tenths[site][column] = profile->corrections[site][column];
+        }
+    }
+
+    return packSites(speeds,tenths,profile->siteCount,packed);
+}
+
+int packCorrectionTable(const float (*rows)[4], int rowCount, packedProfile* packed)
+{
+    int speeds[packedMaxSites];
+    int tenths[packedMaxSites][3];
+    if(rowCount<2 || rowCount>packedMaxSites)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(int row=0;row<rowCount;row++)
+    {
+        // a held top row may sit anywhere above the axis, as the Davis table's 999 does
+        double speed = rows[row][0];
+        if(!(speed>=0.0 && speed<=1000.0) || speed!=floor(speed))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        speeds[row] = (int)speed;
+        for(int column=0;column<3;column++)
+        {
+            double correction = rows[row][column+1]*10.0;
+            if(!(fabs(correction)<=127.5))
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            tenths[row][column] = (int)lround(correction);
+        }
+    }
+
+    return packSites(speeds,tenths,rowCount,packed);
+}
+
+static packedProfile buildDefaultPackedProfile(void)
+{
+    packedProfile packed;
+    packCorrectionTable(correctionTable,correctionTableSize,&packed);
+    return packed;
+}
+
+const packedProfile defaultPackedProfile = buildDefaultPackedProfile();
+
+// speed of a site on the implicit axis
+static inline int packedSpeed(const packedProfile* packed, int site)
+{
+    return site ? packed->origin+((site-1)*packed->spacing) : 0;
+}
+
+static inline float packedSample(const packedProfile* packed, float rawSpeed, float angle)
+{
+    // calculate the angle to be used in the calculation
+    float correctionAngle = (angle>180.0) ? (180.0-(angle-180.0)) : angle;
+
+    // the site at or above the speed, as profileSpeedSite finds it
+    int lastSite = packed->siteCount-1;
+    int speedIndexHigh = 1;
+    if(rawSpeed>packed->origin)
+    {
+        float offset = (rawSpeed-packed->origin)*spacingReciprocals.reciprocal[packed->spacing];
+        offset = (offset<(lastSite-1)) ? offset : (lastSite-1);
+        speedIndexHigh = (int)offset+2;
+        speedIndexHigh = (speedIndexHigh>lastSite) ? lastSite : speedIndexHigh;
+        speedIndexHigh += (speedIndexHigh<lastSite && rawSpeed>packedSpeed(packed,speedIndexHigh)) ? 1 : 0;
+        speedIndexHigh -= (rawSpeed<=packedSpeed(packed,speedIndexHigh-1)) ? 1 : 0;
+    }
+    int speedIndexLow = speedIndexHigh-1;
+
+    // a held correction is interpolated from the last site to itself, as the profile
+    // interpolates between its top site and the repeat of it
+    int correctionIndexLow = (packed->held && rawSpeed>packedSpeed(packed,lastSite)) ? speedIndexHigh : speedIndexLow;
+
+    // calculate the scaling factor based on the input speeds position relative to the
+    // high and low speed sites, above the top site the correction is held, 1+(f-f) is 1,
+    // or NaN for the infinite factor of an infinite speed as correctSpeed gives it
+    float speedDelta = ((float)packedSpeed(packed,speedIndexHigh)-(float)packedSpeed(packed,speedIndexLow));
+    float speedOffset = (rawSpeed-packedSpeed(packed,speedIndexLow));
+    float speedFactor = (speedOffset/speedDelta);
+    speedFactor = (speedFactor>1.0f) ? 1.0f+(speedFactor-speedFactor) : speedFactor;
+
+    // 0->90 uses the 0 and 90 degree corrections, 90->180 the 90 and 180 degree corrections
+    int lowColumn = zeroDegreeIndex;
+    float angleFactor = (correctionAngle/90.0);
+    if(correctionAngle>90.0)
+    {
+        lowColumn = ninetyDegreeIndex;
+        angleFactor = ((correctionAngle-90.0)/90.0);
+    }
+
+    const int8_t* correctionsLow = &packed->corrections[correctionIndexLow*3];
+    const int8_t* correctionsHigh = &packed->corrections[speedIndexHigh*3];
+    float speedCorrectionLow = (tenthsToMph(correctionsLow[lowColumn+1])-tenthsToMph(correctionsLow[lowColumn]));
+    speedCorrectionLow *= angleFactor;
+    speedCorrectionLow += tenthsToMph(correctionsLow[lowColumn]);
+    float speedCorrectionHigh = (tenthsToMph(correctionsHigh[lowColumn+1])-tenthsToMph(correctionsHigh[lowColumn]));
+    speedCorrectionHigh *= angleFactor;
+    speedCorrectionHigh += tenthsToMph(correctionsHigh[lowColumn]);
+
+    float calculatedSpeed = ((speedCorrectionHigh-speedCorrectionLow)*speedFactor)+speedCorrectionLow;
+    calculatedSpeed += rawSpeed;
+
+    return calculatedSpeed;
+}
+
+float correctSpeedPacked(const packedProfile* packed, float rawSpeed, float angle)
+{
+    return packedSample(packed,rawSpeed,angle);
+}
+
+static void packedScalarBatch(const packedProfile* packed, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        correctedSpeed[sample] = packedSample(packed,rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void packedScalarStations(const packedProfile* profiles, const uint16_t* station, const float* rawSpeed, const float* angle,
+                                 float* __restrict correctedSpeed, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        correctedSpeed[sample] = packedSample(&profiles[station[sample]],rawSpeed[sample],angle[sample]);
+    }
+}
+
+#ifdef packedHaveX86
+
+// speed of a site on each lane's axis, sites are at least 1
+__attribute__((target("avx2")))
+static inline __m256 packedSpeedAvx2(__m256i site, __m256i origin, __m256i spacing)
+{
+    __m256i speed = _mm256_add_epi32(origin,_mm256_mullo_epi32(_mm256_sub_epi32(site,_mm256_set1_epi32(1)),spacing));
+    return _mm256_cvtepi32_ps(speed);
+}
+
+// the two corrections of a sector from a gathered site word, shifted down a byte for the
+// upper sector, as mph
+__attribute__((target("avx2")))
+static inline void sectorCorrectionsAvx2(__m256i word, __m256i shift, __m256* low, __m256* high)
+{
+    word = _mm256_srlv_epi32(word,shift);
+    __m256 ten = _mm256_set1_ps(10.0f);
+    *low = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(word,24),24)),ten);
+    *high = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(word,16),24)),ten);
+}
+
+// every step as packedSample takes it for eight samples, each lane with the profile at
+// byte offset base from profiles
+__attribute__((target("avx2")))
+static inline __m256 packedAvx2(const packedProfile* profiles, __m256i base, __m256 rawSpeed, __m256 angle)
+{
+    const int* bytes = (const int*)profiles;
+    __m256i header = _mm256_i32gather_epi32(bytes,base,1);
+    __m256i byteMask = _mm256_set1_epi32(0xff);
+    __m256i lastSite = _mm256_sub_epi32(_mm256_and_si256(header,byteMask),_mm256_set1_epi32(1));
+    __m256i origin = _mm256_and_si256(_mm256_srli_epi32(header,8),byteMask);
+    __m256i spacing = _mm256_and_si256(_mm256_srli_epi32(header,16),byteMask);
+    __m256i held = _mm256_cmpgt_epi32(_mm256_srli_epi32(header,24),_mm256_setzero_si256());
+    __m256i one = _mm256_set1_epi32(1);
+
+    // the site at or above the speed, lanes at or below the origin take site 1
+    __m256 originSpeed = _mm256_cvtepi32_ps(origin);
+    __m256 inRun = _mm256_cmp_ps(rawSpeed,originSpeed,_CMP_GT_OQ);
+    __m256 offset = _mm256_mul_ps(_mm256_sub_ps(rawSpeed,originSpeed),_mm256_i32gather_ps(spacingReciprocals.reciprocal,spacing,4));
+    offset = _mm256_min_ps(offset,_mm256_cvtepi32_ps(_mm256_sub_epi32(lastSite,one)));
+    __m256i site = _mm256_add_epi32(_mm256_cvttps_epi32(offset),_mm256_set1_epi32(2));
+    site = _mm256_min_epi32(site,lastSite);
+    __m256 up = _mm256_cmp_ps(rawSpeed,packedSpeedAvx2(site,origin,spacing),_CMP_GT_OQ);
+    up = _mm256_and_ps(up,_mm256_castsi256_ps(_mm256_cmpgt_epi32(lastSite,site)));
+    site = _mm256_sub_epi32(site,_mm256_castps_si256(up));
+    __m256 down = _mm256_cmp_ps(rawSpeed,packedSpeedAvx2(_mm256_sub_epi32(site,one),origin,spacing),_CMP_LE_OQ);
+    site = _mm256_add_epi32(site,_mm256_castps_si256(down));
+    __m256i siteHigh = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(one),_mm256_castsi256_ps(site),inRun));
+
+    __m256 aboveLast = _mm256_cmp_ps(rawSpeed,packedSpeedAvx2(lastSite,origin,spacing),_CMP_GT_OQ);
+    __m256i holding = _mm256_and_si256(_mm256_castps_si256(aboveLast),held);
+    __m256i siteLow = _mm256_sub_epi32(siteHigh,one);
+    __m256i correctionLow = _mm256_sub_epi32(siteHigh,_mm256_andnot_si256(holding,one));
+
+    // site 0 is at 0 mph, whatever the axis
+    __m256 speedHigh = packedSpeedAvx2(siteHigh,origin,spacing);
+    __m256 speedLow = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(siteLow,_mm256_setzero_si256())),
+                                       packedSpeedAvx2(siteLow,origin,spacing));
+    __m256 speedFactor = _mm256_div_ps(_mm256_sub_ps(rawSpeed,speedLow),_mm256_sub_ps(speedHigh,speedLow));
+    // blend rather than min so NaN stays NaN as it does in packedSample, 1+(f-f) is 1, or
+    // NaN for an infinite factor
+    __m256 oneSpeed = _mm256_set1_ps(1.0f);
+    __m256 heldFactor = _mm256_add_ps(oneSpeed,_mm256_sub_ps(speedFactor,speedFactor));
+    speedFactor = _mm256_blendv_ps(speedFactor,heldFactor,_mm256_cmp_ps(speedFactor,oneSpeed,_CMP_GT_OQ));
+
+    __m256 foldedAngle = _mm256_sub_ps(_mm256_set1_ps(360.0f),angle);
+    __m256 correctionAngle = _mm256_blendv_ps(angle,foldedAngle,_mm256_cmp_ps(angle,_mm256_set1_ps(180.0f),_CMP_GT_OQ));
+    __m256 upper = _mm256_cmp_ps(correctionAngle,_mm256_set1_ps(90.0f),_CMP_GT_OQ);
+    __m256 angleFactor = _mm256_div_ps(_mm256_sub_ps(correctionAngle,_mm256_and_ps(upper,_mm256_set1_ps(90.0f))),_mm256_set1_ps(90.0f));
+
+    __m256i corrections = _mm256_add_epi32(base,_mm256_set1_epi32(packedHeaderBytes));
+    __m256i three = _mm256_set1_epi32(3);
+    __m256i wordLow = _mm256_i32gather_epi32(bytes,_mm256_add_epi32(corrections,_mm256_mullo_epi32(correctionLow,three)),1);
+    __m256i wordHigh = _mm256_i32gather_epi32(bytes,_mm256_add_epi32(corrections,_mm256_mullo_epi32(siteHigh,three)),1);
+    __m256i shift = _mm256_and_si256(_mm256_castps_si256(upper),_mm256_set1_epi32(8));
+    __m256 lowFirst, lowSecond, highFirst, highSecond;
+    sectorCorrectionsAvx2(wordLow,shift,&lowFirst,&lowSecond);
+    sectorCorrectionsAvx2(wordHigh,shift,&highFirst,&highSecond);
+
+    __m256 speedCorrectionLow = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(lowSecond,lowFirst),angleFactor),lowFirst);
+    __m256 speedCorrectionHigh = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(highSecond,highFirst),angleFactor),highFirst);
+    __m256 calculatedSpeed = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(speedCorrectionHigh,speedCorrectionLow),speedFactor),speedCorrectionLow);
+
+    return _mm256_add_ps(calculatedSpeed,rawSpeed);
+}
+
+__attribute__((target("avx2")))
+static void packedAvx2Batch(const packedProfile* packed, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    size_t sample = 0;
+    for(;sample+8<=count;sample+=8)
+    {
+        __m256 corrected = packedAvx2(packed,_mm256_setzero_si256(),_mm256_loadu_ps(&rawSpeed[sample]),_mm256_loadu_ps(&angle[sample]));
+        _mm256_storeu_ps(&correctedSpeed[sample],corrected);
+    }
+
+    packedScalarBatch(packed,&rawSpeed[sample],&angle[sample],&correctedSpeed[sample],count-sample);
+}
+
+__attribute__((target("avx2")))
+static void packedAvx2Stations(const packedProfile* profiles, const uint16_t* station, const float* rawSpeed, const float* angle,
+                               float* __restrict correctedSpeed, size_t count)
+{
+    __m256i stride = _mm256_set1_epi32(packedStride);
+    size_t sample = 0;
+    for(;sample+8<=count;sample+=8)
+    {
+        __m256i stations = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&station[sample]));
+        __m256 corrected = packedAvx2(profiles,_mm256_mullo_epi32(stations,stride),_mm256_loadu_ps(&rawSpeed[sample]),_mm256_loadu_ps(&angle[sample]));
+        _mm256_storeu_ps(&correctedSpeed[sample],corrected);
+    }
+
+    packedScalarStations(profiles,&station[sample],&rawSpeed[sample],&angle[sample],&correctedSpeed[sample],count-sample);
+}
+
+static const int packedUseAvx2 = avx2Supported();
+
+#endif
+
+void correctSpeedPackedBatch(const packedProfile* packed, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+#ifdef packedHaveX86
+    if(packedUseAvx2)
+    {
+        packedAvx2Batch(packed,rawSpeed,angle,correctedSpeed,count);
+        return;
+    }
+#endif
+    packedScalarBatch(packed,rawSpeed,angle,correctedSpeed,count);
+}
+
+void correctStationsPacked(const packedProfile* profiles, const uint16_t* station, const float* rawSpeed, const float* angle,
+                           float* __restrict correctedSpeed, size_t count)
+{
+#ifdef packedHaveX86
+    if(packedUseAvx2)
+    {
+        packedAvx2Stations(profiles,station,rawSpeed,angle,correctedSpeed,count);
+        return;
+    }
+#endif
+    packedScalarStations(profiles,station,rawSpeed,angle,correctedSpeed,count);
+}
@@ -0,0 +1,80 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _packedProfile_h_
+#define _packedProfile_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calibrationProfile.h"
+
+#define packedMaxSites profileMaxSites
+
+// stations a station batch can index
+#define packedMaxStations 65536
+
+// a calibration packed for hosting many stations in one process, 92 bytes with no alignment
+// so an array of them has no gaps, 11000 stations to a megabyte of L2
+//
+// the speed axis is implicit, site 0 is at 0 mph and site n at origin+(n-1)*spacing, so only
+// the corrections are stored, as tenths of a mph at 0, 90 and 180 degrees one site after
+// another. A site's three corrections are read as one 4 byte word (the spare byte at the end
+// keeps the read of the last site inside), so the batches gather a word for the sites either
+// side of each sample and expand the corrections in registers.
+//
+// above the last site the correction is held, either as a profile holds it up to
+// profileTopSpeed (held, the profile's top site repeated the site below and was dropped) or
+// along the last interval as correctSpeed extends it
+typedef struct
+{
+    uint8_t siteCount;
+    uint8_t origin;                                 // speed of site 1, mph
+    uint8_t spacing;                                // mph between sites from site 1 on
+    uint8_t held;                                   // the correction at the last site is held above it
+    int8_t corrections[(packedMaxSites*3)+1];       // tenths of a mph by site and angle site
+} packedProfile;
+
+// the global correctionTable, packed at start up
+extern const packedProfile defaultPackedProfile;
+
+// packs a profile whose sites after 0 mph are equally spaced, apart from a top site holding
+// the corrections of the site below it. Corrections the profile holds are unchanged, so
+// correctSpeedPacked gives the profile's corrections bit for bit
+//
+// both return 0, or -1 with errno set to EINVAL if the sites are not on an implicit axis or
+// a correction is beyond +/-12.7 mph, leaving packed untouched
+int packCalibrationProfile(const calibrationProfile* profile, packedProfile* packed);
+
+// packs rows of a speed site and the corrections at 0, 90 and 180 degrees in mph, laid out as
+// correctionTable, rounding the corrections to the nearest tenth so a correction is never
+// more than 0.05 mph from the table's. The Davis table is held in tenths, so the default
+// packed profile corrects as correctSpeed does bit for bit
+int packCorrectionTable(const float (*rows)[4], int rowCount, packedProfile* packed);
+
+// the same corrections as correctSpeed(profile,rawSpeed,angle) for the profile packed
+float correctSpeedPacked(const packedProfile* packed, float rawSpeed, float angle);
+
+// corrects count samples with one profile, the avx2 kernel where the cpu has it, bit
+// identical to correctSpeedPacked on x86
+void correctSpeedPackedBatch(const packedProfile* packed, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+// corrects count samples from many stations, each with profiles[station[sample]], as a
+// service correcting the readings of every station it hosts a block at a time does
+void correctStationsPacked(const packedProfile* profiles, const uint16_t* station, const float* rawSpeed, const float* angle,
+                           float* __restrict correctedSpeed, size_t count);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Work stealing bulk correction for interpolator.c
+
+    The input is cut into parallelChunkSamples chunks and each thread starts with an
+    equal, contiguous range of chunks. A thread takes chunks from the front of its own
+    range, and when that runs dry it steals the back half of another thread's range,
+    keeps the first stolen chunk and publishes the rest as its new range for others to
+    steal from in turn. A range is a single 64 bit word (next chunk and end chunk) so
+    taking and stealing are each one compare and swap.
+
+    Every chunk is written to its own place in the output, so the order of the output
+    and the value of every sample do not depend on which thread did the work.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "parallelCorrection.h"
+#include "simdCorrection.h"
+
+// a thread's range of chunks, next in the low 32 bits and end in the high 32 bits, each
+// on its own cache line so takes by the owner do not slow down the other threads
+typedef struct
+{
+    uint64_t chunks;
+} __attribute__((aligned(64))) workRange;
+
+typedef struct
+{
+    correctionPool* pool;
+    int id;
+} workerSlot;
+
+struct correctionPool
+{
+    workRange ranges[parallelMaxThreads];
+    workerSlot slots[parallelMaxThreads];
+    pthread_t threads[parallelMaxThreads];
+    int threadCount;
+    int startedThreads;
+
+    pthread_mutex_t callerLock;         // one bulk correction at a time
+    pthread_mutex_t lock;               // everything below
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned generation;                // bumped for every bulk correction
+    int finishedWorkers;
+    int shutdown;
+
+    const float* rawSpeed;
+    const float* angle;
+    float* correctedSpeed;
+    size_t count;
+};
+
+static inline uint64_t packRange(uint32_t next, uint32_t end)
+{
+    return ((uint64_t)end<<32)|next;
+}
+
+static int takeChunk(workRange* range, uint32_t* chunk)
+{
+    uint64_t current = __atomic_load_n(&range->chunks,__ATOMIC_ACQUIRE);
+    for(;;)
+    {
+        uint32_t next = (uint32_t)current;
+        uint32_t end = (uint32_t)(current>>32);
+        if(next>=end)
+        {
+            return 0;
+        }
+        if(__atomic_compare_exchange_n(&range->chunks,&current,packRange(next+1,end),0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+        {
+            *chunk = next;
+            return 1;
+        }
+    }
+}
+
+// takes the back half (at least one chunk) of a victim's range
+static int stealChunks(workRange* range, uint32_t* first, uint32_t* end)
+{
+    uint64_t current = __atomic_load_n(&range->chunks,__ATOMIC_ACQUIRE);
+    for(;;)
+    {
+        uint32_t next = (uint32_t)current;
+        uint32_t last = (uint32_t)(current>>32);
+        if(next>=last)
+        {
+            return 0;
+        }
+        uint32_t split = last-((last-next+1)/2);
+        if(__atomic_compare_exchange_n(&range->chunks,&current,packRange(next,split),0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+        {
+            *first = split;
+            *end = last;
+            return 1;
+        }
+    }
+}
+
+static void correctChunk(correctionPool* pool, uint32_t chunk)
+{
+    size_t first = (size_t)chunk*parallelChunkSamples;
+    size_t samples = ((pool->count-first)<parallelChunkSamples) ? (pool->count-first) : parallelChunkSamples;
+    correctSpeedSimd(pool->rawSpeed+first,pool->angle+first,pool->correctedSpeed+first,samples);
+}
+
+// works until every range is empty, a chunk is never lost in a steal because the thief
+// holds the stolen chunks until it has published or corrected them
+static void runWorker(correctionPool* pool, int id)
+{
+    workRange* own = &pool->ranges[id];
+    uint32_t chunk;
+
+    for(;;)
+    {
+        if(takeChunk(own,&chunk))
+        {
+            correctChunk(pool,chunk);
+            continue;
+        }
+
+        int stole = 0;
+        for(int offset=1;offset<pool->threadCount && !stole;offset++)
+        {
+            uint32_t first;
+            uint32_t end;
+            if(stealChunks(&pool->ranges[(id+offset)%pool->threadCount],&first,&end))
+            {
+                // the own range is empty so no other thread can change it before this store
+                __atomic_store_n(&own->chunks,packRange(first+1,end),__ATOMIC_RELEASE);
+                correctChunk(pool,first);
+                stole = 1;
+            }
+        }
+
+        if(!stole)
+        {
+            return;
+        }
+    }
+}
+
+static void* workerThread(void* argument)
+{
+    workerSlot* slot = (workerSlot*)argument;
+    correctionPool* pool = slot->pool;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for(;;)
+    {
+        while(pool->generation==seen && !pool->shutdown)
+        {
+            pthread_cond_wait(&pool->start,&pool->lock);
+        }
+        if(pool->shutdown)
+        {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        runWorker(pool,slot->id);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finishedWorkers++;
+        if(pool->finishedWorkers==(pool->threadCount-1))
+        {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+correctionPool* createCorrectionPool(int threadCount)
+{
+    if(threadCount<1 || threadCount>parallelMaxThreads)
+    {
+        return NULL;
+    }
+
+    void* memory = NULL;
+    if(posix_memalign(&memory,64,sizeof(correctionPool))!=0)
+    {
+        return NULL;
+    }
+
+    correctionPool* pool = (correctionPool*)memory;
+    pool->threadCount = threadCount;
+    pool->startedThreads = 0;
+    pool->generation = 0;
+    pool->finishedWorkers = 0;
+    pool->shutdown = 0;
+    for(int id=0;id<parallelMaxThreads;id++)
+    {
+        pool->ranges[id].chunks = 0;
+    }
+    pthread_mutex_init(&pool->callerLock,NULL);
+    pthread_mutex_init(&pool->lock,NULL);
+    pthread_cond_init(&pool->start,NULL);
+    pthread_cond_init(&pool->done,NULL);
+
+    // the calling thread is thread 0
+    for(int id=1;id<threadCount;id++)
+    {
+        pool->slots[id].pool = pool;
+        pool->slots[id].id = id;
+        if(pthread_create(&pool->threads[id],NULL,workerThread,&pool->slots[id])!=0)
+        {
+            destroyCorrectionPool(pool);
+            return NULL;
+        }
+        pool->startedThreads++;
+    }
+
+    return pool;
+}
+
+void destroyCorrectionPool(correctionPool* pool)
+{
+    if(!pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int id=1;id<=pool->startedThreads;id++)
+    {
+        pthread_join(pool->threads[id],NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->callerLock);
+    free(pool);
+}
+
+int correctionPoolThreads(const correctionPool* pool)
+{
+    return pool->threadCount;
+}
+
+void correctSpeedParallel(correctionPool* pool, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    // a single chunk is not worth waking the workers for
+    if(pool->threadCount==1 || count<=parallelChunkSamples)
+    {
+        correctSpeedSimd(rawSpeed,angle,correctedSpeed,count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->callerLock);
+    pthread_mutex_lock(&pool->lock);
+
+    pool->rawSpeed = rawSpeed;
+    pool->angle = angle;
+    pool->correctedSpeed = correctedSpeed;
+    pool->count = count;
+
+    uint32_t chunkCount = (uint32_t)((count+parallelChunkSamples-1)/parallelChunkSamples);
+    for(int id=0;id<pool->threadCount;id++)
+    {
+        uint32_t first = (uint32_t)(((uint64_t)chunkCount*id)/pool->threadCount);
+        uint32_t end = (uint32_t)(((uint64_t)chunkCount*(id+1))/pool->threadCount);
+        pool->ranges[id].chunks = packRange(first,end);
+    }
+
+    pool->finishedWorkers = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    runWorker(pool,0);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->finishedWorkers<(pool->threadCount-1))
+    {
+        pthread_cond_wait(&pool->done,&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->callerLock);
+}
@@ -0,0 +1,46 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _parallelCorrection_h_
+#define _parallelCorrection_h_
+
+#include <stddef.h>
+
+// samples corrected as one unit of work, the speeds, angles and corrected speeds of a
+// chunk take 48KB so a chunk stays in the core's cache while it is corrected
+#define parallelChunkSamples 4096
+
+// most threads a pool will run, including the calling thread
+#define parallelMaxThreads 64
+
+// pool of worker threads that correct chunks of a bulk correction in parallel, the thread
+// calling correctSpeedParallel works as well so a pool of n threads starts n-1 workers
+typedef struct correctionPool correctionPool;
+
+// returns NULL if threadCount is out of range or the threads can not be started
+correctionPool* createCorrectionPool(int threadCount);
+void destroyCorrectionPool(correctionPool* pool);
+int correctionPoolThreads(const correctionPool* pool);
+
+// corrects count samples across the pool, each sample is corrected by correctSpeedSimd
+// whichever thread takes its chunk, so the output is identical to a single
+// correctSpeedSimd call over the whole input
+//
+// one bulk correction at a time per pool, a second caller waits for the first to finish
+void correctSpeedParallel(correctionPool* pool, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Training run for the profile guided build of the library (make pgo)
+
+    Linked against the instrumented library, it drives the correction paths a service
+    calls with the wind the bench times them over (benchHarness.h), calm, gusty, storm,
+    sweep and veering, and with a recorded trace if one is given, so the profile the
+    pgo build is optimised with weights the branches and loops as real wind does.
+
+    usage: pgoTrain [-r repeats] [archive]
+
+        -r repeats  passes over each distribution (default 4)
+
+    archive is a binary archive of packed archiveRecords (see archiveStream.h).
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "benchHarness.h"
+#include "interpolator.h"
+#include "simdCorrection.h"
+#include "correctionLattice.h"
+#include "parallelCorrection.h"
+#include "calibrationProfile.h"
+#include "correctionCache.h"
+#include "smoothCorrection.h"
+#include "inverseCorrection.h"
+#include "packedProfile.h"
+#include "windVector.h"
+#include "archiveStream.h"
+
+// samples in each distribution, a day of 1 second readings
+#define trainSamples 86400
+
+// summaries are over 10 minute windows
+#define trainWindowSamples 600
+
+typedef struct
+{
+    correctionLattice lattice;
+    correctionPool* pool;
+    correctionCache* cache;
+    float* corrected;
+    float* restored;
+    float* whole;
+    windSummary windows[(trainSamples/trainWindowSamples)+1];
+    double checksum;
+} trainContext;
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: pgoTrain [-r repeats] [archive]\n");
+}
+
+// reads a binary archive into speed and angle arrays, returns the sample count or -1
+static long readTrace(const char* name, float** speed, float** angle)
+{
+    FILE* trace = fopen(name,"rb");
+    if(!trace)
+    {
+        return -1;
+    }
+    fseek(trace,0,SEEK_END);
+    size_t records = ftell(trace)/sizeof(archiveRecord);
+    fseek(trace,0,SEEK_SET);
+    *speed = (float*)malloc((records+1)*sizeof(float));
+    *angle = (float*)malloc((records+1)*sizeof(float));
+    size_t samples = 0;
+    archiveRecord record;
+    while(*speed && *angle && samples<records && fread(&record,sizeof(record),1,trace)==1)
+    {
+        (*speed)[samples] = record.windSpeed;
+        (*angle)[samples] = record.windDirection;
+        samples++;
+    }
+    fclose(trace);
+    return (*speed && *angle) ? (long)samples : -1;
+}
+
+// one pass of every path over count samples, a service's mix of single readings from a
+// live feed and bulk corrections of archives
+static void trainPaths(trainContext* context, const float* speed, const float* angle, size_t count)
+{
+    windAccumulator accumulator;
+    resetWindAccumulator(&accumulator);
+    for(size_t sample=0;sample<count;sample++)
+    {
+        context->checksum += correctSpeed(speed[sample],angle[sample]);
+        context->checksum += correctSpeed(&defaultCalibrationProfile,speed[sample],angle[sample]);
+        context->checksum += correctSpeedCached(context->cache,rintf(speed[sample]),rintf(angle[sample]));
+        context->checksum += correctSpeedLatticeNode(&context->lattice,(int)context->whole[sample],(int)rintf(angle[sample]));
+        context->checksum += accumulateWind(&accumulator,speed[sample],angle[sample]);
+    }
+
+    correctSpeedBatch(speed,angle,context->corrected,count);
+    correctSpeedSimd(speed,angle,context->corrected,count);
+    correctSpeedBinned(speed,angle,context->corrected,count);
+    correctSpeedLatticeBatch(&context->lattice,speed,angle,context->corrected,count);
+    correctSpeedParallel(context->pool,speed,angle,context->corrected,count);
+    correctSpeedPackedBatch(&defaultPackedProfile,speed,angle,context->corrected,count);
+    correctSpeedSmoothBatch(&defaultSmoothCorrection,speed,angle,context->corrected,count);
+    correctSpeedSimd(speed,angle,context->corrected,count);
+    uncorrectSpeedBatch(&defaultInverseCorrection,context->corrected,angle,context->restored,count);
+    correctWindWindows(speed,angle,count,trainWindowSamples,context->windows,context->corrected);
+    context->checksum += context->corrected[count/2]+context->restored[count/2];
+}
+
+int main(int argc, char* argv[])
+{
+    int repeats = 4;
+    int option;
+    while((option = getopt(argc,argv,"r:"))!=-1)
+    {
+        if(option!='r')
+        {
+            usage();
+            return 2;
+        }
+        repeats = atoi(optarg);
+    }
+    if((argc-optind)>1 || repeats<1)
+    {
+        usage();
+        return 2;
+    }
+
+    float* traceSpeed = NULL;
+    float* traceAngle = NULL;
+    long traceSamples = 0;
+    if(optind<argc)
+    {
+        traceSamples = readTrace(argv[optind],&traceSpeed,&traceAngle);
+        if(traceSamples<0)
+        {
+            fprintf(stderr,"pgoTrain: can not read %s\n",argv[optind]);
+            return 1;
+        }
+    }
+
+    size_t maxSamples = ((size_t)traceSamples>trainSamples) ? (size_t)traceSamples : trainSamples;
+    static trainContext context;
+    float* latticeStorage = (float*)malloc(correctionLatticeBytes(1.0f,1.0f));
+    float* speed = (float*)malloc(trainSamples*sizeof(float));
+    float* angle = (float*)malloc(trainSamples*sizeof(float));
+    context.corrected = (float*)malloc(maxSamples*sizeof(float));
+    context.restored = (float*)malloc(maxSamples*sizeof(float));
+    context.whole = (float*)malloc(maxSamples*sizeof(float));
+    context.pool = createCorrectionPool(2);
+    context.cache = createCorrectionCache(cacheMaxEntries);
+    if(!latticeStorage || !speed || !angle || !context.corrected || !context.restored || !context.whole || !context.pool || !context.cache)
+    {
+        fprintf(stderr,"pgoTrain: can not set up the correction paths\n");
+        return 1;
+    }
+    buildCorrectionLattice(&context.lattice,latticeStorage,1.0f,1.0f);
+
+    size_t trained = 0;
+    for(int distribution=0;distribution<=benchDistributionCount;distribution++)
+    {
+        const float* trainSpeed = speed;
+        const float* trainAngle = angle;
+        size_t count = trainSamples;
+        if(distribution<benchDistributionCount)
+        {
+            benchFillWind((benchDistribution)distribution,speed,angle,trainSamples);
+        }
+        else if(traceSamples>0)
+        {
+            trainSpeed = traceSpeed;
+            trainAngle = traceAngle;
+            count = traceSamples;
+        }
+        else
+        {
+            break;
+        }
+
+        // the lattice node takes whole mph inside the lattice
+        for(size_t sample=0;sample<count;sample++)
+        {
+            float wholeSpeed = rintf(trainSpeed[sample]);
+            wholeSpeed = (wholeSpeed>latticeMaxSpeed) ? latticeMaxSpeed : wholeSpeed;
+            context.whole[sample] = (wholeSpeed>=0.0f) ? wholeSpeed : 0.0f;
+        }
+        for(int repeat=0;repeat<repeats;repeat++)
+        {
+            trainPaths(&context,trainSpeed,trainAngle,count);
+            trained += count;
+        }
+    }
+
+    printf("PGO:trained on %zu samples, checksum %.6g\n",trained,context.checksum);
+
+    destroyCorrectionCache(context.cache);
+    destroyCorrectionPool(context.pool);
+    free(context.whole);
+    free(context.restored);
+    free(context.corrected);
+    free(angle);
+    free(speed);
+    free(latticeStorage);
+    free(traceAngle);
+    free(traceSpeed);
+
+    return 0;
+}
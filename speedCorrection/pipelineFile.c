@@ -0,0 +1,150 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Streams a csv archive of timestamp,speed,direction lines through the correction
+    pipeline (see correctionPipeline.h), reading, parsing, correcting, aggregating,
+    formatting and writing on their own threads, and writes timestamp,corrected
+    speed,direction lines.
+
+    usage: pipelineFile [-c workers] [-f workers] [-b blocks] [-s] [-q] [input [output]]
+
+        -c workers  threads correcting (default 1)
+        -f workers  threads formatting (default 1)
+        -b blocks   blocks queued between stages (default 4)
+        -s          run the stages one after another on one thread, for comparison
+        -q          do not report the mean wind and the time in each stage on stderr
+
+    input and output default to stdin and stdout, - also means stdin or stdout.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "correctionPipeline.h"
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: pipelineFile [-c workers] [-f workers] [-b blocks] [-s] [-q] [input [output]]\n");
+}
+
+static void reportStage(const char* name, const pipelineStageStats* stats)
+{
+    fprintf(stderr,"pipelineFile: %-10s %6llu blocks, busy %.3f s, starved %.3f s, blocked %.3f s\n",name,
+            (unsigned long long)stats->blocks,stats->busySeconds,stats->starvedSeconds,stats->blockedSeconds);
+}
+
+int main(int argc, char* argv[])
+{
+    int correctWorkers = 1;
+    int formatWorkers = 1;
+    int queueBlocks = 4;
+    int sequential = 0;
+    int quiet = 0;
+    int option;
+
+    while((option = getopt(argc,argv,"c:f:b:sq"))!=-1)
+    {
+        switch(option)
+        {
+            case 'c':
+                correctWorkers = atoi(optarg);
+                break;
+            case 'f':
+                formatWorkers = atoi(optarg);
+                break;
+            case 'b':
+                queueBlocks = atoi(optarg);
+                break;
+            case 's':
+                sequential = 1;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if((argc-optind)>2)
+    {
+        usage();
+        return 2;
+    }
+
+    const char* inputName = (optind<argc) ? argv[optind] : "-";
+    const char* outputName = ((optind+1)<argc) ? argv[optind+1] : "-";
+    static pipelineTextSource source;
+    source.fd = strcmp(inputName,"-") ? open(inputName,O_RDONLY) : STDIN_FILENO;
+    if(source.fd<0)
+    {
+        fprintf(stderr,"pipelineFile: %s: %s\n",inputName,strerror(errno));
+        return 1;
+    }
+    int outputFd = strcmp(outputName,"-") ? open(outputName,O_WRONLY|O_CREAT|O_TRUNC,0644) : STDOUT_FILENO;
+    if(outputFd<0)
+    {
+        fprintf(stderr,"pipelineFile: %s: %s\n",outputName,strerror(errno));
+        return 1;
+    }
+
+    pipelineAggregate aggregate;
+    memset(&aggregate,0,sizeof(aggregate));
+    pipelineConfig config;
+    memset(&config,0,sizeof(config));
+    config.source = (pipelineStage){"read",readTextBlock,&source,1};
+    config.stages[0] = (pipelineStage){"parse",parseWindBlock,NULL,1};
+    config.stages[1] = (pipelineStage){"correct",correctWindBlock,NULL,correctWorkers};
+    config.stages[2] = (pipelineStage){"aggregate",aggregateWindBlock,&aggregate,1};
+    config.stages[3] = (pipelineStage){"format",formatWindBlock,NULL,formatWorkers};
+    config.stages[4] = (pipelineStage){"write",writeTextBlock,&outputFd,1};
+    config.stageCount = 5;
+    config.queueBlocks = queueBlocks;
+
+    pipelineStats stats;
+    int result = sequential ? runPipelineSequentially(&config,&stats) : runPipeline(&config,&stats);
+    if(result<0)
+    {
+        fprintf(stderr,"pipelineFile: %s\n",strerror(errno));
+        return 1;
+    }
+    if(outputFd!=STDOUT_FILENO && close(outputFd)<0)
+    {
+        fprintf(stderr,"pipelineFile: %s: %s\n",outputName,strerror(errno));
+        return 1;
+    }
+
+    if(!quiet)
+    {
+        windSummary summary;
+        summariseWind(&aggregate.wind,&summary);
+        fprintf(stderr,"pipelineFile: %llu samples in %.3f s, %.1f M samples/s\n",(unsigned long long)stats.samples,
+                stats.seconds,(stats.seconds>0.0) ? stats.samples/(stats.seconds*1e6) : 0.0);
+        fprintf(stderr,"pipelineFile: mean %.2f mph, vector mean %.2f mph from %.0f degrees, peak %.2f mph\n",
+                summary.meanSpeed,summary.vectorSpeed,summary.direction,aggregate.peak);
+        reportStage(config.source.name,&stats.source);
+        for(int stage=0;stage<config.stageCount;stage++)
+        {
+            reportStage(config.stages[stage].name,&stats.stages[stage]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Hand vectorised wind speed correction for interpolator.c
+
+    Each lane follows correctSpeed step for step. The speed site is found from the
+    equally spaced run of the speed site index with two fix-up compares, and the
+    0->90 / 90->180 sector is chosen with masks rather than a branch. The correction
+    table is rearranged so that every value a lane needs is a single gather indexed
+    by its low speed site and sector.
+
+    correctSpeed divides the angle by 90.0 in double precision, the kernels divide in
+    single precision. The two agree for every float angle in 0->180 because x/90 never
+    lies close enough to a float rounding boundary for the double rounding to matter
+    (checked exhaustively when this was written).
+
+    The kernel is chosen once at start up from the features the cpu reports.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <math.h>
+#include "simdCorrection.h"
+#include "interpolator.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define simdHaveX86
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define simdHaveNeon
+#endif
+
+// rows are padded so every sector offset plus row stays inside the arrays
+#define simdRows 32
+
+// correction table rearranged for the kernels
+typedef struct
+{
+    float searchSpeed[simdRows];        // site speeds, first and last replaced by -inf/+inf
+    float siteSpeed[simdRows];          // site speeds
+    float siteDelta[simdRows];          // siteSpeed[row+1]-siteSpeed[row]
+    float sectorBase[2*simdRows];       // correction at the start of the sector, by sector*simdRows+row
+    float sectorSlope[2*simdRows];      // correction change across the sector, by sector*simdRows+row
+    float uniformOrigin;                // equally spaced run from the speed site index
+    float uniformScale;
+    float offsetLimit;                  // largest offset into the run
+    int uniformLow;
+    int usable;                         // the site layout suits the kernel
+} simdTable;
+
+static simdTable buildSimdTable(void)
+{
+    simdTable table = {};
+    speedSiteIndex index = buildSpeedSiteIndex(&correctionTable[0][0],4,correctionTableSize);
+
+    for(int row=0;row<correctionTableSize;row++)
+    {
+        table.siteSpeed[row] = correctionTable[row][0];
+        table.searchSpeed[row] = correctionTable[row][0];
+        table.siteDelta[row] = (row<(correctionTableSize-1)) ? (correctionTable[row+1][0]-correctionTable[row][0]) : 1.0f;
+        table.sectorBase[row] = correctionTable[row][1];
+        table.sectorSlope[row] = correctionTable[row][2]-correctionTable[row][1];
+        table.sectorBase[simdRows+row] = correctionTable[row][2];
+        table.sectorSlope[simdRows+row] = correctionTable[row][3]-correctionTable[row][2];
+    }
+
+    // the fix-up compares never step below site 1 or above the last site, which is where
+    // correctSpeed clamps the search
+    table.searchSpeed[0] = -INFINITY;
+    table.searchSpeed[correctionTableSize-1] = INFINITY;
+
+    // the kernel only handles speeds outside the equally spaced run when there is at most
+    // one site either side of it, as in the Davis table
+    table.uniformOrigin = index.uniformOrigin;
+    table.uniformScale = index.uniformScale;
+    table.uniformLow = index.uniformLow;
+    table.offsetLimit = correctionTableSize-2-index.uniformLow;
+    table.usable = (index.uniformHigh>index.uniformLow && index.uniformLow<=1 && index.uniformHigh>=(correctionTableSize-2)) ? 1 : 0;
+
+    return table;
+}
+
+static const simdTable kernelTable = buildSimdTable();
+
+#ifdef simdHaveX86
+
+static inline __m128 gatherSse2(const float* table, __m128i index)
+{
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes,index);
+    return _mm_setr_ps(table[lanes[0]],table[lanes[1]],table[lanes[2]],table[lanes[3]]);
+}
+
+static inline __m128 correctSse2(__m128 rawSpeed, __m128 angle)
+{
+    const simdTable* table = &kernelTable;
+
+    // calculate the angle to be used in the calculation
+    __m128 foldedAngle = _mm_sub_ps(_mm_set1_ps(360.0f),angle);
+    __m128 fold = _mm_cmplt_ps(foldedAngle,angle);
+    __m128 correctionAngle = _mm_or_ps(_mm_and_ps(fold,foldedAngle),_mm_andnot_ps(fold,angle));
+
+    // candidate site from the spacing, then step up and down as findSpeedSite does
+    __m128 offset = _mm_mul_ps(_mm_sub_ps(rawSpeed,_mm_set1_ps(table->uniformOrigin)),_mm_set1_ps(table->uniformScale));
+    offset = _mm_max_ps(offset,_mm_setzero_ps());
+    offset = _mm_min_ps(offset,_mm_set1_ps(table->offsetLimit));
+    __m128i site = _mm_add_epi32(_mm_cvttps_epi32(offset),_mm_set1_epi32(table->uniformLow+1));
+    __m128 above = _mm_cmpgt_ps(rawSpeed,gatherSse2(table->searchSpeed,site));
+    site = _mm_sub_epi32(site,_mm_castps_si128(above));
+    __m128 below = _mm_cmple_ps(rawSpeed,gatherSse2(table->searchSpeed,_mm_sub_epi32(site,_mm_set1_epi32(1))));
+    site = _mm_add_epi32(site,_mm_castps_si128(below));
+    __m128i siteLow = _mm_sub_epi32(site,_mm_set1_epi32(1));
+
+    __m128 speedOffset = _mm_sub_ps(rawSpeed,gatherSse2(table->siteSpeed,siteLow));
+    __m128 speedFactor = _mm_div_ps(speedOffset,gatherSse2(table->siteDelta,siteLow));
+
+    // 0->90 or 90->180 sector, NaN angles take the upper sector as correctSpeed does
+    __m128 upper = _mm_cmpnle_ps(correctionAngle,_mm_set1_ps(90.0f));
+    __m128 angleOrigin = _mm_and_ps(upper,_mm_set1_ps(90.0f));
+    __m128 angleFactor = _mm_div_ps(_mm_sub_ps(correctionAngle,angleOrigin),_mm_set1_ps(90.0f));
+    __m128i row = _mm_add_epi32(siteLow,_mm_and_si128(_mm_castps_si128(upper),_mm_set1_epi32(simdRows)));
+    __m128i rowHigh = _mm_add_epi32(row,_mm_set1_epi32(1));
+
+    __m128 speedCorrectionLow = _mm_add_ps(_mm_mul_ps(gatherSse2(table->sectorSlope,row),angleFactor),gatherSse2(table->sectorBase,row));
+    __m128 speedCorrectionHigh = _mm_add_ps(_mm_mul_ps(gatherSse2(table->sectorSlope,rowHigh),angleFactor),gatherSse2(table->sectorBase,rowHigh));
+
+    __m128 calculatedSpeed = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(speedCorrectionHigh,speedCorrectionLow),speedFactor),speedCorrectionLow);
+    return _mm_add_ps(calculatedSpeed,rawSpeed);
+}
+
+static void correctSse2Batch(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    size_t sample = 0;
+    for(;sample+8<=count;sample+=8)
+    {
+        __m128 first = correctSse2(_mm_loadu_ps(&rawSpeed[sample]),_mm_loadu_ps(&angle[sample]));
+        __m128 second = correctSse2(_mm_loadu_ps(&rawSpeed[sample+4]),_mm_loadu_ps(&angle[sample+4]));
+        _mm_storeu_ps(&correctedSpeed[sample],first);
+        _mm_storeu_ps(&correctedSpeed[sample+4],second);
+    }
+
+    correctSpeedBatch(&rawSpeed[sample],&angle[sample],&correctedSpeed[sample],count-sample);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 correctAvx2(__m256 rawSpeed, __m256 angle)
+{
+    const simdTable* table = &kernelTable;
+
+    // calculate the angle to be used in the calculation
+    __m256 foldedAngle = _mm256_sub_ps(_mm256_set1_ps(360.0f),angle);
+    __m256 correctionAngle = _mm256_blendv_ps(angle,foldedAngle,_mm256_cmp_ps(foldedAngle,angle,_CMP_LT_OQ));
+
+    // candidate site from the spacing, then step up and down as findSpeedSite does
+    __m256 offset = _mm256_mul_ps(_mm256_sub_ps(rawSpeed,_mm256_set1_ps(table->uniformOrigin)),_mm256_set1_ps(table->uniformScale));
+    offset = _mm256_max_ps(offset,_mm256_setzero_ps());
+    offset = _mm256_min_ps(offset,_mm256_set1_ps(table->offsetLimit));
+    __m256i site = _mm256_add_epi32(_mm256_cvttps_epi32(offset),_mm256_set1_epi32(table->uniformLow+1));
+    __m256 above = _mm256_cmp_ps(rawSpeed,_mm256_i32gather_ps(table->searchSpeed,site,4),_CMP_GT_OQ);
+    site = _mm256_sub_epi32(site,_mm256_castps_si256(above));
+    __m256 below = _mm256_cmp_ps(rawSpeed,_mm256_i32gather_ps(table->searchSpeed,_mm256_sub_epi32(site,_mm256_set1_epi32(1)),4),_CMP_LE_OQ);
+    site = _mm256_add_epi32(site,_mm256_castps_si256(below));
+    __m256i siteLow = _mm256_sub_epi32(site,_mm256_set1_epi32(1));
+
+    __m256 speedOffset = _mm256_sub_ps(rawSpeed,_mm256_i32gather_ps(table->siteSpeed,siteLow,4));
+    __m256 speedFactor = _mm256_div_ps(speedOffset,_mm256_i32gather_ps(table->siteDelta,siteLow,4));
+
+    // 0->90 or 90->180 sector, NaN angles take the upper sector as correctSpeed does
+    __m256 upper = _mm256_cmp_ps(correctionAngle,_mm256_set1_ps(90.0f),_CMP_NLE_UQ);
+    __m256 angleOrigin = _mm256_and_ps(upper,_mm256_set1_ps(90.0f));
+    __m256 angleFactor = _mm256_div_ps(_mm256_sub_ps(correctionAngle,angleOrigin),_mm256_set1_ps(90.0f));
+    __m256i row = _mm256_add_epi32(siteLow,_mm256_and_si256(_mm256_castps_si256(upper),_mm256_set1_epi32(simdRows)));
+    __m256i rowHigh = _mm256_add_epi32(row,_mm256_set1_epi32(1));
+
+    __m256 speedCorrectionLow = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(table->sectorSlope,row,4),angleFactor),_mm256_i32gather_ps(table->sectorBase,row,4));
+    __m256 speedCorrectionHigh = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(table->sectorSlope,rowHigh,4),angleFactor),_mm256_i32gather_ps(table->sectorBase,rowHigh,4));
+
+    __m256 calculatedSpeed = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(speedCorrectionHigh,speedCorrectionLow),speedFactor),speedCorrectionLow);
+    return _mm256_add_ps(calculatedSpeed,rawSpeed);
+}
+
+__attribute__((target("avx2")))
+static void correctAvx2Batch(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    size_t sample = 0;
+    for(;sample+8<=count;sample+=8)
+    {
+        __m256 corrected = correctAvx2(_mm256_loadu_ps(&rawSpeed[sample]),_mm256_loadu_ps(&angle[sample]));
+        _mm256_storeu_ps(&correctedSpeed[sample],corrected);
+    }
+
+    correctSpeedBatch(&rawSpeed[sample],&angle[sample],&correctedSpeed[sample],count-sample);
+}
+
+#endif
+
+#ifdef simdHaveNeon
+
+static inline float32x4_t gatherNeon(const float* table, int32x4_t index)
+{
+    float32x4_t gathered = vdupq_n_f32(0.0f);
+    gathered = vsetq_lane_f32(table[vgetq_lane_s32(index,0)],gathered,0);
+    gathered = vsetq_lane_f32(table[vgetq_lane_s32(index,1)],gathered,1);
+    gathered = vsetq_lane_f32(table[vgetq_lane_s32(index,2)],gathered,2);
+    gathered = vsetq_lane_f32(table[vgetq_lane_s32(index,3)],gathered,3);
+    return gathered;
+}
+
+static inline float32x4_t correctNeon(float32x4_t rawSpeed, float32x4_t angle)
+{
+    const simdTable* table = &kernelTable;
+
+    // calculate the angle to be used in the calculation
+    float32x4_t foldedAngle = vsubq_f32(vdupq_n_f32(360.0f),angle);
+    float32x4_t correctionAngle = vbslq_f32(vcltq_f32(foldedAngle,angle),foldedAngle,angle);
+
+    // candidate site from the spacing, then step up and down as findSpeedSite does, the
+    // maxnm keeps NaN speeds on a valid site
+    float32x4_t offset = vmulq_f32(vsubq_f32(rawSpeed,vdupq_n_f32(table->uniformOrigin)),vdupq_n_f32(table->uniformScale));
+    offset = vmaxnmq_f32(offset,vdupq_n_f32(0.0f));
+    offset = vminq_f32(offset,vdupq_n_f32(table->offsetLimit));
+    int32x4_t site = vaddq_s32(vcvtq_s32_f32(offset),vdupq_n_s32(table->uniformLow+1));
+    uint32x4_t above = vcgtq_f32(rawSpeed,gatherNeon(table->searchSpeed,site));
+    site = vsubq_s32(site,vreinterpretq_s32_u32(above));
+    uint32x4_t below = vcleq_f32(rawSpeed,gatherNeon(table->searchSpeed,vsubq_s32(site,vdupq_n_s32(1))));
+    site = vaddq_s32(site,vreinterpretq_s32_u32(below));
+    int32x4_t siteLow = vsubq_s32(site,vdupq_n_s32(1));
+
+    float32x4_t speedOffset = vsubq_f32(rawSpeed,gatherNeon(table->siteSpeed,siteLow));
+    float32x4_t speedFactor = vdivq_f32(speedOffset,gatherNeon(table->siteDelta,siteLow));
+
+    // 0->90 or 90->180 sector, NaN angles take the upper sector as correctSpeed does
+    uint32x4_t upper = vmvnq_u32(vcleq_f32(correctionAngle,vdupq_n_f32(90.0f)));
+    float32x4_t angleOrigin = vreinterpretq_f32_u32(vandq_u32(upper,vreinterpretq_u32_f32(vdupq_n_f32(90.0f))));
+    float32x4_t angleFactor = vdivq_f32(vsubq_f32(correctionAngle,angleOrigin),vdupq_n_f32(90.0f));
+    int32x4_t row = vaddq_s32(siteLow,vandq_s32(vreinterpretq_s32_u32(upper),vdupq_n_s32(simdRows)));
+    int32x4_t rowHigh = vaddq_s32(row,vdupq_n_s32(1));
+
+    float32x4_t speedCorrectionLow = vaddq_f32(vmulq_f32(gatherNeon(table->sectorSlope,row),angleFactor),gatherNeon(table->sectorBase,row));
+    float32x4_t speedCorrectionHigh = vaddq_f32(vmulq_f32(gatherNeon(table->sectorSlope,rowHigh),angleFactor),gatherNeon(table->sectorBase,rowHigh));
+
+    float32x4_t calculatedSpeed = vaddq_f32(vmulq_f32(vsubq_f32(speedCorrectionHigh,speedCorrectionLow),speedFactor),speedCorrectionLow);
+    return vaddq_f32(calculatedSpeed,rawSpeed);
+}
+
+static void correctNeonBatch(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    size_t sample = 0;
+    for(;sample+8<=count;sample+=8)
+    {
+        float32x4_t first = correctNeon(vld1q_f32(&rawSpeed[sample]),vld1q_f32(&angle[sample]));
+        float32x4_t second = correctNeon(vld1q_f32(&rawSpeed[sample+4]),vld1q_f32(&angle[sample+4]));
+        vst1q_f32(&correctedSpeed[sample],first);
+        vst1q_f32(&correctedSpeed[sample+4],second);
+    }
+
+    correctSpeedBatch(&rawSpeed[sample],&angle[sample],&correctedSpeed[sample],count-sample);
+}
+
+#endif
+
+int avx2Supported(void)
+{
+#ifdef simdHaveX86
+    // this can run from a static initialiser, before the runtime has probed the cpu
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+int simdLevelSupported(simdLevel level)
+{
+    if(level==simdScalar)
+    {
+        return 1;
+    }
+
+    if(!kernelTable.usable)
+    {
+        return 0;
+    }
+
+    switch(level)
+    {
+#ifdef simdHaveX86
+        case simdSse2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2") ? 1 : 0;
+        case simdAvx2:
+            return avx2Supported();
+#endif
+#ifdef simdHaveNeon
+        case simdNeon:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+simdLevel bestSimdLevel(void)
+{
+    simdLevel best = simdScalar;
+    for(int level=simdScalar;level<simdLevelCount;level++)
+    {
+        if(simdLevelSupported((simdLevel)level))
+        {
+            best = (simdLevel)level;
+        }
+    }
+    return best;
+}
+
+const char* simdLevelName(simdLevel level)
+{
+    switch(level)
+    {
+        case simdScalar:
+            return "scalar";
+        case simdSse2:
+            return "sse2";
+        case simdAvx2:
+            return "avx2";
+        case simdNeon:
+            return "neon";
+        default:
+            return "unknown";
+    }
+}
+
+void correctSpeedSimdLevel(simdLevel level, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    if(!simdLevelSupported(level))
+    {
+        level = simdScalar;
+    }
+
+    switch(level)
+    {
+#ifdef simdHaveX86
+        case simdSse2:
+            correctSse2Batch(rawSpeed,angle,correctedSpeed,count);
+            break;
+        case simdAvx2:
+            correctAvx2Batch(rawSpeed,angle,correctedSpeed,count);
+            break;
+#endif
+#ifdef simdHaveNeon
+        case simdNeon:
+            correctNeonBatch(rawSpeed,angle,correctedSpeed,count);
+            break;
+#endif
+        default:
+            correctSpeedBatch(rawSpeed,angle,correctedSpeed,count);
+            break;
+    }
+}
+
+static const simdLevel selectedLevel = bestSimdLevel();
+
+void correctSpeedSimd(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    correctSpeedSimdLevel(selectedLevel,rawSpeed,angle,correctedSpeed,count);
+}
@@ -0,0 +1,50 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _simdCorrection_h_
+#define _simdCorrection_h_
+
+#include <stddef.h>
+
+// instruction set levels of the hand vectorised correction kernel
+typedef enum
+{
+    simdScalar = 0,             // correctSpeedBatch, always available
+    simdSse2,                   // 2 x 4 lanes per iteration, gathers done as scalar loads
+    simdAvx2,                   // 8 lanes per iteration, hardware gathers
+    simdNeon,                   // 2 x 4 lanes per iteration, aarch64 only
+    simdLevelCount
+} simdLevel;
+
+// the kernels perform the same operations in the same order as correctSpeed and are bit
+// identical to it on x86, the tolerance allows for multiply-add contraction elsewhere
+#define simdUlpTolerance 2
+
+simdLevel bestSimdLevel(void);
+int simdLevelSupported(simdLevel level);
+
+// 1 if this cpu runs avx2, whatever the table, for the other avx2 kernels to pick their path
+int avx2Supported(void);
+const char* simdLevelName(simdLevel level);
+
+// corrects count samples with the best kernel this cpu supports
+void correctSpeedSimd(const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+// corrects count samples with the given kernel, unsupported levels use the scalar kernel
+void correctSpeedSimdLevel(simdLevel level, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Both splines are linear in the values they pass through, so the periodic spline in
+    angle is a weighted sum of the three angle columns whose weights are cubics in the
+    angle and the same for every speed. Multiplying each column's cubic in speed by its
+    weight cubic and summing gives one bicubic per speed interval and angle sector,
+    worked out once in double precision. A correction is then the interval search, four
+    cubics in the angle for the coefficients of the cubic in speed and that cubic, 15
+    multiply-adds against correctSpeed's 3.
+
+    Outside the sites t is clamped to the end interval and the part of t beyond it is
+    multiplied by the change across the interval, the straight line through its sites.
+    The end slopes of the speed cubics are set to that line so the slope does not jump.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include "smoothCorrection.h"
+#include "interpolator.h"
+#include "simdCorrection.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define smoothHaveX86
+#endif
+
+#define smoothColumns 3
+
+// weights of the 0, 90 and 180 degree columns across each sector as cubics in a, from the
+// periodic spline through 0, 90, 180 and 270 degrees with 270 holding the 90 degree column
+static void angleWeights(double weights[2][smoothColumns][4])
+{
+    for(int column=0;column<smoothColumns;column++)
+    {
+        double y[3] = {0.0,0.0,0.0};
+        y[column] = 1.0;
+
+        // second derivatives scaled by h^2/6, the spline is even about 0 and 180 degrees so
+        // the four periodic equations fold down to three
+        //     4 m0 + 2 m1        = 2 (y1-y0)
+        //       m0 + 4 m1 +   m2 = y0-2 y1+y2
+        //            2 m1 + 4 m2 = 2 (y1-y2)
+        double r0 = 2.0*(y[1]-y[0]);
+        double r1 = y[0]-(2.0*y[1])+y[2];
+        double r2 = 2.0*(y[1]-y[2]);
+        double determinant = 4.0*((4.0*4.0)-(1.0*2.0))-2.0*((1.0*4.0)-(1.0*0.0));
+        double m[3];
+        m[0] = (r0*((4.0*4.0)-(1.0*2.0))-2.0*((r1*4.0)-(1.0*r2)))/determinant;
+        m[1] = (4.0*((r1*4.0)-(1.0*r2))-r0*((1.0*4.0)-(1.0*0.0)))/determinant;
+        m[2] = (r2-(2.0*m[1]))/4.0;
+
+        for(int sector=0;sector<2;sector++)
+        {
+            weights[sector][column][0] = y[sector];
+            weights[sector][column][1] = y[sector+1]-y[sector]-(2.0*m[sector])-m[sector+1];
+            weights[sector][column][2] = 3.0*m[sector];
+            weights[sector][column][3] = m[sector+1]-m[sector];
+        }
+    }
+}
+
+int buildSmoothCorrection(smoothCorrection* smooth, const float (*rows)[4], int rowCount)
+{
+    if(rowCount<2 || rowCount>smoothMaxSites)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(int row=1;row<rowCount;row++)
+    {
+        if(!(rows[row][0]>rows[row-1][0]))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    int intervals = rowCount-1;
+    double speedCubics[smoothMaxSites-1][smoothColumns][4];
+    for(int column=0;column<smoothColumns;column++)
+    {
+        // Fritsch-Butland slopes of the correction, the weighted harmonic mean of the
+        // secants either side or flat at a local extreme or next to a flat interval, and the
+        // end secants at the ends
+        double width[smoothMaxSites];
+        double secant[smoothMaxSites];
+        double slope[smoothMaxSites];
+        for(int interval=0;interval<intervals;interval++)
+        {
+            width[interval] = (double)rows[interval+1][0]-rows[interval][0];
+            secant[interval] = ((double)rows[interval+1][column+1]-rows[interval][column+1])/width[interval];
+        }
+        slope[0] = secant[0];
+        slope[intervals] = secant[intervals-1];
+        for(int site=1;site<intervals;site++)
+        {
+            double left = secant[site-1];
+            double right = secant[site];
+            if((left*right)<=0.0)
+            {
+                slope[site] = 0.0;
+            }
+            else
+            {
+                double leftWeight = (2.0*width[site])+width[site-1];
+                double rightWeight = width[site]+(2.0*width[site-1]);
+                slope[site] = (leftWeight+rightWeight)/((leftWeight/left)+(rightWeight/right));
+            }
+        }
+
+        // Hermite cubic of the correction in t
+        for(int interval=0;interval<intervals;interval++)
+        {
+            double low = rows[interval][column+1];
+            double change = (double)rows[interval+1][column+1]-low;
+            double lowSlope = width[interval]*slope[interval];
+            double highSlope = width[interval]*slope[interval+1];
+            speedCubics[interval][column][0] = low;
+            speedCubics[interval][column][1] = lowSlope;
+            speedCubics[interval][column][2] = (3.0*change)-(2.0*lowSlope)-highSlope;
+            speedCubics[interval][column][3] = lowSlope+highSlope-(2.0*change);
+        }
+    }
+
+    double weights[2][smoothColumns][4];
+    angleWeights(weights);
+
+    memset(smooth,0,sizeof(smoothCorrection));
+    smooth->siteCount = rowCount;
+    for(int row=0;row<rowCount;row++)
+    {
+        smooth->sites[row] = rows[row][0];
+        smooth->scales[row] = (row<intervals) ? (float)(1.0/((double)rows[row+1][0]-rows[row][0])) : 0.0f;
+    }
+    for(int sector=0;sector<2;sector++)
+    {
+        for(int interval=0;interval<intervals;interval++)
+        {
+            for(int speedPower=0;speedPower<4;speedPower++)
+            {
+                for(int anglePower=0;anglePower<4;anglePower++)
+                {
+                    double coefficient = 0.0;
+                    for(int column=0;column<smoothColumns;column++)
+                    {
+                        coefficient += speedCubics[interval][column][speedPower]*weights[sector][column][anglePower];
+                    }
+                    smooth->patches[sector][interval].coefficients[speedPower][anglePower] = coefficient;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int buildSmoothCorrection(smoothCorrection* smooth, const calibrationProfile* profile)
+{
+    if(profile->siteCount>smoothMaxSites)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    float rows[smoothMaxSites][4];
+    for(int row=0;row<profile->siteCount;row++)
+    {
+        rows[row][0] = profile->speeds[row];
+        for(int column=0;column<smoothColumns;column++)
+        {
+            rows[row][column+1] = profile->corrections[row][column]/10.0f;
+        }
+    }
+    return buildSmoothCorrection(smooth,rows,profile->siteCount);
+}
+
+static smoothCorrection buildDefaultSmoothCorrection(void)
+{
+    smoothCorrection smooth;
+    buildSmoothCorrection(&smooth,correctionTable,correctionTableSize);
+    return smooth;
+}
+
+const smoothCorrection defaultSmoothCorrection = buildDefaultSmoothCorrection();
+
+static inline float smoothSample(const smoothCorrection* smooth, float rawSpeed, float angle)
+{
+    // fold and pick the sector as correctSample does, NaN angles take the upper sector
+    float foldedAngle = 360.0f-angle;
+    float correctionAngle = (foldedAngle<angle) ? foldedAngle : angle;
+    int upperSector = (correctionAngle<=90.0f) ? 0 : 1;
+    float a = (correctionAngle-(90.0f*upperSector))*(1.0f/90.0f);
+
+    // count the inner sites below the speed, speeds off either end (and NaN) stay on the
+    // end intervals
+    int interval = 0;
+    for(int site=1;site<(smooth->siteCount-1);site++)
+    {
+        interval += (rawSpeed>smooth->sites[site]) ? 1 : 0;
+    }
+    float t = (rawSpeed-smooth->sites[interval])*smooth->scales[interval];
+    float inside = (t<0.0f) ? 0.0f : ((t>1.0f) ? 1.0f : t);
+    float beyond = t-inside;
+
+    const float (*c)[4] = smooth->patches[upperSector][interval].coefficients;
+    float q0 = (((c[0][3]*a)+c[0][2])*a+c[0][1])*a+c[0][0];
+    float q1 = (((c[1][3]*a)+c[1][2])*a+c[1][1])*a+c[1][0];
+    float q2 = (((c[2][3]*a)+c[2][2])*a+c[2][1])*a+c[2][0];
+    float q3 = (((c[3][3]*a)+c[3][2])*a+c[3][1])*a+c[3][0];
+    float correction = (((q3*inside)+q2)*inside+q1)*inside+q0;
+    correction += beyond*((q1+q2)+q3);
+
+    return rawSpeed+correction;
+}
+
+float correctSpeedSmooth(float rawSpeed, float angle)
+{
+    return smoothSample(&defaultSmoothCorrection,rawSpeed,angle);
+}
+
+float correctSpeedSmooth(const smoothCorrection* smooth, float rawSpeed, float angle)
+{
+    return smoothSample(smooth,rawSpeed,angle);
+}
+
+static void smoothScalarBatch(const smoothCorrection* smooth, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        correctedSpeed[sample] = smoothSample(smooth,rawSpeed[sample],angle[sample]);
+    }
+}
+
+#ifdef smoothHaveX86
+
+// every step as smoothSample takes it, the patch coefficients are gathered by interval and
+// sector and the inner sites are compared a site at a time across all eight lanes
+__attribute__((target("avx2")))
+static inline __m256 smoothAvx2(const smoothCorrection* smooth, __m256 rawSpeed, __m256 angle)
+{
+    __m256 foldedAngle = _mm256_sub_ps(_mm256_set1_ps(360.0f),angle);
+    __m256 correctionAngle = _mm256_blendv_ps(angle,foldedAngle,_mm256_cmp_ps(foldedAngle,angle,_CMP_LT_OQ));
+    __m256 upper = _mm256_cmp_ps(correctionAngle,_mm256_set1_ps(90.0f),_CMP_NLE_UQ);
+    __m256 a = _mm256_mul_ps(_mm256_sub_ps(correctionAngle,_mm256_and_ps(upper,_mm256_set1_ps(90.0f))),_mm256_set1_ps(1.0f/90.0f));
+
+    __m256i interval = _mm256_setzero_si256();
+    for(int site=1;site<(smooth->siteCount-1);site++)
+    {
+        __m256 above = _mm256_cmp_ps(rawSpeed,_mm256_set1_ps(smooth->sites[site]),_CMP_GT_OQ);
+        interval = _mm256_sub_epi32(interval,_mm256_castps_si256(above));
+    }
+    __m256 t = _mm256_mul_ps(_mm256_sub_ps(rawSpeed,_mm256_i32gather_ps(smooth->sites,interval,4)),
+                             _mm256_i32gather_ps(smooth->scales,interval,4));
+    // max and min return their second operand for NaN, which keeps NaN t as smoothSample does
+    __m256 inside = _mm256_max_ps(_mm256_set1_ps(0.0f),t);
+    inside = _mm256_min_ps(_mm256_set1_ps(1.0f),inside);
+    __m256 beyond = _mm256_sub_ps(t,inside);
+
+    __m256i sector = _mm256_and_si256(_mm256_castps_si256(upper),_mm256_set1_epi32(smoothMaxSites-1));
+    __m256i patch = _mm256_slli_epi32(_mm256_add_epi32(interval,sector),4);
+    const float* coefficients = &smooth->patches[0][0].coefficients[0][0];
+    __m256 q[4];
+    for(int speedPower=0;speedPower<4;speedPower++)
+    {
+        const float* row = coefficients+(speedPower*4);
+        __m256 value = _mm256_i32gather_ps(row+3,patch,4);
+        value = _mm256_add_ps(_mm256_mul_ps(value,a),_mm256_i32gather_ps(row+2,patch,4));
+        value = _mm256_add_ps(_mm256_mul_ps(value,a),_mm256_i32gather_ps(row+1,patch,4));
+        q[speedPower] = _mm256_add_ps(_mm256_mul_ps(value,a),_mm256_i32gather_ps(row,patch,4));
+    }
+    __m256 correction = _mm256_add_ps(_mm256_mul_ps(q[3],inside),q[2]);
+    correction = _mm256_add_ps(_mm256_mul_ps(correction,inside),q[1]);
+    correction = _mm256_add_ps(_mm256_mul_ps(correction,inside),q[0]);
+    correction = _mm256_add_ps(correction,_mm256_mul_ps(beyond,_mm256_add_ps(_mm256_add_ps(q[1],q[2]),q[3])));
+
+    return _mm256_add_ps(rawSpeed,correction);
+}
+
+__attribute__((target("avx2")))
+static void smoothAvx2Batch(const smoothCorrection* smooth, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    size_t sample = 0;
+    for(;sample+8<=count;sample+=8)
+    {
+        __m256 corrected = smoothAvx2(smooth,_mm256_loadu_ps(&rawSpeed[sample]),_mm256_loadu_ps(&angle[sample]));
+        _mm256_storeu_ps(&correctedSpeed[sample],corrected);
+    }
+
+    smoothScalarBatch(smooth,&rawSpeed[sample],&angle[sample],&correctedSpeed[sample],count-sample);
+}
+
+static const int smoothUseAvx2 = avx2Supported();
+
+#endif
+
+void correctSpeedSmoothBatch(const smoothCorrection* smooth, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+#ifdef smoothHaveX86
+    if(smoothUseAvx2)
+    {
+        smoothAvx2Batch(smooth,rawSpeed,angle,correctedSpeed,count);
+        return;
+    }
+#endif
+    smoothScalarBatch(smooth,rawSpeed,angle,correctedSpeed,count);
+}
+
+void correctSpeedInterpolated(interpolationMode mode, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count)
+{
+    if(mode==interpolationSmooth)
+    {
+        correctSpeedSmoothBatch(&defaultSmoothCorrection,rawSpeed,angle,correctedSpeed,count);
+    }
+    else
+    {
+        correctSpeedSimd(rawSpeed,angle,correctedSpeed,count);
+    }
+}
+
+const char* interpolationModeName(interpolationMode mode)
+{
+    switch(mode)
+    {
+        case interpolationLinear:
+            return "linear";
+        case interpolationSmooth:
+            return "smooth";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,85 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _smoothCorrection_h_
+#define _smoothCorrection_h_
+
+#include <stddef.h>
+#include "calibrationProfile.h"
+
+#define smoothMaxSites profileMaxSites
+
+// how corrections are interpolated between the speed and angle sites
+typedef enum
+{
+    interpolationLinear = 0,    // correctSpeed, kinks at every site
+    interpolationSmooth,        // correctSpeedSmooth, continuous slope everywhere
+    interpolationModeCount
+} interpolationMode;
+
+// the correction over one speed interval and one angle sector as a bicubic in
+// t = (rawSpeed-site)/(interval width), 0->1 across the interval, and a = (folded angle-sector
+// start)/90, 0->1 across the sector. coefficients[i][j] multiplies t^i a^j, one cache line
+typedef struct
+{
+    float coefficients[4][4];
+} __attribute__((aligned(64))) smoothPatch;
+
+// corrections that pass through every site of a table like correctSpeed's but with no kinks
+// between them. Along speed each angle column is a monotone (Fritsch-Butland) cubic through
+// the corrections, so between two sites a correction never goes beyond the corrections at
+// them, and the corrected speed rises with the raw speed as long as no correction falls by
+// more than a third of a mph per mph between sites (the Davis table falls by at most 0.24).
+// Along angle the columns are blended by a periodic cubic spline through 0, 90, 180 and 270
+// (= 90) degrees, so the slope is also continuous across 0/360 and 180 degrees. Below the
+// first site and above the last the corrected speed carries on along the straight line
+// through the end interval's sites, as correctSpeed does
+//
+// built once, then read only and shared by any number of threads
+typedef struct
+{
+    int siteCount;
+    float sites[smoothMaxSites];
+    float scales[smoothMaxSites];                   // reciprocal width of the interval above each site
+    smoothPatch patches[2][smoothMaxSites-1];       // 0->90 and 90->180 degrees, by interval
+} smoothCorrection;
+
+// the global correctionTable, built at start up
+extern const smoothCorrection defaultSmoothCorrection;
+
+// from rows of a speed site and the corrections at 0, 90 and 180 degrees in mph, laid out as
+// correctionTable, or from a calibration profile. Sites must strictly increase, returns 0, or
+// -1 with errno set to EINVAL
+int buildSmoothCorrection(smoothCorrection* smooth, const float (*rows)[4], int rowCount);
+int buildSmoothCorrection(smoothCorrection* smooth, const calibrationProfile* profile);
+
+// within float rounding of correctSpeed at every speed site and at 0, 90, 180 and 270 degrees
+float correctSpeedSmooth(float rawSpeed, float angle);
+float correctSpeedSmooth(const smoothCorrection* smooth, float rawSpeed, float angle);
+
+// corrects count samples with the avx2 kernel where the cpu has it, bit identical to
+// correctSpeedSmooth on x86, the tolerance allows for multiply-add contraction elsewhere
+#define smoothUlpTolerance 4
+
+void correctSpeedSmoothBatch(const smoothCorrection* smooth, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+// correctSpeedSimd or correctSpeedSmoothBatch with defaultSmoothCorrection
+void correctSpeedInterpolated(interpolationMode mode, const float* rawSpeed, const float* angle, float* __restrict correctedSpeed, size_t count);
+
+const char* interpolationModeName(interpolationMode mode);
+
+#endif
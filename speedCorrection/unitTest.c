@@ -28,8 +28,34 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include "interpolator.h"
+#include "correctionLattice.h"
+#include "simdCorrection.h"
+#include "davisCalibration.h"
+#include "archiveStream.h"
+#include "parallelCorrection.h"
+#include "calibrationProfile.h"
+#include "liveCalibration.h"
+#include "windVector.h"
+#include "columnArchive.h"
+#include "correctionCache.h"
+#include "correctionInstrumentation.h"
+#include "correctionServer.h"
+#include "correctionPipeline.h"
+#include "smoothCorrection.h"
+#include "inverseCorrection.h"
+#include "packedProfile.h"
 
 // 0 degree tests
 float zeroTests[27][2] = {{20,23.3},
@@ -119,6 +145,173 @@ float oneeightyTests[27][2] = {{20,16.4},
                                {145,134.5},
                                {150,138.0}};
 
+// live calibration stress test, readers correct continuously while the writer swaps
+// between two profiles and every result must come from one profile or the other
+#define liveStressReaders 4
+#define liveStressSwaps 20000
+
+typedef struct
+{
+    liveCalibration* live;
+    const calibrationProfile* profiles[2];
+    int* stop;
+    long corrections;
+    long mismatches;
+} liveStressReader;
+
+static void* liveStressRead(void* argument)
+{
+    liveStressReader* stress = (liveStressReader*)argument;
+    liveReader* reader = registerLiveReader(stress->live);
+    assert(reader);
+
+    unsigned sample = 0;
+    while(!__atomic_load_n(stress->stop,__ATOMIC_ACQUIRE))
+    {
+        for(int batch=0;batch<16;batch++,sample++)
+        {
+            float rawSpeed = (sample%800)*0.25;
+            float angle = (sample*7)%360;
+            float correctedSpeed = correctSpeedLive(reader,rawSpeed,angle);
+            float first = correctSpeed(stress->profiles[0],rawSpeed,angle);
+            float second = correctSpeed(stress->profiles[1],rawSpeed,angle);
+            stress->mismatches += (memcmp(&correctedSpeed,&first,sizeof(float))!=0 && memcmp(&correctedSpeed,&second,sizeof(float))!=0) ? 1 : 0;
+            stress->corrections++;
+        }
+        liveQuiescent(reader);
+        if((sample%4096)==0)
+        {
+            liveOffline(reader);
+            liveOnline(reader);
+        }
+    }
+
+    unregisterLiveReader(reader);
+    return NULL;
+}
+
+// correction cache worker threads, started and joined in waves of more threads in all than
+// have counters of their own, each makes the same lookups so the totals are known
+#define cacheWorkerWaves 4
+#define cacheWorkerThreads 48
+#define cacheWorkerLookups 1000
+
+static void* cacheWorkerLookup(void* argument)
+{
+    correctionCache* cache = (correctionCache*)argument;
+    for(int lookup=0;lookup<cacheWorkerLookups;lookup++)
+    {
+        correctSpeedCached(cache,(float)(10+(lookup%7)),(float)((lookup*13)%360));
+    }
+    return NULL;
+}
+
+// correction cache stress test, readers look up through one cache with whichever profile is
+// live while the writer swaps between two, every hit must come from the profile it was asked for
+#define cacheStressReaders 4
+#define cacheStressSwaps 400
+
+typedef struct
+{
+    liveCalibration* live;
+    correctionCache* cache;
+    int* stop;
+    long lookups;
+    long mismatches;
+} cacheStressReader;
+
+static void* cacheStressRead(void* argument)
+{
+    cacheStressReader* stress = (cacheStressReader*)argument;
+    liveReader* reader = registerLiveReader(stress->live);
+    assert(reader);
+
+    unsigned sample = 0;
+    while(!__atomic_load_n(stress->stop,__ATOMIC_ACQUIRE))
+    {
+        const calibrationProfile* profile = currentLiveProfile(reader);
+        for(int batch=0;batch<64;batch++,sample++)
+        {
+            float rawSpeed = 10+(sample%7);
+            float angle = (sample*13)%360;
+            float cachedSpeed = correctSpeedCached(stress->cache,profile,rawSpeed,angle);
+            float expected = correctSpeed(profile,rawSpeed,angle);
+            stress->mismatches += (memcmp(&cachedSpeed,&expected,sizeof(float))!=0) ? 1 : 0;
+            stress->lookups++;
+        }
+        liveQuiescent(reader);
+    }
+
+    unregisterLiveReader(reader);
+    return NULL;
+}
+
+#ifdef correctionInstrumentation
+// instrumentation threads, each makes the same corrections so the totals are known
+#define instrumentThreads 4
+#define instrumentThreadCalls 10000
+
+static void* instrumentCorrect(void* argument)
+{
+    float* total = (float*)argument;
+    for(int call=0;call<instrumentThreadCalls;call++)
+    {
+        *total += correctSpeed((call%200)+0.5f,call%360);
+    }
+    return NULL;
+}
+#endif
+
+static void* runServer(void* argument)
+{
+    assert(runCorrectionServer((correctionServer*)argument)==0);
+    return NULL;
+}
+
+// pipeline stages for the tests, blocks counted in and out to see the backpressure
+typedef struct
+{
+    int blocks;
+    int failAt;
+    int produced;
+    int consumed;
+    int mostInFlight;
+} pipelineProbe;
+
+static int probeSource(void* context, pipelineBlock* block)
+{
+    pipelineProbe* probe = (pipelineProbe*)context;
+    if(__atomic_load_n(&probe->produced,__ATOMIC_ACQUIRE)==probe->blocks)
+    {
+        return 0;
+    }
+    int inFlight = __atomic_add_fetch(&probe->produced,1,__ATOMIC_ACQ_REL)-__atomic_load_n(&probe->consumed,__ATOMIC_ACQUIRE);
+    probe->mostInFlight = (inFlight>probe->mostInFlight) ? inFlight : probe->mostInFlight;
+    block->samples = 1;
+    block->timestamp[0] = (uint32_t)block->sequence;
+    return 1;
+}
+
+static int probeStage(void* context, pipelineBlock* block)
+{
+    pipelineProbe* probe = (pipelineProbe*)context;
+    if((int)block->sequence==probe->failAt)
+    {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int probeSink(void* context, pipelineBlock* block)
+{
+    pipelineProbe* probe = (pipelineProbe*)context;
+    assert(block->timestamp[0]==(uint32_t)__atomic_load_n(&probe->consumed,__ATOMIC_ACQUIRE));
+    usleep(200);
+    __atomic_add_fetch(&probe->consumed,1,__ATOMIC_ACQ_REL);
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     // test 0 degrees sites
@@ -160,6 +353,1588 @@ int main(int argc, char* argv[])
         printf("***********************\n");
     }
 
+    // batch tests against the documented sites, each table is run through the batch
+    // api and the in place api and must match the scalar results bit for bit
+    float (*siteTests[3])[2] = {zeroTests,ninetyTests,oneeightyTests};
+    float siteAngles[3] = {0.0,90.0,180.0};
+    for(int site=0;site<3;site++)
+    {
+        float speeds[27];
+        float angles[27];
+        float corrected[27];
+        for(int test=0;test<27;test++)
+        {
+            speeds[test] = siteTests[site][test][0];
+            angles[test] = siteAngles[site];
+        }
+
+        correctSpeedBatch(speeds,angles,corrected,27);
+        correctSpeedBatchInPlace(speeds,angles,27);
+
+        for(int test=0;test<27;test++)
+        {
+            float correctedSpeed = correctSpeed(siteTests[site][test][0],siteAngles[site]);
+            assert(siteTests[site][test][1]==corrected[test]);
+            assert(memcmp(&correctedSpeed,&corrected[test],sizeof(float))==0);
+            assert(memcmp(&correctedSpeed,&speeds[test],sizeof(float))==0);
+        }
+        printf("TEST:batch angle:%3.2f\n",siteAngles[site]);
+        printf("***********************\n");
+    }
+
+    // batch sweep over the whole speed and angle range, including speeds beyond the last site
+    {
+        const int sweepSpeeds = 1101;
+        const int sweepAngles = 360;
+        const int sweepSize = sweepSpeeds*sweepAngles;
+        float* speeds = (float*)malloc(sweepSize*sizeof(float));
+        float* angles = (float*)malloc(sweepSize*sizeof(float));
+        float* corrected = (float*)malloc(sweepSize*sizeof(float));
+        for(int speed=0;speed<sweepSpeeds;speed++)
+        {
+            for(int angle=0;angle<sweepAngles;angle++)
+            {
+                speeds[(speed*sweepAngles)+angle] = speed*0.25;
+                angles[(speed*sweepAngles)+angle] = angle+((speed%4)*0.25);
+            }
+        }
+
+        correctSpeedBatch(speeds,angles,corrected,sweepSize);
+        correctSpeedBatchInPlace(speeds,angles,sweepSize);
+
+        for(int sample=0;sample<sweepSize;sample++)
+        {
+            float correctedSpeed = correctSpeed((sample/sweepAngles)*0.25,angles[sample]);
+            assert(memcmp(&correctedSpeed,&corrected[sample],sizeof(float))==0);
+            assert(memcmp(&correctedSpeed,&speeds[sample],sizeof(float))==0);
+        }
+        printf("TEST:batch sweep samples:%d\n",sweepSize);
+        printf("***********************\n");
+
+        free(speeds);
+        free(angles);
+        free(corrected);
+    }
+
+    // speed site index tests, the index must agree with the linear search everywhere for
+    // the default table and for a table with no equally spaced run
+    {
+        float defaultSites[29];
+        for(int site=0;site<29;site++)
+        {
+            defaultSites[site] = (site==0) ? 0.0 : ((site==28) ? 999.0 : 15.0+(site*5.0));
+        }
+        float irregularSites[8] = {0.0,3.0,7.5,8.0,20.0,21.0,40.0,255.0};
+
+        speedSiteIndex defaultIndex = buildSpeedSiteIndex(defaultSites,1,29);
+        speedSiteIndex irregularIndex = buildSpeedSiteIndex(irregularSites,1,8);
+        assert(defaultIndex.uniformLow==1);
+        assert(defaultIndex.uniformHigh==27);
+        assert(irregularIndex.uniformLow==irregularIndex.uniformHigh);
+
+        for(int speed=-40;speed<=4400;speed++)
+        {
+            float rawSpeed = speed*0.25;
+            assert(findSpeedSite(&defaultIndex,rawSpeed)==scanSpeedSite(&defaultIndex,rawSpeed));
+            assert(findSpeedSite(&irregularIndex,rawSpeed)==scanSpeedSite(&irregularIndex,rawSpeed));
+            assert(findSpeedSite(&defaultIndex,nextafterf(rawSpeed,1000.0))==scanSpeedSite(&defaultIndex,nextafterf(rawSpeed,1000.0)));
+            assert(findSpeedSite(&defaultIndex,nextafterf(rawSpeed,-1000.0))==scanSpeedSite(&defaultIndex,nextafterf(rawSpeed,-1000.0)));
+        }
+        printf("TEST:speed site index\n");
+        printf("***********************\n");
+    }
+
+    // correction lattice tests, a 1 mph x 1 degree lattice reproduces correctSpeed exactly
+    // at the nodes and blends to within float rounding between them, as does a coarser
+    // lattice whose steps divide the speed and angle site spacing
+    {
+        correctionLattice fineLattice;
+        correctionLattice coarseLattice;
+        float* fineStorage = (float*)malloc(correctionLatticeBytes(1.0,1.0));
+        float* coarseStorage = (float*)malloc(correctionLatticeBytes(5.0,15.0));
+        buildCorrectionLattice(&fineLattice,fineStorage,1.0,1.0);
+        buildCorrectionLattice(&coarseLattice,coarseStorage,5.0,15.0);
+        assert(fineLattice.speedCount==256 && fineLattice.angleCount==181);
+        assert(coarseLattice.speedCount==52 && coarseLattice.angleCount==13);
+        assert(correctionLatticeFootprint(&fineLattice)==sizeof(correctionLattice)+(256*181*sizeof(float)));
+
+        for(int speed=0;speed<=255;speed++)
+        {
+            for(int angle=0;angle<360;angle++)
+            {
+                float correctedSpeed = correctSpeed(speed,angle);
+                float latticeSpeed = correctSpeedLatticeNode(&fineLattice,speed,angle);
+                assert(memcmp(&correctedSpeed,&latticeSpeed,sizeof(float))==0);
+            }
+        }
+
+        const int sweepSize = 1021*90;
+        float* speeds = (float*)malloc(sweepSize*sizeof(float));
+        float* angles = (float*)malloc(sweepSize*sizeof(float));
+        float* corrected = (float*)malloc(sweepSize*sizeof(float));
+        for(int sample=0;sample<sweepSize;sample++)
+        {
+            speeds[sample] = (sample/90)*0.25;
+            angles[sample] = ((sample%90)*4.0)+((sample/90)%4);
+        }
+        correctSpeedLatticeBatch(&fineLattice,speeds,angles,corrected,sweepSize);
+
+        for(int sample=0;sample<sweepSize;sample++)
+        {
+            float correctedSpeed = correctSpeed(speeds[sample],angles[sample]);
+            assert(fabsf(corrected[sample]-correctedSpeed)<0.001);
+            assert(fabsf(correctSpeedLattice(&coarseLattice,speeds[sample],angles[sample])-correctedSpeed)<0.001);
+        }
+        printf("TEST:correction lattice bytes:%d\n",(int)correctionLatticeFootprint(&fineLattice));
+        printf("***********************\n");
+
+        free(speeds);
+        free(angles);
+        free(corrected);
+        free(fineStorage);
+        free(coarseStorage);
+    }
+
+    // vector kernel tests, every kernel this cpu supports must match correctSpeed to within
+    // simdUlpTolerance over a dense sweep, and every short length must take the tail path
+    {
+        const int sweepSize = 1103*361;
+        float* speeds = (float*)malloc(sweepSize*sizeof(float));
+        float* angles = (float*)malloc(sweepSize*sizeof(float));
+        float* corrected = (float*)malloc(sweepSize*sizeof(float));
+        for(int sample=0;sample<sweepSize;sample++)
+        {
+            speeds[sample] = ((sample/361)*0.25)+((sample%7)*0.01);
+            angles[sample] = (sample%361)+((sample%3)*0.3);
+        }
+        speeds[0] = 1200.0;
+
+        for(int level=simdScalar;level<simdLevelCount;level++)
+        {
+            if(!simdLevelSupported((simdLevel)level))
+            {
+                continue;
+            }
+
+            for(int length=0;length<=17;length++)
+            {
+                correctSpeedSimdLevel((simdLevel)level,&speeds[1000],&angles[1000],corrected,length);
+                for(int sample=0;sample<length;sample++)
+                {
+                    assert(corrected[sample]==correctSpeed(speeds[1000+sample],angles[1000+sample]));
+                }
+            }
+
+            correctSpeedSimdLevel((simdLevel)level,speeds,angles,corrected,sweepSize);
+            int worstUlp = 0;
+            for(int sample=0;sample<sweepSize;sample++)
+            {
+                float correctedSpeed = correctSpeed(speeds[sample],angles[sample]);
+                int expectedBits;
+                int actualBits;
+                memcpy(&expectedBits,&correctedSpeed,sizeof(float));
+                memcpy(&actualBits,&corrected[sample],sizeof(float));
+                int ulp = abs(expectedBits-actualBits);
+                worstUlp = (ulp>worstUlp) ? ulp : worstUlp;
+            }
+            assert(worstUlp<=simdUlpTolerance);
+            printf("TEST:vector kernel:%s worst ulp:%d\n",simdLevelName((simdLevel)level),worstUlp);
+            printf("***********************\n");
+        }
+
+        correctSpeedSimd(speeds,angles,corrected,sweepSize);
+        for(int sample=0;sample<sweepSize;sample+=97)
+        {
+            assert(fabsf(corrected[sample]-correctSpeed(speeds[sample],angles[sample]))<0.001);
+        }
+
+        free(speeds);
+        free(angles);
+        free(corrected);
+    }
+
+    // compile time calibration tests, the generated table is the one correctSpeed uses,
+    // correctSpeed<Table> is bit identical to it (at compile time as well as at run time)
+    // and the generated lattice matches a lattice built at run time
+    {
+        static_assert(correctSpeed<davisFloatTable>(20,0)==23.3f,"compile time correction");
+        static_assert(correctSpeed<davisFloatTable>(150,180)==138.0f,"compile time correction");
+        assert(&correctionTable[0][0]==&davisFloatTable::table.rows[0][0]);
+
+        for(int speed=0;speed<=1100;speed++)
+        {
+            for(int angle=0;angle<360;angle++)
+            {
+                float rawSpeed = speed*0.25;
+                float rawAngle = angle+((speed%4)*0.25);
+                float correctedSpeed = correctSpeed(rawSpeed,rawAngle);
+                float templateSpeed = correctSpeed<davisFloatTable>(rawSpeed,rawAngle);
+                assert(memcmp(&correctedSpeed,&templateSpeed,sizeof(float))==0);
+            }
+        }
+
+        static constexpr denseCorrectionLattice<5,15> dense = makeDenseCorrectionLattice<davisFloatTable,5,15>();
+        correctionLattice lattice;
+        float* storage = (float*)malloc(correctionLatticeBytes(5,15));
+        buildCorrectionLattice(&lattice,storage,5,15);
+        assert(lattice.speedCount==dense.speedCount && lattice.angleCount==dense.angleCount);
+        assert(memcmp(storage,dense.corrections,sizeof(dense.corrections))==0);
+        printf("TEST:compile time calibration\n");
+        printf("***********************\n");
+
+        free(storage);
+    }
+
+    // archive stream tests, archives several chunks long with records and lines split across
+    // chunk boundaries, odd lines copied through and a trailing partial record
+    {
+        const int recordCount = 200000;
+        FILE* binaryInput = tmpfile();
+        FILE* binaryOutput = tmpfile();
+        for(int record=0;record<recordCount;record++)
+        {
+            archiveRecord archived = {(uint32_t)record,(record%800)*0.25f,(float)(record%360)};
+            fwrite(&archived,sizeof(archived),1,binaryInput);
+        }
+        fwrite("tail",4,1,binaryInput);
+        fflush(binaryInput);
+        rewind(binaryInput);
+
+        streamStats stats;
+        assert(correctBinaryStream(fileno(binaryInput),fileno(binaryOutput),&stats)==0);
+        assert(stats.records==(uint64_t)recordCount && stats.bytesWritten==stats.bytesRead);
+        rewind(binaryOutput);
+        for(int record=0;record<recordCount;record++)
+        {
+            archiveRecord archived;
+            assert(fread(&archived,sizeof(archived),1,binaryOutput)==1);
+            float correctedSpeed = correctSpeed((record%800)*0.25f,record%360);
+            assert(archived.timestamp==(uint32_t)record && archived.windDirection==(float)(record%360));
+            assert(fabsf(archived.windSpeed-correctedSpeed)<0.001);
+        }
+        char tail[8];
+        assert(fread(tail,1,sizeof(tail),binaryOutput)==4 && memcmp(tail,"tail",4)==0);
+        fclose(binaryInput);
+        fclose(binaryOutput);
+
+        FILE* csvInput = tmpfile();
+        FILE* csvOutput = tmpfile();
+        fprintf(csvInput,"dateTime;windDir;windSpeed;outTemp\n");
+        for(int line=0;line<recordCount;line++)
+        {
+            switch(line%50)
+            {
+                case 0:
+                    fprintf(csvInput,"%d;;0;12.5\n",line);
+                    break;
+                case 1:
+                    fprintf(csvInput,"%d;%d;%d;12.5\r\n",line,line%360,line%150);
+                    break;
+                default:
+                    fprintf(csvInput,"%d;%d;%.2f;12.5\n",line,line%360,(line%800)*0.25);
+                    break;
+            }
+        }
+        fprintf(csvInput,"last;180;20.0");
+        fflush(csvInput);
+        rewind(csvInput);
+
+        csvLayout layout = {2,1,';'};
+        assert(correctCsvStream(fileno(csvInput),fileno(csvOutput),&layout,&stats)==0);
+        assert(stats.records==(uint64_t)recordCount+2);
+        assert(stats.corrected==(uint64_t)recordCount-(recordCount/50)+1);
+        assert(stats.bytesRead>(3*archiveChunkBytes));
+        rewind(csvOutput);
+
+        char text[128];
+        assert(fgets(text,sizeof(text),csvOutput) && strcmp(text,"dateTime;windDir;windSpeed;outTemp\n")==0);
+        for(int line=0;line<recordCount;line++)
+        {
+            char expected[128];
+            assert(fgets(text,sizeof(text),csvOutput));
+            switch(line%50)
+            {
+                case 0:
+                    sprintf(expected,"%d;;0;12.5\n",line);
+                    break;
+                case 1:
+                    sprintf(expected,"%d;%d;%.1f;12.5\r\n",line,line%360,correctSpeed(line%150,line%360));
+                    break;
+                default:
+                    sprintf(expected,"%d;%d;%.2f;12.5\n",line,line%360,correctSpeed((line%800)*0.25f,line%360));
+                    break;
+            }
+            assert(strcmp(text,expected)==0);
+        }
+        assert(fgets(text,sizeof(text),csvOutput) && strcmp(text,"last;180;16.4")==0);
+        assert(!fgets(text,sizeof(text),csvOutput));
+        printf("TEST:archive stream records:%d\n",recordCount);
+        printf("***********************\n");
+
+        fclose(csvInput);
+        fclose(csvOutput);
+    }
+
+    // parallel correction tests, the output must be identical to a single vector kernel call
+    // for every size around the chunk boundaries and for every pool size, repeated so the
+    // steals land differently each time
+    {
+        const int sampleCount = (64*parallelChunkSamples)+123;
+        float* speeds = (float*)malloc(sampleCount*sizeof(float));
+        float* angles = (float*)malloc(sampleCount*sizeof(float));
+        float* expected = (float*)malloc(sampleCount*sizeof(float));
+        float* corrected = (float*)malloc(sampleCount*sizeof(float));
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            speeds[sample] = (sample%1000)*0.25;
+            angles[sample] = (sample*7)%360;
+        }
+        correctSpeedSimd(speeds,angles,expected,sampleCount);
+
+        assert(createCorrectionPool(0)==NULL);
+        assert(createCorrectionPool(parallelMaxThreads+1)==NULL);
+
+        int sizes[6] = {0,1,parallelChunkSamples,parallelChunkSamples+1,(5*parallelChunkSamples)-1,sampleCount};
+        int threadCounts[4] = {1,2,5,16};
+        for(int pools=0;pools<4;pools++)
+        {
+            correctionPool* pool = createCorrectionPool(threadCounts[pools]);
+            assert(pool && correctionPoolThreads(pool)==threadCounts[pools]);
+            for(int size=0;size<6;size++)
+            {
+                for(int repeat=0;repeat<5;repeat++)
+                {
+                    memset(corrected,0xff,sampleCount*sizeof(float));
+                    correctSpeedParallel(pool,speeds,angles,corrected,sizes[size]);
+                    assert(memcmp(corrected,expected,sizes[size]*sizeof(float))==0);
+                    assert(sizes[size]==sampleCount || corrected[sizes[size]]!=corrected[sizes[size]]);
+                }
+            }
+            destroyCorrectionPool(pool);
+        }
+        printf("TEST:parallel correction samples:%d\n",sampleCount);
+        printf("***********************\n");
+
+        free(speeds);
+        free(angles);
+        free(expected);
+        free(corrected);
+    }
+
+    // calibration profile tests, the default profile reproduces correctSpeed bit for bit,
+    // a loaded profile interpolates its own sites and malformed profiles are rejected
+    {
+        assert(sizeof(calibrationProfile)==128 && ((uintptr_t)&defaultCalibrationProfile%64)==0);
+        assert(defaultCalibrationProfile.uniformLow==1 && defaultCalibrationProfile.uniformHigh==27);
+
+        for(int speed=0;speed<=1100;speed++)
+        {
+            for(int angle=0;angle<360;angle++)
+            {
+                float rawSpeed = speed*0.25;
+                float rawAngle = angle+((speed%4)*0.25);
+                float correctedSpeed = correctSpeed(rawSpeed,rawAngle);
+                float profileSpeed = correctSpeed(&defaultCalibrationProfile,rawSpeed,rawAngle);
+                assert(memcmp(&correctedSpeed,&profileSpeed,sizeof(float))==0);
+            }
+        }
+
+        const char* fieldProfile = "# field calibration, anemometer 7\n"
+                                   "0, 0.0, 0.0, 0.0\n"
+                                   "\n"
+                                   "10\t1.0\t-1.0\t-2.0\r\n"
+                                   "20 2.0 -2.0 -4.0   # top of the wind tunnel\n"
+                                   "30 3.04 -3.0 -6.0";
+        FILE* profileFile = fopen("unitTest.profile","w");
+        fputs(fieldProfile,profileFile);
+        fclose(profileFile);
+
+        calibrationProfile profile;
+        assert(loadCalibrationProfile("unitTest.profile",&profile)==0);
+        remove("unitTest.profile");
+        assert(profile.siteCount==5 && profile.speeds[4]==profileTopSpeed);
+        assert(profile.uniformLow==0 && profile.uniformHigh==3 && profile.uniformSpacing==10);
+        assert(profile.corrections[3][0]==30 && profile.corrections[4][2]==-60);
+        assert(fabsf(correctSpeed(&profile,10,0)-11.0)<0.0001);
+        assert(fabsf(correctSpeed(&profile,15,45)-15.0)<0.0001);
+        assert(fabsf(correctSpeed(&profile,25,135)-21.25)<0.0001);
+        assert(fabsf(correctSpeed(&profile,200,180)-194.0)<0.0001);
+        assert(fabsf(correctSpeed(&profile,300,0)-303.0)<0.0001);
+        assert(isnan(correctSpeed(&profile,INFINITY,0)) && isnan(correctSpeed(&defaultCalibrationProfile,INFINITY,90)));
+
+        const char* badProfiles[7] = {"",
+                                      "0 0 0 0\n",
+                                      "5 0 0 0\n20 1 1 1\n",
+                                      "0 0 0 0\n20 1 1 1\n20 2 2 2\n",
+                                      "0 0 0 0\n20.5 1 1 1\n",
+                                      "0 0 0 0\n20 13 1 1\n",
+                                      "0 0 0 0\n20 1 1\n"};
+        for(int bad=0;bad<7;bad++)
+        {
+            calibrationProfile untouched = profile;
+            errno = 0;
+            assert(parseCalibrationProfile(badProfiles[bad],&profile)==-1 && errno==EINVAL);
+            assert(memcmp(&untouched,&profile,sizeof(profile))==0);
+        }
+        assert(loadCalibrationProfile("no such profile",&profile)==-1 && errno==ENOENT);
+        printf("TEST:calibration profile bytes:%d\n",(int)sizeof(calibrationProfile));
+        printf("***********************\n");
+    }
+
+    // live calibration tests, a hot swap stress test and reclamation once readers are idle
+    {
+        calibrationProfile windy;
+        assert(parseCalibrationProfile("0 0 0 0\n20 4.3 -1.3 -2.6\n150 10.8 -11.1 -11.0\n",&windy)==0);
+
+        liveCalibration* live = createLiveCalibration(&defaultCalibrationProfile);
+        assert(live);
+
+        int stop = 0;
+        pthread_t threads[liveStressReaders];
+        liveStressReader stress[liveStressReaders];
+        for(int thread=0;thread<liveStressReaders;thread++)
+        {
+            stress[thread] = (liveStressReader){live,{&defaultCalibrationProfile,&windy},&stop,0,0};
+            assert(pthread_create(&threads[thread],NULL,liveStressRead,&stress[thread])==0);
+        }
+
+        for(int swap=0;swap<liveStressSwaps;swap++)
+        {
+            assert(publishCalibrationProfile(live,(swap%2) ? &defaultCalibrationProfile : &windy)==0);
+            if((swap%64)==0)
+            {
+                sched_yield();
+            }
+        }
+        __atomic_store_n(&stop,1,__ATOMIC_RELEASE);
+
+        long corrections = 0;
+        for(int thread=0;thread<liveStressReaders;thread++)
+        {
+            pthread_join(threads[thread],NULL);
+            assert(stress[thread].mismatches==0);
+            corrections += stress[thread].corrections;
+        }
+
+        // with every reader gone nothing holds a replaced profile
+        assert(reclaimCalibrationProfiles(live)==0);
+        liveReader* reader = registerLiveReader(live);
+        float correctedSpeed = correctSpeedLive(reader,20,0);
+        float expected = correctSpeed(&defaultCalibrationProfile,20,0);
+        assert(memcmp(&correctedSpeed,&expected,sizeof(float))==0);
+
+        // a reader that has not been quiescent since a swap holds the old profile back
+        assert(publishCalibrationProfile(live,&windy)==0);
+        assert(reclaimCalibrationProfiles(live)==1);
+        liveQuiescent(reader);
+        assert(reclaimCalibrationProfiles(live)==0);
+        unregisterLiveReader(reader);
+        destroyLiveCalibration(live);
+        printf("TEST:live calibration swaps:%d corrections:%ld\n",liveStressSwaps,corrections);
+        printf("***********************\n");
+    }
+
+    {
+        // fused correction and vector mean against correcting, decomposing with sin and cos
+        // and averaging as separate passes in double
+        const int sampleCount = 10000;
+        const int windowSamples = 600;
+        float* rawSpeed = (float*)malloc(sampleCount*sizeof(float));
+        float* angle = (float*)malloc(sampleCount*sizeof(float));
+        float* corrected = (float*)malloc(sampleCount*sizeof(float));
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            rawSpeed[sample] = ((sample*7919)%2000)/10.0;
+            angle[sample] = fmod(200.0+(sample*0.37)+((sample*104729)%90),360.0);
+        }
+
+        windSummary windows[(sampleCount/windowSamples)+1];
+        size_t windowCount = correctWindWindows(rawSpeed,angle,sampleCount,windowSamples,windows,corrected);
+        assert(windowCount==(size_t)(sampleCount+windowSamples-1)/windowSamples);
+
+        for(size_t window=0;window<windowCount;window++)
+        {
+            double speedSum = 0.0;
+            double uSum = 0.0;
+            double vSum = 0.0;
+            windAccumulator live;
+            resetWindAccumulator(&live);
+            int first = window*windowSamples;
+            int last = ((first+windowSamples)<sampleCount) ? first+windowSamples : sampleCount;
+            for(int sample=first;sample<last;sample++)
+            {
+                float expected = correctSpeed(rawSpeed[sample],angle[sample]);
+                assert(fabsf(corrected[sample]-expected)<=1e-5*expected);
+                assert(accumulateWind(&live,rawSpeed[sample],angle[sample])==expected);
+
+                double radians = angle[sample]*(M_PI/180.0);
+                speedSum += expected;
+                uSum -= expected*sin(radians);
+                vSum -= expected*cos(radians);
+            }
+
+            double meanSpeed = speedSum/(last-first);
+            double vectorSpeed = sqrt((uSum*uSum)+(vSum*vSum))/(last-first);
+            double direction = fmod((atan2(-uSum,-vSum)*(180.0/M_PI))+360.0,360.0);
+
+            windSummary liveSummary;
+            summariseWind(&live,&liveSummary);
+            const windSummary* summaries[2] = {&windows[window],&liveSummary};
+            for(int summary=0;summary<2;summary++)
+            {
+                assert(summaries[summary]->samples==(size_t)(last-first));
+                assert(fabs(summaries[summary]->meanSpeed-meanSpeed)<=1e-4*meanSpeed);
+                assert(fabs(summaries[summary]->vectorSpeed-vectorSpeed)<=1e-3);
+                assert(fabs(summaries[summary]->direction-direction)<=0.01);
+                assert(fabs(summaries[summary]->steadiness-(vectorSpeed/meanSpeed))<=1e-4);
+            }
+        }
+
+        // steady wind from the east, and wind that swings between east and west at the same
+        // corrected speed so the vectors cancel, both as one window without corrected output
+        for(int sample=0;sample<1000;sample++)
+        {
+            rawSpeed[sample] = 30.0;
+            angle[sample] = ((sample%2)==1) ? 270.0 : 90.0;
+        }
+        assert(correctWindWindows(rawSpeed,angle,999,0,windows,NULL)==1);
+        assert(windows[0].samples==999);
+        assert(fabs(windows[0].direction-90.0)<=0.01);
+        assert(fabs(windows[0].vectorSpeed-(correctSpeed(30.0,90.0)/999.0))<=1e-3);
+        assert(correctWindWindows(rawSpeed,angle,1000,0,windows,NULL)==1);
+        assert(windows[0].vectorSpeed<1e-3 && windows[0].steadiness<1e-4);
+        assert(fabs(windows[0].meanSpeed-correctSpeed(30.0,90.0))<=1e-4);
+        assert(correctWindWindows(rawSpeed,angle,2,1,windows,NULL)==2);
+        assert(fabs(windows[0].direction-90.0)<=0.01 && fabs(windows[1].direction-270.0)<=0.01);
+        assert(fabs(windows[1].steadiness-1.0)<=1e-6);
+
+        // calm has no direction
+        windAccumulator calm;
+        resetWindAccumulator(&calm);
+        summariseWind(&calm,&windows[0]);
+        assert(windows[0].samples==0 && windows[0].meanSpeed==0.0f && windows[0].steadiness==0.0f);
+
+        // a direction with no angle on the compass adds no vector, huge ones still add one
+        const float badAngles[5] = {NAN,INFINITY,-INFINITY,1e30f,-1e30f};
+        windAccumulator odd;
+        resetWindAccumulator(&odd);
+        for(int bad=0;bad<5;bad++)
+        {
+            accumulateCorrectedWind(&odd,10.0f,badAngles[bad]);
+            assert(isfinite(odd.uSum) && isfinite(odd.vSum));
+        }
+        assert(odd.samples==5 && odd.speedSum==50.0);
+        assert(fabs(odd.uSum)<=20.0 && fabs(odd.vSum)<=20.0);
+        for(int sample=0;sample<5;sample++)
+        {
+            rawSpeed[sample] = 10.0f;
+            angle[sample] = badAngles[sample];
+        }
+        assert(correctWindWindows(rawSpeed,angle,5,0,windows,NULL)==1 && windows[0].samples==5);
+
+        free(rawSpeed);
+        free(angle);
+        free(corrected);
+        printf("TEST:wind vector samples:%d windows:%d\n",sampleCount,(int)windowCount);
+        printf("***********************\n");
+    }
+
+    {
+        // rolling statistics against recomputing every window from the history of samples,
+        // a random walk with plateaus so equal samples are common, long enough for the
+        // sequence numbers to wrap
+        static constexpr uint16_t lengths[4] = {3,48,240,1000};
+        static_assert(rollingStatisticsBytes(lengths,4)==(1024+(2*1291))*sizeof(uint16_t),"rolling storage");
+        static uint16_t storage[rollingStatisticsBytes(lengths,4)/sizeof(uint16_t)];
+        const int sampleCount = 70000;
+        uint16_t* history = (uint16_t*)malloc(sampleCount*sizeof(uint16_t));
+
+        rollingStatistics statistics;
+        assert(initRollingStatistics(&statistics,storage,lengths,4)==0);
+        uint16_t walk = 300;
+        uint16_t peak = 0;
+        unsigned int seed = 12345;
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            seed = (seed*1103515245)+12345;
+            int step = (int)((seed>>16)%9)-4;
+            walk = ((seed>>8)%3==0) ? walk : (uint16_t)(((walk+step)<0) ? 0 : (((walk+step)>600) ? 600 : walk+step));
+            history[sample] = walk;
+            peak = (walk>peak) ? walk : peak;
+            pushRollingTenths(&statistics,walk);
+
+            for(int window=0;window<4;window++)
+            {
+                int first = ((sample+1)>lengths[window]) ? (sample+1)-lengths[window] : 0;
+                uint32_t sum = 0;
+                uint16_t maximum = 0;
+                uint16_t minimum = UINT16_MAX;
+                for(int older=first;older<=sample;older++)
+                {
+                    sum += history[older];
+                    maximum = (history[older]>maximum) ? history[older] : maximum;
+                    minimum = (history[older]<minimum) ? history[older] : minimum;
+                }
+                uint16_t samples = (sample+1)-first;
+                assert(rollingSamples(&statistics,window)==samples);
+                assert(rollingMeanTenths(&statistics,window)==(sum+(samples/2))/samples);
+                assert(rollingMean(&statistics,window)==sum/(10.0f*samples));
+                assert(rollingMaxTenths(&statistics,window)==maximum);
+                assert(rollingMinTenths(&statistics,window)==minimum);
+            }
+            assert(rollingPeakTenths(&statistics)==peak);
+        }
+
+        resetRollingPeak(&statistics);
+        assert(rollingPeakTenths(&statistics)==0);
+        resetRollingStatistics(&statistics);
+        assert(rollingSamples(&statistics,3)==0 && rollingMaxTenths(&statistics,3)==0 && rollingMeanTenths(&statistics,3)==0);
+
+        // fed straight from the corrector, rounded to the nearest tenth
+        float corrected = correctSpeedRolling(&statistics,57.3,135.0);
+        float expected = correctSpeed(57.3,135.0);
+        assert(memcmp(&corrected,&expected,sizeof(float))==0);
+        assert(rollingMaxTenths(&statistics,0)==(uint16_t)((expected*10.0f)+0.5f));
+        // a NaN or infinite reading corrects to NaN and leaves every window as it was
+        uint16_t filled = rollingSamples(&statistics,0);
+        uint16_t maximum = rollingMaxTenths(&statistics,0);
+        uint16_t mean = rollingMeanTenths(&statistics,0);
+        uint16_t peakBefore = rollingPeakTenths(&statistics);
+        assert(isnan(correctSpeedRolling(&statistics,NAN,135.0)));
+        assert(isnan(correctSpeedRolling(&statistics,INFINITY,135.0)));
+        assert(rollingSamples(&statistics,0)==filled && rollingMaxTenths(&statistics,0)==maximum && rollingMeanTenths(&statistics,0)==mean);
+        assert(rollingPeakTenths(&statistics)==peakBefore);
+        // a window must hold at least one sample and no more than rollingMaxLength
+        static constexpr uint16_t invalid[2] = {10,0};
+        errno = 0;
+        assert(initRollingStatistics(&statistics,storage,invalid,2)==-1 && errno==EINVAL);
+        assert(rollingStatisticsBytes(invalid,2)==0 && rollingStatisticsBytes(lengths,5)==0 && rollingStatisticsBytes(lengths,0)==0);
+
+        free(history);
+        printf("TEST:rolling statistics samples:%d storage bytes:%d\n",sampleCount,(int)sizeof(storage));
+        printf("***********************\n");
+    }
+
+    {
+        // binned batch against correctSpeed, bit for bit, over a sweep, direction jittering
+        // across 90 and 270 degrees, the sector boundaries, the sites themselves and speeds
+        // past the top site, in more samples than one block
+        const int sampleCount = 5000;
+        float* rawSpeed = (float*)malloc(sampleCount*sizeof(float));
+        float* angle = (float*)malloc(sampleCount*sizeof(float));
+        float* corrected = (float*)malloc(sampleCount*sizeof(float));
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            rawSpeed[sample] = ((sample*7919)%12000)/10.0;
+            angle[sample] = ((sample%2)==0) ? fmod(sample*0.73,360.0) : (((sample%4)==1) ? 90.0 : 270.0)+(((sample*31)%41)-20)*0.5;
+        }
+        for(int site=0;site<correctionTableSize;site++)
+        {
+            rawSpeed[site] = correctionTable[site][0];
+        }
+        const float boundaries[6] = {0.0,90.0,180.0,270.0,360.0,89.99999};
+        for(int boundary=0;boundary<6;boundary++)
+        {
+            angle[100+boundary] = boundaries[boundary];
+        }
+
+        correctSpeedBinned(rawSpeed,angle,corrected,sampleCount);
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            float expected = correctSpeed(rawSpeed[sample],angle[sample]);
+            assert(memcmp(&corrected[sample],&expected,sizeof(float))==0);
+        }
+
+        // a short batch, and none at all
+        correctSpeedBinned(rawSpeed+7,angle+7,corrected,3);
+        for(int sample=0;sample<3;sample++)
+        {
+            float expected = correctSpeed(rawSpeed[7+sample],angle[7+sample]);
+            assert(memcmp(&corrected[sample],&expected,sizeof(float))==0);
+        }
+        correctSpeedBinned(rawSpeed,angle,corrected,0);
+
+        free(rawSpeed);
+        free(angle);
+        free(corrected);
+        printf("TEST:binned batch samples:%d\n",sampleCount);
+        printf("***********************\n");
+    }
+
+    {
+        // column archive round trip, speeds and directions come back to the nearest whole mph
+        // and degree whatever they were written as, across several chunks and a short last one
+        const int sampleCount = (2*columnChunkSamples)+1000;
+        const char* archiveName = "unitTest.wca";
+        columnWriter* writer = createColumnWriter(archiveName);
+        assert(writer);
+        uint32_t timestamp = 1500000000;
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            float speed = (sample<columnChunkSamples) ? 12.0+((sample*7)%9)*0.5 : ((sample*7919)%3000)/10.0-5.0;
+            float direction = ((sample*104729)%7200)/10.0-360.0;
+            timestamp += (sample%100==0) ? 3600 : 60;
+            assert(appendColumnSample(writer,timestamp,speed,direction)==0);
+        }
+        errno = 0;
+        assert(appendColumnSample(writer,timestamp-1,10.0,10.0)==-1 && errno==EINVAL);
+        assert(closeColumnWriter(writer)==0);
+
+        columnReader* reader = openColumnArchive(archiveName);
+        assert(reader);
+        assert(columnChunkCount(reader)==3 && columnSampleCount(reader)==(uint64_t)sampleCount);
+
+        static uint32_t timestamps[columnChunkSamples];
+        static float rawSpeed[columnChunkSamples];
+        static float direction[columnChunkSamples];
+        static float corrected[columnChunkSamples];
+        timestamp = 1500000000;
+        int sample = 0;
+        for(uint32_t chunk=0;chunk<columnChunkCount(reader);chunk++)
+        {
+            columnChunkInfo info;
+            columnChunk(reader,chunk,&info);
+            uint32_t count = correctColumnChunk(reader,chunk,timestamps,rawSpeed,direction,corrected);
+            assert(count==info.samples && count==((chunk<2) ? columnChunkSamples : 1000));
+
+            uint8_t speedMin = 255;
+            uint8_t speedMax = 0;
+            for(uint32_t decoded=0;decoded<count;decoded++,sample++)
+            {
+                float speed = (sample<columnChunkSamples) ? 12.0+((sample*7)%9)*0.5 : ((sample*7919)%3000)/10.0-5.0;
+                float degrees = ((sample*104729)%7200)/10.0-360.0;
+                timestamp += (sample%100==0) ? 3600 : 60;
+                float expectedSpeed = (speed<0.5f) ? 0.0f : ((speed>255.0f) ? 255.0f : floorf(speed+0.5f));
+                float expectedDirection = fmod(floor(fmod(degrees,360.0)+0.5)+360.0,360.0);
+
+                assert(timestamps[decoded]==timestamp);
+                assert(rawSpeed[decoded]==expectedSpeed);
+                assert(direction[decoded]==expectedDirection);
+                assert(fabsf(corrected[decoded]-correctSpeed(expectedSpeed,expectedDirection))<=1e-4f*(1.0f+corrected[decoded]));
+                speedMin = (expectedSpeed<speedMin) ? expectedSpeed : speedMin;
+                speedMax = (expectedSpeed>speedMax) ? expectedSpeed : speedMax;
+            }
+            assert(info.speedMin==speedMin && info.speedMax==speedMax);
+            assert(info.firstTimestamp==timestamps[0] && info.lastTimestamp==timestamps[count-1]);
+        }
+
+        // the steady first chunk packs to a few bits a sample, the sweep to a little over three bytes
+        struct stat status;
+        stat(archiveName,&status);
+        printf("TEST:column archive samples:%d bytes:%d (binary archive %d)\n",sampleCount,(int)status.st_size,(int)(sampleCount*sizeof(archiveRecord)));
+        assert(status.st_size<(off_t)(sampleCount*sizeof(archiveRecord)/3));
+        closeColumnArchive(reader);
+
+        // a truncated archive, or one whose index points past the chunks, is refused
+        FILE* archive = fopen(archiveName,"r+b");
+        ftruncate(fileno(archive),status.st_size-5);
+        fclose(archive);
+        errno = 0;
+        assert(!openColumnArchive(archiveName) && errno==EINVAL);
+        archive = fopen(archiveName,"wb");
+        fwrite("not an archive at all, not even close",1,37,archive);
+        fclose(archive);
+        assert(!openColumnArchive(archiveName) && errno==EINVAL);
+
+        // no samples at all is a valid archive
+        writer = createColumnWriter(archiveName);
+        assert(closeColumnWriter(writer)==0);
+        reader = openColumnArchive(archiveName);
+        assert(reader && columnChunkCount(reader)==0 && columnSampleCount(reader)==0);
+        closeColumnArchive(reader);
+        remove(archiveName);
+        assert(!openColumnArchive(archiveName) && errno==ENOENT);
+        printf("***********************\n");
+    }
+
+    // correction cache, every whole mph and degree pair is cached and comes back bit for bit,
+    // anything else goes straight to the corrector, and a change of profile invalidates
+    {
+        errno = 0;
+        assert(!createCorrectionCache(0) && errno==EINVAL);
+        assert(!createCorrectionCache(cacheMaxEntries+1) && errno==EINVAL);
+
+        correctionCache* cache = createCorrectionCache(cacheMaxEntries);
+        assert(cache);
+        for(int pass=0;pass<2;pass++)
+        {
+            for(int rawSpeed=0;rawSpeed<=255;rawSpeed++)
+            {
+                for(int angle=0;angle<360;angle++)
+                {
+                    float cachedSpeed = correctSpeedCached(cache,rawSpeed,angle);
+                    float expected = correctSpeed(rawSpeed,angle);
+                    assert(memcmp(&cachedSpeed,&expected,sizeof(float))==0);
+                }
+            }
+        }
+        correctionCacheStats stats;
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.misses==256*360 && stats.hits==256*360 && stats.uncached==0 && stats.invalidations==0);
+
+        // the default profile shares the global table's entries
+        float cachedSpeed = correctSpeedCached(cache,&defaultCalibrationProfile,20,90);
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.hits==(256*360)+1 && stats.invalidations==0);
+
+        const float uncachedSpeeds[6][2] = {{20.5,90},{20,90.5},{256,0},{20,360},{-0.0f,0},{NAN,0}};
+        for(int uncached=0;uncached<6;uncached++)
+        {
+            cachedSpeed = correctSpeedCached(cache,uncachedSpeeds[uncached][0],uncachedSpeeds[uncached][1]);
+            float expected = correctSpeed(uncachedSpeeds[uncached][0],uncachedSpeeds[uncached][1]);
+            assert(memcmp(&cachedSpeed,&expected,sizeof(float))==0);
+        }
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.uncached==6);
+
+        // a new profile invalidates once, returning to the default invalidates again
+        calibrationProfile windy;
+        assert(parseCalibrationProfile("0 0 0 0\n20 4.3 -1.3 -2.6\n150 10.8 -11.1 -11.0\n",&windy)==0);
+        assert(windy.generation!=defaultCalibrationProfile.generation);
+        for(int rawSpeed=0;rawSpeed<=200;rawSpeed+=5)
+        {
+            cachedSpeed = correctSpeedCached(cache,&windy,rawSpeed,45);
+            float expected = correctSpeed(&windy,rawSpeed,45);
+            assert(memcmp(&cachedSpeed,&expected,sizeof(float))==0);
+        }
+        cachedSpeed = correctSpeedCached(cache,20,0);
+        assert(cachedSpeed==23.3f);
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.invalidations==2 && stats.misses==(256*360)+41+1);
+        invalidateCorrectionCache(cache);
+        cachedSpeed = correctSpeedCached(cache,20,0);
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.invalidations==3 && stats.misses==(256*360)+43);
+
+        // a small cache holds what it can and still corrects everything else exactly
+        correctionCache* small = createCorrectionCache(100);
+        for(int sample=0;sample<20000;sample++)
+        {
+            float rawSpeed = (sample*7)%256;
+            float angle = (sample*11)%360;
+            cachedSpeed = correctSpeedCached(small,rawSpeed,angle);
+            float expected = correctSpeed(rawSpeed,angle);
+            assert(memcmp(&cachedSpeed,&expected,sizeof(float))==0);
+        }
+        correctionCacheStatistics(small,&stats);
+        assert(stats.hits+stats.misses==20000);
+        destroyCorrectionCache(small);
+
+        // live calibration, the cache follows a published profile
+        liveCalibration* live = createLiveCalibration(&defaultCalibrationProfile);
+        liveReader* reader = registerLiveReader(live);
+        cachedSpeed = correctSpeedCached(cache,reader,20,0);
+        assert(cachedSpeed==23.3f);
+        assert(publishCalibrationProfile(live,&windy)==0);
+        cachedSpeed = correctSpeedCached(cache,reader,20,0);
+        float expected = correctSpeedLive(reader,20,0);
+        assert(memcmp(&cachedSpeed,&expected,sizeof(float))==0 && cachedSpeed!=23.3f);
+        liveQuiescent(reader);
+        unregisterLiveReader(reader);
+        destroyCorrectionCache(cache);
+
+        // readers sharing one cache while the profile is swapped under them
+        cache = createCorrectionCache(4096);
+        int stop = 0;
+        pthread_t threads[cacheStressReaders];
+        cacheStressReader stress[cacheStressReaders];
+        for(int thread=0;thread<cacheStressReaders;thread++)
+        {
+            stress[thread] = (cacheStressReader){live,cache,&stop,0,0};
+            assert(pthread_create(&threads[thread],NULL,cacheStressRead,&stress[thread])==0);
+        }
+        for(int swap=0;swap<cacheStressSwaps;swap++)
+        {
+            assert(publishCalibrationProfile(live,(swap%2) ? &windy : &defaultCalibrationProfile)==0);
+            sched_yield();
+        }
+        __atomic_store_n(&stop,1,__ATOMIC_RELEASE);
+
+        long lookups = 0;
+        for(int thread=0;thread<cacheStressReaders;thread++)
+        {
+            pthread_join(threads[thread],NULL);
+            assert(stress[thread].mismatches==0);
+            lookups += stress[thread].lookups;
+        }
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.hits+stats.misses==(uint64_t)lookups);
+        printf("TEST:correction cache lookups:%ld hits:%lu misses:%lu invalidations:%lu\n",lookups,
+               (unsigned long)stats.hits,(unsigned long)stats.misses,(unsigned long)stats.invalidations);
+        destroyCorrectionCache(cache);
+
+        // worker threads coming and going hand their counters on, none of the counts is lost
+        cache = createCorrectionCache(4096);
+        pthread_t workers[cacheWorkerThreads];
+        for(int wave=0;wave<cacheWorkerWaves;wave++)
+        {
+            for(int thread=0;thread<cacheWorkerThreads;thread++)
+            {
+                assert(pthread_create(&workers[thread],NULL,cacheWorkerLookup,cache)==0);
+            }
+            for(int thread=0;thread<cacheWorkerThreads;thread++)
+            {
+                pthread_join(workers[thread],NULL);
+            }
+        }
+        correctionCacheStatistics(cache,&stats);
+        assert(stats.hits+stats.misses==(uint64_t)cacheWorkerWaves*cacheWorkerThreads*cacheWorkerLookups);
+        destroyCorrectionCache(cache);
+        destroyLiveCalibration(live);
+        printf("***********************\n");
+    }
+
+    // instrumentation counts only when built with make instrumented, a snapshot of the
+    // default build stays empty
+    {
+        const float instrumentSpeeds[8] = {0,10,20,150,160,999,-1,NAN};
+        const float instrumentAngles[8] = {0,45,100,200,300,359.9,-5,360};
+        resetInstrumentation();
+        for(int speed=0;speed<8;speed++)
+        {
+            for(int angle=0;angle<8;angle++)
+            {
+                correctSpeed(instrumentSpeeds[speed],instrumentAngles[angle]);
+            }
+        }
+        instrumentSnapshot snapshot;
+        snapshotInstrumentation(&snapshot);
+
+        for(int bucket=1;bucket<instrumentBuckets;bucket++)
+        {
+            assert(instrumentBucketTicks(bucket)>instrumentBucketTicks(bucket-1));
+        }
+        assert(instrumentBucketTicks(instrumentLinearTicks)==instrumentLinearTicks);
+        assert(instrumentBucketTicks(instrumentBuckets-1)<(1ULL<<instrumentMaxMagnitude));
+
+#ifdef correctionInstrumentation
+        assert(snapshot.calls==64);
+        assert(snapshot.extrapolated==16 && snapshot.invalidSpeeds==16 && snapshot.invalidAngles==16);
+        assert(snapshot.sectors[0]==16 && snapshot.sectors[1]==8 && snapshot.sectors[2]==8 && snapshot.sectors[3]==16);
+        // a speed that is not a number lands on whichever site the search gives up on
+        assert(snapshot.sites[1]>=32 && snapshot.sites[27]==8 && snapshot.sites[instrumentSites-1]>=16);
+        uint64_t sited = 0;
+        for(int site=0;site<instrumentSites;site++)
+        {
+            sited += snapshot.sites[site];
+        }
+        assert(sited==64);
+        uint64_t timed = 0;
+        for(int bucket=0;bucket<instrumentBuckets;bucket++)
+        {
+            timed += snapshot.latency[bucket];
+        }
+        assert(timed>=(64/instrumentLatencyInterval) && timed<=(64/instrumentLatencyInterval)+1 && snapshot.ticksPerNs>0.0);
+        assert(instrumentLatencyNs(&snapshot,0.5)>0.0 && instrumentLatencyNs(&snapshot,0.5)<=instrumentLatencyNs(&snapshot,1.0));
+
+        // threads count into their own blocks, which outlive them
+        pthread_t threads[instrumentThreads];
+        float totals[instrumentThreads] = {};
+        for(int thread=0;thread<instrumentThreads;thread++)
+        {
+            assert(pthread_create(&threads[thread],NULL,instrumentCorrect,&totals[thread])==0);
+        }
+        for(int thread=0;thread<instrumentThreads;thread++)
+        {
+            pthread_join(threads[thread],NULL);
+            assert(totals[thread]==totals[0]);
+        }
+        snapshotInstrumentation(&snapshot);
+        assert(snapshot.calls==64+(instrumentThreads*instrumentThreadCalls));
+
+        FILE* dump = tmpfile();
+        assert(printInstrumentation(&snapshot,dump)==0 && writeInstrumentationJson(&snapshot,dump)==0);
+        rewind(dump);
+        char text[8192];
+        size_t length = fread(text,1,sizeof(text)-1,dump);
+        text[length] = '\0';
+        fclose(dump);
+        assert(strstr(text,"INSTRUMENT:calls 40064") && strstr(text,"\"calls\": 40064,"));
+        printInstrumentation(&snapshot,stdout);
+
+        resetInstrumentation();
+        snapshotInstrumentation(&snapshot);
+        assert(snapshot.calls==0 && snapshot.sites[1]==0);
+#else
+        assert(snapshot.calls==0 && instrumentLatencyNs(&snapshot,0.99)==0.0);
+#endif
+        printf("TEST:instrumentation calls:%lu\n",(unsigned long)snapshot.calls);
+        printf("***********************\n");
+    }
+
+    // correction server, pipelined requests from several stations come back in order and
+    // corrected with each station's profile, bad requests are answered with EINVAL
+    {
+        serverConfig badConfig = {"/tmp/unused",0,100};
+        errno = 0;
+        assert(!createCorrectionServer(&badConfig) && errno==EINVAL);
+
+        char directory[] = "/tmp/unitTestServerXXXXXX";
+        assert(mkdtemp(directory));
+        char socketName[64];
+        snprintf(socketName,sizeof(socketName),"%s/socket",directory);
+        serverConfig config = {socketName,64,2000};
+        correctionServer* server = createCorrectionServer(&config);
+        assert(server);
+
+        calibrationProfile windy;
+        assert(parseCalibrationProfile("0 0 0 0\n20 4.3 -1.3 -2.6\n150 10.8 -11.1 -11.0\n",&windy)==0);
+        assert(setStationProfile(server,7,&windy)==0);
+        assert(setStationProfile(server,serverMaxStations,&windy)==-1 && errno==EINVAL);
+        pthread_t serverThread;
+        assert(pthread_create(&serverThread,NULL,runServer,server)==0);
+
+        int client = connectCorrectionServer(socketName);
+        assert(client>=0);
+
+        // one that leaves without reading its response must not disturb the others
+        int leaver = connectCorrectionServer(socketName);
+        serverReading leaving[4] = {{10,10},{20,20},{30,30},{40,40}};
+        assert(leaver>=0 && sendReadings(leaver,0,3,leaving,4)==0);
+        close(leaver);
+
+        const int requestCount = 100;
+        const uint16_t stations[3] = {0,7,3};
+        serverReading readings[serverMaxReadings+50];
+        for(int request=0;request<requestCount;request++)
+        {
+            int count = 1+(request%13);
+            for(int reading=0;reading<count;reading++)
+            {
+                readings[reading].rawSpeed = ((request*31)+(reading*7))%200+0.25f;
+                readings[reading].angle = ((request*47)+(reading*11))%360;
+            }
+            assert(sendReadings(client,request,stations[request%3],readings,count)==0);
+        }
+        assert(sendReadings(client,requestCount,serverMaxStations,readings,1)==0);
+        assert(sendReadings(client,requestCount+1,0,readings,serverMaxReadings+50)==0);
+
+        float corrected[serverMaxReadings];
+        for(int request=0;request<requestCount;request++)
+        {
+            uint32_t requestId;
+            uint16_t status;
+            int count = receiveCorrected(client,&requestId,&status,corrected);
+            assert(requestId==(uint32_t)request && status==0 && count==1+(request%13));
+            for(int reading=0;reading<count;reading++)
+            {
+                float rawSpeed = ((request*31)+(reading*7))%200+0.25f;
+                float angle = ((request*47)+(reading*11))%360;
+                float expected = (stations[request%3]==7) ? correctSpeed(&windy,rawSpeed,angle) : correctSpeed(rawSpeed,angle);
+                assert(memcmp(&corrected[reading],&expected,sizeof(float))==0);
+            }
+        }
+        for(int bad=0;bad<2;bad++)
+        {
+            uint32_t requestId;
+            uint16_t status;
+            assert(receiveCorrected(client,&requestId,&status,corrected)==0);
+            assert(requestId==(uint32_t)(requestCount+bad) && status==EINVAL);
+        }
+        close(client);
+
+        stopCorrectionServer(server);
+        pthread_join(serverThread,NULL);
+        serverStats stats;
+        correctionServerStatistics(server,&stats);
+        assert(stats.connections==2 && stats.requests==(uint64_t)requestCount+3 && stats.rejected==2);
+        assert(stats.batches>0 && stats.batches<stats.requests);
+        destroyCorrectionServer(server);
+        assert(access(socketName,F_OK)<0);
+
+        // a socket left behind is replaced, a file at the socket path is left alone
+        FILE* victim = fopen(socketName,"w");
+        fputs("not a socket\n",victim);
+        fclose(victim);
+        errno = 0;
+        assert(!createCorrectionServer(&config) && errno==EEXIST && access(socketName,F_OK)==0);
+        assert(unlink(socketName)==0);
+        struct sockaddr_un staleAddress;
+        memset(&staleAddress,0,sizeof(staleAddress));
+        staleAddress.sun_family = AF_UNIX;
+        strcpy(staleAddress.sun_path,socketName);
+        int stale = socket(AF_UNIX,SOCK_SEQPACKET,0);
+        assert(stale>=0 && bind(stale,(struct sockaddr*)&staleAddress,sizeof(staleAddress))==0);
+        close(stale);
+        server = createCorrectionServer(&config);
+        assert(server);
+        destroyCorrectionServer(server);
+        assert(access(socketName,F_OK)<0 && rmdir(directory)==0);
+        printf("TEST:correction server requests:%lu readings:%lu batches:%lu\n",(unsigned long)stats.requests,
+               (unsigned long)stats.readings,(unsigned long)stats.batches);
+        printf("***********************\n");
+    }
+
+    // pipeline, a csv file streamed through read, parse, correct, aggregate, format and write
+    {
+        const int lineCount = 20000;
+        char inputName[] = "/tmp/unitTestPipelineInXXXXXX";
+        char outputName[] = "/tmp/unitTestPipelineOutXXXXXX";
+        int input = mkstemp(inputName);
+        int output = mkstemp(outputName);
+        assert(input>=0 && output>=0);
+
+        FILE* file = fdopen(input,"w");
+        fprintf(file,"timestamp,speed,direction\n");
+        fprintf(file,"1499999940,10,nan\n1499999940,inf,10\n1499999940,10,-inf\n1499999940,-nan,1e30\n");
+        windAccumulator expectedWind;
+        resetWindAccumulator(&expectedWind);
+        float expectedPeak = 0.0f;
+        for(int line=0;line<lineCount;line++)
+        {
+            float rawSpeed = ((line*7919)%2000)/10.0f;
+            float angle = (line*104729)%360;
+            fprintf(file,(line==lineCount-1) ? "%d,%.1f,%g" : "%d,%.1f,%g\n",1500000000+(line*60),rawSpeed,angle);
+            float corrected = accumulateWind(&expectedWind,rawSpeed,angle);
+            expectedPeak = (corrected>expectedPeak) ? corrected : expectedPeak;
+        }
+        fclose(file);
+
+        static pipelineTextSource source;
+        pipelineAggregate aggregate;
+        pipelineConfig config;
+        memset(&config,0,sizeof(config));
+        config.source = (pipelineStage){"read",readTextBlock,&source,1};
+        config.stages[0] = (pipelineStage){"parse",parseWindBlock,NULL,1};
+        config.stages[1] = (pipelineStage){"correct",correctWindBlock,NULL,3};
+        config.stages[2] = (pipelineStage){"aggregate",aggregateWindBlock,&aggregate,1};
+        config.stages[3] = (pipelineStage){"format",formatWindBlock,NULL,2};
+        config.stages[4] = (pipelineStage){"write",writeTextBlock,&output,1};
+        config.stageCount = 5;
+        config.queueBlocks = 1;
+
+        // threaded and one block at a time give the same file and the same sums
+        for(int sequential=0;sequential<2;sequential++)
+        {
+            source.fd = open(inputName,O_RDONLY);
+            source.carried = 0;
+            assert(source.fd>=0 && ftruncate(output,0)==0 && lseek(output,0,SEEK_SET)==0);
+            memset(&aggregate,0,sizeof(aggregate));
+            pipelineStats stats;
+            assert((sequential ? runPipelineSequentially(&config,&stats) : runPipeline(&config,&stats))==0);
+            close(source.fd);
+            assert(stats.samples==(uint64_t)lineCount && stats.source.blocks==5 && stats.stages[4].blocks==5);
+            assert(memcmp(&aggregate.wind,&expectedWind,sizeof(windAccumulator))==0 && aggregate.peak==expectedPeak);
+
+            file = fopen(outputName,"r");
+            char line[64];
+            char expected[64];
+            int lines = 0;
+            while(fgets(line,sizeof(line),file))
+            {
+                float rawSpeed = ((lines*7919)%2000)/10.0f;
+                float angle = (lines*104729)%360;
+                snprintf(expected,sizeof(expected),"%d,%.2f,%g\n",1500000000+(lines*60),correctSpeed(rawSpeed,angle),angle);
+                assert(strcmp(line,expected)==0);
+                lines++;
+            }
+            fclose(file);
+            assert(lines==lineCount);
+        }
+        close(output);
+        unlink(inputName);
+        unlink(outputName);
+
+        // a slow sink holds the source back to the blocks the pipeline owns, 1 + 2 queued + 1 working
+        pipelineProbe probe = {200,-1,0,0,0};
+        pipelineConfig probeConfig;
+        memset(&probeConfig,0,sizeof(probeConfig));
+        probeConfig.source = (pipelineStage){"source",probeSource,&probe,1};
+        probeConfig.stages[0] = (pipelineStage){"stage",probeStage,&probe,4};
+        probeConfig.stages[1] = (pipelineStage){"sink",probeSink,&probe,1};
+        probeConfig.stageCount = 2;
+        probeConfig.queueBlocks = 2;
+        pipelineStats stats;
+        assert(runPipeline(&probeConfig,&stats)==0);
+        assert(probe.consumed==200 && probe.mostInFlight<=10 && stats.stages[1].blocks==200);
+        printf("TEST:pipeline most blocks in flight:%d of %d\n",probe.mostInFlight,1+(2+4)+(2+1));
+
+        // the first failure stops every stage and comes back with its errno
+        probe = (pipelineProbe){200,37,0,0,0};
+        errno = 0;
+        assert(runPipeline(&probeConfig,&stats)==-1 && errno==EIO && probe.consumed<=37);
+        probe = (pipelineProbe){200,37,0,0,0};
+        errno = 0;
+        assert(runPipelineSequentially(&probeConfig,&stats)==-1 && errno==EIO && probe.consumed==37);
+
+        probeConfig.queueBlocks = 0;
+        errno = 0;
+        assert(runPipeline(&probeConfig,NULL)==-1 && errno==EINVAL);
+        probeConfig.queueBlocks = 1;
+        probeConfig.stages[0].workers = pipelineMaxWorkers+1;
+        errno = 0;
+        assert(runPipelineSequentially(&probeConfig,NULL)==-1 && errno==EINVAL);
+        printf("TEST:pipeline lines:%d\n",lineCount);
+        printf("***********************\n");
+    }
+
+    // smooth interpolation, through the sites, no kinks between them and never falling as
+    // the speed rises
+    {
+        // the same corrections as correctSpeed at every site below the top one and at every
+        // angle site, and the same straight line beyond both ends
+        const float angleSites[5] = {0.0f,90.0f,180.0f,270.0f,360.0f};
+        for(int site=0;site<correctionTableSize-1;site++)
+        {
+            for(int angleSite=0;angleSite<5;angleSite++)
+            {
+                float speed = correctionTable[site][0];
+                float smooth = correctSpeedSmooth(speed,angleSites[angleSite]);
+                assert(fabsf(smooth-correctSpeed(speed,angleSites[angleSite]))<=1e-5f*(1.0f+speed));
+            }
+        }
+        for(int angle=0;angle<=360;angle+=90)
+        {
+            assert(fabsf(correctSpeedSmooth(1200.0f,angle)-correctSpeed(1200.0f,angle))<=1e-3f);
+            assert(fabsf(correctSpeedSmooth(-5.0f,angle)-correctSpeed(-5.0f,angle))<=1e-4f);
+        }
+
+        // the slope either side of every inner site and of 0/360 and 180 degrees, correctSpeed
+        // jumps by up to a few tenths of a mph per mph
+        const float step = 0.01f;
+        float worstSmoothKink = 0.0f;
+        float worstLinearKink = 0.0f;
+        for(int site=1;site<correctionTableSize-1;site++)
+        {
+            for(int angle=0;angle<360;angle+=15)
+            {
+                float speed = correctionTable[site][0];
+                float smoothKink = fabsf((correctSpeedSmooth(speed+step,angle)-correctSpeedSmooth(speed,angle))-
+                                         (correctSpeedSmooth(speed,angle)-correctSpeedSmooth(speed-step,angle)))/step;
+                float linearKink = fabsf((correctSpeed(speed+step,angle)-correctSpeed(speed,angle))-
+                                         (correctSpeed(speed,angle)-correctSpeed(speed-step,angle)))/step;
+                worstSmoothKink = (smoothKink>worstSmoothKink) ? smoothKink : worstSmoothKink;
+                worstLinearKink = (linearKink>worstLinearKink) ? linearKink : worstLinearKink;
+            }
+        }
+        assert(worstSmoothKink<0.02f && worstLinearKink>0.2f);
+        for(int speed=1;speed<200;speed+=7)
+        {
+            for(int angleSite=0;angleSite<3;angleSite++)
+            {
+                float angle = angleSites[2*angleSite];
+                float rising = correctSpeedSmooth(speed,angle+0.1f)-correctSpeedSmooth(speed,angle);
+                float falling = correctSpeedSmooth(speed,angle)-correctSpeedSmooth(speed,angle-0.1f);
+                assert(fabsf(rising-falling)<1e-3f);
+            }
+        }
+
+        // monotone in speed at every degree, and between two sites at an angle site the
+        // correction stays between the corrections at the sites
+        for(int angle=0;angle<360;angle++)
+        {
+            float previous = correctSpeedSmooth(0.0f,angle);
+            for(int speed=1;speed<=4000;speed++)
+            {
+                float corrected = correctSpeedSmooth(speed*0.05f,angle);
+                assert(corrected>=previous);
+                previous = corrected;
+            }
+        }
+        for(int site=0;site<correctionTableSize-1;site++)
+        {
+            for(int angleSite=0;angleSite<3;angleSite++)
+            {
+                float low = correctionTable[site][angleSite+1];
+                float high = correctionTable[site+1][angleSite+1];
+                for(int part=1;part<20;part++)
+                {
+                    float speed = correctionTable[site][0]+((correctionTable[site+1][0]-correctionTable[site][0])*part/20.0f);
+                    float correction = correctSpeedSmooth(speed,angleSites[angleSite])-speed;
+                    assert(correction>=fminf(low,high)-1e-4f && correction<=fmaxf(low,high)+1e-4f);
+                }
+            }
+        }
+
+        // the batch kernel matches the scalar path over a sweep with every awkward input, and
+        // every short length takes the tail
+        const int sweepSize = 1103*361;
+        float* speeds = (float*)malloc(sweepSize*sizeof(float));
+        float* angles = (float*)malloc(sweepSize*sizeof(float));
+        float* corrected = (float*)malloc(sweepSize*sizeof(float));
+        for(int sample=0;sample<sweepSize;sample++)
+        {
+            speeds[sample] = ((sample/361)*0.25)+((sample%7)*0.01)-2.0f;
+            angles[sample] = (sample%361)+((sample%3)*0.3)-((sample%5==0) ? 360.0f : 0.0f);
+        }
+        speeds[0] = 1200.0f;
+        speeds[1] = NAN;
+        angles[2] = NAN;
+        speeds[3] = -0.0f;
+        for(int length=0;length<=17;length++)
+        {
+            correctSpeedSmoothBatch(&defaultSmoothCorrection,&speeds[1000],&angles[1000],corrected,length);
+            for(int sample=0;sample<length;sample++)
+            {
+                assert(corrected[sample]==correctSpeedSmooth(speeds[1000+sample],angles[1000+sample]));
+            }
+        }
+        correctSpeedInterpolated(interpolationSmooth,speeds,angles,corrected,sweepSize);
+        assert(isnan(corrected[1]) && isnan(corrected[2]));
+        int worstUlp = 0;
+        for(int sample=0;sample<sweepSize;sample++)
+        {
+            float expected = correctSpeedSmooth(speeds[sample],angles[sample]);
+            int expectedBits;
+            int actualBits;
+            memcpy(&expectedBits,&expected,sizeof(float));
+            memcpy(&actualBits,&corrected[sample],sizeof(float));
+            int ulp = abs(expectedBits-actualBits);
+            worstUlp = (ulp>worstUlp) ? ulp : worstUlp;
+        }
+        assert(worstUlp<=smoothUlpTolerance);
+        correctSpeedInterpolated(interpolationLinear,speeds,angles,corrected,sweepSize);
+        for(int sample=0;sample<sweepSize;sample+=97)
+        {
+            assert(fabsf(corrected[sample]-correctSpeed(speeds[sample],angles[sample]))<0.001);
+        }
+        free(speeds);
+        free(angles);
+        free(corrected);
+
+        // a profile gives the same curve as the table it holds, up to the interval below 150
+        // mph whose slope at 150 sees the top site at 255 rather than 999
+        smoothCorrection fromProfile;
+        assert(buildSmoothCorrection(&fromProfile,&defaultCalibrationProfile)==0);
+        for(int speed=0;speed<1450;speed+=3)
+        {
+            for(int angle=0;angle<360;angle+=11)
+            {
+                float expected = correctSpeedSmooth(speed*0.1f,angle);
+                assert(fabsf(correctSpeedSmooth(&fromProfile,speed*0.1f,angle)-expected)<=1e-4f*(1.0f+expected));
+            }
+        }
+        const float unordered[3][4] = {{0,0,0,0},{20,1,1,1},{20,2,2,2}};
+        errno = 0;
+        assert(buildSmoothCorrection(&fromProfile,unordered,3)==-1 && errno==EINVAL);
+        errno = 0;
+        assert(buildSmoothCorrection(&fromProfile,unordered,1)==-1 && errno==EINVAL);
+        printf("TEST:smooth interpolation worst slope jump:%f (linear %f) worst ulp:%d\n",worstSmoothKink,worstLinearKink,worstUlp);
+        printf("***********************\n");
+    }
+
+    // inverse correction, a round trip through correctSpeed and back over every whole mph
+    // and degree a console reports, a dense sweep beyond the sites, and from the corrected
+    // side back again
+    {
+        static_assert(davisCorrectionMonotone(davisFloatTable::topSpeed),"invertible calibration");
+        float worst = 0.0f;
+        for(int speed=0;speed<=255;speed++)
+        {
+            for(int angle=0;angle<=360;angle++)
+            {
+                float raw = uncorrectSpeed(correctSpeed(speed,angle),angle);
+                float error = fabsf(raw-speed);
+                worst = (error>worst) ? error : worst;
+                assert(error<=2e-5f*(1.0f+speed));
+            }
+        }
+        for(int step=0;step<40000;step++)
+        {
+            float speed = (step*0.03f)-10.0f;
+            float angle = fmodf(step*7.3f,360.0f);
+            float raw = uncorrectSpeed(correctSpeed(speed,angle),angle);
+            assert(fabsf(raw-speed)<=2e-5f*(1.0f+fabsf(speed)));
+        }
+        for(int step=0;step<30000;step++)
+        {
+            float corrected = step*0.01f;
+            float angle = (step*13)%361+0.5f*(step%2);
+            assert(fabsf(correctSpeed(uncorrectSpeed(corrected,angle),angle)-corrected)<=2e-5f*(1.0f+corrected));
+        }
+        assert(isnan(uncorrectSpeed(NAN,10.0f)) && isnan(uncorrectSpeed(20.0f,NAN)));
+
+        // the batch entry point is the scalar one a sample at a time
+        float correctedSpeeds[1000];
+        float angles[1000];
+        float raw[1000];
+        for(int sample=0;sample<1000;sample++)
+        {
+            correctedSpeeds[sample] = (sample*0.37f)-5.0f;
+            angles[sample] = (sample*41)%360;
+        }
+        uncorrectSpeedBatch(&defaultInverseCorrection,correctedSpeeds,angles,raw,1000);
+        for(int sample=0;sample<1000;sample++)
+        {
+            float expected = uncorrectSpeed(correctedSpeeds[sample],angles[sample]);
+            assert(memcmp(&raw[sample],&expected,sizeof(float))==0);
+        }
+
+        // a profile is undone as correctSpeed with the profile corrects
+        calibrationProfile windy;
+        assert(parseCalibrationProfile("0 0 0 0\n20 4.3 -1.3 -2.6\n150 10.8 -11.1 -11.0\n",&windy)==0);
+        inverseCorrection inverse;
+        assert(buildInverseCorrection(&inverse,&windy)==0);
+        for(int speed=0;speed<=255;speed+=3)
+        {
+            for(int angle=0;angle<360;angle+=7)
+            {
+                assert(fabsf(uncorrectSpeed(&inverse,correctSpeed(&windy,speed,angle),angle)-speed)<=2e-5f*(1.0f+speed));
+            }
+        }
+
+        // a correction that falls faster than the speed rises can not be undone
+        const float folding[3][4] = {{0,0,0,0},{20,3,3,3},{25,-3,0,0}};
+        errno = 0;
+        assert(buildInverseCorrection(&inverse,folding,3)==-1 && errno==EDOM);
+        const float unordered[2][4] = {{20,0,0,0},{20,1,1,1}};
+        errno = 0;
+        assert(buildInverseCorrection(&inverse,unordered,2)==-1 && errno==EINVAL);
+        printf("TEST:inverse correction worst round trip error:%g mph\n",worst);
+        printf("***********************\n");
+    }
+
+    // packed profiles, the default and a packed field profile correct as the profile does bit
+    // for bit one sample, a batch or a block of stations at a time, a table off the tenths
+    // rounds within 0.05 mph and sites off an implicit axis are rejected
+    {
+        assert(sizeof(packedProfile)==92);
+        assert(defaultPackedProfile.siteCount==28 && defaultPackedProfile.held==1);
+        assert(defaultPackedProfile.origin==20 && defaultPackedProfile.spacing==5);
+        packedProfile packed;
+        assert(packCalibrationProfile(&defaultCalibrationProfile,&packed)==0);
+        assert(memcmp(&packed,&defaultPackedProfile,sizeof(packed))==0);
+
+        for(int speed=-40;speed<=1200;speed++)
+        {
+            for(int angle=-10;angle<370;angle++)
+            {
+                float rawSpeed = speed*0.25;
+                float rawAngle = angle+((speed%4)*0.25);
+                float correctedSpeed = correctSpeed(rawSpeed,rawAngle);
+                float packedSpeed = correctSpeedPacked(&defaultPackedProfile,rawSpeed,rawAngle);
+                assert(memcmp(&correctedSpeed,&packedSpeed,sizeof(float))==0);
+            }
+        }
+
+        calibrationProfile windy;
+        assert(parseCalibrationProfile("0 0 0 0\n20 4.3 -1.3 -2.6\n150 10.8 -11.1 -11.0\n",&windy)==0);
+        assert(packCalibrationProfile(&windy,&packed)==0 && packed.siteCount==3 && packed.held==1);
+        for(int speed=-40;speed<=1200;speed++)
+        {
+            for(int angle=0;angle<360;angle+=3)
+            {
+                float rawSpeed = speed*0.25;
+                float profileSpeed = correctSpeed(&windy,rawSpeed,angle);
+                float packedSpeed = correctSpeedPacked(&packed,rawSpeed,angle);
+                assert(memcmp(&profileSpeed,&packedSpeed,sizeof(float))==0);
+            }
+        }
+
+        // a block of stations, each a perturbed Davis table, through the batches against
+        // the profile each was packed from
+        const int stationCount = 1000;
+        const int sampleCount = 20003;
+        calibrationProfile* profiles = (calibrationProfile*)malloc(stationCount*sizeof(calibrationProfile));
+        packedProfile* stations = (packedProfile*)malloc(stationCount*sizeof(packedProfile));
+        uint16_t* station = (uint16_t*)malloc(sampleCount*sizeof(uint16_t));
+        float* rawSpeed = (float*)malloc(sampleCount*sizeof(float));
+        float* angle = (float*)malloc(sampleCount*sizeof(float));
+        float* corrected = (float*)malloc(sampleCount*sizeof(float));
+        for(int index=0;index<stationCount;index++)
+        {
+            profiles[index] = defaultCalibrationProfile;
+            for(int site=1;site<28;site++)
+            {
+                for(int column=0;column<3;column++)
+                {
+                    int tenths = profiles[index].corrections[site][column]+((index*7+site*3+column)%9)-4;
+                    profiles[index].corrections[site][column] = (tenths>127) ? 127 : ((tenths<-127) ? -127 : tenths);
+                }
+            }
+            memcpy(profiles[index].corrections[28],profiles[index].corrections[27],3);
+            assert(packCalibrationProfile(&profiles[index],&stations[index])==0 && stations[index].held==1);
+        }
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            station[sample] = (sample*7919)%stationCount;
+            rawSpeed[sample] = ((sample*37)%3000)*0.1f-10.0f;
+            angle[sample] = ((sample*53)%3700)*0.1f-5.0f;
+        }
+        rawSpeed[17] = NAN;
+        angle[18] = NAN;
+        rawSpeed[19] = INFINITY;
+        rawSpeed[20] = -INFINITY;
+        correctStationsPacked(stations,station,rawSpeed,angle,corrected,sampleCount);
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            float expected = correctSpeedPacked(&stations[station[sample]],rawSpeed[sample],angle[sample]);
+            assert(memcmp(&corrected[sample],&expected,sizeof(float))==0);
+            float profileSpeed = correctSpeed(&profiles[station[sample]],rawSpeed[sample],angle[sample]);
+            assert(memcmp(&profileSpeed,&expected,sizeof(float))==0 || (isnan(profileSpeed) && isnan(expected)));
+        }
+        correctSpeedPackedBatch(&defaultPackedProfile,rawSpeed,angle,corrected,sampleCount);
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            float expected = correctSpeedPacked(&defaultPackedProfile,rawSpeed[sample],angle[sample]);
+            assert(memcmp(&corrected[sample],&expected,sizeof(float))==0);
+        }
+
+        // corrections between the tenths round to the nearest, against the table interpolated
+        // in double
+        float table[correctionTableSize][4];
+        memcpy(table,correctionTable,sizeof(table));
+        for(int row=1;row<correctionTableSize-1;row++)
+        {
+            for(int column=1;column<4;column++)
+            {
+                table[row][column] += 0.0137f*((row*column)%7)-0.04f;
+            }
+        }
+        memcpy(table[correctionTableSize-1]+1,table[correctionTableSize-2]+1,3*sizeof(float));
+        assert(packCorrectionTable(table,correctionTableSize,&packed)==0 && packed.held==1);
+        float worst = 0.0f;
+        for(int speed=0;speed<=600;speed++)
+        {
+            for(int angle=0;angle<=360;angle+=2)
+            {
+                double rawSpeed = speed*0.25;
+                int high = 1;
+                while(high<(correctionTableSize-1) && rawSpeed>table[high][0])
+                {
+                    high++;
+                }
+                double factor = (rawSpeed-table[high-1][0])/(table[high][0]-table[high-1][0]);
+                double folded = (angle>180) ? 360-angle : angle;
+                int column = (folded>90.0) ? 2 : 1;
+                double angleFactor = (folded>90.0) ? (folded-90.0)/90.0 : folded/90.0;
+                double low = (table[high-1][column+1]-table[high-1][column])*angleFactor+table[high-1][column];
+                double top = (table[high][column+1]-table[high][column])*angleFactor+table[high][column];
+                double exact = rawSpeed+((top-low)*factor)+low;
+                float error = fabs(correctSpeedPacked(&packed,rawSpeed,angle)-exact);
+                worst = (error>worst) ? error : worst;
+                assert(error<=0.05f+1e-4f);
+            }
+        }
+
+        // off the axis, a correction out of range and a held row that is not the top are
+        // rejected, leaving the packed profile as it was
+        packedProfile untouched = packed;
+        calibrationProfile uneven;
+        assert(parseCalibrationProfile("0 0 0 0\n20 1 1 1\n30 2 2 2\n45 3 3 3\n",&uneven)==0);
+        errno = 0;
+        assert(packCalibrationProfile(&uneven,&packed)==-1 && errno==EINVAL);
+        table[3][2] = 12.76f;
+        errno = 0;
+        assert(packCorrectionTable(table,correctionTableSize,&packed)==-1 && errno==EINVAL);
+        const float offAxis[4][4] = {{0,0,0,0},{20,1,1,1},{999,1,1,1},{1000,2,2,2}};
+        errno = 0;
+        assert(packCorrectionTable(offAxis,4,&packed)==-1 && errno==EINVAL);
+        errno = 0;
+        assert(packCorrectionTable(&correctionTable[1],correctionTableSize-1,&packed)==-1 && errno==EINVAL);
+        assert(memcmp(&untouched,&packed,sizeof(packed))==0);
+        assert(packCorrectionTable(correctionTable,correctionTableSize-1,&packed)==0 && packed.siteCount==28);
+
+        free(corrected);
+        free(angle);
+        free(rawSpeed);
+        free(station);
+        free(stations);
+        free(profiles);
+        printf("TEST:packed profile bytes:%d, worst rounding %g mph\n",(int)sizeof(packedProfile),worst);
+        printf("***********************\n");
+    }
+
     printf("happy days\n");
 }
 
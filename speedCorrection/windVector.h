@@ -0,0 +1,62 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _windVector_h_
+#define _windVector_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// corrected speeds, decomposed into U (towards the east) and V (towards the north) and
+// summed, angles are the meteorological direction the wind blows from in degrees
+typedef struct
+{
+    double speedSum;
+    double uSum;
+    double vSum;
+    size_t samples;
+} windAccumulator;
+
+// one window of wind
+typedef struct
+{
+    size_t samples;
+    float meanSpeed;            // mean of the corrected speeds
+    float vectorSpeed;          // speed of the mean wind vector
+    float direction;            // direction of the mean wind vector, 0->360 degrees
+    float steadiness;           // vectorSpeed/meanSpeed, 1 for wind from one direction, 0 in calm
+} windSummary;
+
+void resetWindAccumulator(windAccumulator* accumulator);
+
+// corrects one sample and adds it to the window, returns the corrected speed
+float accumulateWind(windAccumulator* accumulator, float rawSpeed, float angle);
+
+// adds a sample that has already been corrected, a NaN or infinite angle adds its speed
+// to the mean speed and nothing to the vector
+void accumulateCorrectedWind(windAccumulator* accumulator, float correctedSpeed, float angle);
+
+void summariseWind(const windAccumulator* accumulator, windSummary* summary);
+
+// corrects, decomposes and sums count samples in one pass, a block at a time, summarising
+// every windowSamples samples (all of them if it is 0), the last window may be short.
+// Corrected speeds are written to correctedSpeed unless it is NULL, returns the number of
+// windows written
+size_t correctWindWindows(const float* rawSpeed, const float* angle, size_t count, size_t windowSamples,
+                          windSummary* windows, float* __restrict correctedSpeed);
+
+#endif
@@ -0,0 +1,323 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Benchmarks for interpolator.c
+
+    Times the speed site lookup using the linear search and the speed site index in
+    10 mph bands across 0->200 mph, the linear search gets slower the higher the
+    speed while the index should stay flat.
+
+    Then times a full correction of a 0->200 mph x 0->255 degree sweep through
+    correctSpeed and the correction lattice, and counts cycles per correction for the
+    float and fixed point paths (time stamp counter on x86, nanoseconds scaled by the
+    nominal clock elsewhere).
+
+    Finally times correctSpeed, correctSpeedTenths, the lattice and a 4096 entry
+    correction cache (correctionCache.c) over calm, gusty, storm and uniform sweep wind
+    (benchHarness.h), warm with the tables cached and cold straight after evicting every
+    cache. bench -j file writes these results to file as
+    json.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "interpolator.h"
+#include "correctionLattice.h"
+#include "correctionCache.h"
+#include "benchHarness.h"
+
+#define bandWidth 10
+#define bandCount 20
+#define bandSamples 1000
+#define repeats 2000
+#define sweepSpeeds 200
+#define sweepAngles 256
+#define sweepRepeats 50
+#define nominalGHz 1.0
+#define suiteSamples 65536
+#define suiteWarmRepeats 50
+#define suiteColdSamples 256
+#define suiteColdRepeats 7
+
+static double elapsedNs(struct timespec start, struct timespec end)
+{
+    return ((end.tv_sec-start.tv_sec)*1e9)+(end.tv_nsec-start.tv_nsec);
+}
+
+static unsigned long long cycleCount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (unsigned long long)(((now.tv_sec*1e9)+now.tv_nsec)*nominalGHz);
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    const char* jsonName = NULL;
+    int option;
+    while((option = getopt(argc,argv,"j:"))!=-1)
+    {
+        if(option!='j')
+        {
+            fprintf(stderr,"usage: bench [-j results.json]\n");
+            return 1;
+        }
+        jsonName = optarg;
+    }
+
+    // the bench uses its own copy of the default speed sites so it does not depend
+    // on how the interpolator stores its table
+    uint8_t sites[29];
+    for(int site=0;site<29;site++)
+    {
+        sites[site] = (site==0) ? 0 : ((site==28) ? 255 : 15+(site*5));
+    }
+    speedSiteIndex index = buildSpeedSiteIndex(sites,29);
+
+    uint8_t speeds[bandSamples];
+    long checksum = 0;
+    double scanTotal = 0.0;
+    double findTotal = 0.0;
+
+    printf("BENCH:speed site lookup, ns per lookup\n");
+    printf("BENCH:%8s %10s %10s %8s\n","band","scan","index","gain");
+
+    for(int band=0;band<bandCount;band++)
+    {
+        for(int sample=0;sample<bandSamples;sample++)
+        {
+            speeds[sample] = (band*bandWidth)+((bandWidth*sample)/bandSamples);
+        }
+
+        struct timespec start;
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<repeats;repeat++)
+        {
+            for(int sample=0;sample<bandSamples;sample++)
+            {
+                checksum += scanSpeedSite(&index,speeds[sample]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        double scanNs = elapsedNs(start,end)/((double)repeats*bandSamples);
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<repeats;repeat++)
+        {
+            for(int sample=0;sample<bandSamples;sample++)
+            {
+                checksum -= findSpeedSite(&index,speeds[sample]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        double findNs = elapsedNs(start,end)/((double)repeats*bandSamples);
+
+        scanTotal += scanNs;
+        findTotal += findNs;
+        printf("BENCH:%3d->%3d %10.2f %10.2f %7.2fx\n",band*bandWidth,(band+1)*bandWidth,scanNs,findNs,scanNs/findNs);
+    }
+
+    printf("BENCH:%8s %10.2f %10.2f %7.2fx\n","0->200",scanTotal/bandCount,findTotal/bandCount,scanTotal/findTotal);
+
+    // full corrections over a 0->200 mph sweep at every angle
+    int sweepSize = sweepSpeeds*sweepAngles;
+    uint8_t* sweepSpeed = (uint8_t*)malloc(sweepSize);
+    uint8_t* sweepAngle = (uint8_t*)malloc(sweepSize);
+    float* corrected = (float*)malloc(sweepSize*sizeof(float));
+    for(int sample=0;sample<sweepSize;sample++)
+    {
+        sweepSpeed[sample] = sample/sweepAngles;
+        sweepAngle[sample] = sample%sweepAngles;
+    }
+
+    correctionLattice lattice;
+    float* latticeStorage = (float*)malloc(correctionLatticeBytes(1,1));
+    buildCorrectionLattice(&lattice,latticeStorage,1,1);
+
+    const char* paths[2] = {"correctSpeed","lattice"};
+    double pathNs[2];
+    double correctedTotal = 0.0;
+    for(int path=0;path<2;path++)
+    {
+        struct timespec start;
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC,&start);
+        for(int repeat=0;repeat<sweepRepeats;repeat++)
+        {
+            for(int sample=0;sample<sweepSize;sample++)
+            {
+                corrected[sample] = (path==0) ? correctSpeed(sweepSpeed[sample],sweepAngle[sample]) : correctSpeedLattice(&lattice,sweepSpeed[sample],sweepAngle[sample]);
+            }
+            correctedTotal += corrected[sweepSize-1-repeat];
+        }
+        clock_gettime(CLOCK_MONOTONIC,&end);
+        pathNs[path] = elapsedNs(start,end)/((double)sweepRepeats*sweepSize);
+    }
+
+    printf("BENCH:correction 0->200 mph sweep, lattice bytes:%d\n",(int)correctionLatticeFootprint(&lattice));
+    printf("BENCH:%14s %10s %14s\n","path","ns","samples/sec");
+    for(int path=0;path<2;path++)
+    {
+        printf("BENCH:%14s %10.2f %14.0f\n",paths[path],pathNs[path],1e9/pathNs[path]);
+    }
+
+    // float against fixed point, the fixed point result is summed in tenths
+    uint16_t* correctedTenths = (uint16_t*)malloc(sweepSize*sizeof(uint16_t));
+    const char* arithmetic[2] = {"float","fixed point"};
+    double arithmeticCycles[2];
+    long tenthsTotal = 0;
+    for(int path=0;path<2;path++)
+    {
+        unsigned long long start = cycleCount();
+        for(int repeat=0;repeat<sweepRepeats;repeat++)
+        {
+            if(path==0)
+            {
+                for(int sample=0;sample<sweepSize;sample++)
+                {
+                    corrected[sample] = correctSpeed(sweepSpeed[sample],sweepAngle[sample]);
+                }
+                correctedTotal += corrected[sweepSize-1-repeat];
+            }
+            else
+            {
+                for(int sample=0;sample<sweepSize;sample++)
+                {
+                    correctedTenths[sample] = correctSpeedTenths(sweepSpeed[sample],sweepAngle[sample]);
+                }
+                tenthsTotal += correctedTenths[sweepSize-1-repeat];
+            }
+        }
+        arithmeticCycles[path] = (cycleCount()-start)/((double)sweepRepeats*sweepSize);
+    }
+
+    printf("BENCH:float against fixed point, cycles per correction\n");
+    printf("BENCH:%14s %10s %8s\n","path","cycles","gain");
+    for(int path=0;path<2;path++)
+    {
+        printf("BENCH:%14s %10.2f %7.2fx\n",arithmetic[path],arithmeticCycles[path],arithmeticCycles[0]/arithmeticCycles[path]);
+    }
+    printf("BENCH:checksum %f %ld\n",correctedTotal,tenthsTotal);
+
+    // every path over each wind distribution, speeds are rounded to whole mph and directions
+    // past 255 degrees are folded to the angle with the same correction
+    float* windSpeed = (float*)malloc(suiteSamples*sizeof(float));
+    float* windAngle = (float*)malloc(suiteSamples*sizeof(float));
+    uint8_t* windSpeedMph = (uint8_t*)malloc(suiteSamples);
+    uint8_t* windAngleDegrees = (uint8_t*)malloc(suiteSamples);
+    float* windCorrected = (float*)malloc(suiteSamples*sizeof(float));
+    uint16_t* windCorrectedTenths = (uint16_t*)malloc(suiteSamples*sizeof(uint16_t));
+    benchReport* report = (benchReport*)calloc(1,sizeof(benchReport));
+    static correctionCacheEntry cacheEntries[4096];
+    correctionCache liveCache;
+    initCorrectionCache(&liveCache,cacheEntries,4096);
+    printf("BENCH:wind distributions, %d samples warm, %d samples cold\n",suiteSamples,suiteColdSamples);
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,suiteSamples);
+        for(int sample=0;sample<suiteSamples;sample++)
+        {
+            float speed = windSpeed[sample]+0.5f;
+            int angle = (int)(windAngle[sample]+0.5f)%360;
+            windSpeedMph[sample] = (speed>255.0f) ? 255 : (uint8_t)speed;
+            windAngleDegrees[sample] = (angle>255) ? 360-angle : angle;
+        }
+        const char* name = benchDistributionNames[distribution];
+
+        auto scalar = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                windCorrected[sample] = correctSpeed(windSpeedMph[sample],windAngleDegrees[sample]);
+            }
+        };
+        auto tenths = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                windCorrectedTenths[sample] = correctSpeedTenths(windSpeedMph[sample],windAngleDegrees[sample]);
+            }
+        };
+        auto latticed = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                windCorrected[sample] = correctSpeedLattice(&lattice,windSpeedMph[sample],windAngleDegrees[sample]);
+            }
+        };
+        auto cached = [&](size_t count)
+        {
+            for(size_t sample=0;sample<count;sample++)
+            {
+                windCorrected[sample] = correctSpeedCached(&liveCache,windSpeedMph[sample],windAngleDegrees[sample]);
+            }
+        };
+
+        for(int cold=0;cold<2;cold++)
+        {
+            const char* cache = cold ? "cold" : "warm";
+            size_t samples = cold ? suiteColdSamples : suiteSamples;
+            auto timeSuitePath = [&](auto path) { return cold ? benchColdNs(path,samples,suiteColdRepeats) : benchWarmNs(path,samples,suiteWarmRepeats); };
+            benchRecord(report,"wind","correctSpeed",name,cache,timeSuitePath(scalar));
+            benchRecord(report,"wind","tenths",name,cache,timeSuitePath(tenths));
+            benchRecord(report,"wind","lattice",name,cache,timeSuitePath(latticed));
+            benchRecord(report,"wind","cached",name,cache,timeSuitePath(cached));
+        }
+        correctedTotal += windCorrected[suiteColdSamples-1];
+        tenthsTotal += windCorrectedTenths[suiteColdSamples-1];
+    }
+    printf("BENCH:checksum %f %ld\n",correctedTotal,tenthsTotal);
+
+    if(jsonName && benchWriteJson(report,"speedCorrectionLite",jsonName)<0)
+    {
+        printf("BENCH:can not write every result to %s\n",jsonName);
+        return 1;
+    }
+
+    free(report);
+    free(windSpeed);
+    free(windAngle);
+    free(windSpeedMph);
+    free(windAngleDegrees);
+    free(windCorrected);
+    free(windCorrectedTenths);
+    free(correctedTenths);
+    free(sweepSpeed);
+    free(sweepAngle);
+    free(corrected);
+    free(latticeStorage);
+
+    // both lookups return the same sites so the checksum must come back to zero
+    if(checksum!=0)
+    {
+        printf("BENCH:lookup mismatch\n");
+        return 1;
+    }
+
+    return 0;
+}
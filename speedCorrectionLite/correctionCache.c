@@ -0,0 +1,75 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Memo of corrections keyed on the raw speed and angle
+
+    The float build's cache (../speedCorrection/correctionCache.c) tags its entries with an
+    epoch so it can serve profiles and survive threads racing an invalidation. Here the
+    calibration is the compiled in table and a cache has one user, so an entry is the
+    correction, the pair and a filled flag, and a hit is a load and a compare.
+
+    The angle is folded about 180 degrees first, as correctSpeed folds it, so an angle and
+    its mirror share an entry. The pair is keyed as speed*256+angle and placed in slot
+    speed*181+angle, so the angles of one speed take consecutive slots and each speed starts
+    181 slots on from the one below, the 0->180 degrees that have corrections of their own.
+    Every pair has a slot of its own in the largest table, and 181 is odd so every speed
+    starts on a different slot of the smallest table, and the speeds a station sees in a
+    spell of weather share a small table with few collisions.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include <string.h>
+#include "correctionCache.h"
+#include "interpolator.h"
+
+int initCorrectionCache(correctionCache* cache, correctionCacheEntry* entries, uint32_t capacity)
+{
+    if(capacity<cacheMinEntries || capacity>cacheMaxEntries || (capacity&(capacity-1))!=0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cache->entries = entries;
+    cache->mask = capacity-1;
+    clearCorrectionCache(cache);
+    return 0;
+}
+
+void clearCorrectionCache(correctionCache* cache)
+{
+    memset(cache->entries,0,((size_t)cache->mask+1)*sizeof(correctionCacheEntry));
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+float correctSpeedCached(correctionCache* cache, uint8_t rawSpeed, uint8_t angle)
+{
+    uint8_t correctionAngle = (angle>180) ? (180-(angle-180)) : angle;
+    uint16_t key = (uint16_t)((rawSpeed<<8)|correctionAngle);
+    correctionCacheEntry* entry = &cache->entries[((rawSpeed*181)+correctionAngle)&cache->mask];
+    if(entry->filled && entry->key==key)
+    {
+        cache->hits++;
+        return entry->corrected;
+    }
+
+    entry->corrected = correctSpeed(rawSpeed,angle);
+    entry->key = key;
+    entry->filled = 1;
+    cache->misses++;
+    return entry->corrected;
+}
@@ -0,0 +1,70 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionCache_h_
+#define _correctionCache_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bounds on the number of cached corrections, at the most every speed and angle pair, with
+// the angle folded to 0->180 degrees, has a slot of its own
+#define cacheMinEntries 16
+#define cacheMaxEntries 65536
+
+// one remembered correction, the pair is keyed as speed*256+angle, the angle folded
+typedef struct
+{
+    float corrected;
+    uint16_t key;
+    uint16_t filled;            // 0 for a slot nothing has been stored in
+} correctionCacheEntry;
+
+// memo of corrections for the live feed
+//
+// a device corrects the same few hundred speed and angle pairs over and over, the cache
+// remembers the correction of each pair it has seen in a direct mapped table the caller
+// supplies (usually a static array), a pair that lands on a slot already taken replaces it.
+// No heap is used and there is nothing to invalidate, the calibration is compiled in.
+//
+// one context uses a cache, a cache shared with an interrupt handler needs the interrupt
+// masked around each lookup
+typedef struct
+{
+    correctionCacheEntry* entries;
+    uint16_t mask;              // capacity-1
+    uint32_t hits;
+    uint32_t misses;
+} correctionCache;
+
+// bytes of ram a cache and its entries take
+constexpr size_t correctionCacheRamBytes(size_t capacity)
+{
+    return sizeof(correctionCache)+(capacity*sizeof(correctionCacheEntry));
+}
+
+// capacity must be a power of two from cacheMinEntries to cacheMaxEntries, returns 0, or
+// -1 with errno set to EINVAL
+int initCorrectionCache(correctionCache* cache, correctionCacheEntry* entries, uint32_t capacity);
+
+// drops every entry and zeroes the counts
+void clearCorrectionCache(correctionCache* cache);
+
+// the same corrections as correctSpeed(rawSpeed,angle), bit for bit
+float correctSpeedCached(correctionCache* cache, uint8_t rawSpeed, uint8_t angle);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Precomputed correction lattice for interpolator.c
+
+    The lattice samples correctSpeed once at every node and stores the correction
+    (corrected speed - raw speed). The correction is well under half the raw speed, so
+    the subtraction is exact and adding it back to the raw speed at a node gives the
+    correctSpeed result bit for bit.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include "correctionLattice.h"
+#include "interpolator.h"
+
+static uint16_t latticeSpeedCount(uint8_t speedStep)
+{
+    return ((latticeMaxSpeed+speedStep-1)/speedStep)+1;
+}
+
+static uint16_t latticeAngleCount(uint8_t angleStep)
+{
+    return ((180+angleStep-1)/angleStep)+1;
+}
+
+size_t correctionLatticeBytes(uint8_t speedStep, uint8_t angleStep)
+{
+    return (size_t)latticeSpeedCount(speedStep)*latticeAngleCount(angleStep)*sizeof(float);
+}
+
+void buildCorrectionLattice(correctionLattice* lattice, float* storage, uint8_t speedStep, uint8_t angleStep)
+{
+    lattice->speedStep = speedStep;
+    lattice->angleStep = angleStep;
+    lattice->unitSteps = (speedStep==1 && angleStep==1) ? 1 : 0;
+    lattice->speedCount = latticeSpeedCount(speedStep);
+    lattice->angleCount = latticeAngleCount(angleStep);
+    lattice->corrections = storage;
+
+    for(uint16_t row=0;row<lattice->speedCount;row++)
+    {
+        // rows past 255 mph repeat the correction at 255 mph
+        uint16_t speed = row*speedStep;
+        uint8_t rawSpeed = (speed>latticeMaxSpeed) ? latticeMaxSpeed : speed;
+        for(uint16_t column=0;column<lattice->angleCount;column++)
+        {
+            uint16_t angle = column*angleStep;
+            uint8_t correctionAngle = (angle>180) ? 180 : angle;
+            lattice->corrections[(row*lattice->angleCount)+column] = correctSpeed(rawSpeed,correctionAngle)-rawSpeed;
+        }
+    }
+}
+
+size_t correctionLatticeFootprint(const correctionLattice* lattice)
+{
+    return sizeof(correctionLattice)+((size_t)lattice->speedCount*lattice->angleCount*sizeof(float));
+}
+
+float correctSpeedLattice(const correctionLattice* lattice, uint8_t rawSpeed, uint8_t angle)
+{
+    // fold the angle onto 0->180 as correctSpeed does
+    uint8_t correctionAngle = (angle>180) ? (180-(angle-180)) : angle;
+
+    if(lattice->unitSteps)
+    {
+        return rawSpeed+lattice->corrections[(rawSpeed*lattice->angleCount)+correctionAngle];
+    }
+
+    // inputs on the last row or column blend from the cell below with a factor of one so
+    // the blend never reads past the end of the lattice
+    uint16_t row = rawSpeed/lattice->speedStep;
+    row = (row>(lattice->speedCount-2)) ? (lattice->speedCount-2) : row;
+    uint16_t column = correctionAngle/lattice->angleStep;
+    column = (column>(lattice->angleCount-2)) ? (lattice->angleCount-2) : column;
+    float speedFactor = (float)(rawSpeed-(row*lattice->speedStep))/lattice->speedStep;
+    float angleFactor = (float)(correctionAngle-(column*lattice->angleStep))/lattice->angleStep;
+
+    const float* corrections = lattice->corrections;
+    uint32_t low = (row*lattice->angleCount)+column;
+    uint32_t high = low+lattice->angleCount;
+    float correctionLow = ((corrections[low+1]-corrections[low])*angleFactor)+corrections[low];
+    float correctionHigh = ((corrections[high+1]-corrections[high])*angleFactor)+corrections[high];
+
+    return (((correctionHigh-correctionLow)*speedFactor)+correctionLow)+rawSpeed;
+}
@@ -0,0 +1,56 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionLattice_h_
+#define _correctionLattice_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// speeds covered by a lattice, the whole uint8_t range
+#define latticeMaxSpeed 255
+
+// dense grid of corrections over 0->255 mph and 0->180 degrees, built once from correctSpeed
+// so a correction is a single fetch on a 1 mph x 1 degree lattice or a bilinear blend of four
+// nodes on a coarser one
+//
+// the correction table is itself bilinear between its speed and angle sites, so a lattice
+// whose steps divide the site spacing (5 mph, 90 degrees) reproduces correctSpeed to within
+// float rounding, coarser lattices trade accuracy for memory
+typedef struct
+{
+    uint8_t speedStep;          // mph between rows
+    uint8_t angleStep;          // degrees between columns
+    uint8_t unitSteps;          // 1 mph x 1 degree lattice, every input is a node
+    uint16_t speedCount;        // rows, the last row is at or above latticeMaxSpeed
+    uint16_t angleCount;        // columns, the last column is at or above 180 degrees
+    float* corrections;         // speedCount*angleCount corrections, row major by speed
+} correctionLattice;
+
+// bytes of correction storage needed for a lattice of the given resolution
+size_t correctionLatticeBytes(uint8_t speedStep, uint8_t angleStep);
+
+// fills the caller supplied storage (at least correctionLatticeBytes) and sets up the lattice
+void buildCorrectionLattice(correctionLattice* lattice, float* storage, uint8_t speedStep, uint8_t angleStep);
+
+// memory used by a built lattice, the structure plus its correction storage
+size_t correctionLatticeFootprint(const correctionLattice* lattice);
+
+// single fetch at a node (bit identical to correctSpeed), bilinear blend between nodes
+float correctSpeedLattice(const correctionLattice* lattice, uint8_t rawSpeed, uint8_t angle);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fixed footprint streaming correction for small devices
+
+    The pusher stores a sample then publishes it with a release store of written, the
+    puller acquires written before reading the samples and releases read once it has
+    corrected them, so the pusher never overwrites a sample still being read. On a single
+    core with the pusher in an interrupt handler the same ordering keeps the compiler from
+    moving the ring accesses across the index updates.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <errno.h>
+#include "correctionStream.h"
+#include "interpolator.h"
+
+int initCorrectionStream(correctionStream* stream, rawSample* ring, uint16_t capacity)
+{
+    if(capacity==0 || capacity>correctionStreamMaxCapacity || (capacity&(capacity-1))!=0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    stream->ring = ring;
+    stream->mask = capacity-1;
+    stream->written = 0;
+    stream->read = 0;
+    stream->dropped = 0;
+    return 0;
+}
+
+int pushSample(correctionStream* stream, uint8_t rawSpeed, uint8_t angle)
+{
+    uint16_t written = stream->written;
+    uint16_t read = __atomic_load_n(&stream->read,__ATOMIC_ACQUIRE);
+    if((uint16_t)(written-read)>stream->mask)
+    {
+        stream->dropped += (stream->dropped<UINT16_MAX) ? 1 : 0;
+        return -1;
+    }
+
+    rawSample* slot = &stream->ring[written&stream->mask];
+    slot->speed = rawSpeed;
+    slot->angle = angle;
+    __atomic_store_n(&stream->written,(uint16_t)(written+1),__ATOMIC_RELEASE);
+    return 0;
+}
+
+uint16_t pullCorrectedBlock(correctionStream* stream, uint16_t* correctedTenths, uint16_t maxSamples)
+{
+    uint16_t read = stream->read;
+    uint16_t queued = __atomic_load_n(&stream->written,__ATOMIC_ACQUIRE)-read;
+    uint16_t count = (queued<maxSamples) ? queued : maxSamples;
+
+    for(uint16_t sample=0;sample<count;sample++)
+    {
+        const rawSample* slot = &stream->ring[(uint16_t)(read+sample)&stream->mask];
+        correctedTenths[sample] = correctSpeedTenths(slot->speed,slot->angle);
+    }
+
+    __atomic_store_n(&stream->read,(uint16_t)(read+count),__ATOMIC_RELEASE);
+    return count;
+}
+
+uint16_t correctionStreamQueued(const correctionStream* stream)
+{
+    return __atomic_load_n(&stream->written,__ATOMIC_ACQUIRE)-__atomic_load_n(&stream->read,__ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,74 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#ifndef _correctionStream_h_
+#define _correctionStream_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ring capacity the footprint check builds with, a power of two
+#ifndef correctionStreamCapacity
+#define correctionStreamCapacity 64
+#endif
+
+// longest ring a stream can run over
+#define correctionStreamMaxCapacity 32768
+
+// one raw reading as the anemometer reports it
+typedef struct
+{
+    uint8_t speed;              // mph
+    uint8_t angle;              // degrees
+} rawSample;
+
+// raw samples queued in a ring the caller supplies (usually a static array) and corrected a
+// block at a time with correctSpeedTenths, no heap is used
+//
+// one context pushes and one pulls, they may be an interrupt handler and the main loop or
+// two threads, the indices count samples and wrap at 65536 so only the pusher stores
+// written and only the puller stores read
+typedef struct
+{
+    rawSample* ring;
+    uint16_t mask;              // capacity-1
+    uint16_t written;
+    uint16_t read;
+    uint16_t dropped;           // samples pushed while the ring was full, saturates
+} correctionStream;
+
+// bytes of ram a stream and its ring take
+constexpr size_t correctionStreamRamBytes(size_t capacity)
+{
+    return sizeof(correctionStream)+(capacity*sizeof(rawSample));
+}
+
+// capacity must be a power of two up to correctionStreamMaxCapacity, returns 0, or -1 with
+// errno set to EINVAL
+int initCorrectionStream(correctionStream* stream, rawSample* ring, uint16_t capacity);
+
+// queues a sample, returns 0, or -1 if the ring is full and the sample is dropped
+int pushSample(correctionStream* stream, uint8_t rawSpeed, uint8_t angle);
+
+// corrects up to maxSamples queued samples oldest first into correctedTenths (tenths of
+// a mph), returns how many
+uint16_t pullCorrectedBlock(correctionStream* stream, uint16_t* correctedTenths, uint16_t maxSamples);
+
+// samples queued and not yet pulled
+uint16_t correctionStreamQueued(const correctionStream* stream);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Checks every correction path against the reference correctSpeed over the whole
+    input domain, every uint8_t speed at every uint8_t angle (angles above 255 degrees
+    can not be passed in), and prints a DIFF: line for each path with the worst error and
+    the failures, exiting 1 if any path strays past its tolerance.
+
+    The tenths paths round the exact correction to the nearest tenth, so they are allowed
+    half a tenth and a little for the float rounding of the reference.
+
+    usage: differentialTest [-j threads] [-u ulps] [-e tenths]
+
+        -j threads  threads sweeping (default every processor)
+        -u ulps     tolerance of every path compared in ulps (default 0, bit identical)
+        -e tenths   tolerance of every path compared in tenths of a mph (default each
+                    path's own)
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "differentialHarness.h"
+#include "interpolator.h"
+#include "davisCalibration.h"
+#include "correctionLattice.h"
+#include "correctionStream.h"
+#include "correctionCache.h"
+
+// every speed at every angle
+#define differentialSamples (256*256)
+#define differentialBlockSamples 4096
+#define differentialMaxPaths 8
+
+// the reference rounded to the nearest tenth is at most half a tenth out, and at 255 mph the
+// float reference and the tenths held as a float are each out by up to an ulp, 0.00015 tenths
+#define roundedTenthsTolerance 0.501
+
+typedef void (*pathFunction)(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count);
+
+typedef struct
+{
+    const char* name;
+    pathFunction run;
+    differentialUnits units;
+    double tolerance;
+} differentialPath;
+
+static correctionLattice unitLattice;
+static correctionLattice coarseLattice;
+
+static void runTenths(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeedTenths(rawSpeed[sample],angle[sample])/10.0f;
+    }
+}
+
+static void runStream(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count)
+{
+    rawSample ring[differentialBlockSamples];
+    uint16_t correctedTenths[differentialBlockSamples];
+    correctionStream stream;
+    initCorrectionStream(&stream,ring,differentialBlockSamples);
+    for(size_t sample=0;sample<count;sample++)
+    {
+        pushSample(&stream,rawSpeed[sample],angle[sample]);
+    }
+    uint16_t pulled = pullCorrectedBlock(&stream,correctedTenths,differentialBlockSamples);
+    for(size_t sample=0;sample<count;sample++)
+    {
+        // a lost sample shows up as a NaN against the reference
+        result[sample] = (sample<pulled) ? correctedTenths[sample]/10.0f : NAN;
+    }
+}
+
+static void runLatticeNode(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeedLattice(&unitLattice,rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runLattice(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeedLattice(&coarseLattice,rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runTemplate(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count)
+{
+    for(size_t sample=0;sample<count;sample++)
+    {
+        result[sample] = correctSpeed<davisTenthsTable>(rawSpeed[sample],angle[sample]);
+    }
+}
+
+static void runCached(const uint8_t* rawSpeed, const uint8_t* angle, float* result, size_t count)
+{
+    // the first pass fills the cache with pairs replacing pairs that share their slot, the
+    // second is a mix of hits and misses
+    correctionCacheEntry entries[differentialBlockSamples];
+    correctionCache cache;
+    initCorrectionCache(&cache,entries,differentialBlockSamples);
+    for(int pass=0;pass<2;pass++)
+    {
+        for(size_t sample=0;sample<count;sample++)
+        {
+            result[sample] = correctSpeedCached(&cache,rawSpeed[sample],angle[sample]);
+        }
+    }
+}
+
+static differentialPath paths[] = {{"tenths",runTenths,differentialTenths,roundedTenthsTolerance},
+                                   {"stream",runStream,differentialTenths,roundedTenthsTolerance},
+                                   {"lattice-node",runLatticeNode,differentialUlps,0},
+                                   {"lattice",runLattice,differentialTenths,0.01},
+                                   {"template",runTemplate,differentialUlps,0},
+                                   {"cached",runCached,differentialUlps,0}};
+
+static const int pathCount = sizeof(paths)/sizeof(paths[0]);
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: differentialTest [-j threads] [-u ulps] [-e tenths]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double ulpTolerance = -1.0;
+    double tenthsTolerance = -1.0;
+    int option;
+
+    while((option = getopt(argc,argv,"j:u:e:"))!=-1)
+    {
+        switch(option)
+        {
+            case 'j':
+                threadCount = atoi(optarg);
+                break;
+            case 'u':
+                ulpTolerance = atof(optarg);
+                break;
+            case 'e':
+                tenthsTolerance = atof(optarg);
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if(optind!=argc || threadCount<1)
+    {
+        usage();
+        return 2;
+    }
+    threadCount = (threadCount>differentialMaxThreads) ? differentialMaxThreads : threadCount;
+
+    float* unitStorage = (float*)malloc(correctionLatticeBytes(1,1));
+    float* coarseStorage = (float*)malloc(correctionLatticeBytes(5,15));
+    if(!unitStorage || !coarseStorage)
+    {
+        fprintf(stderr,"differentialTest: can not allocate the lattices\n");
+        return 1;
+    }
+    buildCorrectionLattice(&unitLattice,unitStorage,1,1);
+    buildCorrectionLattice(&coarseLattice,coarseStorage,5,15);
+
+    for(int path=0;path<pathCount;path++)
+    {
+        double tolerance = (paths[path].units==differentialUlps) ? ulpTolerance : tenthsTolerance;
+        paths[path].tolerance = (tolerance>=0.0) ? tolerance : paths[path].tolerance;
+    }
+
+    differentialTally totals[differentialMaxPaths];
+    for(int path=0;path<pathCount;path++)
+    {
+        differentialReset(&totals[path]);
+    }
+    pthread_mutex_t totalsLock = PTHREAD_MUTEX_INITIALIZER;
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    int result = differentialRunBlocks(threadCount,differentialSamples/differentialBlockSamples,[&](uint64_t block)
+    {
+        // sample position is speed*256+angle
+        uint8_t rawSpeed[differentialBlockSamples];
+        uint8_t angle[differentialBlockSamples];
+        float expected[differentialBlockSamples];
+        float corrected[differentialBlockSamples];
+        uint64_t first = block*differentialBlockSamples;
+        for(size_t sample=0;sample<differentialBlockSamples;sample++)
+        {
+            rawSpeed[sample] = (first+sample)>>8;
+            angle[sample] = (first+sample)&0xff;
+            expected[sample] = correctSpeed(rawSpeed[sample],angle[sample]);
+        }
+
+        differentialTally tallies[differentialMaxPaths];
+        for(int path=0;path<pathCount;path++)
+        {
+            differentialReset(&tallies[path]);
+            paths[path].run(rawSpeed,angle,corrected,differentialBlockSamples);
+            for(size_t sample=0;sample<differentialBlockSamples;sample++)
+            {
+                differentialCompare(&tallies[path],paths[path].units,paths[path].tolerance,first+sample,
+                                    rawSpeed[sample],angle[sample],corrected[sample],expected[sample]);
+            }
+        }
+
+        pthread_mutex_lock(&totalsLock);
+        for(int path=0;path<pathCount;path++)
+        {
+            differentialMerge(&totals[path],&tallies[path]);
+        }
+        pthread_mutex_unlock(&totalsLock);
+    });
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    if(result<0)
+    {
+        fprintf(stderr,"differentialTest: could not start every thread, the sweep ran on fewer\n");
+    }
+
+    uint64_t failures = 0;
+    for(int path=0;path<pathCount;path++)
+    {
+        failures += differentialReport(paths[path].name,paths[path].units,paths[path].tolerance,&totals[path]);
+    }
+    double seconds = (end.tv_sec-start.tv_sec)+((end.tv_nsec-start.tv_nsec)*1e-9);
+    printf("DIFF:%d samples across %d paths on %d threads in %.3f s, %llu failures\n",differentialSamples,pathCount,threadCount,
+           seconds,(unsigned long long)failures);
+
+    free(coarseStorage);
+    free(unitStorage);
+
+    return failures ? 1 : 0;
+}
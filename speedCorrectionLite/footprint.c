@@ -0,0 +1,46 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    The streaming corrector as a device links it, for make footprint
+
+    Declares the stream and its ring statically the way firmware would, so the object's
+    bss is the stream's ram. The ram is checked against the budget here at compile time,
+    the makefile then sums the flash and ram of this and the objects it links with size
+    and fails if either is over budget. Sizes are for the host's instruction set built for
+    size, a proxy for the device's that moves when the code does.
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include "correctionStream.h"
+
+#ifndef ramBudget
+#define ramBudget 256
+#endif
+
+static rawSample ring[correctionStreamCapacity];
+static correctionStream stream;
+
+static_assert(sizeof(ring)+sizeof(stream)==correctionStreamRamBytes(correctionStreamCapacity),"stream ram");
+static_assert(correctionStreamRamBytes(correctionStreamCapacity)<=ramBudget,"the streaming corrector is over its ram budget");
+
+int footprintStream(uint8_t rawSpeed, uint8_t angle, uint16_t* correctedTenths)
+{
+    if(!stream.ring)
+    {
+        initCorrectionStream(&stream,ring,correctionStreamCapacity);
+    }
+    pushSample(&stream,rawSpeed,angle);
+    return pullCorrectedBlock(&stream,correctedTenths,correctionStreamCapacity);
+}
@@ -29,6 +29,8 @@
 */
 
 #include "interpolator.h"
+#include "davisCalibration.h"
+#include "correctionInstrumentation.h"
 
 #define correctionTableSize  29
 //define speedIndex 0
@@ -36,102 +38,134 @@
 #define ninetyDegreeIndex 1
 #define oneeightyDegreeIndex 2
 
-// from http://www.davis-tr.com/Downloads/Davis_Rzgr_Kepceleri_Karakteristikleri.pdf
+// the tables are generated at compile time from the calibration in davisCalibration.h, the
+// corrections are in tenths of a mph
+static constexpr fixedPointCorrectionTable davisTable = davisFixedPointTable::table;
+static const uint8_t (&speedTable)[correctionTableSize] = davisTable.speeds;
+static const int8_t (&correctionTable)[correctionTableSize][3] = davisTable.corrections;
 
-/*
-float correctionTable[correctionTableSize][4] = {{0,0.0,0.0,0.0}, // simplifies algorithm - causes zero correction at zero speed
-                                                 {20,3.3,-2.3,-3.6},
-                                                 {25,3.5,-2.7,-4.6},
-                                                 {30,3.8,-2.9,-4.8},
-                                                 {35,4.2,-3.4,-5.3},
-                                                 {40,4.5,-4.1,-5.7},
-                                                 {45,4.7,-3.8,-4.5},
-                                                 {50,5.0,-4.5,-4.9},
-                                                 {55,5.3,-4.8,-5.2},
-                                                 {60,5.7,-5.3,-5.9},
-                                                 {65,5.8,-6.0,-6.0},
-                                                 {70,6.2,-5.6,-6.1},
-                                                 {75,6.4,-6.0,-6.8},
-                                                 {80,6.8,-6.4,-6.9},
-                                                 {85,7.1,-7.4,-6.8},
-                                                 {90,7.4,-8.0,-6.8},
-                                                 {95,7.5,-8.1,-7.5},
-                                                 {100,7.7,-7.9,-7.2},
-                                                 {105,8.2,-8.1,-7.7},
-                                                 {110,8.5,-8.5,-7.7},
-                                                 {115,8.9,-8.8,-8.5},
-                                                 {120,9.5,-9.4,-9.0},
-                                                 {125,10.0,-9.6,-9.8},
-                                                 {130,9.8,-9.8,-10.3},
-                                                 {135,9.8,-10.0,-11.0},
-                                                 {140,9.3,-10.2,-11.3},
-                                                 {145,9.5,-10.9,-10.5},
-                                                 {150,9.8,-12.1,-12.0},
-                                                 {999,9.8,-12.1,-12.0}}; // simplifies algorithm - maintains same correction above 150
-*/
+speedSiteIndex buildSpeedSiteIndex(const uint8_t* sites, uint8_t siteCount)
+{
+    speedSiteIndex index;
+    index.sites = sites;
+    index.siteCount = siteCount;
+
+    // find the longest run of equally spaced sites, it must cover at least two intervals
+    // to be worth using, otherwise every lookup falls back to the binary search
+    index.uniformLow = 0;
+    index.uniformHigh = 0;
+    uint8_t runStart = 0;
+    for(uint8_t site=1;site<siteCount;site++)
+    {
+        uint8_t spacing = sites[site]-sites[site-1];
+        uint8_t runSpacing = sites[runStart+1]-sites[runStart];
+        if((site-runStart)>1 && spacing!=runSpacing)
+        {
+            runStart = site-1;
+        }
+
+        if((site-runStart)>=2 && (site-runStart)>(index.uniformHigh-index.uniformLow))
+        {
+            index.uniformLow = runStart;
+            index.uniformHigh = site;
+        }
+    }
+
+    if(index.uniformHigh>index.uniformLow)
+    {
+        // offset/spacing is computed as (offset*reciprocal)>>16, rounding the reciprocal
+        // up keeps the quotient exact for every uint8_t offset, the reciprocal of a 1 mph
+        // spacing is 65536 so it is held in 32 bits
+        uint8_t spacing = sites[index.uniformLow+1]-sites[index.uniformLow];
+        index.uniformOrigin = sites[index.uniformLow];
+        index.uniformLimit = sites[index.uniformHigh];
+        index.uniformReciprocal = (65536+spacing-1)/spacing;
+    }
+    else
+    {
+        // no uniform run, an empty range sends every speed to the binary search
+        index.uniformOrigin = sites[0];
+        index.uniformLimit = sites[0];
+        index.uniformReciprocal = 0;
+    }
+
+    return index;
+}
+
+uint8_t findSpeedSite(const speedSiteIndex* index, uint8_t rawSpeed)
+{
+    uint8_t site = 0;
+
+    if(rawSpeed>index->uniformOrigin && rawSpeed<=index->uniformLimit)
+    {
+        // the site above the speed follows directly from the spacing, the compare moves the
+        // candidate down when the speed lands exactly on a site
+        uint8_t offset = (uint8_t)(((rawSpeed-index->uniformOrigin)*index->uniformReciprocal)>>16);
+        site = index->uniformLow+offset+1;
+        site = (site>index->uniformHigh) ? index->uniformHigh : site;
+        site -= (rawSpeed<=index->sites[site-1]) ? 1 : 0;
+    }
+    else
+    {
+        // binary search for the first site at or above the speed on whichever side of the
+        // equally spaced run the speed lies
+        uint8_t low = 0;
+        uint8_t high = index->uniformLow;
+        if(rawSpeed>index->uniformOrigin)
+        {
+            low = index->uniformHigh;
+            high = index->siteCount-1;
+        }
+
+        while(low<high)
+        {
+            uint8_t middle = (low+high)/2;
+            if(rawSpeed<=index->sites[middle])
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle+1;
+            }
+        }
+        site = low;
+    }
+
+    // zero speed overshoots on the first site, keep the low site in the table
+    return (site<1) ? 1 : site;
+}
+
+uint8_t scanSpeedSite(const speedSiteIndex* index, uint8_t rawSpeed)
+{
+    uint8_t site = 0;
 
-uint8_t speedTable[correctionTableSize] = {0, // simplifies algorithm - causes zero correction at zero speed
-                                          20,
-                                          25,
-                                          30,
-                                          35,
-                                          40,
-                                          45,
-                                          50,
-                                          55,
-                                          60,
-                                          65,
-                                          70,
-                                          75,
-                                          80,
-                                          85,
-                                          90,
-                                          95,
-                                          100,
-                                          105,
-                                          110,
-                                          115,
-                                          120,
-                                          125,
-                                          130,
-                                          135,
-                                          140,
-                                          145,
-                                          150,
-                                          255}; // max supported speed
-
-int8_t correctionTable[correctionTableSize][3] = {{0,0,0}, // zero correction at zero speed
-                                       /*  20 */  {33,-23,-36},
-                                       /*  25 */  {35,-27,-46},
-                                       /*  30 */  {38,-29,-48},
-                                       /*  35 */  {42,-34,-53},
-                                       /*  40 */  {45,-41,-57},
-                                       /*  45 */  {47,-38,-45},
-                                       /*  50 */  {50,-45,-49},
-                                       /*  55 */  {53,-48,-52},
-                                       /*  60 */  {57,-53,-59},
-                                       /*  65 */  {58,-60,-60},
-                                       /*  70 */  {62,-56,-61},
-                                       /*  75 */  {64,-60,-68},
-                                       /*  80 */  {68,-64,-69},
-                                       /*  85 */  {71,-74,-68},
-                                       /*  90 */  {74,-80,-68},
-                                       /*  95 */  {75,-81,-75},
-                                       /* 100 */  {77,-79,-72},
-                                       /* 105 */  {82,-81,-77},
-                                       /* 110 */  {85,-85,-77},
-                                       /* 115 */  {89,-88,-85},
-                                       /* 120 */  {95,-94,-90},
-                                       /* 125 */  {100,-96,-98},
-                                       /* 130 */  {98,-98,-103},
-                                       /* 135 */  {98,-100,-110},
-                                       /* 140 */  {93,-102,-113},
-                                       /* 145 */  {95,-109,-105},
-                                       /* 150 */  {98,-121,-120},
-                                       /* 255 */  {98,-121,-120}}; // max correction up to max speed
+    for(site=0;site<(index->siteCount-1);site++)
+    {
+        if((rawSpeed-index->sites[site]<=0))
+        {
+            // overshot
+            break;
+        }
+    }
+
+    return (site<1) ? 1 : site;
+}
+
+// the index of the generated table, filled in at compile time rather than by buildSpeedSiteIndex
+static constexpr davisSiteRun defaultRun = davisFixedPointTable::run;
+static constexpr uint8_t defaultSpacing = davisTable.speeds[defaultRun.low+1]-davisTable.speeds[defaultRun.low];
+static const speedSiteIndex defaultSiteIndex = {davisTable.speeds,
+                                                correctionTableSize,
+                                                defaultRun.low,
+                                                defaultRun.high,
+                                                davisTable.speeds[defaultRun.low],
+                                                davisTable.speeds[defaultRun.high],
+                                                (65536+defaultSpacing-1)/defaultSpacing};
 
 float correctSpeed(uint8_t rawSpeed, uint8_t angle)
 {
+    instrumentBegin();
     float calculatedSpeed = 0.0;
 
     // find the closest speed site in the correction table
@@ -152,17 +186,7 @@ float correctSpeed(uint8_t rawSpeed, uint8_t angle)
     // calculate the speed sites to be used in the calculation
     // speedIndexHigh will be the speed site above the input speed
     // speedIndexLow will be the speed site below the input speed
-    for(uint8_t index=0;index<correctionTableSize;index++)
-    {
-        if((rawSpeed-speedTable[index]<=0))
-        {
-            // overshot
-            speedIndexHigh = index;
-            break;
-        }
-
-        speedIndexHigh = index;
-    }
+    speedIndexHigh = findSpeedSite(&defaultSiteIndex,rawSpeed);
 
     speedIndexLow = speedIndexHigh-1;
 
@@ -208,6 +232,51 @@ float correctSpeed(uint8_t rawSpeed, uint8_t angle)
         calculatedSpeed += rawSpeed;
     }
 
+    instrumentEnd(speedIndexHigh,rawSpeed,angle);
     return calculatedSpeed;
 }
 
+
+uint16_t correctSpeedTenths(uint8_t rawSpeed, uint8_t angle)
+{
+    instrumentBegin();
+    // calculate the angle to be used in the calculation
+    uint8_t correctionAngle = (angle>180) ? (180-(angle-180)) : angle;
+
+    uint8_t speedIndexHigh = findSpeedSite(&defaultSiteIndex,rawSpeed);
+    uint8_t speedIndexLow = speedIndexHigh-1;
+
+    // interpolate between the angle sites either side of the angle, leaving the
+    // corrections in tenths*90
+    uint8_t angleIndex = zeroDegreeIndex;
+    int16_t angleWeight = correctionAngle;
+    if(correctionAngle>90)
+    {
+        angleIndex = ninetyDegreeIndex;
+        angleWeight = correctionAngle-90;
+    }
+    int32_t speedCorrectionLow = (correctionTable[speedIndexLow][angleIndex]*(90-angleWeight))+(correctionTable[speedIndexLow][angleIndex+1]*angleWeight);
+    int32_t speedCorrectionHigh = (correctionTable[speedIndexHigh][angleIndex]*(90-angleWeight))+(correctionTable[speedIndexHigh][angleIndex+1]*angleWeight);
+
+    // interpolate between the speed sites, leaving the correction in tenths*90*speedDelta
+    int32_t speedDelta = speedTable[speedIndexHigh]-speedTable[speedIndexLow];
+    int32_t speedOffset = rawSpeed-speedTable[speedIndexLow];
+    int32_t correction = (speedCorrectionLow*(speedDelta-speedOffset))+(speedCorrectionHigh*speedOffset);
+
+    // back to tenths, rounding half away from zero with the reciprocal of 180*speedDelta
+    // (see davisCalibration.h)
+    uint32_t magnitude = (correction<0) ? -correction : correction;
+    uint64_t scaled = (uint64_t)((2*magnitude)+(90*speedDelta))*davisTable.tenthsReciprocal[speedIndexLow];
+    int32_t correctionTenths = (int32_t)(scaled>>tenthsShift);
+    correctionTenths = (correction<0) ? -correctionTenths : correctionTenths;
+
+    instrumentEnd(speedIndexHigh,rawSpeed,angle);
+    return (uint16_t)((rawSpeed*10)+correctionTenths);
+}
+
+uint16_t correctSpeedRolling(rollingStatistics* statistics, uint8_t rawSpeed, uint8_t angle)
+{
+    uint16_t correctedTenths = correctSpeedTenths(rawSpeed,angle);
+    pushRollingTenths(statistics,correctedTenths);
+    return correctedTenths;
+}
@@ -19,8 +19,38 @@
 #define _interpolator_h_
 
 #include <stdint.h>
+#include "rollingStatistics.h"
+
+// finds the pair of speed sites bracketing a speed without scanning the table, speeds inside
+// the longest run of equally spaced sites are located arithmetically, all other speeds by
+// binary search
+typedef struct
+{
+    const uint8_t* sites;
+    uint8_t siteCount;
+    uint8_t uniformLow;         // first and last site of the equally spaced run
+    uint8_t uniformHigh;
+    uint8_t uniformOrigin;      // speed of uniformLow
+    uint8_t uniformLimit;       // speed of uniformHigh
+    uint32_t uniformReciprocal; // 65536/spacing rounded up, 65536 for a 1 mph spacing
+} speedSiteIndex;
+
+speedSiteIndex buildSpeedSiteIndex(const uint8_t* sites, uint8_t siteCount);
+
+// both return the index of the site at or above rawSpeed (at least 1, at most siteCount-1),
+// scanSpeedSite is the reference linear search
+uint8_t findSpeedSite(const speedSiteIndex* index, uint8_t rawSpeed);
+uint8_t scanSpeedSite(const speedSiteIndex* index, uint8_t rawSpeed);
 
 float correctSpeed(uint8_t rawSpeed, uint8_t angle);
 
+// integer only correction for targets without an fpu, returns the corrected speed in tenths
+// of a mph, the exact bilinear correction is rounded to the nearest tenth with halves
+// rounded away from zero
+uint16_t correctSpeedTenths(uint8_t rawSpeed, uint8_t angle);
+
+// correctSpeedTenths, feeding the corrected speed to the rolling statistics as well
+uint16_t correctSpeedRolling(rollingStatistics* statistics, uint8_t rawSpeed, uint8_t angle);
+
 #endif
 
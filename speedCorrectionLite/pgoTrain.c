@@ -0,0 +1,138 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Training run for the profile guided build of the library (make pgo)
+
+    Linked against the instrumented library, it drives correctSpeed, correctSpeedTenths,
+    the rolling statistics, the lattice, the cache and the stream with the wind the bench times them
+    over (benchHarness.h), rounded to whole mph and degrees as a console reports them.
+
+    usage: pgoTrain [-r repeats]
+
+        -r repeats  passes over each distribution (default 4)
+
+    Fergus Duncan (github : @fergusd)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "benchHarness.h"
+#include "interpolator.h"
+#include "correctionLattice.h"
+#include "correctionStream.h"
+#include "correctionCache.h"
+
+// samples in each distribution, a day of 1 second readings
+#define trainSamples 86400
+
+// ring the stream is trained with, a block is pulled whenever it fills
+#define trainStreamCapacity 256
+
+static void usage(void)
+{
+    fprintf(stderr,"usage: pgoTrain [-r repeats]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int repeats = 4;
+    int option;
+    while((option = getopt(argc,argv,"r:"))!=-1)
+    {
+        if(option!='r')
+        {
+            usage();
+            return 2;
+        }
+        repeats = atoi(optarg);
+    }
+    if(optind!=argc || repeats<1)
+    {
+        usage();
+        return 2;
+    }
+
+    static constexpr uint16_t lengths[3] = {3,60,600};
+    static uint16_t storage[rollingStatisticsBytes(lengths,3)/sizeof(uint16_t)];
+    rollingStatistics statistics;
+    initRollingStatistics(&statistics,storage,lengths,3);
+
+    static rawSample ring[trainStreamCapacity];
+    static uint16_t pulledTenths[trainStreamCapacity];
+    correctionStream stream;
+    initCorrectionStream(&stream,ring,trainStreamCapacity);
+
+    static correctionCacheEntry cacheEntries[4096];
+    correctionCache cache;
+    initCorrectionCache(&cache,cacheEntries,4096);
+
+    correctionLattice lattice;
+    float* latticeStorage = (float*)malloc(correctionLatticeBytes(1,1));
+    float* windSpeed = (float*)malloc(trainSamples*sizeof(float));
+    float* windAngle = (float*)malloc(trainSamples*sizeof(float));
+    uint8_t* speed = (uint8_t*)malloc(trainSamples);
+    uint8_t* angle = (uint8_t*)malloc(trainSamples);
+    if(!latticeStorage || !windSpeed || !windAngle || !speed || !angle)
+    {
+        fprintf(stderr,"pgoTrain: can not allocate the training samples\n");
+        return 1;
+    }
+    buildCorrectionLattice(&lattice,latticeStorage,1,1);
+
+    double checksum = 0.0;
+    size_t trained = 0;
+    for(int distribution=0;distribution<benchDistributionCount;distribution++)
+    {
+        // whole mph and degrees, angles past 255 folded as the bench folds them
+        benchFillWind((benchDistribution)distribution,windSpeed,windAngle,trainSamples);
+        for(int sample=0;sample<trainSamples;sample++)
+        {
+            float wholeSpeed = windSpeed[sample]+0.5f;
+            int wholeAngle = (int)(windAngle[sample]+0.5f)%360;
+            speed[sample] = (wholeSpeed>255.0f) ? 255 : (uint8_t)wholeSpeed;
+            angle[sample] = (wholeAngle>255) ? 360-wholeAngle : wholeAngle;
+        }
+
+        for(int repeat=0;repeat<repeats;repeat++)
+        {
+            for(int sample=0;sample<trainSamples;sample++)
+            {
+                checksum += correctSpeed(speed[sample],angle[sample]);
+                checksum += correctSpeedTenths(speed[sample],angle[sample]);
+                checksum += correctSpeedRolling(&statistics,speed[sample],angle[sample]);
+                checksum += correctSpeedLattice(&lattice,speed[sample],angle[sample]);
+                checksum += correctSpeedCached(&cache,speed[sample],angle[sample]);
+                if(pushSample(&stream,speed[sample],angle[sample])<0)
+                {
+                    uint16_t pulled = pullCorrectedBlock(&stream,pulledTenths,trainStreamCapacity);
+                    checksum += pulled ? pulledTenths[pulled-1] : 0;
+                    pushSample(&stream,speed[sample],angle[sample]);
+                }
+            }
+            checksum += rollingMeanTenths(&statistics,2)+rollingPeakTenths(&statistics);
+            trained += trainSamples;
+        }
+    }
+
+    printf("PGO:trained on %zu samples, checksum %.6g\n",trained,checksum);
+
+    free(angle);
+    free(speed);
+    free(windAngle);
+    free(windSpeed);
+    free(latticeStorage);
+
+    return 0;
+}
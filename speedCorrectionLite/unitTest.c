@@ -28,8 +28,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
+#include <errno.h>
 #include "interpolator.h"
+#include "correctionLattice.h"
+#include "correctionStream.h"
+#include "correctionCache.h"
+#include "davisCalibration.h"
+#include "correctionInstrumentation.h"
 
 // 0 degree tests
 float zeroTests[27][2] = {{20,23.3},
@@ -180,6 +188,351 @@ int main(int argc, char* argv[])
         printf("***********************\n");
     }
 
+    // speed site index tests, the index must agree with the linear search for every speed
+    // for the default table and for a table with no equally spaced run
+    {
+        uint8_t defaultSites[29];
+        for(int site=0;site<29;site++)
+        {
+            defaultSites[site] = (site==0) ? 0 : ((site==28) ? 255 : 15+(site*5));
+        }
+        uint8_t irregularSites[8] = {0,3,7,8,20,21,40,255};
+        uint8_t wholeMphSites[8] = {0,10,11,12,13,14,15,255};
+        uint8_t everyMphSites[256];
+        for(int site=0;site<256;site++)
+        {
+            everyMphSites[site] = site;
+        }
+
+        speedSiteIndex defaultIndex = buildSpeedSiteIndex(defaultSites,29);
+        speedSiteIndex irregularIndex = buildSpeedSiteIndex(irregularSites,8);
+        speedSiteIndex wholeMphIndex = buildSpeedSiteIndex(wholeMphSites,8);
+        speedSiteIndex everyMphIndex = buildSpeedSiteIndex(everyMphSites,255);
+        assert(defaultIndex.uniformLow==1);
+        assert(defaultIndex.uniformHigh==27);
+        assert(irregularIndex.uniformLow==irregularIndex.uniformHigh);
+        assert(wholeMphIndex.uniformLow==1 && wholeMphIndex.uniformHigh==6 && wholeMphIndex.uniformReciprocal==65536);
+        assert(findSpeedSite(&wholeMphIndex,12)==3 && findSpeedSite(&wholeMphIndex,15)==6);
+
+        for(int speed=0;speed<=255;speed++)
+        {
+            assert(findSpeedSite(&defaultIndex,speed)==scanSpeedSite(&defaultIndex,speed));
+            assert(findSpeedSite(&irregularIndex,speed)==scanSpeedSite(&irregularIndex,speed));
+            assert(findSpeedSite(&wholeMphIndex,speed)==scanSpeedSite(&wholeMphIndex,speed));
+            assert(findSpeedSite(&everyMphIndex,speed)==scanSpeedSite(&everyMphIndex,speed));
+        }
+        printf("TEST:speed site index\n");
+        printf("***********************\n");
+    }
+
+    // correction lattice tests, a 1 mph x 1 degree lattice reproduces correctSpeed exactly
+    // and a coarser lattice whose steps divide the speed and angle site spacing blends to
+    // within float rounding
+    {
+        correctionLattice fineLattice;
+        correctionLattice coarseLattice;
+        float* fineStorage = (float*)malloc(correctionLatticeBytes(1,1));
+        float* coarseStorage = (float*)malloc(correctionLatticeBytes(5,15));
+        buildCorrectionLattice(&fineLattice,fineStorage,1,1);
+        buildCorrectionLattice(&coarseLattice,coarseStorage,5,15);
+        assert(fineLattice.speedCount==256 && fineLattice.angleCount==181);
+        assert(coarseLattice.speedCount==52 && coarseLattice.angleCount==13);
+        assert(correctionLatticeFootprint(&fineLattice)==sizeof(correctionLattice)+(256*181*sizeof(float)));
+
+        for(int speed=0;speed<=255;speed++)
+        {
+            for(int angle=0;angle<=255;angle++)
+            {
+                float correctedSpeed = correctSpeed(speed,angle);
+                float latticeSpeed = correctSpeedLattice(&fineLattice,speed,angle);
+                assert(memcmp(&correctedSpeed,&latticeSpeed,sizeof(float))==0);
+                assert(fabsf(correctSpeedLattice(&coarseLattice,speed,angle)-correctedSpeed)<0.001);
+            }
+        }
+        printf("TEST:correction lattice bytes:%d\n",(int)correctionLatticeFootprint(&fineLattice));
+        printf("***********************\n");
+
+        free(fineStorage);
+        free(coarseStorage);
+    }
+
+    // fixed point tests, the integer path returns the documented results in tenths and
+    // is within rounding of the float path for every input
+    {
+        float (*siteTests[3])[2] = {zeroTests,ninetyTests,oneeightyTests};
+        uint8_t siteAngles[3] = {0,90,180};
+        for(int column=0;column<3;column++)
+        {
+            for(int test=0;test<27;test++)
+            {
+                uint16_t correctedTenths = correctSpeedTenths(siteTests[column][test][0],siteAngles[column]);
+                assert(correctedTenths==lroundf(siteTests[column][test][1]*10));
+            }
+        }
+        for(int test=0;test<6;test++)
+        {
+            assert(correctSpeedTenths(oneeightySpeedIncrementTests[test][0],180)==lroundf(oneeightySpeedIncrementTests[test][1]*10));
+        }
+
+        float worstError = 0.0;
+        for(int speed=0;speed<=255;speed++)
+        {
+            for(int angle=0;angle<=255;angle++)
+            {
+                float error = fabsf(correctSpeedTenths(speed,angle)-(correctSpeed(speed,angle)*10));
+                worstError = (error>worstError) ? error : worstError;
+            }
+        }
+        assert(worstError<=0.501);
+        printf("TEST:fixed point worst error:%1.3f tenths\n",worstError);
+        printf("***********************\n");
+    }
+
+    // compile time calibration tests, correctSpeed<Table> on the tenths table is bit identical
+    // to correctSpeed and the generated lattice matches a lattice built at run time
+    {
+        static_assert(correctSpeed<davisTenthsTable>(20,0)==23.3f,"compile time correction");
+        static_assert(davisFixedPointTable::run.low==1 && davisFixedPointTable::run.high==27,"uniform run");
+
+        for(int speed=0;speed<=255;speed++)
+        {
+            for(int angle=0;angle<=255;angle++)
+            {
+                float correctedSpeed = correctSpeed(speed,angle);
+                float templateSpeed = correctSpeed<davisTenthsTable>(speed,angle);
+                assert(memcmp(&correctedSpeed,&templateSpeed,sizeof(float))==0);
+            }
+        }
+
+        static constexpr denseCorrectionLattice<5,15> dense = makeDenseCorrectionLattice<davisTenthsTable,5,15>();
+        correctionLattice lattice;
+        float* storage = (float*)malloc(correctionLatticeBytes(5,15));
+        buildCorrectionLattice(&lattice,storage,5,15);
+        assert(lattice.speedCount==dense.speedCount && lattice.angleCount==dense.angleCount);
+        assert(memcmp(storage,dense.corrections,sizeof(dense.corrections))==0);
+        printf("TEST:compile time calibration\n");
+        printf("***********************\n");
+
+        free(storage);
+    }
+
+    {
+        // rolling statistics against recomputing every window from the history of samples,
+        // a random walk with plateaus so equal samples are common, long enough for the
+        // sequence numbers to wrap
+        static constexpr uint16_t lengths[4] = {3,48,240,1000};
+        static_assert(rollingStatisticsBytes(lengths,4)==(1024+(2*1291))*sizeof(uint16_t),"rolling storage");
+        static uint16_t storage[rollingStatisticsBytes(lengths,4)/sizeof(uint16_t)];
+        const int sampleCount = 70000;
+        uint16_t* history = (uint16_t*)malloc(sampleCount*sizeof(uint16_t));
+
+        rollingStatistics statistics;
+        assert(initRollingStatistics(&statistics,storage,lengths,4)==0);
+        uint16_t walk = 300;
+        uint16_t peak = 0;
+        unsigned int seed = 12345;
+        for(int sample=0;sample<sampleCount;sample++)
+        {
+            seed = (seed*1103515245)+12345;
+            int step = (int)((seed>>16)%9)-4;
+            walk = ((seed>>8)%3==0) ? walk : (uint16_t)(((walk+step)<0) ? 0 : (((walk+step)>600) ? 600 : walk+step));
+            history[sample] = walk;
+            peak = (walk>peak) ? walk : peak;
+            pushRollingTenths(&statistics,walk);
+
+            for(int window=0;window<4;window++)
+            {
+                int first = ((sample+1)>lengths[window]) ? (sample+1)-lengths[window] : 0;
+                uint32_t sum = 0;
+                uint16_t maximum = 0;
+                uint16_t minimum = UINT16_MAX;
+                for(int older=first;older<=sample;older++)
+                {
+                    sum += history[older];
+                    maximum = (history[older]>maximum) ? history[older] : maximum;
+                    minimum = (history[older]<minimum) ? history[older] : minimum;
+                }
+                uint16_t samples = (sample+1)-first;
+                assert(rollingSamples(&statistics,window)==samples);
+                assert(rollingMeanTenths(&statistics,window)==(sum+(samples/2))/samples);
+                assert(rollingMean(&statistics,window)==sum/(10.0f*samples));
+                assert(rollingMaxTenths(&statistics,window)==maximum);
+                assert(rollingMinTenths(&statistics,window)==minimum);
+            }
+            assert(rollingPeakTenths(&statistics)==peak);
+        }
+
+        resetRollingPeak(&statistics);
+        assert(rollingPeakTenths(&statistics)==0);
+        resetRollingStatistics(&statistics);
+        assert(rollingSamples(&statistics,3)==0 && rollingMaxTenths(&statistics,3)==0 && rollingMeanTenths(&statistics,3)==0);
+
+        // fed straight from the corrector
+        assert(correctSpeedRolling(&statistics,57,135)==correctSpeedTenths(57,135));
+        assert(rollingMaxTenths(&statistics,0)==correctSpeedTenths(57,135));
+        assert(rollingPeakTenths(&statistics)==correctSpeedTenths(57,135));
+        // a window must hold at least one sample and no more than rollingMaxLength
+        static constexpr uint16_t invalid[2] = {10,0};
+        errno = 0;
+        assert(initRollingStatistics(&statistics,storage,invalid,2)==-1 && errno==EINVAL);
+        assert(rollingStatisticsBytes(invalid,2)==0 && rollingStatisticsBytes(lengths,5)==0 && rollingStatisticsBytes(lengths,0)==0);
+
+        free(history);
+        printf("TEST:rolling statistics samples:%d storage bytes:%d\n",sampleCount,(int)sizeof(storage));
+        printf("***********************\n");
+    }
+
+    {
+        // streaming over a static ring, pushes and pulls out of step so the indices wrap
+        // past 65536 many times with the ring partly full
+        static rawSample ring[16];
+        static_assert(correctionStreamRamBytes(16)==sizeof(ring)+sizeof(correctionStream),"stream ram");
+        correctionStream stream;
+        assert(initCorrectionStream(&stream,ring,16)==0);
+
+        uint16_t corrected[16];
+        long pushed = 0;
+        long pulled = 0;
+        for(int round=0;round<100000;round++)
+        {
+            int pushes = (round*7)%11;
+            for(int push=0;push<pushes;push++)
+            {
+                uint8_t speed = (pushed*37)%256;
+                uint8_t angle = (pushed*101)%256;
+                if(correctionStreamQueued(&stream)<16)
+                {
+                    assert(pushSample(&stream,speed,angle)==0);
+                    pushed++;
+                }
+                else
+                {
+                    assert(pushSample(&stream,speed,angle)==-1);
+                }
+            }
+
+            uint16_t count = pullCorrectedBlock(&stream,corrected,(round*5)%9);
+            for(int sample=0;sample<count;sample++)
+            {
+                assert(corrected[sample]==correctSpeedTenths((pulled*37)%256,(pulled*101)%256));
+                pulled++;
+            }
+            assert(correctionStreamQueued(&stream)==pushed-pulled);
+        }
+        assert(pushed>65536 && stream.dropped>0);
+
+        // a full ring drops, an empty one pulls nothing
+        while(pullCorrectedBlock(&stream,corrected,16)>0)
+        {
+        }
+        for(int sample=0;sample<16;sample++)
+        {
+            assert(pushSample(&stream,20,0)==0);
+        }
+        assert(pushSample(&stream,20,0)==-1);
+        assert(pullCorrectedBlock(&stream,corrected,16)==16 && corrected[15]==correctSpeedTenths(20,0));
+        assert(pullCorrectedBlock(&stream,corrected,16)==0);
+
+        // the ring must be a power of two long
+        errno = 0;
+        assert(initCorrectionStream(&stream,ring,12)==-1 && errno==EINVAL);
+        assert(initCorrectionStream(&stream,ring,0)==-1);
+        printf("TEST:correction stream samples:%ld\n",pushed);
+        printf("***********************\n");
+    }
+
+    // instrumentation counts both correctors only when built with make instrumented
+    {
+        const uint8_t instrumentSpeeds[5] = {0,20,150,151,255};
+        const uint8_t instrumentAngles[6] = {0,90,91,180,200,255};
+        resetInstrumentation();
+        for(int speed=0;speed<5;speed++)
+        {
+            for(int angle=0;angle<6;angle++)
+            {
+                correctSpeed(instrumentSpeeds[speed],instrumentAngles[angle]);
+                correctSpeedTenths(instrumentSpeeds[speed],instrumentAngles[angle]);
+            }
+        }
+        instrumentSnapshot snapshot;
+        snapshotInstrumentation(&snapshot);
+
+#ifdef correctionInstrumentation
+        assert(snapshot.calls==60 && snapshot.extrapolated==24 && snapshot.invalidSpeeds==0 && snapshot.invalidAngles==0);
+        assert(snapshot.sectors[0]==10 && snapshot.sectors[1]==20 && snapshot.sectors[2]==30 && snapshot.sectors[3]==0);
+        assert(snapshot.sites[1]==24 && snapshot.sites[27]==12 && snapshot.sites[instrumentSites-1]==24);
+        printInstrumentation(&snapshot,stdout);
+#else
+        assert(snapshot.calls==0);
+#endif
+        printf("TEST:instrumentation calls:%lu\n",(unsigned long)snapshot.calls);
+        printf("***********************\n");
+    }
+
+    // correction cache, hits and misses give correctSpeed's corrections bit for bit, pairs
+    // that share a slot replace each other and bad capacities are rejected
+    {
+        static correctionCacheEntry entries[256];
+        correctionCache cache;
+        assert(initCorrectionCache(&cache,entries,256)==0);
+        for(int pass=0;pass<3;pass++)
+        {
+            for(int speed=0;speed<=255;speed++)
+            {
+                for(int angle=0;angle<=255;angle+=(pass+1))
+                {
+                    float expected = correctSpeed(speed,angle);
+                    float cached = correctSpeedCached(&cache,speed,angle);
+                    assert(memcmp(&expected,&cached,sizeof(float))==0);
+                }
+            }
+        }
+        assert(cache.hits+cache.misses==256*256+256*128+256*86 && cache.misses>cache.hits);
+
+        // a live feed of a few pairs is all hits once they are in
+        clearCorrectionCache(&cache);
+        for(int reading=0;reading<1000;reading++)
+        {
+            uint8_t speed = 10+(reading%7);
+            uint8_t angle = 200+(reading%11);
+            float expected = correctSpeed(speed,angle);
+            float cached = correctSpeedCached(&cache,speed,angle);
+            assert(memcmp(&expected,&cached,sizeof(float))==0);
+        }
+        assert(cache.misses==77 && cache.hits==1000-77);
+
+        // speed 0 angle 0 is a miss in an empty cache, not a match with a zeroed slot
+        clearCorrectionCache(&cache);
+        assert(correctSpeedCached(&cache,0,0)==correctSpeed(0,0) && cache.misses==1);
+
+        // the largest cache holds every pair, an angle and its mirror sharing an entry
+        static correctionCacheEntry allEntries[cacheMaxEntries];
+        correctionCache allCache;
+        assert(initCorrectionCache(&allCache,allEntries,cacheMaxEntries)==0);
+        for(int pass=0;pass<2;pass++)
+        {
+            for(int speed=0;speed<=255;speed++)
+            {
+                for(int angle=0;angle<=255;angle++)
+                {
+                    float expected = correctSpeed(speed,angle);
+                    float cached = correctSpeedCached(&allCache,speed,angle);
+                    assert(memcmp(&expected,&cached,sizeof(float))==0);
+                }
+            }
+        }
+        assert(allCache.misses==256*181 && allCache.hits==(2*256*256)-(256*181));
+
+        const uint32_t badCapacities[4] = {0,8,100,131072};
+        for(int bad=0;bad<4;bad++)
+        {
+            errno = 0;
+            assert(initCorrectionCache(&cache,entries,badCapacities[bad])==-1 && errno==EINVAL);
+        }
+        printf("TEST:correction cache ram bytes:%d\n",(int)correctionCacheRamBytes(256));
+        printf("***********************\n");
+    }
+
     printf("happy days\n");
 }
 